@@ -37,8 +37,9 @@
  * (Yes it's uncommon to include a C file, but this is how MIRACL provided
  * a wrapper). The SHA256 wrappers provided/used are:
  *      MCL_HASH256_init (Initialize the SHA hash)
- *      MCL_HASH256_process (Add data to the SHA hash)
+ *      MCL_HASH256_update (Add data to the SHA hash)
  *      MCL_HASH256_hash (Finalize the SHA hash and return the digest)
+ *      MCL_HASH256_multi (Hash several equal-length blobs in SIMD lanes)
  */
 #include "../vendors/MIRACL/bootrom.c"
 #undef unsign32     /* (benign unconditional define in bootrom.c) */
@@ -46,7 +47,8 @@
 #include "mcl_hash.h"
 
 
-static mcl_hash256 shctx;
+/* Per-thread, so that IMS worker threads can hash concurrently */
+static __thread mcl_hash256 shctx;
 
 
 /**
@@ -64,11 +66,7 @@ void hash_start(void) {
  * @param datalen The length in bytes of the data run.
  */
 void hash_update(const uint8_t *data, const size_t datalen) {
-    size_t i;
-
-    for (i = 0; i < datalen; i++) {
-        MCL_HASH256_process(&shctx, data[i]);
-    }
+    MCL_HASH256_update(&shctx, (const char *)data, (int)datalen);
 }
 
 
@@ -97,3 +95,21 @@ void hash_it(const uint8_t *data, const size_t datalen, uint8_t * digest) {
     hash_update(data, datalen);
     hash_final(digest);
 }
+
+
+/**
+ * @brief Hash several equal-length blobs at once
+ *
+ * The blobs are hashed side by side in SIMD lanes where the CPU supports
+ * it. Each digest is the same as hash_it() on that blob alone.
+ *
+ * @param data Array of count pointers to the data runs.
+ * @param datalen The length in bytes of every data run.
+ * @param digests Array of count pointers to the output digest buffers
+ * @param count The number of data runs
+ */
+void hash_multi(const uint8_t ** data, const size_t datalen,
+                uint8_t ** digests, int count) {
+    MCL_HASH256_multi(count, (const char **)data, (int)datalen,
+                      (char **)digests);
+}
@@ -74,4 +74,19 @@ void hash_final(uint8_t * digest);
  */
 void hash_it(const uint8_t *data, const size_t datalen, uint8_t * digest);
 
+
+/**
+ * @brief Hash several equal-length blobs at once
+ *
+ * The blobs are hashed side by side in SIMD lanes where the CPU supports
+ * it. Each digest is the same as hash_it() on that blob alone.
+ *
+ * @param data Array of count pointers to the data runs.
+ * @param datalen The length in bytes of every data run.
+ * @param digests Array of count pointers to the output digest buffers
+ * @param count The number of data runs
+ */
+void hash_multi(const uint8_t ** data, const size_t datalen,
+                uint8_t ** digests, int count);
+
 #endif /* !_CRYPTO_H */
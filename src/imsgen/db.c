@@ -29,29 +29,90 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sqlite3.h>
 #include "mcl_arch.h"
 #include "mcl_oct.h"
 #include "db.h"
+#include "db_schema.h"
+#include "ims_stats.h"
+#include "uid_set.h"
 
 /* Uncomment the following define to enable DB diagnostic messages */
 /*#define DB_DEBUGMSG*/
 
 #define HOLD_DB_OPEN
 
+/* Largest key blob a queued keyset row can carry */
+#define DB_BLOB_MAX         256
+
 static sqlite3 *db;
+static int db_version;              /* DB_SCHEMA_TEXT_KEY or _BLOB_KEY */
+static sqlite3_stmt *insert;
 static const char * insert_stmt =
     "INSERT INTO pub_keys(ep_uid, epvk, esvk, erpk_mod) VALUES (?, ?, ?, ?)";
-static const char * select_format_stmt =
-    "SELECT ep_uid, epvk, esvk, erpk_mod FROM pub_keys WHERE ep_uid = '%s'";
+static sqlite3_stmt *lookup;
+static pthread_mutex_t lookup_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char * lookup_stmt =
+    "SELECT ep_uid, epvk, esvk, erpk_mod FROM pub_keys WHERE ep_uid = ?";
+static const char * scan_stmt =
+    "SELECT ep_uid, epvk, esvk, erpk_mod FROM pub_keys "
+    "WHERE ep_uid BETWEEN ? AND ? ORDER BY ep_uid";
+
+
+/**
+ * Batched keyset writer: db_writer_add() queues rows, the writer thread
+ * inserts them inside explicit transactions and only then hands each row's
+ * cookie back to its db_committed_fn.
+ */
+typedef struct {
+    uint8_t         ep_uid[DB_EP_UID_SIZE];
+    uint8_t         epvk[DB_BLOB_MAX];
+    int             epvk_len;
+    uint8_t         esvk[DB_BLOB_MAX];
+    int             esvk_len;
+    uint8_t         erpk_mod[DB_BLOB_MAX];
+    int             erpk_mod_len;
+    db_committed_fn committed;
+    void *          cookie;
+} db_row;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;      /* Signalled by db_writer_add */
+    pthread_cond_t  not_full;       /* Signalled by the writer thread */
+    pthread_cond_t  drained;        /* Signalled after each commit */
+    pthread_t       thread;
+    bool            running;
+    bool            stopping;
+    bool            in_flight;      /* The writer holds an open batch */
+    int             error;          /* First failure; sticky */
+    db_row *        queue;
+    uint32_t        queue_depth;
+    uint32_t        head;
+    uint32_t        count;
+    uint32_t        batch_size;
+    db_committed_fn * batch_committed;
+    void **         batch_cookie;
+    ims_stats       stats;          /* INSERT and COMMIT timings */
+} db_writer;
+
+static db_writer writer;
+
+/* Set once every existing EP_UID has been loaded into the uid_set */
+static bool uid_index_loaded;
 
 
 /**
  * @brief Initialize the key database subsystem
  *
+ * A database without a pub_keys table gets the current (BLOB-keyed)
+ * schema; an existing TEXT-keyed database is used as it is.
+ *
  * @param database_name The name of the key database
  *
  * @returns Zero if successful, errno otherwise.
@@ -64,7 +125,17 @@ int db_init(const char * db_name) {
         fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
         sqlite3_close(db);
         db = NULL;
-        status = ENOENT;
+        return ENOENT;
+    }
+
+    status = db_schema_version(db, &db_version);
+    if ((status == 0) && (db_version == DB_SCHEMA_NONE)) {
+        status = db_schema_create(db);
+        db_version = DB_SCHEMA_CURRENT;
+    }
+    if (status != 0) {
+        sqlite3_close(db);
+        db = NULL;
     }
 
     return status;
@@ -77,16 +148,101 @@ int db_init(const char * db_name) {
  * Flushes the IMS output file, closes the database
  */
 void db_deinit(void) {
+    db_writer_stop();
+    if (lookup) {
+        sqlite3_finalize(lookup);
+        lookup = NULL;
+    }
+    if (insert) {
+        sqlite3_finalize(insert);
+        insert = NULL;
+    }
     if (db) {
         sqlite3_close(db);
         db = NULL;
     }
+    if (uid_index_loaded) {
+        uid_set_deinit();
+        uid_index_loaded = false;
+    }
+}
+
+
+/**
+ * @brief Insert one keyset row with the (once-prepared) INSERT statement
+ *
+ * @param ep_uid The 8-byte EP_UID, used as a key
+ * @param epvk, epvk_len The EPVK to save
+ * @param esvk, esvk_len The ESVK to save
+ * @param erpk_mod, erpk_mod_len The modulus for ERPK to save
+ *
+ * @returns SQLITE_DONE if successful, SQLite status otherwise.
+ */
+static int db_insert_row(const uint8_t * ep_uid,
+                         const void * epvk, int epvk_len,
+                         const void * esvk, int esvk_len,
+                         const void * erpk_mod, int erpk_mod_len) {
+    int status;
+
+    if (!insert) {
+        status = sqlite3_prepare_v2(db, insert_stmt, -1, &insert, NULL);
+        if (status != SQLITE_OK) {
+            fprintf(stderr, "db_add_keyset: prepare failed: %s\n",
+                    sqlite3_errmsg(db));
+            insert = NULL;
+            return status;
+        }
+    }
+
+    /* Bind the values to the statement */
+    status = db_bind_ep_uid(insert, 1, db_version, ep_uid);
+    if (status != SQLITE_OK) {
+        fprintf(stderr, "db_add_keyset: ep_uid bind failed: %s\n",
+                sqlite3_errmsg(db));
+    } else {
+        status = sqlite3_bind_blob(insert, 2, epvk, epvk_len, SQLITE_STATIC);
+        if (status != SQLITE_OK) {
+            fprintf(stderr, "db_add_keyset: epvk bind failed: %s\n",
+                    sqlite3_errmsg(db));
+        } else {
+            status = sqlite3_bind_blob(insert, 3, esvk, esvk_len,
+                                       SQLITE_STATIC);
+            if (status != SQLITE_OK) {
+                fprintf(stderr, "db_add_keyset: esvk bind failed: %s\n",
+                        sqlite3_errmsg(db));
+            } else {
+                status = sqlite3_bind_blob(insert, 4, erpk_mod, erpk_mod_len,
+                                           SQLITE_STATIC);
+                if (status != SQLITE_OK) {
+                    fprintf(stderr,
+                            "db_add_keyset: erpk_mod bind failed: %s\n",
+                            sqlite3_errmsg(db));
+                }
+            }
+        }
+    }
+
+    /* Push the row out to the db */
+    if (status == SQLITE_OK) {
+        status = sqlite3_step(insert);
+        if (status != SQLITE_DONE) {
+            fprintf(stderr, "db_add_keyset: can't add row: %s\n",
+                    sqlite3_errmsg(db));
+        }
+    }
+    sqlite3_reset(insert);
+    sqlite3_clear_bindings(insert);
+
+    return status;
 }
 
 
 /**
  * @brief Save the Endpoint Primary Verification Key (EPVK) in the key database
  *
+ * Writes the row immediately (in autocommit mode unless the keyset writer
+ * has a transaction open).
+ *
  * @param ep_uid The EndPoint Unique ID, used as a key
  * @param epsk The EPSK to save
  * @param essk The ESSK to save
@@ -99,8 +255,6 @@ int db_add_keyset(mcl_octet * ep_uid,
                   mcl_octet * esvk,
                   mcl_octet * erpk_mod) {
     int status = 0;
-    char ep_uid_hex[32];
-    sqlite3_stmt *stmt;
 
 #ifdef DB_DEBUGMSG
     printf("db_add_keyset:\n");
@@ -109,56 +263,371 @@ int db_add_keyset(mcl_octet * ep_uid,
     display_binary_data(esvk->val, esvk->len, true, "esvk     ");
     display_binary_data(erpk_mod->val, erpk_mod->len, true, "erpk_mod ");
 #endif
-    status = sqlite3_prepare_v2(db, insert_stmt, -1, &stmt, NULL);
+    if (ep_uid->len != DB_EP_UID_SIZE) {
+        fprintf(stderr, "db_add_keyset: bad EP_UID length %d\n", ep_uid->len);
+        return EINVAL;
+    }
+    status = db_insert_row((uint8_t *)ep_uid->val, epvk->val, epvk->len,
+                           esvk->val, esvk->len, erpk_mod->val, erpk_mod->len);
+    if ((status == SQLITE_DONE) && uid_index_loaded) {
+        uid_set_add((uint8_t *)ep_uid->val);
+    }
+
+    return (status == SQLITE_DONE)? 0 : status;
+}
+
+
+/**
+ * @brief Run an SQL statement that returns no rows
+ *
+ * @param sql The statement
+ *
+ * @returns SQLITE_OK if successful, SQLite status otherwise.
+ */
+static int db_exec(const char * sql) {
+    char * errmsg = NULL;
+    int status;
+
+    status = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
     if (status != SQLITE_OK) {
-        fprintf(stderr, "db_add_keyset: prepare failed: %s\n",
-                sqlite3_errmsg(db));
-    } else {
-        /* Bind the values to the statement */
-        MCL_OCT_toHex(ep_uid, ep_uid_hex);
-        status = sqlite3_bind_text(stmt, 1, ep_uid_hex, 16, SQLITE_STATIC);
-        if (status != SQLITE_OK) {
-            fprintf(stderr, "db_add_keyset: ep_uid bind failed: %s\n",
-                    sqlite3_errmsg(db));
-        } else {
-            status = sqlite3_bind_blob(stmt, 2, epvk->val, epvk->len,
-                                       SQLITE_STATIC);
-            if (status != SQLITE_OK) {
-                fprintf(stderr, "db_add_keyset: epvk bind failed: %s\n",
-                        sqlite3_errmsg(db));
-            } else {
-                status = sqlite3_bind_blob(stmt, 3, esvk->val, esvk->len,
-                                           SQLITE_STATIC);
-                if (status != SQLITE_OK) {
-                    fprintf(stderr, "db_add_keyset: esvk bind failed: %s\n",
-                            sqlite3_errmsg(db));
-                } else {
-                    status = sqlite3_bind_blob(stmt, 4, erpk_mod->val,
-                                               erpk_mod->len, SQLITE_STATIC);
-                    if (status != SQLITE_OK) {
-                        fprintf(stderr,
-                                "db_add_keyset: erpk_mod bind failed: %s\n",
-                                sqlite3_errmsg(db));
-                    }
-                }
+        fprintf(stderr, "ERROR: '%s' failed: %s\n", sql,
+                errmsg? errmsg : sqlite3_errmsg(db));
+    }
+    sqlite3_free(errmsg);
+    return status;
+}
+
+
+/**
+ * @brief Keyset writer thread
+ *
+ * Opens a transaction when rows arrive and inserts until either batch_size
+ * rows are in it or the queue runs dry, then commits. Only after COMMIT
+ * succeeds are the rows' committed callbacks told so; if anything fails
+ * the batch is rolled back, the callbacks are told of the failure and the
+ * writer refuses all further rows.
+ *
+ * @param arg Unused
+ */
+static void * db_writer_thread(void * arg) {
+    db_row * row;
+    uint32_t batch_count;
+    uint32_t i;
+    int status;
+    ims_stats stats;
+    uint64_t start;
+
+    pthread_mutex_lock(&writer.lock);
+    for (;;) {
+        while ((writer.count == 0) && !writer.stopping) {
+            pthread_cond_wait(&writer.not_empty, &writer.lock);
+        }
+        if (writer.count == 0) {
+            break;
+        }
+        writer.in_flight = true;
+        status = writer.error;
+        pthread_mutex_unlock(&writer.lock);
+
+        memset(&stats, 0, sizeof(stats));
+        if (status == 0) {
+            status = (db_exec("BEGIN") == SQLITE_OK)? 0 : EIO;
+        }
+
+        /**
+         * Fill the batch. A row stays in the queue (and so visible to
+         * db_ep_uid_exists) until it has been inserted.
+         */
+        batch_count = 0;
+        pthread_mutex_lock(&writer.lock);
+        while ((writer.count > 0) && (batch_count < writer.batch_size)) {
+            row = &writer.queue[writer.head];
+            pthread_mutex_unlock(&writer.lock);
+
+            start = ims_stats_now();
+            if ((status == 0) &&
+                (db_insert_row(row->ep_uid, row->epvk, row->epvk_len,
+                               row->esvk, row->esvk_len,
+                               row->erpk_mod, row->erpk_mod_len) !=
+                 SQLITE_DONE)) {
+                status = EIO;
             }
+            ims_stats_stage(&stats, IMS_STAGE_DB_INSERT, start);
+            writer.batch_committed[batch_count] = row->committed;
+            writer.batch_cookie[batch_count] = row->cookie;
+            batch_count++;
+
+            pthread_mutex_lock(&writer.lock);
+            writer.head = (writer.head + 1) % writer.queue_depth;
+            writer.count--;
+            pthread_cond_broadcast(&writer.not_full);
         }
+        pthread_mutex_unlock(&writer.lock);
 
+        start = ims_stats_now();
+        if (status == 0) {
+            status = (db_exec("COMMIT") == SQLITE_OK)? 0 : EIO;
+        }
+        ims_stats_stage(&stats, IMS_STAGE_DB_COMMIT, start);
+        if ((status != 0) && !sqlite3_get_autocommit(db)) {
+            db_exec("ROLLBACK");
+        }
 
-        /* Push the row out to the db */
-        status = sqlite3_step(stmt);
-        if (status != SQLITE_DONE) {
-            fprintf(stderr, "db_add_keyset: can't add row: %s\n",
-                    sqlite3_errmsg(db));
+        /* Now (and only now) report the rows */
+        for (i = 0; i < batch_count; i++) {
+            if (writer.batch_committed[i]) {
+                writer.batch_committed[i](writer.batch_cookie[i], status);
+            }
+        }
+
+        pthread_mutex_lock(&writer.lock);
+        ims_stats_add(&writer.stats, &stats);
+        if ((status != 0) && (writer.error == 0)) {
+            writer.error = status;
+        }
+        writer.in_flight = false;
+        pthread_cond_broadcast(&writer.drained);
+        pthread_cond_broadcast(&writer.not_full);
+    }
+    pthread_mutex_unlock(&writer.lock);
+
+    return NULL;
+}
+
+
+/**
+ * @brief Start the batched keyset writer
+ *
+ * Prepares the INSERT once, optionally switches the database to WAL
+ * journaling with synchronous=NORMAL, and starts the writer thread.
+ *
+ * @param batch_size The most rows to commit in one transaction
+ * @param queue_depth The most rows that may wait for the writer
+ * @param wal If true, use WAL journaling and synchronous=NORMAL
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int db_writer_start(uint32_t batch_size, uint32_t queue_depth, bool wal) {
+    int status = 0;
+
+    if (!db || writer.running || (batch_size < 1) || (queue_depth < 1)) {
+        return EINVAL;
+    }
+
+    if (wal) {
+        if ((db_exec("PRAGMA journal_mode=WAL") != SQLITE_OK) ||
+            (db_exec("PRAGMA synchronous=NORMAL") != SQLITE_OK)) {
+            return EIO;
         }
+    }
+    if (!insert &&
+        (sqlite3_prepare_v2(db, insert_stmt, -1, &insert, NULL) != SQLITE_OK)) {
+        fprintf(stderr, "db_writer_start: prepare failed: %s\n",
+                sqlite3_errmsg(db));
+        insert = NULL;
+        return EIO;
+    }
+
+    memset(&writer, 0, sizeof(writer));
+    writer.batch_size = batch_size;
+    writer.queue_depth = queue_depth;
+    writer.queue = calloc(queue_depth, sizeof(*writer.queue));
+    writer.batch_committed = calloc(batch_size,
+                                    sizeof(*writer.batch_committed));
+    writer.batch_cookie = calloc(batch_size, sizeof(*writer.batch_cookie));
+    if (!writer.queue || !writer.batch_committed || !writer.batch_cookie) {
+        fprintf(stderr, "ERROR: Can't allocate the keyset writer queue\n");
+        status = ENOMEM;
+        goto db_writer_start_err;
+    }
+
+    pthread_mutex_init(&writer.lock, NULL);
+    pthread_cond_init(&writer.not_empty, NULL);
+    pthread_cond_init(&writer.not_full, NULL);
+    pthread_cond_init(&writer.drained, NULL);
+    if (pthread_create(&writer.thread, NULL, db_writer_thread, NULL) != 0) {
+        fprintf(stderr, "ERROR: Can't start the keyset writer\n");
+        pthread_cond_destroy(&writer.drained);
+        pthread_cond_destroy(&writer.not_full);
+        pthread_cond_destroy(&writer.not_empty);
+        pthread_mutex_destroy(&writer.lock);
+        status = EAGAIN;
+        goto db_writer_start_err;
+    }
+    writer.running = true;
+    return 0;
+
+db_writer_start_err:
+    free(writer.batch_cookie);
+    free(writer.batch_committed);
+    free(writer.queue);
+    memset(&writer, 0, sizeof(writer));
+    return status;
+}
+
+
+/**
+ * @brief Queue a keyset for the batched writer
+ *
+ * Blocks while the queue is full. The keys are copied, so the caller may
+ * reuse its octets at once.
+ *
+ * @param ep_uid The EndPoint Unique ID, used as a key
+ * @param epvk The EPVK to save
+ * @param esvk The ESVK to save
+ * @param erpk_mod The modulus for ERPK to save
+ * @param committed Called from the writer thread once the row's batch has
+ *        committed (status 0) or failed (errno); may be NULL
+ * @param cookie Passed to committed
+ *
+ * @returns Zero if queued, errno otherwise (including any earlier writer
+ *          failure). If the row was not queued, committed is not called.
+ */
+int db_writer_add(mcl_octet * ep_uid,
+                  mcl_octet * epvk,
+                  mcl_octet * esvk,
+                  mcl_octet * erpk_mod,
+                  db_committed_fn committed,
+                  void * cookie) {
+    db_row * row;
+    int status;
+
+    if (!writer.running) {
+        return EINVAL;
+    }
+    if ((ep_uid->len != DB_EP_UID_SIZE) ||
+        (epvk->len > DB_BLOB_MAX) || (esvk->len > DB_BLOB_MAX) ||
+        (erpk_mod->len > DB_BLOB_MAX)) {
+        fprintf(stderr, "db_writer_add: keyset too large\n");
+        return EINVAL;
+    }
+
+    pthread_mutex_lock(&writer.lock);
+    while ((writer.count == writer.queue_depth) && (writer.error == 0)) {
+        pthread_cond_wait(&writer.not_full, &writer.lock);
+    }
+    status = writer.error;
+    if (status == 0) {
+        row = &writer.queue[(writer.head + writer.count) % writer.queue_depth];
+        memcpy(row->ep_uid, ep_uid->val, DB_EP_UID_SIZE);
+        memcpy(row->epvk, epvk->val, epvk->len);
+        row->epvk_len = epvk->len;
+        memcpy(row->esvk, esvk->val, esvk->len);
+        row->esvk_len = esvk->len;
+        memcpy(row->erpk_mod, erpk_mod->val, erpk_mod->len);
+        row->erpk_mod_len = erpk_mod->len;
+        row->committed = committed;
+        row->cookie = cookie;
+        writer.count++;
+        pthread_cond_signal(&writer.not_empty);
+    }
+    pthread_mutex_unlock(&writer.lock);
+
+    /* Queued rows count as taken for the uniqueness check */
+    if ((status == 0) && uid_index_loaded) {
+        status = uid_set_add((uint8_t *)ep_uid->val);
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Wait until every queued keyset has been committed
+ *
+ * @returns Zero if everything committed, errno of the first failure
+ *          otherwise.
+ */
+int db_writer_flush(void) {
+    int status;
+
+    if (!writer.running) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&writer.lock);
+    while ((writer.count > 0) || writer.in_flight) {
+        pthread_cond_wait(&writer.drained, &writer.lock);
+    }
+    status = writer.error;
+    pthread_mutex_unlock(&writer.lock);
+
+    return status;
+}
+
+
+/**
+ * @brief Add the keyset writer's INSERT and COMMIT timings to a total
+ *
+ * @param total The stats to add to
+ */
+void db_writer_stats(ims_stats * total) {
+    if (writer.running) {
+        pthread_mutex_lock(&writer.lock);
+        ims_stats_add(total, &writer.stats);
+        pthread_mutex_unlock(&writer.lock);
+    }
+}
 
-        status = sqlite3_finalize(stmt);
+
+/**
+ * @brief Commit anything outstanding and stop the keyset writer
+ *
+ * @returns Zero if everything committed, errno of the first failure
+ *          otherwise.
+ */
+int db_writer_stop(void) {
+    int status;
+
+    if (!writer.running) {
+        return 0;
     }
 
+    pthread_mutex_lock(&writer.lock);
+    writer.stopping = true;
+    pthread_cond_signal(&writer.not_empty);
+    pthread_mutex_unlock(&writer.lock);
+    pthread_join(writer.thread, NULL);
+
+    status = writer.error;
+    pthread_cond_destroy(&writer.drained);
+    pthread_cond_destroy(&writer.not_full);
+    pthread_cond_destroy(&writer.not_empty);
+    pthread_mutex_destroy(&writer.lock);
+    free(writer.batch_cookie);
+    free(writer.batch_committed);
+    free(writer.queue);
+    memset(&writer, 0, sizeof(writer));
+
     return status;
 }
 
 
+/**
+ * @brief Determine if an EP_UID is waiting in the keyset writer queue
+ *
+ * @param ep_uid The 8-byte EP_UID
+ *
+ * @returns True if a queued (not yet inserted) row has that EP_UID.
+ */
+static bool db_writer_queued(const uint8_t * ep_uid) {
+    uint32_t i;
+    bool queued = false;
+
+    if (writer.running) {
+        pthread_mutex_lock(&writer.lock);
+        for (i = 0; (i < writer.count) && !queued; i++) {
+            queued = (memcmp(writer.queue[(writer.head + i) %
+                                          writer.queue_depth].ep_uid,
+                             ep_uid, DB_EP_UID_SIZE) == 0);
+        }
+        pthread_mutex_unlock(&writer.lock);
+    }
+
+    return queued;
+}
+
+
 /**
  * @brief Fetch a blob into an octet
  *
@@ -199,6 +668,9 @@ static int db_get_blob(sqlite3_stmt *stmt,
  * @param essk (Optional) the ESSK to retrieve
  * @param erpk_mod (Optional) the modulus for ERPK to retrieve
  *
+ * The SELECT is prepared once and the EP_UID bound to it, rather than
+ * formatting (and re-compiling) a query per lookup.
+ *
  * @returns Zero if successful, errno otherwise.
  */
 int db_get_keyset(mcl_octet * ep_uid,
@@ -207,14 +679,23 @@ int db_get_keyset(mcl_octet * ep_uid,
                   mcl_octet * erpk_mod) {
     int status = 0;
     int step = 0;
-    char ep_uid_hex[32];
-    char query[256];
     sqlite3_stmt *stmt;
 
-    /* Convert the EP_UID to a hex string to use as the key */
-    MCL_OCT_toHex(ep_uid, ep_uid_hex);
-    snprintf(query, sizeof(query), select_format_stmt, ep_uid_hex);
-    status = sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
+    if (ep_uid->len != DB_EP_UID_SIZE) {
+        return SQLITE_NOTFOUND;
+    }
+
+    pthread_mutex_lock(&lookup_lock);
+    if (!lookup) {
+        status = sqlite3_prepare_v2(db, lookup_stmt, -1, &lookup, NULL);
+        if (status != SQLITE_OK) {
+            lookup = NULL;
+        }
+    }
+    stmt = lookup;
+    if (status == SQLITE_OK) {
+        status = db_bind_ep_uid(stmt, 1, db_version, (uint8_t *)ep_uid->val);
+    }
     if (status != SQLITE_OK) {
         fprintf(stderr, "db_get_keyset: prepare failed: %s\n", sqlite3_errmsg(db));
     } else {
@@ -249,8 +730,10 @@ int db_get_keyset(mcl_octet * ep_uid,
             }
         }
 
-        status = sqlite3_finalize(stmt);
+        status = sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
     }
+    pthread_mutex_unlock(&lookup_lock);
 
     if (step != SQLITE_ROW) {
         status = SQLITE_NOTFOUND;
@@ -267,12 +750,208 @@ int db_get_keyset(mcl_octet * ep_uid,
  * @returns True if the EP_UID is already in the db, false if it isn't.
  */
 bool db_ep_uid_exists(mcl_octet * ep_uid) {
+    /**
+     * Without the in-memory index, ask the database. Rows the keyset writer
+     * has inserted are visible through the shared
+     * connection even before their batch commits; rows still queued are not.
+     */
+    if (uid_index_loaded) {
+        return uid_set_contains((uint8_t *)ep_uid->val);
+    }
+    if (db_writer_queued((uint8_t *)ep_uid->val)) {
+        return true;
+    }
+
+   return (db_get_keyset(ep_uid, NULL, NULL, NULL) != SQLITE_NOTFOUND);
+}
+
+
+/**
+ * @brief Count the keysets in the database
+ *
+ * @param count Set to the number of keysets
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+int db_count_keysets(uint64_t * count) {
+    int status = 0;
+    sqlite3_stmt *stmt = NULL;
+
+    if ((sqlite3_prepare_v2(db, "SELECT count(*) FROM pub_keys", -1, &stmt,
+                            NULL) != SQLITE_OK) ||
+        (sqlite3_step(stmt) != SQLITE_ROW)) {
+        fprintf(stderr, "db_count_keysets: can't count keysets: %s\n",
+                sqlite3_errmsg(db));
+        status = EIO;
+    } else {
+        *count = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+
+    return status;
+}
+
+
+/**
+ * @brief Load every EP_UID in the key database into the in-memory index
+ *
+ * From then on db_ep_uid_exists() answers from memory, and keysets added
+ * through db_add_keyset() or db_writer_add() join the index as they are
+ * added.
+ *
+ * @param num_new The number of keysets the run expects to add
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int db_ep_uid_index_load(uint64_t num_new) {
     int status = 0;
-    char ep_uid_hex[32];
-    char sql_stmt[256];
+    int step;
+    uint64_t num_rows = 0;
+    uint8_t ep_uid[UID_SET_KEY_SIZE];
     sqlite3_stmt *stmt;
-    bool ep_uid_exists = false;
 
+    /* Size the set for what will be there when the run ends */
+    status = db_count_keysets(&num_rows);
+    if (status != 0) {
+        return status;
+    }
+    status = uid_set_init(num_rows + num_new);
+    if (status != 0) {
+        fprintf(stderr, "ERROR: Can't allocate the EP_UID index\n");
+        return status;
+    }
 
-   return (db_get_keyset(ep_uid, NULL, NULL, NULL) != SQLITE_NOTFOUND);
+    status = sqlite3_prepare_v2(db, "SELECT ep_uid FROM pub_keys", -1, &stmt,
+                                NULL);
+    if (status != SQLITE_OK) {
+        fprintf(stderr, "db_ep_uid_index_load: prepare failed: %s\n",
+                sqlite3_errmsg(db));
+        uid_set_deinit();
+        return EIO;
+    }
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (!db_column_ep_uid(stmt, 0, db_version, ep_uid)) {
+            fprintf(stderr, "ERROR: malformed EP_UID in db\n");
+            status = EIO;
+            break;
+        }
+        status = uid_set_add(ep_uid);
+        if (status != 0) {
+            break;
+        }
+    }
+    if ((status == 0) && (step != SQLITE_DONE)) {
+        fprintf(stderr, "db_ep_uid_index_load: can't read EP_UIDs: %s\n",
+                sqlite3_errmsg(db));
+        status = EIO;
+    }
+    sqlite3_finalize(stmt);
+
+    if (status == 0) {
+        uid_index_loaded = true;
+    } else {
+        uid_set_deinit();
+    }
+    return status;
+}
+
+
+/**
+ * @brief Walk every keyset in the database in EP_UID order
+ *
+ * A single cursor over the primary key, so visiting the whole database
+ * costs one ordered index scan rather than a query per EP_UID.
+ *
+ * @param fn Called for each keyset, in ascending EP_UID byte order
+ * @param cookie Passed to fn
+ *
+ * @returns Zero if every keyset was visited, the non-zero value fn
+ *          returned to stop the scan, or errno if the scan failed.
+ */
+int db_scan_keysets(const uint8_t * first,
+                    const uint8_t * last,
+                    db_keyset_fn fn,
+                    void * cookie) {
+    static const uint8_t lowest[DB_EP_UID_SIZE] =
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    static const uint8_t highest[DB_EP_UID_SIZE] =
+        {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    int status = 0;
+    int step;
+    uint8_t ep_uid[UID_SET_KEY_SIZE];
+    uint8_t epvk_buf[DB_BLOB_MAX];
+    uint8_t esvk_buf[DB_BLOB_MAX];
+    uint8_t erpk_mod_buf[DB_BLOB_MAX];
+    mcl_octet epvk = {0, sizeof(epvk_buf), (char *)epvk_buf};
+    mcl_octet esvk = {0, sizeof(esvk_buf), (char *)esvk_buf};
+    mcl_octet erpk_mod = {0, sizeof(erpk_mod_buf), (char *)erpk_mod_buf};
+    sqlite3_stmt *stmt;
+
+    if (sqlite3_prepare_v2(db, scan_stmt, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "db_scan_keysets: prepare failed: %s\n",
+                sqlite3_errmsg(db));
+        return EIO;
+    }
+    if ((db_bind_ep_uid(stmt, 1, db_version, first? first : lowest) !=
+         SQLITE_OK) ||
+        (db_bind_ep_uid(stmt, 2, db_version, last? last : highest) !=
+         SQLITE_OK)) {
+        fprintf(stderr, "db_scan_keysets: bind failed: %s\n",
+                sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        return EIO;
+    }
+
+    /* BLOB keys, like lower-case hex ones, sort in EP_UID byte order */
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (!db_column_ep_uid(stmt, 0, db_version, ep_uid)) {
+            fprintf(stderr, "ERROR: malformed EP_UID in db\n");
+            status = EIO;
+            break;
+        }
+        if (!db_get_blob(stmt, 1, &epvk) || !db_get_blob(stmt, 2, &esvk) ||
+            !db_get_blob(stmt, 3, &erpk_mod)) {
+            status = EIO;
+            break;
+        }
+        status = fn(cookie, ep_uid, &epvk, &esvk, &erpk_mod);
+        if (status != 0) {
+            break;
+        }
+    }
+    if ((status == 0) && (step != SQLITE_DONE)) {
+        fprintf(stderr, "db_scan_keysets: can't read keysets: %s\n",
+                sqlite3_errmsg(db));
+        status = EIO;
+    }
+    sqlite3_finalize(stmt);
+
+    return status;
+}
+
+
+/**
+ * @brief Print the in-memory EP_UID index's footprint and Bloom filter
+ * false-positive rate
+ */
+void db_ep_uid_index_report(void) {
+    uid_set_stats stats;
+    uint64_t misses;
+
+    if (!uid_index_loaded) {
+        return;
+    }
+    uid_set_get_stats(&stats);
+
+    /* Lookups that should have been rejected: all but the true hits */
+    misses = stats.lookups - (stats.bloom_passes - stats.false_positives);
+    printf("EP_UID index: %llu entries, %zu KiB (table %zu KiB, Bloom %zu KiB), "
+           "%llu lookups, Bloom false positives %llu/%llu (%.4f%%)\n",
+           (unsigned long long)stats.entries,
+           (stats.table_bytes + stats.bloom_bytes) / 1024,
+           stats.table_bytes / 1024, stats.bloom_bytes / 1024,
+           (unsigned long long)stats.lookups,
+           (unsigned long long)stats.false_positives,
+           (unsigned long long)misses,
+           misses? (100.0 * stats.false_positives / misses) : 0.0);
 }
@@ -36,6 +36,8 @@
 #ifndef _DATABASE_H
 #define _DATABASE_H
 
+#include "ims_stats.h"
+
 
 /**
  * @brief Initialize the key database subsystem
@@ -55,6 +57,71 @@ int db_init(const char * database_name);
 void db_deinit(void);
 
 
+/**
+ * @brief Fetch the set of keys associated with an EP_UID
+ *
+ * @param ep_uid The EndPoint Unique ID, to look up
+ * @param epvk (Optional) the EPVK to retrieve
+ * @param esvk (Optional) the ESVK to retrieve
+ * @param erpk_mod (Optional) the modulus for ERPK to retrieve
+ *
+ * @returns SQLITE_OK if successful, SQLITE_NOTFOUND if there is no such
+ *          EP_UID, another SQLite error code otherwise.
+ */
+int db_get_keyset(mcl_octet * ep_uid,
+                  mcl_octet * epvk,
+                  mcl_octet * esvk,
+                  mcl_octet * erpk_mod);
+
+
+/**
+ * @brief Told about one keyset of an ordered database scan
+ *
+ * @param cookie The cookie given to db_scan_keysets
+ * @param ep_uid The keyset's EP_UID (8 bytes)
+ * @param epvk The EPVK
+ * @param esvk The ESVK
+ * @param erpk_mod The modulus for ERPK
+ *
+ * @returns Zero to continue the scan, non-zero to stop it.
+ */
+typedef int (*db_keyset_fn)(void * cookie,
+                            const uint8_t * ep_uid,
+                            mcl_octet * epvk,
+                            mcl_octet * esvk,
+                            mcl_octet * erpk_mod);
+
+
+/**
+ * @brief Walk the keysets in the database in EP_UID order
+ *
+ * Only the keysets between first and last (inclusive) are visited. The
+ * scan follows the EP_UID index, so a narrow range costs only its rows.
+ *
+ * @param first (Optional) the lowest EP_UID (8 bytes) to visit
+ * @param last (Optional) the highest EP_UID (8 bytes) to visit
+ * @param fn Called for each keyset, in ascending EP_UID byte order
+ * @param cookie Passed to fn
+ *
+ * @returns Zero if every keyset was visited, the non-zero value fn
+ *          returned to stop the scan, or errno if the scan failed.
+ */
+int db_scan_keysets(const uint8_t * first,
+                    const uint8_t * last,
+                    db_keyset_fn fn,
+                    void * cookie);
+
+
+/**
+ * @brief Count the keysets in the database
+ *
+ * @param count Set to the number of keysets
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+int db_count_keysets(uint64_t * count);
+
+
 /**
  * @brief Determine if an EP_UID is already in the key database
  *
@@ -80,4 +147,105 @@ int db_add_keyset(mcl_octet * ep_uid,
                   mcl_octet * esvk,
                   mcl_octet * erpk_mod);
 
+
+
+/**
+ * @brief Told the outcome of a keyset queued with db_writer_add
+ *
+ * Called from the writer thread, in queue order, once the row's batch has
+ * committed.
+ *
+ * @param cookie The cookie given to db_writer_add
+ * @param status Zero if the row is committed, errno if it was not
+ */
+typedef void (*db_committed_fn)(void * cookie, int status);
+
+
+/**
+ * @brief Start the batched keyset writer
+ *
+ * Prepares the INSERT once, optionally switches the database to WAL
+ * journaling with synchronous=NORMAL, and starts the writer thread.
+ *
+ * @param batch_size The most rows to commit in one transaction
+ * @param queue_depth The most rows that may wait for the writer
+ * @param wal If true, use WAL journaling and synchronous=NORMAL
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int db_writer_start(uint32_t batch_size, uint32_t queue_depth, bool wal);
+
+
+/**
+ * @brief Queue a keyset for the batched writer
+ *
+ * Blocks while the queue is full. The keys are copied, so the caller may
+ * reuse its octets at once.
+ *
+ * @param ep_uid The EndPoint Unique ID, used as a key
+ * @param epvk The EPVK to save
+ * @param esvk The ESVK to save
+ * @param erpk_mod The modulus for ERPK to save
+ * @param committed Called from the writer thread once the row's batch has
+ *        committed (status 0) or failed (errno); may be NULL
+ * @param cookie Passed to committed
+ *
+ * @returns Zero if queued, errno otherwise (including any earlier writer
+ *          failure). If the row was not queued, committed is not called.
+ */
+int db_writer_add(mcl_octet * ep_uid,
+                  mcl_octet * epvk,
+                  mcl_octet * esvk,
+                  mcl_octet * erpk_mod,
+                  db_committed_fn committed,
+                  void * cookie);
+
+
+/**
+ * @brief Wait until every queued keyset has been committed
+ *
+ * @returns Zero if everything committed, errno of the first failure
+ *          otherwise.
+ */
+int db_writer_flush(void);
+
+
+/**
+ * @brief Add the keyset writer's INSERT and COMMIT timings to a total
+ *
+ * @param total The stats to add to
+ */
+void db_writer_stats(ims_stats * total);
+
+
+/**
+ * @brief Commit anything outstanding and stop the keyset writer
+ *
+ * @returns Zero if everything committed, errno of the first failure
+ *          otherwise.
+ */
+int db_writer_stop(void);
+
+
+
+/**
+ * @brief Load every EP_UID in the key database into the in-memory index
+ *
+ * From then on db_ep_uid_exists() answers from memory, and keysets added
+ * through db_add_keyset() or db_writer_add() join the index as they are
+ * added.
+ *
+ * @param num_new The number of keysets the run expects to add
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int db_ep_uid_index_load(uint64_t num_new);
+
+
+/**
+ * @brief Print the in-memory EP_UID index's footprint and Bloom filter
+ * false-positive rate
+ */
+void db_ep_uid_index_report(void);
+
 #endif /* !_DATABASE_H */
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the key database schema versions and EP_UID
+ * key conversions (see db_schema.h).
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sqlite3.h>
+#include "db_schema.h"
+
+static const char * create_stmt =
+    "CREATE TABLE pub_keys(ep_uid BLOB PRIMARY KEY NOT NULL, "
+    "epvk BLOB, esvk BLOB, erpk_mod BLOB) WITHOUT ROWID;"
+    "PRAGMA user_version = 1";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+
+/**
+ * @brief Find a key database's schema version
+ *
+ * @param db The database
+ * @param version Set to the schema version, or DB_SCHEMA_NONE if there is
+ *        no pub_keys table
+ *
+ * @returns Zero if successful, EIO if the database can't be read, EPROTO
+ *          if the version is newer than this program knows.
+ */
+int db_schema_version(sqlite3 * db, int * version) {
+    int status = 0;
+    sqlite3_stmt * stmt;
+
+    if (sqlite3_prepare_v2(db, "SELECT count(*) FROM sqlite_master "
+                           "WHERE type = 'table' AND name = 'pub_keys'",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't read the db schema: %s\n",
+                sqlite3_errmsg(db));
+        return EIO;
+    }
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        status = EIO;
+    } else if (sqlite3_column_int(stmt, 0) == 0) {
+        *version = DB_SCHEMA_NONE;
+    } else {
+        sqlite3_finalize(stmt);
+        if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt,
+                               NULL) != SQLITE_OK) {
+            fprintf(stderr, "ERROR: Can't read the db schema: %s\n",
+                    sqlite3_errmsg(db));
+            return EIO;
+        }
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
+            status = EIO;
+        } else {
+            *version = sqlite3_column_int(stmt, 0);
+            if ((*version < DB_SCHEMA_TEXT_KEY) ||
+                (*version > DB_SCHEMA_CURRENT)) {
+                fprintf(stderr, "ERROR: Unknown db schema version %d\n",
+                        *version);
+                status = EPROTO;
+            }
+        }
+    }
+    if (status == EIO) {
+        fprintf(stderr, "ERROR: Can't read the db schema: %s\n",
+                sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+
+    return status;
+}
+
+
+/**
+ * @brief Create the current pub_keys table in an empty database
+ *
+ * @param db The database
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+int db_schema_create(sqlite3 * db) {
+    char * errmsg = NULL;
+    int status = 0;
+
+    if (sqlite3_exec(db, create_stmt, NULL, NULL, &errmsg) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't create the pub_keys table: %s\n",
+                errmsg? errmsg : sqlite3_errmsg(db));
+        status = EIO;
+    }
+    sqlite3_free(errmsg);
+    return status;
+}
+
+
+/**
+ * @brief Format an EP_UID as 16 lower-case hex digits
+ *
+ * @param ep_uid The 8-byte EP_UID
+ * @param hex The output buffer (at least DB_EP_UID_HEX_LEN + 1 characters)
+ */
+void db_ep_uid_to_hex(const uint8_t * ep_uid, char * hex) {
+    int i;
+
+    for (i = 0; i < DB_EP_UID_SIZE; i++) {
+        hex[i * 2] = hex_digits[ep_uid[i] >> 4];
+        hex[i * 2 + 1] = hex_digits[ep_uid[i] & 0x0f];
+    }
+    hex[DB_EP_UID_HEX_LEN] = '\0';
+}
+
+
+/**
+ * @brief Convert a 16-hex-digit EP_UID key back into its 8 bytes
+ *
+ * @param hex The key as stored in a version 0 database
+ * @param length The length of hex
+ * @param ep_uid The 8-byte output buffer
+ *
+ * @returns True if hex was well formed, false otherwise.
+ */
+bool db_hex_to_ep_uid(const char * hex, int length, uint8_t * ep_uid) {
+    int i;
+    int nibble;
+    char c;
+
+    if (!hex || (length != DB_EP_UID_HEX_LEN)) {
+        return false;
+    }
+    for (i = 0; i < DB_EP_UID_HEX_LEN; i++) {
+        c = hex[i];
+        if ((c >= '0') && (c <= '9')) {
+            nibble = c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            nibble = c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')) {
+            nibble = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        ep_uid[i / 2] = (i & 1)? (ep_uid[i / 2] | nibble) : (nibble << 4);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Bind an EP_UID key to a statement parameter
+ *
+ * @param stmt The statement
+ * @param param The parameter index (1-based)
+ * @param version The database's schema version
+ * @param ep_uid The 8-byte EP_UID
+ *
+ * @returns SQLITE_OK if successful, SQLite status otherwise.
+ */
+int db_bind_ep_uid(sqlite3_stmt * stmt, int param, int version,
+                   const uint8_t * ep_uid) {
+    char hex[DB_EP_UID_HEX_LEN + 1];
+
+    if (version == DB_SCHEMA_TEXT_KEY) {
+        db_ep_uid_to_hex(ep_uid, hex);
+        return sqlite3_bind_text(stmt, param, hex, DB_EP_UID_HEX_LEN,
+                                 SQLITE_TRANSIENT);
+    }
+    return sqlite3_bind_blob(stmt, param, ep_uid, DB_EP_UID_SIZE,
+                             SQLITE_TRANSIENT);
+}
+
+
+/**
+ * @brief Fetch an EP_UID key from a result column
+ *
+ * @param stmt The statement, positioned on a row
+ * @param column The column index (0-based)
+ * @param version The database's schema version
+ * @param ep_uid The 8-byte output buffer
+ *
+ * @returns True if the column held a well-formed key, false otherwise.
+ */
+bool db_column_ep_uid(sqlite3_stmt * stmt, int column, int version,
+                      uint8_t * ep_uid) {
+    const void * key;
+
+    if (version == DB_SCHEMA_TEXT_KEY) {
+        return db_hex_to_ep_uid((const char *)sqlite3_column_text(stmt, column),
+                                sqlite3_column_bytes(stmt, column), ep_uid);
+    }
+    key = sqlite3_column_blob(stmt, column);
+    if (!key || (sqlite3_column_bytes(stmt, column) != DB_EP_UID_SIZE)) {
+        return false;
+    }
+    memcpy(ep_uid, key, DB_EP_UID_SIZE);
+    return true;
+}
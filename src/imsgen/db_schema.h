@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the header information for the key database
+ * schema versions shared by imsgen, imsgen_test, ims-merge and
+ * ims-db-migrate.
+ *
+ * The schema version is kept in the database's user_version:
+ *
+ *   0  pub_keys(ep_uid TEXT PRIMARY KEY, epvk BLOB, esvk BLOB,
+ *               erpk_mod BLOB)
+ *      The EP_UID is stored as 16 lower-case hex digits, with a rowid
+ *      table and a separate index on the key.
+ *
+ *   1  pub_keys(ep_uid BLOB PRIMARY KEY NOT NULL, epvk BLOB, esvk BLOB,
+ *               erpk_mod BLOB) WITHOUT ROWID
+ *      The EP_UID is stored as its 8 raw bytes, and the table itself is the
+ *      primary key B-tree.
+ *
+ * Both sort in EP_UID byte order. New databases get the current version;
+ * ims-db-migrate converts version 0 databases.
+ *
+ */
+
+#ifndef _DB_SCHEMA_H
+#define _DB_SCHEMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sqlite3.h>
+
+#define DB_SCHEMA_NONE          -1      /* No pub_keys table yet */
+#define DB_SCHEMA_TEXT_KEY      0
+#define DB_SCHEMA_BLOB_KEY      1
+#define DB_SCHEMA_CURRENT       DB_SCHEMA_BLOB_KEY
+
+/* EP_UID key: 8 bytes, or 16 hex digits in a version 0 database */
+#define DB_EP_UID_SIZE          8
+#define DB_EP_UID_HEX_LEN       (DB_EP_UID_SIZE * 2)
+
+
+/**
+ * @brief Find a key database's schema version
+ *
+ * @param db The database
+ * @param version Set to the schema version, or DB_SCHEMA_NONE if there is
+ *        no pub_keys table
+ *
+ * @returns Zero if successful, EIO if the database can't be read, EPROTO
+ *          if the version is newer than this program knows.
+ */
+int db_schema_version(sqlite3 * db, int * version);
+
+
+/**
+ * @brief Create the current pub_keys table in an empty database
+ *
+ * @param db The database
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+int db_schema_create(sqlite3 * db);
+
+
+/**
+ * @brief Format an EP_UID as 16 lower-case hex digits
+ *
+ * @param ep_uid The 8-byte EP_UID
+ * @param hex The output buffer (at least DB_EP_UID_HEX_LEN + 1 characters)
+ */
+void db_ep_uid_to_hex(const uint8_t * ep_uid, char * hex);
+
+
+/**
+ * @brief Convert a 16-hex-digit EP_UID key back into its 8 bytes
+ *
+ * @param hex The key as stored in a version 0 database
+ * @param length The length of hex
+ * @param ep_uid The 8-byte output buffer
+ *
+ * @returns True if hex was well formed, false otherwise.
+ */
+bool db_hex_to_ep_uid(const char * hex, int length, uint8_t * ep_uid);
+
+
+/**
+ * @brief Bind an EP_UID key to a statement parameter
+ *
+ * @param stmt The statement
+ * @param param The parameter index (1-based)
+ * @param version The database's schema version
+ * @param ep_uid The 8-byte EP_UID
+ *
+ * @returns SQLITE_OK if successful, SQLite status otherwise.
+ */
+int db_bind_ep_uid(sqlite3_stmt * stmt, int param, int version,
+                   const uint8_t * ep_uid);
+
+
+/**
+ * @brief Fetch an EP_UID key from a result column
+ *
+ * @param stmt The statement, positioned on a row
+ * @param column The column index (0-based)
+ * @param version The database's schema version
+ * @param ep_uid The 8-byte output buffer
+ *
+ * @returns True if the column held a well-formed key, false otherwise.
+ */
+bool db_column_ep_uid(sqlite3_stmt * stmt, int column, int version,
+                      uint8_t * ep_uid);
+
+#endif /* !_DB_SCHEMA_H */
@@ -47,6 +47,7 @@
 #include <time.h>
 #include <getopt.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <openssl/conf.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
@@ -59,16 +60,23 @@
 #include "mcl_ecdh.h"
 #include "mcl_rand.h"
 #include "mcl_rsa.h"
+#include "ims_mcl.h"
 #include "crypto.h"
 #include "db.h"
 #include "ims_common.h"
+#include "ims_bignum.h"
+#include "ims_file.h"
+#include "ims_checkpoint.h"
 #include "ims.h"
 
 /* Uncomment the following define to enable IMS diagnostic messages */
 /*#define IMS_DEBUGMSG*/
 
-/* IMS output file */
-static FILE *   fp_ims;
+/* IMS output file: binascii (fp_ims) or a binary container (ims_bin) */
+static FILE *               fp_ims;
+static ims_file_writer *    ims_bin;
+static char *               ims_out_name;
+static bool                 ims_out_binary;
 
 /**
  * Endpoint Rsa pRivate Key (ERRK/ERPK) data:
@@ -80,10 +88,161 @@ mcl_chunk errk_max_pq_ff[MCL_HFLEN][MCL_BS];
 mcl_chunk erpk_mod_ff[MCL_HFLEN][MCL_BS];
 mcl_chunk erpk_e[MCL_HFLEN][MCL_BS];
 mcl_chunk erpk_d[MCL_HFLEN][MCL_BS];
-mcl_chunk p1[MCL_HFLEN][MCL_BS];
-mcl_chunk q1[MCL_HFLEN][MCL_BS];
+
+/* Working context for the single-threaded (--jobs 1) generator */
+static ims_context default_ctx;
+
+/**
+ * Per-index derivation: when set, IMS number (first_index + k) is drawn
+ * from its own PRNG stream (see ims_context_seed_index) rather than the
+ * next stretch of one sequential stream.
+ */
+static bool     ims_indexed;
+static uint64_t ims_first_index;
+
+/* Draw IMS candidates with the original rejection sampler */
+static bool     ims_rejection_sampler;
+
+/**
+ * ERRK big-number backend, and the reference backend (if any) that every
+ * ims_cross_check_every'th P/Q search in each context is replayed on.
+ */
+static const ims_bignum * ims_bignum_primary;
+static const ims_bignum * ims_bignum_reference;
+static uint32_t           ims_cross_check_every = 1;
+
+/**
+ * Keysets go to the database through the batched writer. An IMS value is
+ * only written to the IMS file and reported once its keyset's batch has
+ * committed.
+ */
+#define IMS_DB_QUEUE_DEPTH      1024
+
+typedef struct {
+    uint8_t   ims[IMS_SIZE];
+    int       slot;             /* Checkpoint PRNG state it advances, or -1 */
+    csprng    rng;              /* ...to this */
+    bool      retried;          /* The retry stream was drawn on... */
+    csprng    retry_rng;        /* ...leaving it like this */
+} ims_pending;
+
+/* Progress, updated by the writer thread as batches commit */
+static uint32_t ims_num_total;
+static uint32_t ims_num_committed;
+static int      ims_commit_status;
+
+/**
+ * Instrumentation: each context keeps its own stats; those of contexts
+ * that have been torn down are folded into ims_run_stats, and the
+ * emitting thread's own work is kept in ims_emit_stats.
+ */
+static ims_stats ims_run_stats;
+static ims_stats ims_emit_stats;
+static uint32_t  ims_num_jobs = 1;
+static uint64_t  ims_start_nsec;
+
+/* Periodic throughput line state (writer thread only) */
+static uint64_t  ims_report_nsec;
+static uint32_t  ims_report_count;
+
+/**
+ * Checkpoints (see ims_checkpoint.h): ims_ckpt follows the last IMS value
+ * written out, and the writer thread saves it every ims_ckpt_interval
+ * seconds. On --resume, ims_adopt_remaining of the regenerated IMS values
+ * had their keysets committed by the interrupted run after its last
+ * checkpoint; they are recognised by their keys and adopted rather than
+ * inserted again.
+ */
+static char *          ims_ckpt_name;
+static uint32_t        ims_ckpt_interval = IMS_CHECKPOINT_INTERVAL_SEC;
+static bool            ims_resume;
+static ims_checkpoint  ims_ckpt;
+static uint64_t        ims_ckpt_nsec;
+static uint32_t        ims_adopt_remaining;
+
+/**
+ * Parallel generation: each generated IMS lands in a reorder ring slot
+ * until the writer emits it in order.
+ */
+#define IMS_RING_SLOTS_PER_JOB  4
+
+typedef struct {
+    bool      ready;
+    int       status;           /* Non-zero if the worker failed */
+    uint8_t   ims[IMS_SIZE];
+    uint8_t   ep_uid_buf[EP_UID_SIZE];
+    mcl_octet ep_uid;
+    uint8_t   epvk_buf[EPVK_SIZE];
+    mcl_octet epvk;
+    uint8_t   esvk_buf[ESVK_SIZE];
+    mcl_octet esvk;
+    uint8_t   erpk_mod_buf[ERRK_PQ_SIZE * 2];
+    mcl_octet erpk_mod;
+    csprng    rng;              /* The worker's PRNG after this IMS */
+} ims_result;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  slot_ready;     /* Signalled by workers */
+    pthread_cond_t  slot_free;      /* Signalled by the writer */
+    ims_result *    ring;
+    uint32_t        ring_size;
+    uint32_t        num_ims;
+    uint32_t        num_jobs;
+    uint32_t        first;          /* First IMS index (non-zero on resume) */
+    uint32_t        next_write;     /* Next IMS index the writer will emit */
+    bool            abort;
+    bool            ims_sample_compatibility;
+} ims_batch;
+
+typedef struct {
+    pthread_t    thread;
+    uint32_t     worker;
+    ims_batch *  batch;
+    ims_context  ctx;
+} ims_worker;
+
+/**
+ * ERRK P/Q primality search memo. Each of the (1 << P_Q_BIAS_BITS) Q bias
+ * offsets is Miller-Rabin tested at most once per IMS, with the outcome
+ * kept in a pair of bitmaps.
+ *
+ * MCL_FF_prime draws its witnesses from the PRNG, so to keep the PRNG
+ * stream (and hence every subsequent IMS for a given seed) identical to an
+ * un-memoized search, a repeat visit skips the PRNG ahead by the bytes the
+ * original test consumed (see PRIME_WITNESS_RAND_BYTES).
+ */
+#define PQ_BIAS_SLOTS               (1 << P_Q_BIAS_BITS)
+#define PQ_BITMAP_WORDS             (PQ_BIAS_SLOTS / 64)
+
+/**
+ * Small-prime sieve over the P/Q bias window. Offsets with a factor below
+ * SIEVE_PRIME_LIMIT never reach Miller-Rabin. MCL_FF_prime itself rejects
+ * anything sharing a factor with TRIAL_DIVISOR (3*5*...*19) before drawing
+ * a witness, and rejects any other such composite after one witness, which
+ * is what the sieve replays.
+ */
+#define SIEVE_PRIME_LIMIT           (1 << 15)
+#define SIEVE_MAX_PRIMES            (SIEVE_PRIME_LIMIT / 2)
+#define TRIAL_DIVISOR_MAX_PRIME     19
+
+typedef struct {
+    uint64_t composite[PQ_BITMAP_WORDS];    /* Has a small factor */
+    uint64_t trial[PQ_BITMAP_WORDS];        /* ...of at most 19 */
+} pq_sieve;
+
+typedef struct {
+    uint64_t tested[PQ_BITMAP_WORDS];
+    uint64_t prime[PQ_BITMAP_WORDS];
+    uint8_t  witnesses[PQ_BIAS_SLOTS];
+} pq_prime_memo;
+
+/* The odd primes below SIEVE_PRIME_LIMIT */
+static uint32_t sieve_primes[SIEVE_MAX_PRIMES];
+static uint32_t num_sieve_primes;
 
 void calc_errk_max_pq(void);
+static void calc_sieve_primes(void);
 
 
 /**
@@ -95,6 +254,12 @@ void calc_errk_max_pq(void);
  * @param prng_seed_string Raw seed string
  * @param ims_filename The name of the IMS output file
  * @param database_name The name of the key database
+ * @param db_batch_size The most keysets to commit in one transaction
+ * @param db_wal If true, use WAL journaling with synchronous=NORMAL
+ * @param binary_out If true, write the IMS file as a binary IMS container
+ *        rather than binascii
+ * @param num_ims The number of IMS values the run will generate (sizes the
+ *        EP_UID index)
  *
  * @note One and only 1 of prng_seed_file and prng_seed_string must be
  *       non-null.
@@ -104,24 +269,76 @@ void calc_errk_max_pq(void);
 int ims_init(const char * prng_seed_file,
              const char * prng_seed_string,
              const char * ims_filename,
-             const char * database_name) {
+             const char * database_name,
+             uint32_t db_batch_size,
+             bool db_wal,
+             bool binary_out,
+             uint32_t num_ims) {
     int status = 0;
     mcl_octet * seed = NULL;
 
+    /* Don't overwrite the output of a run that can still be resumed */
+    if (ims_ckpt_interval > 0) {
+        ims_ckpt_name = malloc(strlen(ims_filename) +
+                               sizeof(IMS_CHECKPOINT_SUFFIX));
+        if (!ims_ckpt_name) {
+            return ENOMEM;
+        }
+        sprintf(ims_ckpt_name, "%s%s", ims_filename, IMS_CHECKPOINT_SUFFIX);
+        if (!ims_resume && (access(ims_ckpt_name, F_OK) == 0)) {
+            fprintf(stderr, "ERROR: '%s' holds the checkpoint of an "
+                    "unfinished run: --resume it, or remove it\n",
+                    ims_ckpt_name);
+            return EEXIST;
+        }
+    }
+    ims_out_name = strdup(ims_filename);
+    if (!ims_out_name) {
+        return ENOMEM;
+    }
+
     /* Seed the PRNG */
     status = ims_common_init(prng_seed_file, prng_seed_string);
+    if (status != 0) {
+        goto ims_init_err;
+    }
+    ims_context_init(&default_ctx);
 
-    /* Open the key database */
+    /* Precompute the EPVK/ESVK generator tables (before any threads start) */
+    ims_fixed_base_init();
+
+    /* Open the key database, index its EP_UIDs and start its writer */
     status = db_init(database_name);
     if (status != 0) {
         goto ims_init_err;
     }
+    status = db_ep_uid_index_load(num_ims);
+    if (status != 0) {
+        goto ims_init_err;
+    }
+    status = db_writer_start(db_batch_size, IMS_DB_QUEUE_DEPTH, db_wal);
+    if (status != 0) {
+        goto ims_init_err;
+    }
 
-    /* Open the IMS output file */
-    fp_ims = fopen(ims_filename, "w");
+    /* Open the IMS output file (on --resume, ims_checkpoint_begin does) */
+    ims_out_binary = binary_out;
+    if (!ims_resume) {
+        if (binary_out) {
+            ims_bin = ims_file_create(ims_filename);
+            if (!ims_bin) {
+                status = EIO;
+                goto ims_init_err;
+            }
+        } else {
+            fp_ims = fopen(ims_filename, "w");
+        }
+    }
 
     /* Establish any really big number constants */
+    ims_bignum_primary = ims_bignum_find(IMS_BIGNUM_DEFAULT);
     calc_errk_max_pq();
+    calc_sieve_primes();
 
 ims_init_err:
 
@@ -135,16 +352,98 @@ ims_init_err:
  * Flushes the IMS output file, closes the database
  */
 void ims_deinit(void) {
+    /* Commit (and so write out) anything still queued */
+    db_writer_stop();
+
     /* Close the IMS output file */
     if (fp_ims) {
         fclose(fp_ims);
         fp_ims = NULL;
     }
+    if (ims_bin) {
+        ims_file_close(ims_bin);
+        ims_bin = NULL;
+    }
 
     /* Close the key database */
+    db_ep_uid_index_report();
     db_deinit();
 
+    ims_context_deinit(&default_ctx);
     ims_common_deinit();
+
+    ims_checkpoint_free(&ims_ckpt);
+    free(ims_ckpt_name);
+    ims_ckpt_name = NULL;
+    free(ims_out_name);
+    ims_out_name = NULL;
+}
+
+
+/**
+ * @brief Select checkpointing, and whether to resume an interrupted run
+ *
+ * @param interval_sec Seconds between checkpoints (0 for none)
+ * @param resume If true, continue the run recorded in the IMS file's
+ *        checkpoint
+ */
+void ims_set_checkpoint(uint32_t interval_sec, bool resume) {
+    ims_ckpt_interval = interval_sec;
+    ims_resume = resume;
+}
+
+
+/**
+ * @brief Select per-index IMS derivation
+ *
+ * @param indexed If true, seed every IMS index from its own KDF-derived
+ *        sub-seed, so the output is independent of --jobs and any index
+ *        can be regenerated on its own
+ * @param first_index The index of the first IMS generated
+ */
+void ims_set_index_mode(bool indexed, uint64_t first_index) {
+    ims_indexed = indexed;
+    ims_first_index = first_index;
+}
+
+
+/**
+ * @brief Select the IMS candidate sampler
+ *
+ * @param rejection If true, draw candidates with the original rejection
+ *        sampler rather than the rejection-free one
+ */
+void ims_set_rejection_sampler(bool rejection) {
+    ims_rejection_sampler = rejection;
+}
+
+
+/**
+ * @brief Select the ERRK big-number backend and any cross-check
+ *
+ * @param backend The backend name (NULL for IMS_BIGNUM_DEFAULT)
+ * @param reference The backend name to cross-check against (NULL for none)
+ * @param every Cross-check every this many P/Q searches in each context
+ *
+ * @returns Zero if successful, EINVAL if a backend is unknown.
+ */
+int ims_set_bignum(const char * backend, const char * reference,
+                   uint32_t every) {
+    const ims_bignum * primary;
+    const ims_bignum * check = NULL;
+
+    primary = ims_bignum_find(backend? backend : IMS_BIGNUM_DEFAULT);
+    if (reference) {
+        check = ims_bignum_find(reference);
+    }
+    if (!primary || (reference && !check) || (every < 1)) {
+        return EINVAL;
+    }
+
+    ims_bignum_primary = primary;
+    ims_bignum_reference = check;
+    ims_cross_check_every = every;
+    return 0;
 }
 
 
@@ -176,6 +475,27 @@ void calc_errk_max_pq(void) {
 }
 
 
+/**
+ * @brief Build the table of odd primes used to sieve the P/Q bias window
+ */
+static void calc_sieve_primes(void) {
+    static uint8_t is_composite[SIEVE_PRIME_LIMIT];
+    uint32_t i;
+    uint32_t j;
+
+    memset(is_composite, 0, sizeof(is_composite));
+    num_sieve_primes = 0;
+    for (i = 3; i < SIEVE_PRIME_LIMIT; i += 2) {
+        if (!is_composite[i]) {
+            sieve_primes[num_sieve_primes++] = i;
+            for (j = i * i; j < SIEVE_PRIME_LIMIT; j += 2 * i) {
+                is_composite[j] = 1;
+            }
+        }
+    }
+}
+
+
 /**
  * @brief Write the IMS as an ASCII binarray string
  *
@@ -187,27 +507,17 @@ void calc_errk_max_pq(void) {
  * @returns Zero if successful, errno otherwise.
  */
 int ims_write(FILE * fp, uint8_t * ims) {
-    int status = 0;
-    int byte_index;
-    int bit;
-    uint8_t byte;
+    char line[IMS_LINE_SIZE];
 
 #ifdef IMS_DEBUGMSG
     printf("ims_write:\n");
     display_binary_data(ims, IMS_SIZE, true, NULL);
 #endif
-   if (fp_ims) {
-        for (byte_index = IMS_SIZE - 1; byte_index >= 0; byte_index--) {
-            byte = ims[byte_index];
-            for (bit = 0; bit < 8; bit++) {
-                if (fputc((byte & BYTE_MASK_MSB)? '1' : '0', fp) == EOF) {
-                    return EIO;
-                }
-                byte <<= 1;
-            }
-        }
-        if (fputc('\n', fp) == EOF) {
-                 return EIO;
+    if (fp) {
+        ims_to_binascii(ims, line);
+        line[IMS_BINASCII_SIZE] = '\n';
+        if (fwrite(line, sizeof(line), 1, fp) != 1) {
+            return EIO;
         }
 
         return 0;
@@ -223,88 +533,244 @@ int ims_write(FILE * fp, uint8_t * ims) {
  * Generates a random IMS value, the lower 32-bits of which will have a
  * Hamming weight of 128.
  *
- * @param ims A pointer to the 35-byte IMS value
+ * @param ctx The working context (ctx->ims receives the candidate)
+ * @param rejection If true, use the original rejection sampler (needed to
+ *        reproduce the 100 IMS samples and pre-existing runs)
  */
-static void ims_generate_candidate(uint8_t * ims) {
-    int status = 0;
-    int i;
+static void ims_generate_candidate(ims_context * ctx, bool rejection) {
+    if (rejection) {
+        ims_sample_rejection(&ctx->rng, ctx->ims, IMS_HAMMING_SIZE * 8,
+                             IMS_HAMMING_WEIGHT,
+                             &ctx->stats.candidate_rand_bytes);
+    } else {
+        ims_sample_constant_weight(&ctx->rng, ctx->ims, IMS_HAMMING_SIZE * 8,
+                                   IMS_HAMMING_WEIGHT,
+                                   &ctx->stats.candidate_rand_bytes);
+    }
+}
 
-    do {
-        /* Create a new 35-bit random number... */
-        for(i = 0; i < IMS_HAMMING_SIZE; i++) {
-            ims[i] = MCL_RAND_byte(&rng);
+
+/**
+ * @brief Calculate the inverse of a modulo m (a, m coprime)
+ */
+static uint32_t inverse_mod_small(uint32_t a, uint32_t m) {
+    int64_t t = 0;
+    int64_t new_t = 1;
+    int64_t r = m;
+    int64_t new_r = a % m;
+    int64_t q;
+    int64_t temp;
+
+    while (new_r != 0) {
+        q = r / new_r;
+        temp = t - q * new_t;
+        t = new_t;
+        new_t = temp;
+        temp = r - q * new_r;
+        r = new_r;
+        new_r = temp;
+    }
+
+    return (uint32_t)((t < 0)? t + m : t);
+}
+
+
+/**
+ * @brief Sieve the P or Q bias window by the small primes
+ *
+ * Marks every offset i (candidate = base + i * odd_mod) that has a small
+ * prime factor. Even candidates, which --compatibility can produce, are
+ * marked as trial-division rejects: MCL_FF_prime draws no witness for them.
+ *
+ * @param sieve The sieve to fill in
+ * @param base The candidate at offset 0
+ * @param odd_mod The candidate step
+ */
+static void pq_sieve_window(pq_sieve * sieve,
+                            mcl_chunk base[][MCL_BS],
+                            int odd_mod) {
+    uint8_t  base_buf[MCL_HFLEN * MCL_MODBYTES];
+    mcl_octet base_oct = {0, sizeof(base_buf), base_buf};
+    uint32_t prime;
+    uint32_t residue;
+    uint32_t index;
+    uint32_t i;
+    int byte;
+
+    memset(sieve, 0, sizeof(*sieve));
+    MCL_FF_toOctet_C25519(&base_oct, base, MCL_HFLEN);
+
+    /* Offset i is even when base and i * odd_mod have the same parity */
+    for (index = 0; index < PQ_BIAS_SLOTS; index++) {
+        if (((base_buf[base_oct.len - 1] ^ (index * odd_mod)) & 1) == 0) {
+            sieve->composite[index / 64] |= (uint64_t)1 << (index % 64);
+            sieve->trial[index / 64] |= (uint64_t)1 << (index % 64);
+        }
+    }
+
+    for (i = 0; i < num_sieve_primes; i++) {
+        prime = sieve_primes[i];
+
+        /* base mod prime, Horner-style over the big-endian bytes */
+        residue = 0;
+        for (byte = 0; byte < base_oct.len; byte++) {
+            residue = ((residue << 8) | base_buf[byte]) % prime;
+        }
+
+        /* First offset where base + index * odd_mod == 0 (mod prime) */
+        index = (uint32_t)(((uint64_t)(prime - residue) % prime) *
+                           inverse_mod_small(odd_mod, prime) % prime);
+        for (; index < PQ_BIAS_SLOTS; index += prime) {
+            sieve->composite[index / 64] |= (uint64_t)1 << (index % 64);
+            if (prime <= TRIAL_DIVISOR_MAX_PRIME) {
+                sieve->trial[index / 64] |= (uint64_t)1 << (index % 64);
+            }
         }
-        /* ...and check the Hamming weight of the lower 32 bytes) */
-    } while (hamming_weight(ims, IMS_HAMMING_SIZE) != IMS_HAMMING_WEIGHT);
+    }
 }
 
 
 /**
- * @brief Calculate the Endpoint Rsa pRivate Key (ERRK)
+ * @brief Sieve-filtered primality test for a P or Q bias offset
  *
- * @param y2 A pointer to the Y2 term used by all
- * @param ims A pointer to the ims (the upper 3 bytes will be modified)
- * @param erpk_mod A pointer to a buffer to store the modulus for ERPK
- * @param errk_d A pointer to a buffer to store the  ERPK decryption exponent
+ * @param bignum The big-number backend
+ * @param sieve The sieve for this window
+ * @param index The bias offset (bias / odd_mod)
+ * @param x The candidate at that offset
+ * @param rng The PRNG supplying the Miller-Rabin witnesses
+ * @param witnesses Set to the number of witnesses MCL_FF_prime would draw
+ * @param stats Counts the sieve rejections and Miller-Rabin calls
+ *
+ * @returns 1 if x is (probably) prime, 0 if not, -1 if the backend failed
+ */
+static int pq_sieved_prime(const ims_bignum * bignum,
+                           pq_sieve * sieve,
+                           uint32_t index,
+                           mcl_chunk x[][MCL_BS],
+                           csprng * rng,
+                           uint8_t * witnesses,
+                           ims_stats * stats) {
+    uint64_t bit = (uint64_t)1 << (index % 64);
+    uint32_t word = index / 64;
+    uint8_t x_buf[ERRK_PQ_SIZE];
+    mcl_octet x_oct = { 0, sizeof(x_buf), (char *)x_buf };
+    int prime;
+
+    if (sieve->composite[word] & bit) {
+        /* Known composite - just consume what MCL_FF_prime would have */
+        *witnesses = (sieve->trial[word] & bit)? 0 : 1;
+        ims_rand_skip(rng, *witnesses * PRIME_WITNESS_RAND_BYTES);
+        stats->sieved_out++;
+        return 0;
+    }
+
+    MCL_FF_toOctet_C25519(&x_oct, x, MCL_HFLEN);
+    prime = bignum->prime(x_buf, rng, witnesses);
+    stats->mr_calls++;
+    stats->mr_witnesses += *witnesses;
+    return prime;
+}
+
+
+/**
+ * @brief Memoized primality test for a Q bias offset
+ *
+ * @param bignum The big-number backend
+ * @param memo The memo for the current IMS
+ * @param sieve The sieve for the Q window
+ * @param index The Q bias offset (q_bias / odd_mod)
+ * @param x The Q candidate at that offset
+ * @param rng The PRNG supplying the Miller-Rabin witnesses
+ * @param stats Counts the memo hits, sieve rejections and Miller-Rabin calls
+ *
+ * @returns 1 if x is (probably) prime, 0 if not, -1 if the backend failed
+ */
+static int pq_memo_prime(const ims_bignum * bignum,
+                         pq_prime_memo * memo,
+                         pq_sieve * sieve,
+                         uint32_t index,
+                         mcl_chunk x[][MCL_BS],
+                         csprng * rng,
+                         ims_stats * stats) {
+    uint64_t bit = (uint64_t)1 << (index % 64);
+    uint32_t word = index / 64;
+    int prime;
+
+    if (memo->tested[word] & bit) {
+        /* Already known - just consume what the test would have */
+        ims_rand_skip(rng, memo->witnesses[index] * PRIME_WITNESS_RAND_BYTES);
+        stats->memo_hits++;
+    } else {
+        prime = pq_sieved_prime(bignum, sieve, index, x, rng,
+                                &memo->witnesses[index], stats);
+        if (prime < 0) {
+            return prime;
+        }
+        if (prime == 1) {
+            memo->prime[word] |= bit;
+        }
+        memo->tested[word] |= bit;
+    }
+
+    return (memo->prime[word] & bit)? 1 : 0;
+}
+
+
+/* The outcome of an ERRK P/Q search */
+typedef struct {
+    uint32_t    p_offset;       /* p_bias / odd_mod */
+    uint32_t    q_offset;       /* q_bias / odd_mod */
+    const char * overflowed;    /* "P" or "Q" if the search overflowed */
+    uint8_t     p[ERRK_PQ_SIZE];
+    uint8_t     q[ERRK_PQ_SIZE];
+    ims_rsa_crt crt;
+} errk_search_result;
+
+
+/**
+ * @brief Search the bias windows above ERRK_P and ERRK_Q for a prime pair
+ *
+ * @param bignum The big-number backend
+ * @param ctx The working context (supplies the base P/Q values)
+ * @param rng The PRNG supplying the Miller-Rabin witnesses
+ * @param stats Counts the sieve rejections, memo hits and Miller-Rabin calls
+ * @param p_sieve The sieve for the P window
+ * @param q_sieve The sieve for the Q window
+ * @param odd_mod The bias step
  * @param ims_sample_compatibility If true, generate IMS values that are
  *        compatible with the original (incorrect) 100 sample values sent
  *        to Toshiba 2016/01/14. If false, generate the IMS value using
  *        the correct form.
+ * @param result Set to the bias offsets and the P/Q found
  *
- * @returns Zero if successful, errno otherwise.
+ * @returns Zero if a pair was found, EOVERFLOW if the IMS must be
+ *          discarded, EIO if the backend failed.
  */
-static int calc_errk(uint8_t * y2,
-                     uint8_t * ims,
-                     mcl_octet * erpk_mod,
-                     mcl_octet * errk_d,
-                     bool ims_sample_compatibility) {
-    int status = 0;
+static int errk_search(const ims_bignum * bignum,
+                       ims_context * ctx,
+                       csprng * rng,
+                       ims_stats * stats,
+                       pq_sieve * p_sieve,
+                       pq_sieve * q_sieve,
+                       int odd_mod,
+                       bool ims_sample_compatibility,
+                       errk_search_result * result) {
     uint32_t p_bias;
     uint32_t q_bias;
     uint32_t pq_bias;
-    MCL_rsa_private_key priv_key = { 0 };
-    MCL_rsa_public_key pub_key = { 0 };
-    int odd_mod;
+    mcl_chunk p[MCL_HFLEN][MCL_BS];
+    mcl_chunk q[MCL_HFLEN][MCL_BS];
+    mcl_chunk p1[MCL_HFLEN][MCL_BS];
+    mcl_chunk q1[MCL_HFLEN][MCL_BS];
+    mcl_octet p_oct = { 0, sizeof(result->p), (char *)result->p };
+    mcl_octet q_oct = { 0, sizeof(result->q), (char *)result->q };
+    pq_prime_memo q_memo;
+    uint8_t p_witnesses;
     int prime_search_limit;
-    uint8_t odd_mod_bitmask;
+    int prime;
 
-    /**
-     * Define constants based on compatibility with the original 100 IMS samples
-     * delivered to Toshiba or the correct production form.
-     */
-    odd_mod = (ims_sample_compatibility)? ODD_MOD_SAMPLE : ODD_MOD_PRODUCTION;
     prime_search_limit = ((1 << P_Q_BIAS_BITS) * (odd_mod));
-
-    /**
-     * Calculate the initial ERRK P & Q values, ensuring that they
-     * are odd (3 mod 4)
-     *
-     *  Y2 = sha256(IMS[0:31] xor copy(0x5a, 32))  // (provided)
-     *  Z3 = sha256(Y2 || copy(0x03, 32))
-     *  ERRK_P[0:31]   = sha256(Z3 || copy(0x01, 32))
-     *  ERRK_P[32:63]  = sha256(Z3 || copy(0x02, 32))
-     *  ERRK_P[64:95]  = sha256(Z3 || copy(0x03, 32))
-     *  ERRK_P[96:127] = sha256(Z3 || copy(0x41, 32))
-     *  ERRK_Q[0:31]   = sha256(Z3 || copy(0x05, 32))
-     *  ERRK_Q[32:63]  = sha256(Z3 || copy(0x06, 32))
-     *  ERRK_Q[64:95]  = sha256(Z3 || copy(0x07, 32))
-     *  ERRK_Q[96:127] = sha256(Z3 || copy(0x8, 32))
-     *  ERRK_P[0] |= 0x03    // force P, Q to be odd
-     *  ERRK_Q[0] |= 0x03
-     *    :
-     */
-    calc_errk_pq_bias_odd(y2, ims, &errk_p, &errk_q, ims_sample_compatibility);
-
-    /* Convert P & Q into FFs for arithmetic operations */
-    if (ims_sample_compatibility) {
-        /* Used in first 100 IMS samples */
-        ff_from_big_endian_octet(p_ff, &errk_p, MCL_HFLEN);
-        ff_from_big_endian_octet(q_ff, &errk_q, MCL_HFLEN);
-    } else {
-        /* Used subsequent to the first 100 IMS samples */
-        ff_from_little_endian_octet(p_ff, &errk_p, MCL_HFLEN);
-        ff_from_little_endian_octet(q_ff, &errk_q, MCL_HFLEN);
-    }
+    result->overflowed = NULL;
 
     /**
      *    :
@@ -316,22 +782,28 @@ static int calc_errk(uint8_t * y2,
      * 2 and test again. Give up when we've swept all 4k possibilities for each
      * without finding a prime number.
      */
-    MCL_FF_copy_C25519(priv_key.p, p_ff, MCL_HFLEN);
+    memset(&q_memo, 0, sizeof(q_memo));
+    MCL_FF_copy_C25519(p, ctx->p_ff, MCL_HFLEN);
 
     for (p_bias = 0;
          p_bias < prime_search_limit;
          p_bias += odd_mod,
-         MCL_FF_inc_C25519(priv_key.p, odd_mod, MCL_HFLEN)) {
-        if (MCL_FF_comp_C25519(priv_key.p, errk_max_pq_ff, MCL_HFLEN) == 1) {
+         MCL_FF_inc_C25519(p, odd_mod, MCL_HFLEN)) {
+        if (MCL_FF_comp_C25519(p, errk_max_pq_ff, MCL_HFLEN) == 1) {
             /* The sum of P + P_bias will overflow */
-            fprintf(stderr, "P would overflow - discard IMS\n");
-            break;
+            result->overflowed = "P";
+            return EOVERFLOW;
+        }
+        /* Check if P is prime (Miller-Rabin only if it survived the sieve) */
+        prime = pq_sieved_prime(bignum, p_sieve, p_bias / odd_mod, p,
+                                rng, &p_witnesses, stats);
+        if (prime < 0) {
+            return EIO;
         }
-        /* Check if P is prime */
-        if (MCL_FF_prime_C25519(priv_key.p, &rng, MCL_HFLEN) == 1) {
+        if (prime == 1) {
 #ifdef RSA_PQ_FACTORABILITY
             if (ims_sample_compatibility) {
-                MCL_FF_copy_C25519(p1, priv_key.p, MCL_HFLEN);
+                MCL_FF_copy_C25519(p1, p, MCL_HFLEN);
                 MCL_FF_dec_C25519(p1, 1, MCL_HFLEN);
 
                 if (MCL_FF_cfactor_C25519(p1, ERPK_EXPONENT, MCL_HFLEN)) {
@@ -344,16 +816,16 @@ static int calc_errk(uint8_t * y2,
              * Always start with the base value of Q, since the inner loop
              * modifies it.
              */
-            MCL_FF_copy_C25519(priv_key.q, q_ff, MCL_HFLEN);
+            MCL_FF_copy_C25519(q, ctx->q_ff, MCL_HFLEN);
 
             for (q_bias = 0;
                  q_bias < prime_search_limit;
                  q_bias += odd_mod,
-                 MCL_FF_inc_C25519(priv_key.q, odd_mod, MCL_HFLEN)) {
-                if (MCL_FF_comp_C25519(priv_key.q, errk_max_pq_ff, MCL_HFLEN) == 1) {
+                 MCL_FF_inc_C25519(q, odd_mod, MCL_HFLEN)) {
+                if (MCL_FF_comp_C25519(q, errk_max_pq_ff, MCL_HFLEN) == 1) {
                     /* The sum of Q + Q_bias will overflow */
-                    fprintf(stderr, "Q would overflow - discard IMS\n");
-                    break;
+                    result->overflowed = "Q";
+                    return EOVERFLOW;
                 }
                 /**
                  * P_bias and Q_bias are guaranteed to be >= 0, < 8192, and even.
@@ -372,11 +844,19 @@ static int calc_errk(uint8_t * y2,
                     continue;
                 }
 #endif
-                /* Check if Q is prime */
-                if (MCL_FF_prime_C25519(priv_key.q, &rng, MCL_HFLEN) == 1) {
+                /**
+                 * Check if Q is prime. Each P restarts the Q sweep, so
+                 * only the first visit to each Q actually tests it.
+                 */
+                prime = pq_memo_prime(bignum, &q_memo, q_sieve,
+                                      q_bias / odd_mod, q, rng, stats);
+                if (prime < 0) {
+                    return EIO;
+                }
+                if (prime == 1) {
 #ifdef RSA_PQ_FACTORABILITY
                     if (ims_sample_compatibility) {
-                        MCL_FF_copy_C25519(q1, priv_key.q, MCL_HFLEN);
+                        MCL_FF_copy_C25519(q1, q, MCL_HFLEN);
                         MCL_FF_dec_C25519(q1, 1, MCL_HFLEN);
 
                         if (MCL_FF_cfactor_C25519(q1, ERPK_EXPONENT, MCL_HFLEN)) {
@@ -385,119 +865,1241 @@ static int calc_errk(uint8_t * y2,
                         }
                     }
 #endif
-                    goto SUCCESS;
+                    /* P and Q now include their biases, and are prime */
+                    result->p_offset = p_bias / odd_mod;
+                    result->q_offset = q_bias / odd_mod;
+                    MCL_FF_toOctet_C25519(&p_oct, p, MCL_HFLEN);
+                    MCL_FF_toOctet_C25519(&q_oct, q, MCL_HFLEN);
+                    return 0;
                 }
             }
         }
         /* If the Q loop ends, no Q + Q_bias was prime, so try next P */
     }
+
     /**
      * No valid P_bias and Q_bias combo was found within 8192, discard this
      *  IMS and try again
      */
     return EOVERFLOW;
+}
 
-SUCCESS:
-    /**
-     * When we get here, P and Q are already modified by the bias values
-     * and are guaranteed to be prime.
-     */
 
-    /* Save the bias offset in IMS[32:34] */
-    ims[32] = (uint8_t)(pq_bias);
-    ims[33] = (uint8_t)(pq_bias >> 8);
-    ims[34] = (uint8_t)(pq_bias >> 16);
+/**
+ * @brief Compare an ERRK search with its cross-check replay
+ *
+ * @param result The primary backend's outcome
+ * @param status The primary backend's status
+ * @param rng The PRNG after the primary search
+ * @param check The reference backend's outcome
+ * @param check_status The reference backend's status
+ * @param check_rng The PRNG after the reference search
+ * @param ims_sample_compatibility If true, don't compare dp and dq: the
+ *        samples' dp (dq) comes from MCL_FF_invmodp mod (p - 1) / 2, which
+ *        isn't an inverse when that is even (p = 1 mod 4), and no other
+ *        backend reproduces it
+ *
+ * @returns Zero if they agree, ENOTRECOVERABLE if they don't.
+ */
+static int errk_compare(const errk_search_result * result, int status,
+                        const csprng * rng,
+                        const errk_search_result * check, int check_status,
+                        const csprng * check_rng,
+                        bool ims_sample_compatibility) {
+    const char * mismatch[8];
+    int num_mismatches = 0;
+    int i;
 
-    /**
-     * Generate the public and private keys
-     *    :
-     *  ERPK_MOD = ERRK_Q * ERRK_P                 // generate modulus for ERPK
-     *  ERPK_E = 65537                             // public exponent
-     *  ERRK_D = RSA_secret(ERRK_P, ERK_Q, ERPK_E) // Private decrypt exponent
-     *                                             // (unused in IMS creation)
-     * On return, the structs are set to the following:
-     *   - pub_key.n    ERRPK_MOD (p * q)
-     *   - pub_key.e    ERPK_EXPONENT (65537)
-     *
-     *   - priv_key.p   secret prime p
-     *   - priv_key.q   secret prime q
-     *   - priv_key.dp  decrypting exponent mod (p-1)
-     *   - priv_key.dq  decrypting exponent mod (q-1)
-     *   - priv_key.c   1/p mod q
-     */
-    rsa_secret(&priv_key, &pub_key, ERPK_EXPONENT, ims_sample_compatibility);
+    if (status != check_status) {
+        mismatch[num_mismatches++] = "search outcome";
+    } else if (status == 0) {
+        if (result->p_offset != check->p_offset) {
+            mismatch[num_mismatches++] = "P bias";
+        }
+        if (result->q_offset != check->q_offset) {
+            mismatch[num_mismatches++] = "Q bias";
+        }
+        if (memcmp(result->crt.n, check->crt.n, sizeof(check->crt.n)) != 0) {
+            mismatch[num_mismatches++] = "modulus";
+        }
+        if (!ims_sample_compatibility &&
+            (memcmp(result->crt.dp, check->crt.dp,
+                    sizeof(check->crt.dp)) != 0)) {
+            mismatch[num_mismatches++] = "dp";
+        }
+        if (!ims_sample_compatibility &&
+            (memcmp(result->crt.dq, check->crt.dq,
+                    sizeof(check->crt.dq)) != 0)) {
+            mismatch[num_mismatches++] = "dq";
+        }
+        if (memcmp(result->crt.c, check->crt.c, sizeof(check->crt.c)) != 0) {
+            mismatch[num_mismatches++] = "c";
+        }
+    }
+    if (memcmp(rng, check_rng, sizeof(*rng)) != 0) {
+        mismatch[num_mismatches++] = "PRNG state";
+    }
 
-    /* Convert the calculated FF nums back into octets for later storage */
-    MCL_FF_toOctet_C25519(erpk_mod, pub_key.n, MCL_FFLEN);
+    if (num_mismatches == 0) {
+        return 0;
+    }
 
-    return status;
+    fprintf(stderr, "ERROR: big-number cross-check failed (%s vs %s): "
+            "mismatched", ims_bignum_primary->name,
+            ims_bignum_reference->name);
+    for (i = 0; i < num_mismatches; i++) {
+        fprintf(stderr, "%s %s", (i == 0)? "" : ",", mismatch[i]);
+    }
+    fprintf(stderr, "\n");
+    if ((status == 0) && (check_status == 0)) {
+        fprintf(stderr, "ERROR:   P/Q bias offsets %u/%u vs %u/%u\n",
+                result->p_offset, result->q_offset,
+                check->p_offset, check->q_offset);
+    } else {
+        fprintf(stderr, "ERROR:   search status %d vs %d\n",
+                status, check_status);
+    }
+    return ENOTRECOVERABLE;
 }
 
 
 /**
- * @brief Generate an IMS value
+ * @brief Calculate the Endpoint Rsa pRivate Key (ERRK)
  *
- * Generates a unique IMS value, storing it in the IMS output file and
- * the generated EPVK, ERPK and ESVK keys in the key
- * database.
+ * If cross-checking is on, every ims_cross_check_every'th search in the
+ * context is replayed from the same PRNG state with the reference
+ * backend, and any difference in the outcome, biases, modulus, CRT
+ * parameters or the PRNG state left behind is fatal.
  *
+ * @param ctx The working context (supplies the PRNG and P/Q scratch)
+ * @param y2 A pointer to the Y2 term used by all
+ * @param ims A pointer to the ims (the upper 3 bytes will be modified)
+ * @param erpk_mod A pointer to a buffer to store the modulus for ERPK
+ * @param errk_d A pointer to a buffer to store the  ERPK decryption exponent
  * @param ims_sample_compatibility If true, generate IMS values that are
  *        compatible with the original (incorrect) 100 sample values sent
  *        to Toshiba 2016/01/14. If false, generate the IMS value using
  *        the correct form.
  *
- * @returns Zero if successful, errno otherwise.
+ * @returns Zero if successful, EOVERFLOW if the IMS must be discarded,
+ *          errno otherwise.
  */
-int ims_generate(bool ims_sample_compatibility) {
-    int status = 0;
-    int epvk_status;
-    int esvk_status;
-
-    /* Generate a cryptographiclly good IMS value */
-    do {
-        /* Find a unique IMS value */
-        do {
-            ims_generate_candidate(ims);
-            calculate_epuid_es3(ims, &ep_uid);
-         } while (db_ep_uid_exists(&ep_uid));
-
-        /* Calculate "Y2", used in generating EPSK, MPDK, ERRK, EPCK, ERGS */
-        calculate_y2(ims, y2);
+static int calc_errk(ims_context * ctx,
+                     uint8_t * y2,
+                     uint8_t * ims,
+                     mcl_octet * erpk_mod,
+                     mcl_octet * errk_d,
+                     bool ims_sample_compatibility) {
+    int status;
+    int check_status;
+    uint32_t pq_bias;
+    pq_sieve p_sieve;
+    pq_sieve q_sieve;
+    errk_search_result result;
+    errk_search_result check;
+    ims_stats check_stats;
+    csprng check_rng;
+    int odd_mod;
+    bool cross_check;
+    uint64_t start;
 
-        /**
-         * Calculate ERRK from that IMS (returns EOVERFLOW if we need to spin
-         * a new IMS)
-         */
-        status = calc_errk(y2, ims, &erpk_mod, &errk_d,
-                           ims_sample_compatibility);
+    /**
+     * Define constants based on compatibility with the original 100 IMS samples
+     * delivered to Toshiba or the correct production form.
+     */
+    start = ims_stats_now();
+    odd_mod = (ims_sample_compatibility)? ODD_MOD_SAMPLE : ODD_MOD_PRODUCTION;
 
-        if (status == 0) {
-            /* Calculate EPSK/EPVK and  ESSK/ESVK from the confirmed-valid IMS */
-            calc_epsk(y2, &epsk);
-            epvk_status = calc_epvk(&epsk, &epvk);
-            calc_essk(y2, &essk, ims_sample_compatibility);
-            esvk_status = calc_esvk(&essk, &esvk);
-            /**
-             * For the first 100 samples, we didn't check epvk or esvk
-             * generation status. In a production environment, we do, and
-             * if either one fails, we discard the IMS.
-             */
-            if (!ims_sample_compatibility &&
-                    ((epvk_status != 0) || (esvk_status != 0))) {
-                status = -1;
+    /**
+     * Calculate the initial ERRK P & Q values, ensuring that they
+     * are odd (3 mod 4)
+     *
+     *  Y2 = sha256(IMS[0:31] xor copy(0x5a, 32))  // (provided)
+     *  Z3 = sha256(Y2 || copy(0x03, 32))
+     *  ERRK_P[0:31]   = sha256(Z3 || copy(0x01, 32))
+     *  ERRK_P[32:63]  = sha256(Z3 || copy(0x02, 32))
+     *  ERRK_P[64:95]  = sha256(Z3 || copy(0x03, 32))
+     *  ERRK_P[96:127] = sha256(Z3 || copy(0x41, 32))
+     *  ERRK_Q[0:31]   = sha256(Z3 || copy(0x05, 32))
+     *  ERRK_Q[32:63]  = sha256(Z3 || copy(0x06, 32))
+     *  ERRK_Q[64:95]  = sha256(Z3 || copy(0x07, 32))
+     *  ERRK_Q[96:127] = sha256(Z3 || copy(0x8, 32))
+     *  ERRK_P[0] |= 0x03    // force P, Q to be odd
+     *  ERRK_Q[0] |= 0x03
+     *    :
+     */
+    calc_errk_pq_bias_odd(y2, ims, &ctx->errk_p, &ctx->errk_q,
+                          ims_sample_compatibility);
+
+    /* Convert P & Q into FFs for arithmetic operations */
+    if (ims_sample_compatibility) {
+        /* Used in first 100 IMS samples */
+        ff_from_big_endian_octet(ctx->p_ff, &ctx->errk_p, MCL_HFLEN);
+        ff_from_big_endian_octet(ctx->q_ff, &ctx->errk_q, MCL_HFLEN);
+    } else {
+        /* Used subsequent to the first 100 IMS samples */
+        ff_from_little_endian_octet(ctx->p_ff, &ctx->errk_p, MCL_HFLEN);
+        ff_from_little_endian_octet(ctx->q_ff, &ctx->errk_q, MCL_HFLEN);
+    }
+    pq_sieve_window(&p_sieve, ctx->p_ff, odd_mod);
+    pq_sieve_window(&q_sieve, ctx->q_ff, odd_mod);
+
+    /* Keep the PRNG state for the cross-check replay */
+    cross_check = (ims_bignum_reference != NULL) &&
+                  ((ctx->stats.stage_calls[IMS_STAGE_ERRK_SEARCH] %
+                    ims_cross_check_every) == 0);
+    if (cross_check) {
+        check_rng = ctx->rng;
+    }
+
+    status = errk_search(ims_bignum_primary, ctx, &ctx->rng, &ctx->stats,
+                         &p_sieve, &q_sieve, odd_mod,
+                         ims_sample_compatibility, &result);
+    start = ims_stats_stage(&ctx->stats, IMS_STAGE_ERRK_SEARCH, start);
+    if (status == 0) {
+        ims_stats_bias(&ctx->stats, result.p_offset, result.q_offset);
+
+        /**
+         * Generate the public and private keys
+         *    :
+         *  ERPK_MOD = ERRK_Q * ERRK_P                 // generate modulus for ERPK
+         *  ERPK_E = 65537                             // public exponent
+         *  ERRK_D = RSA_secret(ERRK_P, ERK_Q, ERPK_E) // Private decrypt exponent
+         *                                             // (unused in IMS creation)
+         * On return, result.crt holds:
+         *   - n    ERRPK_MOD (p * q)
+         *   - dp   decrypting exponent mod (p-1)
+         *   - dq   decrypting exponent mod (q-1)
+         *   - c    1/p mod q
+         */
+        status = ims_bignum_primary->rsa_crt(result.p, result.q,
+                                             ERPK_EXPONENT, &result.crt);
+        ims_stats_stage(&ctx->stats, IMS_STAGE_ERRK_RSA, start);
+    } else if (status == EOVERFLOW) {
+        if (result.overflowed) {
+            fprintf(stderr, "%s would overflow - discard IMS\n",
+                    result.overflowed);
+            ctx->stats.rejected_overflow++;
+        } else {
+            ctx->stats.rejected_no_prime++;
+        }
+    }
+
+    /* Replay the search with the reference backend and compare */
+    if (cross_check && ((status == 0) || (status == EOVERFLOW))) {
+        start = ims_stats_now();
+        memset(&check_stats, 0, sizeof(check_stats));
+        check_status = errk_search(ims_bignum_reference, ctx, &check_rng,
+                                   &check_stats, &p_sieve, &q_sieve, odd_mod,
+                                   ims_sample_compatibility, &check);
+        if (check_status == 0) {
+            check_status = ims_bignum_reference->rsa_crt(check.p, check.q,
+                                                         ERPK_EXPONENT,
+                                                         &check.crt);
+        }
+        if ((check_status == 0) || (check_status == EOVERFLOW)) {
+            check_status = errk_compare(&result, status, &ctx->rng,
+                                        &check, check_status, &check_rng,
+                                        ims_sample_compatibility);
+            if (check_status != 0) {
+                status = check_status;
             }
+        } else {
+            status = check_status;
         }
-    } while (status != 0);
+        memset(&check_rng, 0, sizeof(check_rng));
+        memset(&check, 0, sizeof(check));
+        ims_stats_stage(&ctx->stats, IMS_STAGE_CROSS_CHECK, start);
+    }
+
+    if (status == 0) {
+        /* Save the bias offset in IMS[32:34] */
+        pq_bias = (4096 * result.p_offset) + result.q_offset;
+        ims[32] = (uint8_t)(pq_bias);
+        ims[33] = (uint8_t)(pq_bias >> 8);
+        ims[34] = (uint8_t)(pq_bias >> 16);
+
+        /* Keep the modulus for later storage */
+        memcpy(erpk_mod->val, result.crt.n, sizeof(result.crt.n));
+        erpk_mod->len = sizeof(result.crt.n);
+    }
+    memset(&result, 0, sizeof(result));
+
+    return status;
+}
+
+
+/**
+ * @brief Derive the keys for the candidate IMS in a context
+ *
+ * @param ctx The working context (ctx->ims holds IMS[0:31] on entry)
+ * @param ims_sample_compatibility If true, generate IMS values that are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, generate the IMS value using
+ *        the correct form.
+ *
+ * @returns Zero if successful, EOVERFLOW or EAGAIN if the IMS must be
+ *          discarded, errno otherwise.
+ */
+static int ims_calc_keys(ims_context * ctx, bool ims_sample_compatibility) {
+    int status;
+    int epvk_status;
+    int esvk_status;
+    uint64_t start;
+
+    /* Calculate "Y2", used in generating EPSK, MPDK, ERRK, EPCK, ERGS */
+    calculate_y2(ctx->ims, ctx->y2);
 
     /**
-     * Write the IMS value to the IMS file and the various keys and magic
-     * numbers to the database
+     * Calculate ERRK from that IMS (returns EOVERFLOW if we need to spin
+     * a new IMS)
      */
-    if (status == 0){
-        status = ims_write(fp_ims, ims);
+    status = calc_errk(ctx, ctx->y2, ctx->ims, &ctx->erpk_mod, &ctx->errk_d,
+                       ims_sample_compatibility);
+
+    if (status == 0) {
+        /* Calculate EPSK/EPVK and  ESSK/ESVK from the confirmed-valid IMS */
+        start = ims_stats_now();
+        calc_epsk(ctx->y2, &ctx->epsk);
+        epvk_status = calc_epvk(&ctx->epsk, &ctx->epvk);
+        start = ims_stats_stage(&ctx->stats, IMS_STAGE_EPVK, start);
+        calc_essk(ctx->y2, &ctx->essk, ims_sample_compatibility);
+        esvk_status = calc_esvk(&ctx->essk, &ctx->esvk);
+        ims_stats_stage(&ctx->stats, IMS_STAGE_ESVK, start);
+        /**
+         * For the first 100 samples, we didn't check epvk or esvk
+         * generation status. In a production environment, we do, and
+         * if either one fails, we discard the IMS.
+         */
+        if (!ims_sample_compatibility &&
+                ((epvk_status != 0) || (esvk_status != 0))) {
+            ctx->stats.rejected_key++;
+            status = EAGAIN;
+        }
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Determine if a keyset is one the interrupted run committed
+ *
+ * While resuming, an EP_UID already in the database is either one the
+ * interrupted run committed after its last checkpoint (the stored keys are
+ * the ones just derived) or a genuine duplicate.
+ *
+ * @returns True if the database holds exactly these keys and there are
+ *          committed keysets still to re-derive.
+ */
+static bool ims_keyset_committed(mcl_octet * ep_uid,
+                                 mcl_octet * epvk,
+                                 mcl_octet * esvk,
+                                 mcl_octet * erpk_mod) {
+    uint8_t epvk_buf[EPVK_SIZE];
+    uint8_t esvk_buf[ESVK_SIZE];
+    uint8_t erpk_mod_buf[ERRK_PQ_SIZE * 2];
+    mcl_octet epvk_db = {0, sizeof(epvk_buf), (char *)epvk_buf};
+    mcl_octet esvk_db = {0, sizeof(esvk_buf), (char *)esvk_buf};
+    mcl_octet erpk_mod_db = {0, sizeof(erpk_mod_buf), (char *)erpk_mod_buf};
+
+    return (ims_adopt_remaining > 0) &&
+           (db_get_keyset(ep_uid, &epvk_db, &esvk_db, &erpk_mod_db) == 0) &&
+           MCL_OCT_comp(epvk, &epvk_db) && MCL_OCT_comp(esvk, &esvk_db) &&
+           MCL_OCT_comp(erpk_mod, &erpk_mod_db);
+}
+
+
+/**
+ * @brief Find a cryptographically good IMS value in a context
+ *
+ * @param ctx The working context
+ * @param check_db If true, skip candidates whose EP_UID is already in the
+ *        key database. Worker threads pass false (the writer checks instead).
+ * @param ims_sample_compatibility If true, generate IMS values that are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, generate the IMS value using
+ *        the correct form.
+ * @param adopted (With check_db) set true if the IMS value's keyset was
+ *        already committed by the run being resumed
+ *
+ * @returns Zero if successful, errno (e.g. a failed cross-check) otherwise.
+ */
+static int ims_find(ims_context * ctx, bool check_db,
+                    bool ims_sample_compatibility, bool * adopted) {
+    int status;
+    bool duplicate;
+    uint64_t start;
+    csprng rng;
+
+    if (adopted) {
+        *adopted = false;
+    }
+    do {
+        /* Find a unique IMS value */
+        do {
+            start = ims_stats_now();
+            ims_generate_candidate(ctx, ims_sample_compatibility ||
+                                        ims_rejection_sampler);
+            start = ims_stats_stage(&ctx->stats, IMS_STAGE_CANDIDATE, start);
+            ctx->stats.candidates++;
+            calculate_epuid_es3(ctx->ims, &ctx->ep_uid);
+            start = ims_stats_stage(&ctx->stats, IMS_STAGE_EP_UID, start);
+            duplicate = check_db && db_ep_uid_exists(&ctx->ep_uid);
+            if (check_db) {
+                ims_stats_stage(&ctx->stats, IMS_STAGE_EP_UID_LOOKUP, start);
+            }
+            if (duplicate && adopted && (ims_adopt_remaining > 0)) {
+                /**
+                 * Resuming: derive the keys as the interrupted run did. If
+                 * they aren't the ones stored, it was a genuine duplicate,
+                 * so rewind the PRNG to draw the next candidate.
+                 */
+                rng = ctx->rng;
+                status = ims_calc_keys(ctx, ims_sample_compatibility);
+                if ((status == 0) &&
+                    ims_keyset_committed(&ctx->ep_uid, &ctx->epvk,
+                                         &ctx->esvk, &ctx->erpk_mod)) {
+                    *adopted = true;
+                    return 0;
+                }
+                if ((status != 0) && (status != EOVERFLOW) &&
+                    (status != EAGAIN)) {
+                    return status;
+                }
+                ctx->rng = rng;
+            }
+            if (duplicate) {
+                ctx->stats.rejected_duplicate++;
+            }
+         } while (duplicate);
+
+        status = ims_calc_keys(ctx, ims_sample_compatibility);
+    } while ((status == EOVERFLOW) || (status == EAGAIN));
+
+    return status;
+}
+
+
+/**
+ * @brief Print a throughput line every IMS_STATS_INTERVAL_SEC
+ *
+ * Called from the keyset writer thread as each IMS is written.
+ */
+static void ims_throughput(void) {
+    uint64_t now = ims_stats_now();
+    double elapsed;
+    double interval;
+
+    if (ims_report_nsec == 0) {
+        ims_report_nsec = ims_start_nsec;
+    }
+    if ((now - ims_report_nsec >= IMS_STATS_INTERVAL_SEC * 1000000000ull) ||
+        (ims_num_committed == ims_num_total)) {
+        elapsed = (now - ims_start_nsec) / 1e9;
+        interval = (now - ims_report_nsec) / 1e9;
+        printf("Throughput: %u/%u IMS in %.1f s, %.2f IMS/s "
+               "(%.2f IMS/s over the last %.1f s)\n",
+               ims_num_committed, ims_num_total, elapsed,
+               (elapsed > 0)? ims_num_committed / elapsed : 0.0,
+               (interval > 0)?
+                   (ims_num_committed - ims_report_count) / interval : 0.0,
+               interval);
+        ims_report_nsec = now;
+        ims_report_count = ims_num_committed;
+    }
+}
+
+
+/**
+ * @brief Save the checkpoint
+ *
+ * Everything written to the IMS file so far is put on disk first, so a
+ * checkpoint never counts an IMS value that the file could still lose.
+ * Called from the keyset writer thread, or while it is idle.
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int ims_checkpoint_save(void) {
+    int status = 0;
+
+    if (ims_bin) {
+        status = ims_file_sync(ims_bin);
+        ims_ckpt.ims_offset = IMS_FILE_HEADER_SIZE +
+                              (uint64_t)ims_ckpt.count * IMS_FILE_RECORD_SIZE;
+    } else if (!fp_ims) {
+        status = EBADF;
+    } else {
+        if ((fflush(fp_ims) != 0) || (fdatasync(fileno(fp_ims)) != 0)) {
+            fprintf(stderr, "ERROR: Can't sync IMS file (err %d)\n", errno);
+            status = EIO;
+        }
+        ims_ckpt.ims_offset = (uint64_t)ims_ckpt.count * IMS_LINE_SIZE;
+    }
+    if (status == 0) {
+        status = ims_checkpoint_write(ims_ckpt_name, &ims_ckpt);
+    }
+    ims_ckpt_nsec = ims_stats_now();
+
+    return status;
+}
+
+
+/**
+ * @brief Move the checkpoint on past an IMS value that has been written
+ *
+ * Called from the keyset writer thread, in emit order. Saves the
+ * checkpoint once ims_ckpt_interval seconds have passed since the last.
+ *
+ * @param pending The IMS value just written, and the PRNG state(s) after it
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int ims_checkpoint_advance(const ims_pending * pending) {
+    if (pending->slot >= 0) {
+        ims_ckpt.states[pending->slot] = pending->rng;
+    }
+    if (pending->retried) {
+        ims_ckpt.states[ims_ckpt.num_states - 1] = pending->retry_rng;
+    }
+    ims_ckpt.count = ims_num_committed;
+
+    if (ims_stats_now() - ims_ckpt_nsec >=
+        (uint64_t)ims_ckpt_interval * 1000000000ull) {
+        return ims_checkpoint_save();
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Write out an IMS value whose keyset has been committed
+ *
+ * Called from the keyset writer thread, in emit order.
+ *
+ * @param cookie The ims_pending queued by ims_emit
+ * @param status Zero if the keyset committed, errno otherwise
+ */
+static void ims_committed(void * cookie, int status) {
+    ims_pending * pending = cookie;
+
+    if ((status == 0) && (ims_commit_status == 0)) {
+        if (ims_bin) {
+            /* Buffered; pushed out by ims_flush() and ims_deinit() */
+            status = ims_file_append(ims_bin, pending->ims);
+        } else {
+            status = ims_write(fp_ims, pending->ims);
+            if ((status == 0) && (fflush(fp_ims) != 0)) {
+                status = EIO;
+            }
+        }
+        if (status == 0) {
+            ims_num_committed++;
+            printf("IMS %u/%u\n", ims_num_committed, ims_num_total);
+            ims_throughput();
+        } else {
+            fprintf(stderr, "ERROR: Can't write IMS file (err %d)\n", status);
+        }
+        if ((status == 0) && ims_ckpt_name) {
+            status = ims_checkpoint_advance(pending);
+        }
+    }
+    if ((status != 0) && (ims_commit_status == 0)) {
+        ims_commit_status = status;
+    }
+    free(pending);
+}
+
+
+/**
+ * @brief Wait for every emitted IMS value to be committed and written
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int ims_flush(void) {
+    int status;
+
+    status = db_writer_flush();
+    if (status == 0) {
+        status = ims_commit_status;
+    }
+    if ((status == 0) && ims_bin) {
+        status = ims_file_flush(ims_bin);
+    }
+    return status;
+}
+
+
+/**
+ * @brief Reopen the IMS file of a resumed run, cut back to its checkpoint
+ *
+ * Anything after the checkpointed IMS values (a partly written line or
+ * record, or values written after the checkpoint) is dropped; those values
+ * are written again as they are regenerated.
+ *
+ * @param count The number of IMS values to keep
+ * @param offset The size of the file holding them
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int ims_reopen(uint32_t count, uint64_t offset) {
+    int status = 0;
+
+    if (ims_out_binary) {
+        if (offset != IMS_FILE_HEADER_SIZE +
+                      (uint64_t)count * IMS_FILE_RECORD_SIZE) {
+            status = EIO;
+        } else {
+            ims_bin = ims_file_reopen(ims_out_name, count);
+            return ims_bin? 0 : EIO;
+        }
+    } else if (offset != (uint64_t)count * IMS_LINE_SIZE) {
+        status = EIO;
+    } else {
+        fp_ims = fopen(ims_out_name, "r+");
+        if (!fp_ims) {
+            fprintf(stderr, "ERROR: Can't open IMS file '%s'\n",
+                    ims_out_name);
+            return errno;
+        }
+        if ((fseeko(fp_ims, 0, SEEK_END) != 0) ||
+            ((uint64_t)ftello(fp_ims) < offset)) {
+            fprintf(stderr, "ERROR: IMS file '%s' is shorter than its "
+                    "checkpoint\n", ims_out_name);
+            return EIO;
+        }
+        if ((ftruncate(fileno(fp_ims), offset) != 0) ||
+            (fseeko(fp_ims, offset, SEEK_SET) != 0)) {
+            fprintf(stderr, "ERROR: Can't truncate IMS file '%s'\n",
+                    ims_out_name);
+            return EIO;
+        }
+    }
+
+    if (status != 0) {
+        fprintf(stderr, "ERROR: The checkpoint doesn't match IMS file '%s'\n",
+                ims_out_name);
+    }
+    return status;
+}
+
+
+/**
+ * @brief Start checkpointing a run, or pick up the one being resumed
+ *
+ * A new run saves its identity and starting PRNG state(s) at once, so it
+ * can be resumed even if it stops before its first periodic checkpoint.
+ *
+ * On --resume the checkpoint must come from the same seed and options. The
+ * IMS file is cut back to the checkpoint, the PRNG states are restored,
+ * and any keysets the database holds beyond the checkpoint are left for
+ * ims_find() and ims_generate_batch() to adopt as they are regenerated.
+ *
+ * @param num_ims The number of IMS values in the run
+ * @param num_jobs The number of generator threads
+ * @param ims_sample_compatibility The sample compatibility mode
+ * @param rngs The PRNGs the checkpoint follows, in ims_pending slot order
+ * @param num_rngs The number of PRNGs
+ * @param first Set to the (zero-based) number of the first IMS to generate
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int ims_checkpoint_begin(uint32_t num_ims,
+                                uint32_t num_jobs,
+                                bool ims_sample_compatibility,
+                                csprng ** rngs,
+                                uint32_t num_rngs,
+                                uint32_t * first) {
+    int status;
+    ims_checkpoint saved;
+    const char * mismatch = NULL;
+    uint64_t num_keysets = 0;
+    uint64_t expected = 0;
+    uint32_t i;
+
+    *first = 0;
+    if (!ims_ckpt_name) {
+        return 0;
+    }
+
+    ims_ckpt.flags = (ims_indexed? IMS_CHECKPOINT_INDEXED : 0) |
+                     (ims_rejection_sampler? IMS_CHECKPOINT_REJECTION : 0) |
+                     (ims_sample_compatibility? IMS_CHECKPOINT_COMPAT : 0) |
+                     (ims_out_binary? IMS_CHECKPOINT_BINARY : 0);
+    ims_seed_digest(ims_ckpt.seed_digest);
+    ims_ckpt.num_ims = num_ims;
+    ims_ckpt.num_jobs = num_jobs;
+    ims_ckpt.first_index = ims_first_index;
+    status = ims_checkpoint_alloc(&ims_ckpt, num_rngs);
+    if (status == 0) {
+        status = db_count_keysets(&num_keysets);
+    }
+    if (status != 0) {
+        return status;
+    }
+
+    if (!ims_resume) {
+        ims_ckpt.base_keysets = num_keysets;
+        ims_ckpt.count = 0;
+        for (i = 0; i < num_rngs; i++) {
+            ims_ckpt.states[i] = *rngs[i];
+        }
+        return ims_checkpoint_save();
+    }
+
+    /* The checkpoint must be from this run... */
+    status = ims_checkpoint_read(ims_ckpt_name, &saved);
+    if (status == ENOENT) {
+        fprintf(stderr, "ERROR: There is no checkpoint '%s' to resume\n",
+                ims_ckpt_name);
+    }
+    if (status != 0) {
+        return status;
+    }
+    if (memcmp(saved.seed_digest, ims_ckpt.seed_digest,
+               sizeof(saved.seed_digest)) != 0) {
+        mismatch = "seed";
+    } else if ((saved.num_ims != num_ims) || (saved.count > num_ims)) {
+        mismatch = "--num or --shard";
+    } else if (saved.first_index != ims_first_index) {
+        mismatch = "--first-index or --shard";
+    } else if (saved.flags != ims_ckpt.flags) {
+        mismatch = "--indexed, --rejection-sampler, --compatibility "
+                   "or --binary";
+    } else if ((saved.num_states != num_rngs) ||
+               (!ims_indexed && (saved.num_jobs != num_jobs))) {
+        mismatch = "--jobs";
+    }
+    if (mismatch) {
+        fprintf(stderr, "ERROR: Checkpoint '%s' is from a run with a "
+                "different %s\n", ims_ckpt_name, mismatch);
+        status = EINVAL;
+    }
+
+    /* ...every keyset it counts must still be there... */
+    if (status == 0) {
+        expected = saved.base_keysets + saved.count;
+        if (num_keysets < expected) {
+            fprintf(stderr, "ERROR: The database has lost %llu keysets "
+                    "since the checkpoint\n",
+                    (unsigned long long)(expected - num_keysets));
+            status = EIO;
+        } else if (num_keysets - expected > num_ims - saved.count) {
+            fprintf(stderr, "ERROR: The database has %llu more keysets than "
+                    "the run could have added\n",
+                    (unsigned long long)(num_keysets - expected));
+            status = EIO;
+        }
+    }
+
+    /* ...and the IMS file must hold every IMS value it counts */
+    if (status == 0) {
+        status = ims_reopen(saved.count, saved.ims_offset);
+    }
+
+    if (status == 0) {
+        for (i = 0; i < num_rngs; i++) {
+            *rngs[i] = saved.states[i];
+            ims_ckpt.states[i] = saved.states[i];
+        }
+        ims_ckpt.base_keysets = saved.base_keysets;
+        ims_ckpt.count = saved.count;
+        ims_ckpt.ims_offset = saved.ims_offset;
+        ims_ckpt_nsec = ims_stats_now();
+        ims_adopt_remaining = (uint32_t)(num_keysets - expected);
+        ims_num_committed = saved.count;
+        ims_report_count = saved.count;
+        *first = saved.count;
+        printf("Resuming after IMS %u/%u (%u committed keysets to "
+               "re-derive)\n", saved.count, num_ims, ims_adopt_remaining);
+    }
+    ims_checkpoint_free(&saved);
+
+    return status;
+}
+
+
+/**
+ * @brief Finish checkpointing a run
+ *
+ * A completed run's checkpoint is removed. An unfinished run saves a last
+ * one covering everything it committed and wrote, so --resume picks up
+ * exactly where it stopped. Call once the keyset writer is idle.
+ *
+ * @param status The run's status
+ *
+ * @returns The run's status, or errno if it is now known to have failed.
+ */
+static int ims_checkpoint_end(int status) {
+    if (!ims_ckpt_name) {
+        return status;
+    }
+
+    if ((status == 0) && (ims_adopt_remaining > 0)) {
+        fprintf(stderr, "ERROR: %u keysets in the database were not "
+                "re-derived\n", ims_adopt_remaining);
+        status = EIO;
+    }
+    if (status == 0) {
+        unlink(ims_ckpt_name);
+    } else {
+        ims_checkpoint_save();
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Store an IMS value and its public keys
+ *
+ * Queues the keys and magic numbers for the database. The IMS value is
+ * written to the IMS file once they have been committed.
+ *
+ * @param state The IMS value, and the PRNG state(s) after it
+ * @param adopted If true, the keys are already committed (by the run being
+ *        resumed), so only the IMS value is written
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int ims_emit(const ims_pending * state,
+                    bool adopted,
+                    mcl_octet * ep_uid,
+                    mcl_octet * epvk,
+                    mcl_octet * esvk,
+                    mcl_octet * erpk_mod) {
+    int status;
+    ims_pending * pending;
+
+    pending = malloc(sizeof(*pending));
+    if (!pending) {
+        return ENOMEM;
     }
-    if (status == 0){
-        status = db_add_keyset(&ep_uid, &epvk, &esvk, &erpk_mod);
+    *pending = *state;
+    ims_emit_stats.accepted++;
+
+    if (adopted) {
+        /* Write it out behind everything already queued */
+        ims_adopt_remaining--;
+        status = db_writer_flush();
+        if (status == 0) {
+            ims_committed(pending, 0);
+            status = ims_commit_status;
+        } else {
+            free(pending);
+        }
+        return status;
+    }
+
+    status = db_writer_add(ep_uid, epvk, esvk, erpk_mod, ims_committed,
+                           pending);
+    if (status != 0) {
+        free(pending);
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Generate an IMS value
+ *
+ * Generates a unique IMS value and queues the generated EPVK, ERPK and
+ * ESVK keys for the key database. The IMS value is written to the IMS
+ * output file once they have committed.
+ *
+ * @param ims_sample_compatibility If true, generate IMS values that are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, generate the IMS value using
+ *        the correct form.
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_generate(bool ims_sample_compatibility) {
+    ims_context * ctx = &default_ctx;
+    ims_pending state;
+    bool adopted;
+    int status;
+
+    /* Generate a cryptographiclly good IMS value */
+    status = ims_find(ctx, true, ims_sample_compatibility, &adopted);
+    if (status != 0) {
+        return status;
+    }
+
+    memcpy(state.ims, ctx->ims, IMS_SIZE);
+    state.slot = ims_indexed? -1 : 0;
+    state.rng = ctx->rng;
+    state.retried = false;
+    return ims_emit(&state, adopted, &ctx->ep_uid, &ctx->epvk, &ctx->esvk,
+                    &ctx->erpk_mod);
+}
+
+
+/**
+ * @brief Generate a set of IMS values on the calling thread
+ *
+ * @param num_ims The number of IMS values to generate
+ * @param ims_sample_compatibility If true, generate IMS values that are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, generate the IMS value using
+ *        the correct form.
+ * @param num_generated Set to the number of IMS values committed to the
+ *        database and written to the IMS file
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_generate_set(uint32_t num_ims,
+                     bool ims_sample_compatibility,
+                     uint32_t * num_generated) {
+    int status = 0;
+    int flush_status;
+    uint32_t count;
+    uint32_t first;
+    csprng * rng = &default_ctx.rng;
+
+    ims_num_total = num_ims;
+    ims_num_jobs = 1;
+    ims_start_nsec = ims_stats_now();
+    status = ims_checkpoint_begin(num_ims, 1, ims_sample_compatibility,
+                                  &rng, ims_indexed? 0 : 1, &first);
+    if (status != 0) {
+        *num_generated = 0;
+        return status;
+    }
+
+    for (count = first; (count < num_ims) && (status == 0); count++) {
+        if (ims_indexed) {
+            ims_context_seed_index(&default_ctx, ims_first_index + count);
+        }
+        status = ims_generate(ims_sample_compatibility);
+    }
+
+    flush_status = ims_flush();
+    if (status == 0) {
+        status = flush_status;
+    }
+    status = ims_checkpoint_end(status);
+    *num_generated = ims_num_committed;
+
+    return status;
+}
+
+
+/**
+ * @brief Save the results of a context into a reorder ring slot
+ *
+ * @param result The ring slot
+ * @param ctx The context holding a freshly generated IMS
+ */
+static void ims_result_save(ims_result * result, ims_context * ctx) {
+    memcpy(result->ims, ctx->ims, IMS_SIZE);
+    result->ep_uid.max = sizeof(result->ep_uid_buf);
+    result->ep_uid.val = (char *)result->ep_uid_buf;
+    result->epvk.max = sizeof(result->epvk_buf);
+    result->epvk.val = (char *)result->epvk_buf;
+    result->esvk.max = sizeof(result->esvk_buf);
+    result->esvk.val = (char *)result->esvk_buf;
+    result->erpk_mod.max = sizeof(result->erpk_mod_buf);
+    result->erpk_mod.val = (char *)result->erpk_mod_buf;
+    MCL_OCT_copy(&result->ep_uid, &ctx->ep_uid);
+    MCL_OCT_copy(&result->epvk, &ctx->epvk);
+    MCL_OCT_copy(&result->esvk, &ctx->esvk);
+    MCL_OCT_copy(&result->erpk_mod, &ctx->erpk_mod);
+    result->rng = ctx->rng;
+}
+
+
+/**
+ * @brief IMS worker thread
+ *
+ * Worker w generates IMS indices w, w + N, w + 2N... from its own PRNG
+ * stream (or, in per-index mode, from each index's own stream), parking
+ * each one in the reorder ring for the writer.
+ *
+ * @param arg The ims_worker descriptor
+ */
+static void * ims_worker_thread(void * arg) {
+    ims_worker * worker = arg;
+    ims_batch * batch = worker->batch;
+    uint32_t index;
+    bool aborted;
+    int status;
+
+    /* Our first index at or after batch->first */
+    index = batch->first + (worker->worker + batch->num_jobs -
+                            batch->first % batch->num_jobs) % batch->num_jobs;
+    for (; index < batch->num_ims; index += batch->num_jobs) {
+        /* Wait until our slot in the ring has been drained */
+        pthread_mutex_lock(&batch->lock);
+        while (!batch->abort &&
+               (index >= batch->next_write + batch->ring_size)) {
+            pthread_cond_wait(&batch->slot_free, &batch->lock);
+        }
+        aborted = batch->abort;
+        pthread_mutex_unlock(&batch->lock);
+        if (aborted) {
+            break;
+        }
+
+        if (ims_indexed) {
+            ims_context_seed_index(&worker->ctx, ims_first_index + index);
+        }
+        status = ims_find(&worker->ctx, false,
+                          batch->ims_sample_compatibility, NULL);
+        if (status == 0) {
+            ims_result_save(&batch->ring[index % batch->ring_size],
+                            &worker->ctx);
+        }
+
+        /* A failure is handed to the writer in place of the IMS */
+        pthread_mutex_lock(&batch->lock);
+        batch->ring[index % batch->ring_size].status = status;
+        batch->ring[index % batch->ring_size].ready = true;
+        pthread_cond_broadcast(&batch->slot_ready);
+        pthread_mutex_unlock(&batch->lock);
+        if (status != 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief Generate a set of IMS values using multiple threads
+ *
+ * IMS index k is generated by worker (k mod num_jobs), each worker using
+ * its own PRNG stream derived from the master seed, so the output depends
+ * only on the seed and num_jobs. The calling thread is the sole writer: it
+ * emits the values in index order, checks EP_UID uniqueness against the
+ * database and, in the (astronomically unlikely) event of a collision,
+ * replaces that value from a dedicated "retry" stream.
+ *
+ * In per-index mode each index is drawn from its own stream, and a
+ * collision is resolved by replaying that index's stream with the database
+ * check on, exactly as ims_generate_set() would, so the output is the same
+ * for any num_jobs.
+ *
+ * @param num_ims The number of IMS values to generate
+ * @param num_jobs The number of worker threads
+ * @param ims_sample_compatibility If true, generate IMS values that are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, generate the IMS value using
+ *        the correct form.
+ * @param num_generated Set to the number of IMS values committed to the
+ *        database and written to the IMS file
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_generate_batch(uint32_t num_ims,
+                       uint32_t num_jobs,
+                       bool ims_sample_compatibility,
+                       uint32_t * num_generated) {
+    int status = 0;
+    int flush_status;
+    ims_batch batch;
+    ims_worker * workers = NULL;
+    ims_context * retry_ctx = NULL;
+    ims_result * result;
+    ims_pending state;
+    csprng ** rngs = NULL;
+    uint32_t num_started = 0;
+    uint32_t index;
+    uint32_t i;
+    bool duplicate;
+    bool adopted;
+    bool begun = false;
+    uint64_t start;
+
+    *num_generated = 0;
+    if (num_jobs < 1) {
+        return EINVAL;
+    }
+    ims_num_total = num_ims;
+    ims_num_jobs = num_jobs;
+    ims_start_nsec = ims_stats_now();
+
+    memset(&batch, 0, sizeof(batch));
+    batch.num_ims = num_ims;
+    batch.num_jobs = num_jobs;
+    batch.ring_size = num_jobs * IMS_RING_SLOTS_PER_JOB;
+    batch.ims_sample_compatibility = ims_sample_compatibility;
+    batch.ring = calloc(batch.ring_size, sizeof(*batch.ring));
+    workers = calloc(num_jobs, sizeof(*workers));
+    retry_ctx = calloc(1, sizeof(*retry_ctx));
+    rngs = calloc(num_jobs + 1, sizeof(*rngs));
+    if (!batch.ring || !workers || !retry_ctx || !rngs) {
+        fprintf(stderr, "ERROR: Can't allocate %u IMS workers\n", num_jobs);
+        status = ENOMEM;
+        goto ims_generate_batch_err;
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.slot_ready, NULL);
+    pthread_cond_init(&batch.slot_free, NULL);
+    ims_context_init_stream(retry_ctx, "retry", 0);
+    for (i = 0; i < num_jobs; i++) {
+        workers[i].worker = i;
+        workers[i].batch = &batch;
+        ims_context_init_stream(&workers[i].ctx, "worker", i);
+        rngs[i] = &workers[i].ctx.rng;
+    }
+    rngs[num_jobs] = &retry_ctx->rng;
+
+    /* Checkpoint the streams in ims_pending slot order: workers, retry */
+    status = ims_checkpoint_begin(num_ims, num_jobs, ims_sample_compatibility,
+                                  rngs, ims_indexed? 0 : num_jobs + 1,
+                                  &batch.first);
+    begun = (status == 0);
+    batch.next_write = batch.first;
+
+    /* Start the workers */
+    for (i = 0; (status == 0) && (i < num_jobs); i++) {
+        if (pthread_create(&workers[i].thread, NULL, ims_worker_thread,
+                           &workers[i]) != 0) {
+            fprintf(stderr, "ERROR: Can't start IMS worker %u\n", i);
+            status = EAGAIN;
+            break;
+        }
+        num_started++;
+    }
+
+    /* Emit the IMS values in order as they become available */
+    for (index = batch.first; (status == 0) && (index < num_ims); index++) {
+        result = &batch.ring[index % batch.ring_size];
+
+        pthread_mutex_lock(&batch.lock);
+        while (!result->ready) {
+            pthread_cond_wait(&batch.slot_ready, &batch.lock);
+        }
+        pthread_mutex_unlock(&batch.lock);
+
+        if (result->status != 0) {
+            /* The worker gave up on this IMS */
+            status = result->status;
+        } else {
+            start = ims_stats_now();
+            duplicate = db_ep_uid_exists(&result->ep_uid);
+            ims_stats_stage(&ims_emit_stats, IMS_STAGE_EP_UID_LOOKUP, start);
+            adopted = duplicate &&
+                      ims_keyset_committed(&result->ep_uid, &result->epvk,
+                                           &result->esvk, &result->erpk_mod);
+            memcpy(state.ims, result->ims, IMS_SIZE);
+            state.slot = ims_indexed? -1 : (int)(index % num_jobs);
+            state.rng = result->rng;
+            state.retried = false;
+            if (duplicate && !adopted) {
+                /* Collision with an earlier IMS - replace it */
+                ims_emit_stats.rejected_duplicate++;
+                if (ims_indexed) {
+                    ims_context_seed_index(retry_ctx,
+                                           ims_first_index + index);
+                }
+                status = ims_find(retry_ctx, true, ims_sample_compatibility,
+                                  &adopted);
+                if (status == 0) {
+                    memcpy(state.ims, retry_ctx->ims, IMS_SIZE);
+                    state.retried = !ims_indexed;
+                    state.retry_rng = retry_ctx->rng;
+                    status = ims_emit(&state, adopted, &retry_ctx->ep_uid,
+                                      &retry_ctx->epvk, &retry_ctx->esvk,
+                                      &retry_ctx->erpk_mod);
+                }
+            } else {
+                status = ims_emit(&state, adopted, &result->ep_uid,
+                                  &result->epvk, &result->esvk,
+                                  &result->erpk_mod);
+            }
+        }
+
+        /* Release the slot */
+        pthread_mutex_lock(&batch.lock);
+        result->ready = false;
+        batch.next_write = index + 1;
+        pthread_cond_broadcast(&batch.slot_free);
+        pthread_mutex_unlock(&batch.lock);
+    }
+
+    /* Stop any workers still running (only on error) and reap them */
+    pthread_mutex_lock(&batch.lock);
+    batch.abort = true;
+    pthread_cond_broadcast(&batch.slot_free);
+    pthread_mutex_unlock(&batch.lock);
+    for (i = 0; i < num_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for (i = 0; i < num_jobs; i++) {
+        ims_stats_add(&ims_run_stats, &workers[i].ctx.stats);
+        ims_context_deinit(&workers[i].ctx);
+    }
+    ims_stats_add(&ims_run_stats, &retry_ctx->stats);
+    ims_context_deinit(retry_ctx);
+
+    /* Only what has committed counts as generated */
+    flush_status = ims_flush();
+    if (status == 0) {
+        status = flush_status;
+    }
+    if (begun) {
+        status = ims_checkpoint_end(status);
+    }
+    *num_generated = ims_num_committed;
+
+    pthread_cond_destroy(&batch.slot_free);
+    pthread_cond_destroy(&batch.slot_ready);
+    pthread_mutex_destroy(&batch.lock);
+
+ims_generate_batch_err:
+    free(rngs);
+    free(retry_ctx);
+    free(workers);
+    free(batch.ring);
+
+    return status;
+}
+
+
+/**
+ * @brief Write the run's instrumentation as a JSON report
+ *
+ * Call after generation (the keyset writer must be idle).
+ *
+ * @param filename Where to write the report ("-" for stdout)
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_write_stats(const char * filename) {
+    int status;
+    ims_stats total;
+    FILE * fp;
+
+    memset(&total, 0, sizeof(total));
+    ims_stats_add(&total, &ims_run_stats);
+    ims_stats_add(&total, &ims_emit_stats);
+    ims_stats_add(&total, &default_ctx.stats);
+    db_writer_stats(&total);
+
+    if (strcmp(filename, "-") == 0) {
+        fp = stdout;
+    } else {
+        fp = fopen(filename, "w");
+        if (!fp) {
+            fprintf(stderr, "ERROR: Can't create stats file '%s'\n",
+                    filename);
+            return errno;
+        }
+    }
+
+    status = ims_stats_write_json(fp, &total, ims_num_total, ims_num_jobs,
+                                  ims_stats_now() - ims_start_nsec);
+    if (fp != stdout) {
+        if ((fclose(fp) != 0) && (status == 0)) {
+            status = EIO;
+        }
+    }
+    if (status != 0) {
+        fprintf(stderr, "ERROR: Can't write stats file '%s'\n", filename);
     }
 
     return status;
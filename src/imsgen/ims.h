@@ -47,6 +47,12 @@
  * @param prng_seed_string Raw seed string
  * @param ims_filename The name of the IMS output file
  * @param database_name The name of the certificate database
+ * @param db_batch_size The most keysets to commit in one transaction
+ * @param db_wal If true, use WAL journaling with synchronous=NORMAL
+ * @param binary_out If true, write the IMS file as a binary IMS container
+ *        rather than binascii
+ * @param num_ims The number of IMS values the run will generate (sizes the
+ *        EP_UID index)
  *
  * @note One and only 1 of prng_seed_file and prng_seed_string must be used.
  *
@@ -55,15 +61,87 @@
 int ims_init(const char * prng_seed_file,
              const char * prng_seed_string,
              const char * ims_filename,
-             const char * database_name);
+             const char * database_name,
+             uint32_t db_batch_size,
+             bool db_wal,
+             bool binary_out,
+             uint32_t num_ims);
+
+
+/* Seconds between checkpoints unless another interval is selected */
+#define IMS_CHECKPOINT_INTERVAL_SEC 5
+
+/**
+ * @brief Select checkpointing, and whether to resume an interrupted run
+ *
+ * Call before ims_init(). The checkpoint is kept next to the IMS file, as
+ * "<file>.ckpt", and removed when the run completes.
+ *
+ * @param interval_sec Seconds between checkpoints (0 for none)
+ * @param resume If true, continue the run recorded in the IMS file's
+ *        checkpoint
+ */
+void ims_set_checkpoint(uint32_t interval_sec, bool resume);
+
+
+/**
+ * @brief Select per-index IMS derivation
+ *
+ * Call after ims_init() and before generating.
+ *
+ * @param indexed If true, seed every IMS index from its own KDF-derived
+ *        sub-seed, so the output is independent of --jobs and any index
+ *        can be regenerated on its own
+ * @param first_index The index of the first IMS generated
+ */
+void ims_set_index_mode(bool indexed, uint64_t first_index);
+
+
+/**
+ * @brief Select the IMS candidate sampler
+ *
+ * The rejection-free sampler is the default. The rejection sampler draws
+ * different candidates from the same seed, so use it to reproduce IMS
+ * files generated before the rejection-free sampler existed. The 100-IMS
+ * sample compatibility mode always uses it.
+ *
+ * @param rejection If true, draw candidates with the original rejection
+ *        sampler
+ */
+void ims_set_rejection_sampler(bool rejection);
+
+
+/* The ERRK big-number backend used unless another is selected */
+#define IMS_BIGNUM_DEFAULT  "mcl"
+
+/**
+ * @brief Select the ERRK big-number backend and any cross-check
+ *
+ * The backend runs the P/Q Miller-Rabin tests and the RSA CRT math. Every
+ * backend consumes the PRNG as MIRACL does, so they all generate the same
+ * IMS values. With a reference backend, every Nth P/Q search in each
+ * generator context is replayed on it, and generation stops with
+ * ENOTRECOVERABLE if the biases, modulus, CRT parameters or PRNG state
+ * differ. The 100-IMS sample compatibility mode skips dp and dq, which
+ * only MIRACL reproduces, so it must keep the default backend. Call after
+ * ims_init() and before generating.
+ *
+ * @param backend The backend name (NULL for IMS_BIGNUM_DEFAULT)
+ * @param reference The backend name to cross-check against (NULL for none)
+ * @param every Cross-check every this many P/Q searches in each context
+ *
+ * @returns Zero if successful, EINVAL if a backend is unknown.
+ */
+int ims_set_bignum(const char * backend, const char * reference,
+                   uint32_t every);
 
 
 /**
  * @brief Generate an IMS value
  *
- * Generates a unique IMS value, storing it in the IMS output file and
- * the generated EPVK, ERPK and ESVK keys in the key
- * database.
+ * Generates a unique IMS value and queues the generated EPVK, ERPK and
+ * ESVK keys for the key database. The IMS value is written to the IMS
+ * output file once they have committed.
  *
  * @param ims_sample_compatibility If true, generate IMS values that are
  *        compatible with the original (incorrect) 100 sample values sent
@@ -75,6 +153,63 @@ int ims_init(const char * prng_seed_file,
 int ims_generate(bool ims_sample_compatibility);
 
 
+/**
+ * @brief Generate a set of IMS values on the calling thread
+ *
+ * @param num_ims The number of IMS values to generate
+ * @param ims_sample_compatibility If true, generate IMS values that are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, generate the IMS value using
+ *        the correct form.
+ * @param num_generated Set to the number of IMS values committed to the
+ *        database and written to the IMS file
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_generate_set(uint32_t num_ims,
+                     bool ims_sample_compatibility,
+                     uint32_t * num_generated);
+
+
+/**
+ * @brief Generate a set of IMS values using multiple threads
+ *
+ * IMS index k is generated by worker (k mod num_jobs), each worker using
+ * its own PRNG stream derived from the master seed, so the output depends
+ * only on the seed and num_jobs. Values are written to the IMS file and
+ * database in index order.
+ *
+ * @param num_ims The number of IMS values to generate
+ * @param num_jobs The number of worker threads
+ * @param ims_sample_compatibility If true, generate IMS values that are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, generate the IMS value using
+ *        the correct form.
+ * @param num_generated Set to the number of IMS values committed to the
+ *        database and written to the IMS file
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_generate_batch(uint32_t num_ims,
+                       uint32_t num_jobs,
+                       bool ims_sample_compatibility,
+                       uint32_t * num_generated);
+
+
+/**
+ * @brief Write the run's instrumentation as a JSON report
+ *
+ * Stage timings, rejection and Miller-Rabin counts, and the P/Q bias
+ * iteration distributions, summed over every generator thread and the
+ * keyset writer. Call after generation and before ims_deinit().
+ *
+ * @param filename Where to write the report ("-" for stdout)
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_write_stats(const char * filename);
+
+
 /**
  * @brief De-initialize the IMS generation subsystem
  *
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the imsgen big-number backends: MIRACL's FF
+ * arithmetic (the reference) and OpenSSL's BIGNUMs.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <openssl/bn.h>
+#include <openssl/err.h>
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "mcl_rand.h"
+#include "mcl_rsa.h"
+#include "ims_mcl.h"
+#include "crypto.h"
+#include "ims_common.h"
+#include "ims_bignum.h"
+
+
+/**
+ * @brief Advance a PRNG by a number of bytes
+ *
+ * @param rng The PRNG
+ * @param num_bytes How many bytes to discard
+ */
+void ims_rand_skip(csprng * rng, uint32_t num_bytes) {
+    while (num_bytes-- > 0) {
+        MCL_RAND_byte(rng);
+    }
+}
+
+
+/**
+ * @brief Each thread's scratch for the MIRACL FF routines
+ *
+ * Keeps the primality test's temporaries off the (possibly small) worker
+ * stacks, cache-line aligned and reused from one candidate to the next.
+ */
+static __thread mcl_ff_ws ff_ws;
+
+
+/**
+ * @brief Load an ERRK_PQ_SIZE big-endian number into an HFLEN FF
+ */
+static void ff_from_bytes(mcl_chunk ff[][MCL_BS], const uint8_t * bytes) {
+    mcl_octet oct = { ERRK_PQ_SIZE, ERRK_PQ_SIZE, (char *)bytes };
+
+    MCL_FF_fromOctet_C25519(ff, &oct, MCL_HFLEN);
+}
+
+
+/**
+ * @brief Store an FF of n BIGs as big-endian bytes
+ */
+static void ff_to_bytes(uint8_t * bytes, mcl_chunk ff[][MCL_BS], int n) {
+    mcl_octet oct = { 0, n * MCL_MODBYTES, (char *)bytes };
+
+    MCL_FF_toOctet_C25519(&oct, ff, n);
+}
+
+
+/**
+ * @brief MIRACL primality test, noting how many witnesses were drawn
+ *
+ * @param x The candidate (ERRK_PQ_SIZE bytes, big-endian)
+ * @param rng The PRNG supplying the Miller-Rabin witnesses
+ * @param witnesses Set to the number of witnesses MCL_FF_prime drew
+ *
+ * @returns 1 if x is (probably) prime, 0 otherwise
+ */
+static int mcl_prime(const uint8_t * x, csprng * rng, uint8_t * witnesses) {
+    mcl_chunk x_ff[MCL_HFLEN][MCL_BS];
+    csprng before = *rng;
+    int prime;
+
+    ff_from_bytes(x_ff, x);
+    MCL_FF_ws_init_C25519(&ff_ws);
+    prime = MCL_FF_prime_ws_C25519(x_ff, rng, MCL_HFLEN, &ff_ws);
+
+    /* Replay the PRNG a witness at a time until it catches up */
+    *witnesses = 0;
+    while ((*witnesses < PRIME_MAX_WITNESSES) &&
+           (memcmp(&before, rng, sizeof(before)) != 0)) {
+        ims_rand_skip(&before, PRIME_WITNESS_RAND_BYTES);
+        (*witnesses)++;
+    }
+    memset(&before, 0, sizeof(before));
+
+    return prime;
+}
+
+
+/**
+ * @brief MIRACL RSA CRT parameters (via rsa_secret)
+ *
+ * @param p The (prime) ERRK_P, ERRK_PQ_SIZE bytes big-endian
+ * @param q The (prime) ERRK_Q, ERRK_PQ_SIZE bytes big-endian
+ * @param e The public exponent
+ * @param crt Set to the modulus and CRT parameters
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int mcl_rsa_crt(const uint8_t * p, const uint8_t * q, uint32_t e,
+                       ims_rsa_crt * crt) {
+    MCL_rsa_private_key priv_key = { 0 };
+    MCL_rsa_public_key pub_key = { 0 };
+    mcl_chunk pq1[MCL_HFLEN][MCL_BS];
+
+    ff_from_bytes(priv_key.p, p);
+    ff_from_bytes(priv_key.q, q);
+
+    /**
+     * rsa_secret's sample-compatibility path reaches the same dp/dq (it
+     * only changes how (p - 1) / 2 is formed), so it isn't needed here.
+     */
+    rsa_secret(&priv_key, &pub_key, e, false);
+
+    ff_to_bytes(crt->n, pub_key.n, MCL_FFLEN);
+    ff_to_bytes(crt->dp, priv_key.dp, MCL_HFLEN);
+    ff_to_bytes(crt->dq, priv_key.dq, MCL_HFLEN);
+    ff_to_bytes(crt->c, priv_key.c, MCL_HFLEN);
+
+    /* MCL_FF_invmodp doesn't fail, so flag a missing inverse here */
+    MCL_FF_ws_init_C25519(&ff_ws);
+    MCL_FF_copy_C25519(pq1, priv_key.p, MCL_HFLEN);
+    MCL_FF_dec_C25519(pq1, 1, MCL_HFLEN);
+    if (MCL_FF_cfactor_ws_C25519(pq1, e, MCL_HFLEN, &ff_ws)) {
+        memset(crt->dp, 0, sizeof(crt->dp));
+    }
+    MCL_FF_copy_C25519(pq1, priv_key.q, MCL_HFLEN);
+    MCL_FF_dec_C25519(pq1, 1, MCL_HFLEN);
+    if (MCL_FF_cfactor_ws_C25519(pq1, e, MCL_HFLEN, &ff_ws)) {
+        memset(crt->dq, 0, sizeof(crt->dq));
+    }
+
+    memset(&priv_key, 0, sizeof(priv_key));
+    memset(pq1, 0, sizeof(pq1));
+    return 0;
+}
+
+
+/**
+ * @brief Greatest common divisor of two words
+ */
+static uint32_t gcd32(uint32_t a, uint32_t b) {
+    uint32_t t;
+
+    while (b != 0) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+/**
+ * @brief OpenSSL primality test
+ *
+ * BN_check_prime does its own trial division and Miller-Rabin rounds from
+ * OpenSSL's DRBG; the IMS PRNG is then advanced by what MCL_FF_prime would
+ * have drawn: nothing for an even number or one sharing a factor with
+ * 3*5*...*19, all PRIME_MAX_WITNESSES for a prime, and one witness for any
+ * other composite. (A composite that is a strong pseudoprime to MCL's first
+ * witness would draw more; --cross-check catches that, as the PRNG states
+ * would then differ.)
+ *
+ * @param x The candidate (ERRK_PQ_SIZE bytes, big-endian)
+ * @param rng The PRNG, advanced as MCL_FF_prime would advance it
+ * @param witnesses Set to the number of witnesses MCL_FF_prime would draw
+ *
+ * @returns 1 if x is (probably) prime, 0 if not, -1 on failure
+ */
+static int openssl_prime(const uint8_t * x, csprng * rng,
+                         uint8_t * witnesses) {
+    BN_CTX * bn_ctx = BN_CTX_new();
+    BIGNUM * bn = BN_bin2bn(x, ERRK_PQ_SIZE, NULL);
+    BN_ULONG residue;
+    int prime = -1;
+
+    if (bn_ctx && bn) {
+        prime = BN_check_prime(bn, bn_ctx, NULL);
+    }
+    if (prime == 1) {
+        *witnesses = PRIME_MAX_WITNESSES;
+    } else if (prime == 0) {
+        residue = BN_mod_word(bn, PRIME_TRIAL_DIVISOR);
+        if (!BN_is_odd(bn) ||
+            (gcd32((uint32_t)residue, PRIME_TRIAL_DIVISOR) != 1)) {
+            *witnesses = 0;
+        } else {
+            *witnesses = 1;
+        }
+    } else {
+        fprintf(stderr, "ERROR: OpenSSL primality test failed\n");
+        *witnesses = 0;
+        prime = -1;
+    }
+    ims_rand_skip(rng, *witnesses * PRIME_WITNESS_RAND_BYTES);
+
+    BN_clear_free(bn);
+    BN_CTX_free(bn_ctx);
+    return prime;
+}
+
+
+/**
+ * @brief Store e^-1 mod m as big-endian bytes (zero if there is none)
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int bn_inverse_to_bytes(uint8_t * bytes, int length, const BIGNUM * e,
+                               const BIGNUM * m, BN_CTX * bn_ctx) {
+    BIGNUM * inverse;
+    int status = 0;
+
+    ERR_set_mark();
+    inverse = BN_mod_inverse(NULL, e, m, bn_ctx);
+    ERR_pop_to_mark();
+    if (!inverse) {
+        memset(bytes, 0, length);
+    } else if (BN_bn2binpad(inverse, bytes, length) != length) {
+        status = ERANGE;
+    }
+
+    BN_clear_free(inverse);
+    return status;
+}
+
+
+/**
+ * @brief OpenSSL RSA CRT parameters
+ *
+ * @param p The (prime) ERRK_P, ERRK_PQ_SIZE bytes big-endian
+ * @param q The (prime) ERRK_Q, ERRK_PQ_SIZE bytes big-endian
+ * @param e The public exponent
+ * @param crt Set to the modulus and CRT parameters
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int openssl_rsa_crt(const uint8_t * p, const uint8_t * q, uint32_t e,
+                           ims_rsa_crt * crt) {
+    BN_CTX * bn_ctx = BN_CTX_new();
+    BIGNUM * p_bn = BN_bin2bn(p, ERRK_PQ_SIZE, NULL);
+    BIGNUM * q_bn = BN_bin2bn(q, ERRK_PQ_SIZE, NULL);
+    BIGNUM * e_bn = BN_new();
+    BIGNUM * n_bn = BN_new();
+    BIGNUM * pm1_bn = BN_new();
+    int status = ENOMEM;
+
+    if (!bn_ctx || !p_bn || !q_bn || !e_bn || !n_bn || !pm1_bn ||
+        !BN_set_word(e_bn, e) ||
+        !BN_mul(n_bn, p_bn, q_bn, bn_ctx)) {
+        goto openssl_rsa_crt_err;
+    }
+    if (BN_bn2binpad(n_bn, crt->n, sizeof(crt->n)) != sizeof(crt->n)) {
+        status = ERANGE;
+        goto openssl_rsa_crt_err;
+    }
+
+    /* dp = e^-1 mod (p - 1), dq = e^-1 mod (q - 1) */
+    if (!BN_sub(pm1_bn, p_bn, BN_value_one())) {
+        goto openssl_rsa_crt_err;
+    }
+    status = bn_inverse_to_bytes(crt->dp, sizeof(crt->dp), e_bn, pm1_bn,
+                                 bn_ctx);
+    if (status != 0) {
+        goto openssl_rsa_crt_err;
+    }
+    status = ENOMEM;
+    if (!BN_sub(pm1_bn, q_bn, BN_value_one())) {
+        goto openssl_rsa_crt_err;
+    }
+    status = bn_inverse_to_bytes(crt->dq, sizeof(crt->dq), e_bn, pm1_bn,
+                                 bn_ctx);
+    if (status != 0) {
+        goto openssl_rsa_crt_err;
+    }
+
+    /* c = p^-1 mod q */
+    status = bn_inverse_to_bytes(crt->c, sizeof(crt->c), p_bn, q_bn, bn_ctx);
+
+openssl_rsa_crt_err:
+    if (status == ENOMEM) {
+        fprintf(stderr, "ERROR: OpenSSL RSA CRT calculation failed\n");
+    }
+    BN_clear_free(pm1_bn);
+    BN_free(n_bn);
+    BN_free(e_bn);
+    BN_clear_free(q_bn);
+    BN_clear_free(p_bn);
+    BN_CTX_free(bn_ctx);
+    return status;
+}
+
+
+/* The known backends */
+static const ims_bignum bignum_backends[] = {
+    { "mcl", mcl_prime, mcl_rsa_crt },
+    { "openssl", openssl_prime, openssl_rsa_crt },
+};
+
+#define NUM_BIGNUM_BACKENDS \
+    (sizeof(bignum_backends) / sizeof(bignum_backends[0]))
+
+
+/**
+ * @brief Look up a big-number backend by name
+ *
+ * @param name The backend name ("mcl" or "openssl")
+ *
+ * @returns The backend, or NULL (after listing the known ones) if there is
+ *          no such backend.
+ */
+const ims_bignum * ims_bignum_find(const char * name) {
+    size_t i;
+
+    for (i = 0; i < NUM_BIGNUM_BACKENDS; i++) {
+        if (strcmp(name, bignum_backends[i].name) == 0) {
+            return &bignum_backends[i];
+        }
+    }
+
+    fprintf(stderr, "ERROR: unknown big-number backend '%s' (one of:", name);
+    for (i = 0; i < NUM_BIGNUM_BACKENDS; i++) {
+        fprintf(stderr, " %s", bignum_backends[i].name);
+    }
+    fprintf(stderr, ")\n");
+    return NULL;
+}
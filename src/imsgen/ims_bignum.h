@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the header information for the imsgen
+ * big-number backends: the Miller-Rabin tests of the ERRK P/Q search and
+ * the RSA CRT parameters derived from the primes found.
+ *
+ * Backends exchange fixed-width big-endian byte strings, so the same P/Q
+ * search can be run over MIRACL's FF arithmetic or OpenSSL's BIGNUMs and
+ * the results compared byte for byte (see imsgen --cross-check).
+ *
+ */
+
+#ifndef _IMS_BIGNUM_H
+#define _IMS_BIGNUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mcl_arch.h"
+#include "mcl_rand.h"
+#include "crypto.h"
+#include "ims_common.h"
+
+/**
+ * MCL_FF_prime draws each Miller-Rabin witness with MCL_FF_randomnum() of
+ * 2 * MCL_HFLEN BIGs, and uses at most 10 of them. Every backend consumes
+ * the PRNG exactly as MCL_FF_prime would, so the choice of backend never
+ * changes the IMS stream.
+ */
+#define PRIME_WITNESS_RAND_BYTES    (2 * MCL_HFLEN * MCL_MODBYTES)
+#define PRIME_MAX_WITNESSES         10
+
+/* The product of the primes MCL_FF_prime trial-divides by (3*5*...*19) */
+#define PRIME_TRIAL_DIVISOR         4849845
+
+/* The RSA CRT parameters for a P/Q pair (all big-endian) */
+typedef struct {
+    uint8_t n[ERRK_PQ_SIZE * 2];    /* p * q (ERPK_MOD) */
+    uint8_t dp[ERRK_PQ_SIZE];       /* e^-1 mod (p - 1), zero if none */
+    uint8_t dq[ERRK_PQ_SIZE];       /* e^-1 mod (q - 1), zero if none */
+    uint8_t c[ERRK_PQ_SIZE];        /* p^-1 mod q */
+} ims_rsa_crt;
+
+typedef struct {
+    const char * name;
+
+    /**
+     * @brief Test an ERRK_PQ_SIZE big-endian number for primality
+     *
+     * @param x The candidate
+     * @param rng The PRNG, advanced as MCL_FF_prime would advance it
+     * @param witnesses Set to the number of witnesses MCL_FF_prime would
+     *        draw (0 to PRIME_MAX_WITNESSES)
+     *
+     * @returns 1 if x is (probably) prime, 0 if not, -1 on failure
+     */
+    int (*prime)(const uint8_t * x, csprng * rng, uint8_t * witnesses);
+
+    /**
+     * @brief Calculate the RSA CRT parameters
+     *
+     * @param p The (prime) ERRK_P, ERRK_PQ_SIZE bytes big-endian
+     * @param q The (prime) ERRK_Q, ERRK_PQ_SIZE bytes big-endian
+     * @param e The public exponent
+     * @param crt Set to the modulus and CRT parameters
+     *
+     * @returns Zero if successful, errno otherwise.
+     */
+    int (*rsa_crt)(const uint8_t * p, const uint8_t * q, uint32_t e,
+                   ims_rsa_crt * crt);
+} ims_bignum;
+
+
+/**
+ * @brief Look up a big-number backend by name
+ *
+ * @param name The backend name ("mcl" or "openssl")
+ *
+ * @returns The backend, or NULL (after listing the known ones) if there is
+ *          no such backend.
+ */
+const ims_bignum * ims_bignum_find(const char * name);
+
+
+/**
+ * @brief Advance a PRNG by a number of bytes
+ *
+ * @param rng The PRNG
+ * @param num_bytes How many bytes to discard
+ */
+void ims_rand_skip(csprng * rng, uint32_t num_bytes);
+
+#endif /* !_IMS_BIGNUM_H */
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains imsgen's run checkpoint files (see
+ * ims_checkpoint.h for the layout).
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "mcl_ecdh.h"
+#include "mcl_rand.h"
+#include "mcl_rsa.h"
+#include "crypto.h"
+#include "ims_common.h"
+#include "ims_file.h"
+#include "ims_checkpoint.h"
+
+/* Header field offsets */
+#define CKPT_VERSION        8
+#define CKPT_FLAGS          12
+#define CKPT_SEED_DIGEST    16
+#define CKPT_NUM_IMS        48
+#define CKPT_NUM_JOBS       52
+#define CKPT_FIRST_INDEX    56
+#define CKPT_BASE_KEYSETS   64
+#define CKPT_COUNT          72
+#define CKPT_NUM_STATES     76
+#define CKPT_IMS_OFFSET     80
+#define CKPT_STATE_SIZE     88
+
+/* The most PRNG states a checkpoint may hold (one per thread, plus one) */
+#define CKPT_MAX_STATES     4096
+
+
+static void put_le32(uint8_t * buf, uint32_t value) {
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+    buf[2] = (uint8_t)(value >> 16);
+    buf[3] = (uint8_t)(value >> 24);
+}
+
+static void put_le64(uint8_t * buf, uint64_t value) {
+    put_le32(buf, (uint32_t)value);
+    put_le32(buf + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t get_le32(const uint8_t * buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t * buf) {
+    return get_le32(buf) | ((uint64_t)get_le32(buf + 4) << 32);
+}
+
+
+/**
+ * @brief Allocate a checkpoint's PRNG states
+ *
+ * @param ckpt The checkpoint
+ * @param num_states The number of PRNG states it holds
+ *
+ * @returns Zero if successful, ENOMEM otherwise.
+ */
+int ims_checkpoint_alloc(ims_checkpoint * ckpt, uint32_t num_states) {
+    free(ckpt->states);
+    ckpt->states = NULL;
+    ckpt->num_states = num_states;
+    if (num_states > 0) {
+        ckpt->states = calloc(num_states, sizeof(*ckpt->states));
+        if (!ckpt->states) {
+            ckpt->num_states = 0;
+            return ENOMEM;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Free a checkpoint's PRNG states
+ *
+ * @param ckpt The checkpoint
+ */
+void ims_checkpoint_free(ims_checkpoint * ckpt) {
+    if (ckpt->states) {
+        memset(ckpt->states, 0, ckpt->num_states * sizeof(*ckpt->states));
+        free(ckpt->states);
+    }
+    ckpt->states = NULL;
+    ckpt->num_states = 0;
+}
+
+
+/**
+ * @brief Sync the directory holding a file, so a rename in it is durable
+ *
+ * @param filename The file
+ */
+static void sync_parent_dir(const char * filename) {
+    char * path;
+    int fd;
+
+    path = strdup(filename);
+    if (path) {
+        fd = open(dirname(path), O_RDONLY);
+        if (fd != -1) {
+            fsync(fd);
+            close(fd);
+        }
+        free(path);
+    }
+}
+
+
+/**
+ * @brief Atomically replace a checkpoint file
+ *
+ * @param filename The checkpoint file
+ * @param ckpt The checkpoint to write
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_checkpoint_write(const char * filename, const ims_checkpoint * ckpt) {
+    int status = 0;
+    uint8_t * buf;
+    size_t states_size = ckpt->num_states * sizeof(csprng);
+    size_t size = IMS_CHECKPOINT_HEADER_SIZE + states_size + 4;
+    char * tmp_name;
+    int fd;
+
+    buf = calloc(1, size);
+    tmp_name = malloc(strlen(filename) + 5);
+    if (!buf || !tmp_name) {
+        free(tmp_name);
+        free(buf);
+        return ENOMEM;
+    }
+    sprintf(tmp_name, "%s.tmp", filename);
+
+    memcpy(buf, IMS_CHECKPOINT_MAGIC, IMS_CHECKPOINT_MAGIC_SIZE);
+    put_le32(&buf[CKPT_VERSION], IMS_CHECKPOINT_VERSION);
+    put_le32(&buf[CKPT_FLAGS], ckpt->flags);
+    memcpy(&buf[CKPT_SEED_DIGEST], ckpt->seed_digest,
+           sizeof(ckpt->seed_digest));
+    put_le32(&buf[CKPT_NUM_IMS], ckpt->num_ims);
+    put_le32(&buf[CKPT_NUM_JOBS], ckpt->num_jobs);
+    put_le64(&buf[CKPT_FIRST_INDEX], ckpt->first_index);
+    put_le64(&buf[CKPT_BASE_KEYSETS], ckpt->base_keysets);
+    put_le32(&buf[CKPT_COUNT], ckpt->count);
+    put_le32(&buf[CKPT_NUM_STATES], ckpt->num_states);
+    put_le64(&buf[CKPT_IMS_OFFSET], ckpt->ims_offset);
+    put_le32(&buf[CKPT_STATE_SIZE], sizeof(csprng));
+    if (states_size > 0) {
+        memcpy(&buf[IMS_CHECKPOINT_HEADER_SIZE], ckpt->states, states_size);
+    }
+    put_le32(&buf[size - 4], crc32c(0, buf, size - 4));
+
+    /* Write it aside, then rename it over the old one */
+    fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if ((fd == -1) || (write(fd, buf, size) != (ssize_t)size) ||
+        (fsync(fd) != 0)) {
+        status = errno? errno : EIO;
+    }
+    if ((fd != -1) && (close(fd) != 0) && (status == 0)) {
+        status = errno;
+    }
+    if ((status == 0) && (rename(tmp_name, filename) != 0)) {
+        status = errno;
+    }
+    if (status == 0) {
+        sync_parent_dir(filename);
+    } else {
+        fprintf(stderr, "ERROR: Can't write checkpoint '%s' (err %d)\n",
+                filename, status);
+        unlink(tmp_name);
+    }
+
+    memset(buf, 0, size);
+    free(buf);
+    free(tmp_name);
+    return status;
+}
+
+
+/**
+ * @brief Read a checkpoint file
+ *
+ * @param filename The checkpoint file
+ * @param ckpt The checkpoint to fill in (free with ims_checkpoint_free)
+ *
+ * @returns Zero if successful, ENOENT if there is no checkpoint, EIO if it
+ *          is unreadable or corrupt.
+ */
+int ims_checkpoint_read(const char * filename, ims_checkpoint * ckpt) {
+    int status = 0;
+    uint8_t header[IMS_CHECKPOINT_HEADER_SIZE];
+    uint8_t crc[4];
+    uint32_t num_states;
+    uint32_t running_crc;
+    size_t states_size;
+    FILE * fp;
+
+    memset(ckpt, 0, sizeof(*ckpt));
+    fp = fopen(filename, "rb");
+    if (!fp) {
+        return (errno == ENOENT)? ENOENT : EIO;
+    }
+
+    if ((fread(header, sizeof(header), 1, fp) != 1) ||
+        (memcmp(header, IMS_CHECKPOINT_MAGIC,
+                IMS_CHECKPOINT_MAGIC_SIZE) != 0) ||
+        (get_le32(&header[CKPT_VERSION]) != IMS_CHECKPOINT_VERSION) ||
+        (get_le32(&header[CKPT_STATE_SIZE]) != sizeof(csprng)) ||
+        (get_le32(&header[CKPT_NUM_STATES]) > CKPT_MAX_STATES)) {
+        status = EIO;
+    } else {
+        num_states = get_le32(&header[CKPT_NUM_STATES]);
+        states_size = num_states * sizeof(csprng);
+        status = ims_checkpoint_alloc(ckpt, num_states);
+        if ((status == 0) && (states_size > 0) &&
+            (fread(ckpt->states, states_size, 1, fp) != 1)) {
+            status = EIO;
+        }
+        if ((status == 0) && (fread(crc, sizeof(crc), 1, fp) != 1)) {
+            status = EIO;
+        }
+        if (status == 0) {
+            running_crc = crc32c(0, header, sizeof(header));
+            running_crc = crc32c(running_crc, (uint8_t *)ckpt->states,
+                                 states_size);
+            if (get_le32(crc) != running_crc) {
+                status = EIO;
+            }
+        }
+    }
+    fclose(fp);
+
+    if (status == 0) {
+        ckpt->flags = get_le32(&header[CKPT_FLAGS]);
+        memcpy(ckpt->seed_digest, &header[CKPT_SEED_DIGEST],
+               sizeof(ckpt->seed_digest));
+        ckpt->num_ims = get_le32(&header[CKPT_NUM_IMS]);
+        ckpt->num_jobs = get_le32(&header[CKPT_NUM_JOBS]);
+        ckpt->first_index = get_le64(&header[CKPT_FIRST_INDEX]);
+        ckpt->base_keysets = get_le64(&header[CKPT_BASE_KEYSETS]);
+        ckpt->count = get_le32(&header[CKPT_COUNT]);
+        ckpt->ims_offset = get_le64(&header[CKPT_IMS_OFFSET]);
+    } else {
+        fprintf(stderr, "ERROR: Checkpoint '%s' is corrupt\n", filename);
+        ims_checkpoint_free(ckpt);
+        status = EIO;
+    }
+    return status;
+}
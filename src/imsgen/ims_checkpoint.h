@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the header information for imsgen's run
+ * checkpoints, from which "imsgen --resume" continues an interrupted run.
+ *
+ * A checkpoint records how many IMS values are committed to the database
+ * and on disk in the IMS file, and the PRNG state(s) that generate the
+ * next ones. It is replaced atomically (written to a temporary file, synced
+ * and renamed over the old one).
+ *
+ * Checkpoint file layout (all integers little-endian):
+ *
+ *    0  magic "IMSCKPT\n"
+ *    8  u32 version (1)
+ *   12  u32 flags (IMS_CHECKPOINT_*)
+ *   16  32 bytes: digest identifying the PRNG seed
+ *   48  u32 IMS values in the run
+ *   52  u32 generator threads
+ *   56  u64 first IMS index
+ *   64  u64 keysets in the database before the run
+ *   72  u32 IMS values committed and written
+ *   76  u32 number of PRNG states
+ *   80  u64 IMS file size holding them
+ *   88  u32 size of a PRNG state
+ *   92  PRNG states
+ *       u32 CRC32C of everything before it
+ *
+ */
+
+#ifndef _IMS_CHECKPOINT_H
+#define _IMS_CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IMS_CHECKPOINT_MAGIC        "IMSCKPT\n"
+#define IMS_CHECKPOINT_MAGIC_SIZE   8
+#define IMS_CHECKPOINT_VERSION      1
+#define IMS_CHECKPOINT_HEADER_SIZE  92
+
+/* What made the run: these must match for a run to be resumed */
+#define IMS_CHECKPOINT_INDEXED      0x00000001
+#define IMS_CHECKPOINT_REJECTION    0x00000002
+#define IMS_CHECKPOINT_COMPAT       0x00000004
+#define IMS_CHECKPOINT_BINARY       0x00000008
+
+/* The checkpoint file name is the IMS file name with this suffix */
+#define IMS_CHECKPOINT_SUFFIX       ".ckpt"
+
+
+/**
+ * @brief An imsgen run checkpoint
+ */
+typedef struct {
+    /* The run */
+    uint32_t  flags;
+    uint8_t   seed_digest[SHA256_HASH_DIGEST_SIZE];
+    uint32_t  num_ims;
+    uint32_t  num_jobs;
+    uint64_t  first_index;
+    uint64_t  base_keysets;
+
+    /* Its progress */
+    uint32_t  count;
+    uint64_t  ims_offset;
+    uint32_t  num_states;
+    csprng *  states;
+} ims_checkpoint;
+
+
+/**
+ * @brief Allocate a checkpoint's PRNG states
+ *
+ * @param ckpt The checkpoint
+ * @param num_states The number of PRNG states it holds
+ *
+ * @returns Zero if successful, ENOMEM otherwise.
+ */
+int ims_checkpoint_alloc(ims_checkpoint * ckpt, uint32_t num_states);
+
+
+/**
+ * @brief Free a checkpoint's PRNG states
+ *
+ * @param ckpt The checkpoint
+ */
+void ims_checkpoint_free(ims_checkpoint * ckpt);
+
+
+/**
+ * @brief Atomically replace a checkpoint file
+ *
+ * @param filename The checkpoint file
+ * @param ckpt The checkpoint to write
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_checkpoint_write(const char * filename, const ims_checkpoint * ckpt);
+
+
+/**
+ * @brief Read a checkpoint file
+ *
+ * @param filename The checkpoint file
+ * @param ckpt The checkpoint to fill in (free with ims_checkpoint_free)
+ *
+ * @returns Zero if successful, ENOENT if there is no checkpoint, EIO if it
+ *          is unreadable or corrupt.
+ */
+int ims_checkpoint_read(const char * filename, ims_checkpoint * ckpt);
+
+#endif /* !_IMS_CHECKPOINT_H */
@@ -49,6 +49,7 @@
 #include <libgen.h>
 #include <openssl/conf.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/err.h>
 #include <openssl/pem.h>
 #include <openssl/rsa.h>
@@ -60,6 +61,7 @@
 #include "mcl_ecdh.h"
 #include "mcl_rand.h"
 #include "mcl_rsa.h"
+#include "ims_mcl.h"
 #include "crypto.h"
 #include "db.h"
 #include "ims_common.h"
@@ -74,13 +76,25 @@
 /* The maximum number of bytes to read from a prng_seed_file */
 #define DEFAULT_PRNG_SEED_LENGTH    128
 
-/* The PRNG seed is stored in this buffer */
-uint8_t  prng_seed_buffer[EVP_MAX_MD_SIZE];
-mcl_octet prng_seed = {0, sizeof(prng_seed_buffer), prng_seed_buffer};
+/* How many IMS values calculate_epuids() hashes side by side */
+#define EPUID_MAX_LANES             16
+
+/* 32-bit words of the IMS hashed into Y1, and of 0x01s into Z0 */
+#define EPUID_Y1_WORDS              4
+#define EPUID_Z0_WORDS              8
+
+/* KDF label for the per-index PRNG sub-seeds */
+#define IMS_INDEX_KDF_LABEL         "imsgen IMS index"
 
+/* Domain separator for the checkpoint seed digest */
+#define IMS_SEED_DIGEST_LABEL       "imsgen checkpoint seed"
 
-/* Cryptographically Secure Random Number Generator */
-csprng  rng;        /* Generic */
+/* True once ims_fixed_base_init() has built the EPVK/ESVK generator tables */
+static bool     fixed_base;
+
+/* The master PRNG seed is stored in this buffer */
+static uint8_t  prng_seed_buffer[EVP_MAX_MD_SIZE];
+mcl_octet prng_seed = {0, sizeof(prng_seed_buffer), prng_seed_buffer};
 
 
 /* SHA256 working variable */
@@ -91,93 +105,359 @@ typedef struct {
 } sha256;
 
 
-/* IMS working set */
-#define IMS_SIZE            35
-#define IMS_HAMMING_SIZE    32
-#define IMS_HAMMING_WEIGHT  (IMS_HAMMING_SIZE * 8 / 2)
-uint8_t  ims[IMS_SIZE];     /* TODO: convert to an octet for consistency? */
+static int get_prng_seed(const char * prng_seed_file,
+                  const char * prng_seed_string);
+
+
+/**
+ * @brief Perform any common IMS initialization
+ *
+ * @param prng_seed_file Filename from which to read the seed
+ * @param prng_seed_string Raw seed string
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_common_init(const char * prng_seed_file,
+                    const char * prng_seed_string) {
+    /**
+     * Pick the SHA-256 kernels now: MIRACL otherwise resolves them on the
+     * first hash, and that write would race between generator threads.
+     */
+    MCL_HASH256_kernel(MCL_HASH_KERNEL_AUTO);
+    MCL_HASH256_multi_kernel(MCL_HASH_MULTI_AUTO);
+
+    /**
+     * Obtain the master seed. The cryptographically strong random number
+     * generators are seeded from it per-context (see ims_context_init).
+     */
+    return get_prng_seed(prng_seed_file, prng_seed_string);
+}
+
 
-/* Endpoint Unique ID (EP_UID) working set */
-uint8_t  ep_uid_buf[EP_UID_SIZE];
-mcl_octet ep_uid = {0, sizeof(ep_uid_buf), ep_uid_buf};
+/**
+ * @brief Build the fixed-base generator tables for EPVK/ESVK generation
+ *
+ * From then on calc_epvk() and calc_esvk() compute the public key from a
+ * precomputed table of multiples of the curve generator (one table lookup
+ * and one point addition per 4-bit digit of the private key) instead of a
+ * generic scalar multiplication. The keys are bit-identical either way.
+ * Since the table only holds multiples of the generator, every key it
+ * yields is in the prime-order subgroup by construction. Validation is
+ * therefore reduced to the range and on-curve checks, which still catch a
+ * faulty computation, and the multiplication by the group order is
+ * skipped.
+ *
+ * Not thread safe: call once, before any keys are generated. The verifier
+ * deliberately doesn't call it, so it cross-checks the tables with the
+ * generic multiplication and full validation.
+ */
+void ims_fixed_base_init(void) {
+    int epvk_table = MCL_ECP_FIXED_BASE_INIT_C488();
+    int esvk_table = MCL_ECP_FIXED_BASE_INIT_C25519();
 
+    fixed_base = epvk_table && esvk_table;
+}
 
-/* Hash value used in calculating EPSK, MPDK ERRK */
-uint8_t  y2[Y2_SIZE];       /* TODO: convert to an octet for consistency? */
 
-/* Scratch octet for generating terms to feed sha256 */
-uint8_t  scratch_buf[128];
-mcl_octet scratch = {0, sizeof(scratch_buf), scratch_buf};
+/**
+ * @brief Perform any common IMS de-initialization
+ */
+void ims_common_deinit(void) {
+    /* Scrub the master seed */
+    memset(prng_seed_buffer, 0, sizeof(prng_seed_buffer));
+    prng_seed.len = 0;
+}
 
 
-/* Endpoint Primary Signing/Verification Keys (EPSK, EPVK) */
-uint8_t  epsk_buf[EPSK_SIZE];
-mcl_octet epsk = {0, sizeof(epsk_buf), epsk_buf};
+/**
+ * @brief Point an octet at its (empty) backing buffer
+ *
+ * @param octet The octet to wire up
+ * @param buf The backing buffer
+ * @param max The size of buf in bytes
+ */
+static void wire_octet(mcl_octet * octet, uint8_t * buf, int max) {
+    octet->len = 0;
+    octet->max = max;
+    octet->val = (char *)buf;
+}
 
-uint8_t  epvk_buf[EPVK_SIZE];
-mcl_octet epvk = {0, sizeof(epvk_buf), epvk_buf};
 
+/**
+ * @brief Point a context's octets at their backing buffers
+ *
+ * @param ctx The context to wire up
+ */
+static void ims_context_wire(ims_context * ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+
+    wire_octet(&ctx->ep_uid, ctx->ep_uid_buf, sizeof(ctx->ep_uid_buf));
+    wire_octet(&ctx->epsk, ctx->epsk_buf, sizeof(ctx->epsk_buf));
+    wire_octet(&ctx->epvk, ctx->epvk_buf, sizeof(ctx->epvk_buf));
+    wire_octet(&ctx->essk, ctx->essk_buf, sizeof(ctx->essk_buf));
+    wire_octet(&ctx->esvk, ctx->esvk_buf, sizeof(ctx->esvk_buf));
+    wire_octet(&ctx->errk_p, ctx->errk_p_buf, sizeof(ctx->errk_p_buf));
+    wire_octet(&ctx->errk_q, ctx->errk_q_buf, sizeof(ctx->errk_q_buf));
+    wire_octet(&ctx->erpk_mod, ctx->erpk_mod_buf, sizeof(ctx->erpk_mod_buf));
+    wire_octet(&ctx->errk_d, ctx->errk_d_buf, sizeof(ctx->errk_d_buf));
+}
 
-/* Endpoint Secondary Signing/Verification Keys (ESSK/ESVK) */
-uint8_t  essk_buf[ESSK_SIZE];
-mcl_octet essk = {0, sizeof(essk_buf), essk_buf};
-uint8_t  esvk_buf[ESVK_SIZE];
-mcl_octet esvk = {0, sizeof(esvk_buf), esvk_buf};
 
+/**
+ * @brief Initialize an IMS working context
+ *
+ * Wires up the context's octets and seeds its PRNG from the master seed,
+ * exactly as the single-threaded imsgen always has (stream 0).
+ *
+ * @param ctx The context to initialize
+ */
+void ims_context_init(ims_context * ctx) {
+    ims_context_wire(ctx);
+    MCL_RAND_seed(&ctx->rng, prng_seed.len, prng_seed.val);
+}
 
 
-/* Endpoint Rsa pRivate Key (ERRK/ERPK) */
-uint8_t errk_pbuf[ERRK_PQ_SIZE];
-mcl_octet errk_p = {0, sizeof(errk_pbuf), errk_pbuf};
+/**
+ * @brief Initialize an IMS working context with a derived PRNG stream
+ *
+ * Like ims_context_init(), but seeds the PRNG with
+ * sha256(master_seed || label || index) so that every worker gets its own
+ * independent, reproducible stream.
+ *
+ * @param ctx The context to initialize
+ * @param label A short ASCII tag naming the stream family (e.g. "worker")
+ * @param index The stream number within that family
+ */
+void ims_context_init_stream(ims_context * ctx,
+                             const char * label,
+                             uint32_t index) {
+    uint8_t index_be[4];
+    uint8_t stream_seed[SHA256_HASH_DIGEST_SIZE];
 
-uint8_t errk_qbuf[ERRK_PQ_SIZE];
-mcl_octet errk_q = {0, sizeof(errk_qbuf), errk_qbuf};
+    ims_context_wire(ctx);
 
-uint8_t  erpk_mod_buf[ERRK_PQ_SIZE*2];
-mcl_octet erpk_mod = {0, sizeof(erpk_mod_buf), erpk_mod_buf};
+    index_be[0] = (uint8_t)(index >> 24);
+    index_be[1] = (uint8_t)(index >> 16);
+    index_be[2] = (uint8_t)(index >> 8);
+    index_be[3] = (uint8_t)(index);
 
-uint8_t  errk_d_buf[RSA2048_PUBLIC_KEY_SIZE];
-mcl_octet errk_d = {0, sizeof(errk_d_buf), errk_d_buf};
+    hash_start();
+    hash_update((uint8_t *)prng_seed.val, prng_seed.len);
+    hash_update((const uint8_t *)label, strlen(label));
+    hash_update(index_be, sizeof(index_be));
+    hash_final(stream_seed);
 
-#define ERPK_EXPONENT   65537
-mcl_chunk p_ff[MCL_HFLEN][MCL_BS];
-mcl_chunk q_ff[MCL_HFLEN][MCL_BS];
+    MCL_RAND_seed(&ctx->rng, sizeof(stream_seed), (char *)stream_seed);
+    memset(stream_seed, 0, sizeof(stream_seed));
+}
 
-MCL_rsa_private_key rsa_private;
-MCL_rsa_public_key  rsa_public;
 
-static int get_prng_seed(const char * prng_seed_file,
-                  const char * prng_seed_string);
+/**
+ * @brief Identify the master seed without revealing it
+ *
+ * @param digest The SHA256_HASH_DIGEST_SIZE-byte output:
+ *        sha256(IMS_SEED_DIGEST_LABEL || master_seed)
+ */
+void ims_seed_digest(uint8_t * digest) {
+    hash_start();
+    hash_update((const uint8_t *)IMS_SEED_DIGEST_LABEL,
+                sizeof(IMS_SEED_DIGEST_LABEL));
+    hash_update((uint8_t *)prng_seed.val, prng_seed.len);
+    hash_final(digest);
+}
 
 
 /**
- * @brief Perform any common IMS initialization
+ * @brief Reseed an IMS working context for a single IMS index
  *
- * @param prng_seed_file Filename from which to read the seed
- * @param prng_seed_string Raw seed string
+ * The sub-seed is the SP 800-108 counter-mode KDF (HMAC-SHA256 PRF) of the
+ * master seed, with the fixed label IMS_INDEX_KDF_LABEL and the index as
+ * context:
  *
- * @returns Zero if successful, errno otherwise.
+ *   HMAC(master_seed, [1]_32 || label || 0x00 || [index]_64 || [256]_32)
+ *
+ * so IMS number k can be regenerated without replaying IMS 0..k-1.
+ *
+ * @param ctx The (initialized) context to reseed
+ * @param index The IMS index
  */
-int ims_common_init(const char * prng_seed_file,
-                    const char * prng_seed_string) {
-    int status = 0;
+void ims_context_seed_index(ims_context * ctx, uint64_t index) {
+    uint8_t kdf_input[4 + sizeof(IMS_INDEX_KDF_LABEL) + 8 + 4];
+    uint8_t sub_seed[SHA256_HASH_DIGEST_SIZE];
+    unsigned int sub_seed_length = sizeof(sub_seed);
+    uint8_t * p = kdf_input;
+    int i;
 
-    /* Initialize the cryptographically strong random number generators */
-    status = get_prng_seed(prng_seed_file, prng_seed_string);
-    if (status == 0) {
-        MCL_RAND_seed(&rng, prng_seed.len, prng_seed.val);
+    /* Counter (a single block) */
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = 1;
+    /* Label, including its NUL as the separator */
+    memcpy(p, IMS_INDEX_KDF_LABEL, sizeof(IMS_INDEX_KDF_LABEL));
+    p += sizeof(IMS_INDEX_KDF_LABEL);
+    /* Context: the big-endian index */
+    for (i = 7; i >= 0; i--) {
+        *p++ = (uint8_t)(index >> (i * 8));
     }
+    /* Output length in bits */
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = (uint8_t)((sizeof(sub_seed) * 8) >> 8);
+    *p++ = (uint8_t)(sizeof(sub_seed) * 8);
 
-    return status;
+    HMAC(EVP_sha256(), prng_seed.val, prng_seed.len,
+         kdf_input, sizeof(kdf_input), sub_seed, &sub_seed_length);
+
+    MCL_RAND_seed(&ctx->rng, sizeof(sub_seed), (char *)sub_seed);
+    memset(sub_seed, 0, sizeof(sub_seed));
 }
 
 
 /**
- * @brief Perform any common IMS de-initialization
+ * @brief Scrub an IMS working context
+ *
+ * @param ctx The context to scrub
  */
-void ims_common_deinit(void) {
-    /* De-initialize the cryptographically strong random number generators */
-    MCL_RAND_clean(&rng);
+void ims_context_deinit(ims_context * ctx) {
+    /* De-initialize the cryptographically strong random number generator */
+    MCL_RAND_clean(&ctx->rng);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+
+/**
+ * Random bits drawn a byte at a time from a context's PRNG, MSb first
+ */
+typedef struct {
+    csprng *   rng;
+    uint32_t   byte;
+    uint32_t   bits_left;
+    uint64_t * rand_bytes;
+} bit_pool;
+
+
+/**
+ * @brief Draw the next random bit from a bit pool
+ */
+static uint32_t bit_pool_next(bit_pool * pool) {
+    if (pool->bits_left == 0) {
+        pool->byte = MCL_RAND_byte(pool->rng) & 0xff;
+        pool->bits_left = 8;
+        if (pool->rand_bytes) {
+            (*pool->rand_bytes)++;
+        }
+    }
+    pool->bits_left--;
+    return (pool->byte >> pool->bits_left) & 1;
+}
+
+
+/**
+ * @brief Draw an exact Bernoulli(k/n) bit
+ *
+ * Compares a uniform U in [0, 1), read lazily one random bit at a time,
+ * against the binary expansion of k/n; the first bit where they differ
+ * decides U < k/n. The result is exact (no rounding of k/n) and costs two
+ * random bits on average.
+ *
+ * @param pool The source of random bits
+ * @param k The numerator (0 <= k <= n)
+ * @param n The denominator (n > 0)
+ *
+ * @returns 1 with probability k/n, 0 otherwise.
+ */
+static uint32_t bernoulli_ratio(bit_pool * pool, uint32_t k, uint32_t n) {
+    uint32_t remainder = k;
+    uint32_t p_bit;
+    uint32_t u_bit;
+
+    if (k == 0) {
+        return 0;
+    }
+    if (k >= n) {
+        return 1;
+    }
+
+    for (;;) {
+        /* Next bit of k/n by long division */
+        remainder <<= 1;
+        p_bit = (remainder >= n);
+        if (p_bit) {
+            remainder -= n;
+        }
+
+        u_bit = bit_pool_next(pool);
+        if (u_bit != p_bit) {
+            return p_bit;
+        }
+        if (remainder == 0) {
+            /* k/n is exhausted and U matches it so far, so U >= k/n */
+            return 0;
+        }
+    }
+}
+
+
+/**
+ * @brief Sample a uniformly random bit string of a fixed Hamming weight
+ *
+ * Selection sampling (Knuth, TAOCP vol. 2, algorithm 3.4.2S): walk the bit
+ * positions MSb first, and set each with probability (bits still to set) /
+ * (positions left). Every string of the given weight comes out with
+ * probability exactly 1 / C(num_bits, weight), and no draw is ever thrown
+ * away: a 256-bit, weight-128 string costs about 61 PRNG bytes, against
+ * about 20 draws of 32 bytes (about 640) for ims_sample_rejection().
+ *
+ * @param rng The PRNG to draw from
+ * @param buf The output buffer (num_bits / 8 bytes, MSb first)
+ * @param num_bits The length of the string in bits (a multiple of 8)
+ * @param weight The Hamming weight required
+ * @param rand_bytes If non-NULL, incremented by the PRNG bytes consumed
+ */
+void ims_sample_constant_weight(csprng * rng, uint8_t * buf,
+                                uint32_t num_bits, uint32_t weight,
+                                uint64_t * rand_bytes) {
+    bit_pool pool = {rng, 0, 0, rand_bytes};
+    uint32_t bit;
+
+    memset(buf, 0, num_bits / 8);
+    for (bit = 0; bit < num_bits; bit++) {
+        if (bernoulli_ratio(&pool, weight, num_bits - bit)) {
+            buf[bit / 8] |= BYTE_MASK_MSB >> (bit % 8);
+            weight--;
+        }
+    }
+}
+
+
+/**
+ * @brief Sample a bit string of a fixed Hamming weight by rejection
+ *
+ * The original IMS candidate sampler: draw fresh random bytes until their
+ * Hamming weight is right. Kept so that the 100-IMS sample compatibility
+ * mode (and runs made before ims_sample_constant_weight) can be
+ * reproduced.
+ *
+ * @param rng The PRNG to draw from
+ * @param buf The output buffer (num_bits / 8 bytes)
+ * @param num_bits The length of the string in bits (a multiple of 8)
+ * @param weight The Hamming weight required
+ * @param rand_bytes If non-NULL, incremented by the PRNG bytes consumed
+ */
+void ims_sample_rejection(csprng * rng, uint8_t * buf,
+                          uint32_t num_bits, uint32_t weight,
+                          uint64_t * rand_bytes) {
+    uint32_t i;
+
+    do {
+        for (i = 0; i < num_bits / 8; i++) {
+            buf[i] = MCL_RAND_byte(rng);
+        }
+        if (rand_bytes) {
+            *rand_bytes += num_bits / 8;
+        }
+    } while (hamming_weight(buf, num_bits / 8) != weight);
 }
 
 
@@ -208,7 +488,7 @@ static int get_prng_seed(const char * prng_seed_file,
         fd = open("/dev/urandom", O_RDONLY);
         if (fd <= -1) {
             fprintf(stderr, "ERROR: Unable to open '%s'(err %d)\n", prng_seed_file, errno);
-            raw_seed_buffer_length = -1;
+            return errno;
         } else {
             raw_seed_buffer_length = read(fd, raw_seed_buffer, sizeof(raw_seed_buffer));
             prng_seed_string = raw_seed_buffer;
@@ -221,13 +501,13 @@ static int get_prng_seed(const char * prng_seed_file,
 
     /* Hash the string obtained above to get the PRNG seed */
     if (!prng_seed_string || (raw_seed_buffer_length < 1)) {
-        errno = EINVAL;
+        status = EINVAL;
     } else {
         hash_it(prng_seed_string, raw_seed_buffer_length, prng_seed.val);
         prng_seed.len = SHA256_HASH_DIGEST_SIZE;
     }
 
-    return errno;
+    return status;
 }
 
 
@@ -257,44 +537,138 @@ void sha256_concat(uint8_t * digest_x,
 
 
 /**
- * @brief Calculate the EP_UID from the IMS (ES3 version)
+ * @brief Implement several "X[i] = sha256(Y || copy(b[i], n))" at once
  *
- * A mistake in ES3 boot ROM makes the EPUID of ES3 different
- * than the spec says. We must use this for the foreseeable future
+ * The terms share Y and n, so they have the same length and are hashed
+ * side by side by hash_multi().
  *
- * @param ims_value A pointer to the 35-byte IMS value
- * @param ep_uid A pointer to the octet EP_UID output value
+ * @param digest_x Array of count pointers to the output digest buffers
+ * @param hash_y Pointer to the input digest ("Y" above)
+ * @param extend_bytes Array of count extension bytes ("b" above)
+ * @param extend_count The number of extension bytes to concatenate ("n"
+ *        above), at most SHA256_CONCAT_MAX_EXTEND
+ * @param count The number of digests to generate
  */
-void calculate_epuid_es3(uint8_t * ims_value,
-                         mcl_octet * ep_uid) {
-    /* same code used in ES3 boot ROM to generate the EUID */
+void sha256_concat_multi(uint8_t ** digest_x,
+                         uint8_t * hash_y,
+                         const uint8_t * extend_bytes,
+                         uint32_t extend_count,
+                         int count) {
+    uint8_t scratch_buf[SHA256_CONCAT_MAX_TERMS]
+                       [SHA256_HASH_DIGEST_SIZE + SHA256_CONCAT_MAX_EXTEND];
+    const uint8_t * terms[SHA256_CONCAT_MAX_TERMS];
+    int batch;
     int i;
-    uint8_t ep_uid_calc[SHA256_HASH_DIGEST_SIZE];
-    uint8_t y1[SHA256_HASH_DIGEST_SIZE];
-    uint8_t z0[SHA256_HASH_DIGEST_SIZE];
-    uint32_t temp;
-    uint32_t *pims = (uint32_t *)ims_value;
 
-    hash_start();
-    /*** grab IMS 4 bytes at a time and feed that to hash_update */
-    for (i = 0; i < 4; i++) {
-        temp = pims[i] ^ 0x3d3d3d3d;
-        hash_update((uint8_t *)&temp, 1);
+    while (count > 0) {
+        batch = (count < SHA256_CONCAT_MAX_TERMS)?
+                count : SHA256_CONCAT_MAX_TERMS;
+        for (i = 0; i < batch; i++) {
+            memcpy(scratch_buf[i], hash_y, SHA256_HASH_DIGEST_SIZE);
+            memset(&scratch_buf[i][SHA256_HASH_DIGEST_SIZE], extend_bytes[i],
+                   extend_count);
+            terms[i] = scratch_buf[i];
+        }
+        hash_multi(terms, SHA256_HASH_DIGEST_SIZE + extend_count,
+                   digest_x, batch);
+        digest_x += batch;
+        extend_bytes += batch;
+        count -= batch;
     }
-    hash_final(y1);
+}
 
-    hash_start();
-    hash_update(y1, SHA256_HASH_DIGEST_SIZE);
-    temp = 0x01010101;
-    for (i = 0; i < 8; i++) {;
-        hash_update((uint8_t *)&temp, 1);
+
+/**
+ * @brief Calculate the EP_UIDs of several IMS values at once
+ *
+ * The EP_UID is a chain of three hashes:
+ *
+ *  Y1 = sha256(IMS[0:15] xor copy(0x3d, 16))
+ *  Z0 = sha256(Y1 || copy(0x01, 32))
+ *  EP_UID = sha256(Z0)[0:7]
+ *
+ * The chain itself is serial, so each step is run across all of the IMS
+ * values side by side with hash_multi().
+ *
+ * A mistake in ES3 boot ROM makes the EPUID of ES3 different than the spec
+ * says: it only hashes the first byte of each 4-byte word, so Y1 is over
+ * 4 bytes and Z0 over 8 bytes of 0x01. We must use this for the
+ * foreseeable future.
+ *
+ * @param ims_values Array of count pointers to the 35-byte IMS values
+ * @param ep_uids Array of count pointers to the octet EP_UID output values
+ * @param count The number of IMS values
+ * @param es3 If true, use the ES3 boot ROM form, otherwise the correct form
+ */
+void calculate_epuids(uint8_t ** ims_values,
+                      mcl_octet ** ep_uids,
+                      int count,
+                      bool es3) {
+    uint8_t y1_in[EPUID_MAX_LANES][EPUID_Y1_WORDS * sizeof(uint32_t)];
+    uint8_t z0_in[EPUID_MAX_LANES][SHA256_HASH_DIGEST_SIZE +
+                                   EPUID_Z0_WORDS * sizeof(uint32_t)];
+    uint8_t digest_buf[EPUID_MAX_LANES][SHA256_HASH_DIGEST_SIZE];
+    const uint8_t * terms[EPUID_MAX_LANES];
+    uint8_t * digests[EPUID_MAX_LANES];
+    size_t word_size = (es3)? 1 : sizeof(uint32_t);
+    int batch;
+    int i;
+    int j;
+
+    while (count > 0) {
+        batch = (count < EPUID_MAX_LANES)? count : EPUID_MAX_LANES;
+
+        /* Y1: the IMS words xor 0x3d3d3d3d (ES3: just their first byte) */
+        for (i = 0; i < batch; i++) {
+            for (j = 0; j < EPUID_Y1_WORDS * word_size; j++) {
+                y1_in[i][j] = ims_values[i][(j / word_size) * sizeof(uint32_t) +
+                                            (j % word_size)] ^ 0x3d;
+            }
+            terms[i] = y1_in[i];
+            digests[i] = z0_in[i];
+        }
+        hash_multi(terms, EPUID_Y1_WORDS * word_size, digests, batch);
+
+        /* Z0 = Y1 || 0x01010101 words (ES3: bytes) */
+        for (i = 0; i < batch; i++) {
+            memset(&z0_in[i][SHA256_HASH_DIGEST_SIZE], 0x01,
+                   EPUID_Z0_WORDS * word_size);
+            terms[i] = z0_in[i];
+            digests[i] = digest_buf[i];
+        }
+        hash_multi(terms, SHA256_HASH_DIGEST_SIZE + EPUID_Z0_WORDS * word_size,
+                   digests, batch);
+
+        /* EP_UID = sha256(Z0) */
+        for (i = 0; i < batch; i++) {
+            memcpy(z0_in[i], digest_buf[i], SHA256_HASH_DIGEST_SIZE);
+            terms[i] = z0_in[i];
+        }
+        hash_multi(terms, SHA256_HASH_DIGEST_SIZE, digests, batch);
+
+        for (i = 0; i < batch; i++) {
+            memcpy(ep_uids[i]->val, digest_buf[i], EP_UID_SIZE);
+            ep_uids[i]->len = EP_UID_SIZE;
+        }
+        ims_values += batch;
+        ep_uids += batch;
+        count -= batch;
     }
-    hash_final(z0);
+}
 
-    hash_it(z0, SHA256_HASH_DIGEST_SIZE, ep_uid_calc);
 
-    memcpy(ep_uid->val, ep_uid_calc, EP_UID_SIZE);
-    ep_uid->len = EP_UID_SIZE;
+/**
+ * @brief Calculate the EP_UID from the IMS (ES3 version)
+ *
+ * A mistake in ES3 boot ROM makes the EPUID of ES3 different
+ * than the spec says. We must use this for the foreseeable future
+ *
+ * @param ims_value A pointer to the 35-byte IMS value
+ * @param ep_uid A pointer to the octet EP_UID output value
+ */
+void calculate_epuid_es3(uint8_t * ims_value,
+                         mcl_octet * ep_uid) {
+    calculate_epuids(&ims_value, &ep_uid, 1, true);
 }
 
 
@@ -309,34 +683,7 @@ void calculate_epuid_es3(uint8_t * ims_value,
  */
 void calculate_epuid(uint8_t * ims_value,
                      mcl_octet * ep_uid) {
-    /* same code used in ES3 boot ROM to generate the EUID */
-    int i;
-    static uint8_t ep_uid_calc[SHA256_HASH_DIGEST_SIZE];
-    static uint8_t y1[SHA256_HASH_DIGEST_SIZE];
-    static uint8_t z0[SHA256_HASH_DIGEST_SIZE];
-    uint32_t temp;
-    uint32_t *pims = (uint32_t *)ims_value;
-
-    hash_start();
-    /* grab IMS 4 bytes at a time and feed that to hash_update */
-    for (i = 0; i < 4; i++) {
-        temp = pims[i] ^ 0x3d3d3d3d;
-        hash_update((uint8_t *)&temp, sizeof(temp));
-    }
-    hash_final(y1);
-
-    hash_start();
-    hash_update(y1, SHA256_HASH_DIGEST_SIZE);
-    temp = 0x01010101;
-    for (i = 0; i < 8; i++) {;
-        hash_update((uint8_t *)&temp, sizeof(temp));
-    }
-    hash_final(z0);
-
-    hash_it(z0, SHA256_HASH_DIGEST_SIZE, ep_uid_calc);
-
-    memcpy(ep_uid->val, ep_uid_calc, EP_UID_SIZE);
-    ep_uid->len = EP_UID_SIZE;
+    calculate_epuids(&ims_value, &ep_uid, 1, false);
 }
 
 
@@ -368,9 +715,10 @@ void calculate_y2(uint8_t * ims_value, uint8_t * y2) {
  * @param epsk A pointer to the output EPSK variable
  */
 void calc_epsk(uint8_t * y2, mcl_octet * epsk) {
+    static const uint8_t epsk_terms[] = {0x01, 0x02};
     uint8_t z1[SHA256_HASH_DIGEST_SIZE];
     uint8_t scratch_hash[SHA256_HASH_DIGEST_SIZE];
-    int status;
+    uint8_t * digests[] = {&epsk->val[0], scratch_hash};
 
     /**
      *  Y2 = sha256(IMS[0:31] xor copy(0x5a, 32))  // (provided)
@@ -380,10 +728,7 @@ void calc_epsk(uint8_t * y2, mcl_octet * epsk) {
      */
     sha256_concat(z1, y2, 0x01, 32);
 
-    sha256_concat(scratch_hash, z1, 0x01, 32);
-    memcpy(&epsk->val[0], scratch_hash, SHA256_HASH_DIGEST_SIZE);
-
-    sha256_concat(scratch_hash, z1, 0x02, 32);
+    sha256_concat_multi(digests, z1, epsk_terms, 32, 2);
     memcpy(&epsk->val[SHA256_HASH_DIGEST_SIZE],
            scratch_hash,
            (EPSK_SIZE - SHA256_HASH_DIGEST_SIZE));
@@ -406,8 +751,8 @@ int calc_epvk(mcl_octet * epsk, mcl_octet * epvk) {
     int status = 0;
 
     /* Generate the corresponding EPVK public key, an Ed488-Goldilocks ECC */
-    MCL_ECP_KEY_PAIR_GENERATE_C488(NULL, epsk, epvk);
-    status = MCL_ECP_PUBLIC_KEY_VALIDATE_C488(1, epvk);
+    MCL_ECP_KEY_PAIR_GENERATE_FIXED_C488(NULL, epsk, epvk);
+    status = MCL_ECP_PUBLIC_KEY_VALIDATE_C488(!fixed_base, epvk);
     if (status != 0) {
         printf("EPVK is invalid!\r\n");
     }
@@ -472,8 +817,8 @@ int calc_esvk(mcl_octet * essk, mcl_octet * esvk) {
     int status = 0;
 
     /* Generate the corresponding EPVK public key, a djb25519 ECC */
-    MCL_ECP_KEY_PAIR_GENERATE_C25519(NULL, essk, esvk);
-    status = MCL_ECP_PUBLIC_KEY_VALIDATE_C25519(1, esvk);
+    MCL_ECP_KEY_PAIR_GENERATE_FIXED_C25519(NULL, essk, esvk);
+    status = MCL_ECP_PUBLIC_KEY_VALIDATE_C25519(!fixed_base, esvk);
     if (status != 0) {
         printf("EPVK is invalid!\r\n");
     }
@@ -507,8 +852,14 @@ void calc_errk_pq_bias_odd(uint8_t * y2,
                            mcl_octet * errk_p,
                            mcl_octet * errk_q,
                            bool ims_sample_compatibility) {
-    int status = 0;
+    static const uint8_t errk_terms[] = {
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+    };
     uint8_t z3[SHA256_HASH_DIGEST_SIZE];
+    uint8_t * digests[] = {
+        &errk_p->val[0], &errk_p->val[32], &errk_p->val[64], &errk_p->val[96],
+        &errk_q->val[0], &errk_q->val[32], &errk_q->val[64], &errk_q->val[96]
+    };
     uint8_t odd_mod_bitmask;
     int pq_len;
 
@@ -537,26 +888,15 @@ void calc_errk_pq_bias_odd(uint8_t * y2,
      *  ERRK_P[32:63] = sha256(Z3 || copy(0x02, 32))
      *  ERRK_P[64:95] = sha256(Z3 || copy(0x03, 32))
      *  ERRK_P[96:127] = sha256(Z3 || copy(0x41, 32))
-     *   :
-     */
-    sha256_concat(&errk_p->val[0],  z3, 0x01, 32);
-    sha256_concat(&errk_p->val[32], z3, 0x02, 32);
-    sha256_concat(&errk_p->val[64], z3, 0x03, 32);
-    sha256_concat(&errk_p->val[96], z3, 0x04, 32);
-    errk_p->len = pq_len;
-
-    /**
-     *   :
      *  ERRK_Q[0:31] = sha256(Z3 || copy(0x05, 32))
      *  ERRK_Q[32:63] = sha256(Z3 || copy(0x06, 32))
      *  ERRK_Q[64:95] = sha256(Z3 || copy(0x07, 32))
      *  ERRK_Q[96:127] = sha256(Z3 || copy(0x8, 32))
      *   :
+     * (All eight are independent, so they are hashed in one batch)
      */
-    sha256_concat(&errk_q->val[0],  z3, 0x05, 32);
-    sha256_concat(&errk_q->val[32], z3, 0x06, 32);
-    sha256_concat(&errk_q->val[64], z3, 0x07, 32);
-    sha256_concat(&errk_q->val[96], z3, 0x08, 32);
+    sha256_concat_multi(digests, z3, errk_terms, 32, 8);
+    errk_p->len = pq_len;
     errk_q->len = pq_len;
 
     /* Force P, Q to be suitably odd */
@@ -609,7 +949,7 @@ void reverse_buf(uint8_t *buf, size_t length) {
 void ff_from_little_endian_octet(mcl_chunk ff[][MCL_BS],
                                  mcl_octet * octet,
                                  int n) {
-    static uint8_t scratch_buf[1024];
+    uint8_t scratch_buf[1024];
     mcl_octet scratch = {0, sizeof(scratch_buf), scratch_buf};
     int i, j;
 
@@ -712,8 +1052,8 @@ void rsa_secret(MCL_rsa_private_key *PRIV,
  */
 #define MSB_FIRST
 void print_ff(char * title, mcl_chunk ff[][MCL_BS], int n) {
-    static uint8_t buf[2048];
-    static mcl_octet temp = {0, sizeof(buf), buf};
+    uint8_t buf[2048];
+    mcl_octet temp = {0, sizeof(buf), buf};
 
     if (!title) {
         title = "";
@@ -36,6 +36,8 @@
 #ifndef _IMS_COMMON_H
 #define _IMS_COMMON_H
 
+#include "ims_stats.h"
+
 /**
  * If enabled, the following define will check RSA coefficients P & Q
  * for factorability by the ERPK exponent ("e" or 65537). This is used
@@ -59,12 +61,8 @@
 /* The maximum number of bytes to read from a prng_seed_file */
 #define DEFAULT_PRNG_SEED_LENGTH    128
 
-/* The PRNG seed is stored in this buffer */
-uint8_t  prng_seed_buffer[EVP_MAX_MD_SIZE];
-uint32_t prng_seed_length;
-
-/* Cryptographically Secure Random Number Generator */
-csprng  rng;        /* Generic */
+/* The (hashed) master PRNG seed, shared by all IMS contexts */
+extern mcl_octet prng_seed;
 
 
 /* IMS working set */
@@ -73,7 +71,6 @@ csprng  rng;        /* Generic */
 #define IMS_PQ_BIAS_SIZE            (IMS_SIZE - IMS_HAMMING_SIZE)
 #define IMS_HAMMING_WEIGHT          (IMS_HAMMING_SIZE * 8 / 2)
 #define IMS_PQ_BIAS_HAMMING_WEIGHT  (IMS_PQ_BIAS_SIZE * 8 / 2)
-uint8_t  ims[IMS_SIZE];
 
 /**
  * 24-bit P&Q bias field, divided evenly into 12 bit fields for each of P & Q bias
@@ -97,37 +94,24 @@ uint8_t  ims[IMS_SIZE];
 
 /* Endpoint Unique ID (EP_UID) working set */
 #define EP_UID_SIZE         8
-mcl_octet ep_uid;
 
+/* sha256_concat_multi limits: terms per hash batch, extension bytes */
+#define SHA256_CONCAT_MAX_TERMS     8
+#define SHA256_CONCAT_MAX_EXTEND    32
 
 /* Hash value used in calculating EPSK, MPDK ERRK */
 #define Y2_SIZE     SHA256_HASH_DIGEST_SIZE
-uint8_t  y2[Y2_SIZE];
-
-/* Scratch octet for generating terms to feed sha256 */
-uint8_t  scratch_buf[128];
-mcl_octet scratch;
-
 
 /* Endpoint Primary Signing/Verification Keys (EPSK, EPVK) */
 #define EPSK_SIZE       56
 #define EPVK_SIZE       113
-mcl_octet epsk;
-mcl_octet epvk;
-
 
 /* Endpoint Secondary Signing/Verification Keys (ESSK/ESVK) */
 #define ESSK_SIZE       32
 #define ESVK_SIZE       65
-mcl_octet essk;
-mcl_octet esvk;
 
 /* Endpoint Rsa pRivate Key (ERRK/ERPK) */
 #define ERRK_PQ_SIZE    128
-mcl_octet errk_p;
-mcl_octet errk_q;
-mcl_octet erpk_mod;
-mcl_octet errk_d;
 
 /*
  * The number of BIG nums needed to represent P or Q as an FF num.
@@ -137,11 +121,55 @@ mcl_octet errk_d;
  * */
 
 #define ERPK_EXPONENT   65537
-mcl_chunk p_ff[MCL_HFLEN][MCL_BS];
-mcl_chunk q_ff[MCL_HFLEN][MCL_BS];
 
-MCL_rsa_private_key rsa_private;
-MCL_rsa_public_key  rsa_public;
+
+/**
+ * IMS working context
+ *
+ * Everything needed to derive one IMS value and its keys. Each generator
+ * or verifier thread owns one of these, so that no working state is
+ * shared between threads. The octets point into the buffers in the same
+ * context, so initialize a context with ims_context_init() before use and
+ * never copy one by value.
+ */
+typedef struct {
+    /* Cryptographically Secure Random Number Generator */
+    csprng    rng;
+
+    uint8_t   ims[IMS_SIZE];
+    uint8_t   y2[Y2_SIZE];
+
+    uint8_t   ep_uid_buf[EP_UID_SIZE];
+    mcl_octet ep_uid;
+
+    uint8_t   epsk_buf[EPSK_SIZE];
+    mcl_octet epsk;
+    uint8_t   epvk_buf[EPVK_SIZE];
+    mcl_octet epvk;
+
+    uint8_t   essk_buf[ESSK_SIZE];
+    mcl_octet essk;
+    uint8_t   esvk_buf[ESVK_SIZE];
+    mcl_octet esvk;
+
+    uint8_t   errk_p_buf[ERRK_PQ_SIZE];
+    mcl_octet errk_p;
+    uint8_t   errk_q_buf[ERRK_PQ_SIZE];
+    mcl_octet errk_q;
+    uint8_t   erpk_mod_buf[ERRK_PQ_SIZE * 2];
+    mcl_octet erpk_mod;
+    uint8_t   errk_d_buf[RSA2048_PUBLIC_KEY_SIZE];
+    mcl_octet errk_d;
+
+    mcl_chunk p_ff[MCL_HFLEN][MCL_BS];
+    mcl_chunk q_ff[MCL_HFLEN][MCL_BS];
+
+    MCL_rsa_private_key rsa_private;
+    MCL_rsa_public_key  rsa_public;
+
+    /* Per-stage instrumentation for the work done in this context */
+    ims_stats stats;
+} ims_context;
 
 
 /**
@@ -156,12 +184,114 @@ int ims_common_init(const char * prng_seed_file,
                     const char * prng_seed_string);
 
 
+/**
+ * @brief Build the fixed-base generator tables for EPVK/ESVK generation
+ *
+ * Makes calc_epvk() and calc_esvk() use the fixed-base tables and skip
+ * the (redundant) group order check. Not thread safe: call once, before
+ * generating any keys.
+ */
+void ims_fixed_base_init(void);
+
+
 /**
  * @brief Perform any common IMS de-initialization
  */
 void ims_common_deinit(void);
 
 
+/**
+ * @brief Initialize an IMS working context
+ *
+ * Wires up the context's octets and seeds its PRNG from the master seed,
+ * exactly as the single-threaded imsgen always has (stream 0).
+ *
+ * @param ctx The context to initialize
+ */
+void ims_context_init(ims_context * ctx);
+
+
+/**
+ * @brief Initialize an IMS working context with a derived PRNG stream
+ *
+ * Like ims_context_init(), but seeds the PRNG with
+ * sha256(master_seed || label || index) so that every worker gets its own
+ * independent, reproducible stream.
+ *
+ * @param ctx The context to initialize
+ * @param label A short ASCII tag naming the stream family (e.g. "worker")
+ * @param index The stream number within that family
+ */
+void ims_context_init_stream(ims_context * ctx,
+                             const char * label,
+                             uint32_t index);
+
+
+/**
+ * @brief Reseed an IMS working context for a single IMS index
+ *
+ * Seeds the PRNG with a KDF of the master seed and the index, so IMS
+ * number k can be regenerated without replaying IMS 0..k-1.
+ *
+ * @param ctx The (initialized) context to reseed
+ * @param index The IMS index
+ */
+void ims_context_seed_index(ims_context * ctx, uint64_t index);
+
+
+/**
+ * @brief Identify the master seed without revealing it
+ *
+ * Used to check that a resumed run has the seed it was started with.
+ *
+ * @param digest The SHA256_HASH_DIGEST_SIZE-byte output: a SHA-256 of a
+ *        fixed label and the master seed
+ */
+void ims_seed_digest(uint8_t * digest);
+
+
+/**
+ * @brief Scrub an IMS working context
+ *
+ * @param ctx The context to scrub
+ */
+void ims_context_deinit(ims_context * ctx);
+
+
+/**
+ * @brief Sample a uniformly random bit string of a fixed Hamming weight
+ *
+ * Rejection-free: every string of the given weight is equally likely, and
+ * each bit position costs about two random bits.
+ *
+ * @param rng The PRNG to draw from
+ * @param buf The output buffer (num_bits / 8 bytes, MSb first)
+ * @param num_bits The length of the string in bits (a multiple of 8)
+ * @param weight The Hamming weight required
+ * @param rand_bytes If non-NULL, incremented by the PRNG bytes consumed
+ */
+void ims_sample_constant_weight(csprng * rng, uint8_t * buf,
+                                uint32_t num_bits, uint32_t weight,
+                                uint64_t * rand_bytes);
+
+
+/**
+ * @brief Sample a bit string of a fixed Hamming weight by rejection
+ *
+ * Draws whole random strings until one has the right weight (the original
+ * IMS candidate sampler).
+ *
+ * @param rng The PRNG to draw from
+ * @param buf The output buffer (num_bits / 8 bytes)
+ * @param num_bits The length of the string in bits (a multiple of 8)
+ * @param weight The Hamming weight required
+ * @param rand_bytes If non-NULL, incremented by the PRNG bytes consumed
+ */
+void ims_sample_rejection(csprng * rng, uint8_t * buf,
+                          uint32_t num_bits, uint32_t weight,
+                          uint64_t * rand_bytes);
+
+
 void MCL_FF_fromOctetRev(mcl_chunk x[][MCL_BS],mcl_octet *S,int n);
 
 
@@ -182,6 +312,43 @@ void sha256_concat(uint8_t * digest_x,
                    uint32_t extend_count);
 
 
+/**
+ * @brief Implement several "X[i] = sha256(Y || copy(b[i], n))" at once
+ *
+ * The terms share Y and n, so they have the same length and are hashed
+ * side by side by hash_multi().
+ *
+ * @param digest_x Array of count pointers to the output digest buffers
+ * @param hash_y Pointer to the input digest ("Y" above)
+ * @param extend_bytes Array of count extension bytes ("b" above)
+ * @param extend_count The number of extension bytes to concatenate ("n"
+ *        above), at most SHA256_CONCAT_MAX_EXTEND
+ * @param count The number of digests to generate
+ */
+void sha256_concat_multi(uint8_t ** digest_x,
+                         uint8_t * hash_y,
+                         const uint8_t * extend_bytes,
+                         uint32_t extend_count,
+                         int count);
+
+
+/**
+ * @brief Calculate the EP_UIDs of several IMS values at once
+ *
+ * Each step of the EP_UID hash chain is run across all of the IMS values
+ * side by side.
+ *
+ * @param ims_values Array of count pointers to the 35-byte IMS values
+ * @param ep_uids Array of count pointers to the octet EP_UID output values
+ * @param count The number of IMS values
+ * @param es3 If true, use the ES3 boot ROM form, otherwise the correct form
+ */
+void calculate_epuids(uint8_t ** ims_values,
+                      mcl_octet ** ep_uids,
+                      int count,
+                      bool es3);
+
+
 /**
  * @brief Calculate the EP_UID from the IMS (ES3 version)
  *
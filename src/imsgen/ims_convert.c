@@ -0,0 +1,269 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the code for "ims-convert" a Linux command-line
+ * app used to convert an IMS file between the Toshiba binascii format and
+ * the binary IMS container written by "imsgen --binary". The direction is
+ * determined by the input file.
+ *
+ */
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include "util.h"
+#include "parse_support.h"
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "mcl_ecdh.h"
+#include "mcl_rand.h"
+#include "mcl_rsa.h"
+#include "crypto.h"
+#include "ims_common.h"
+#include "ims_file.h"
+
+
+/* Program return values */
+#define PROGRAM_SUCCESS     0
+#define PROGRAM_WARNINGS    1
+#define PROGRAM_ERROR       2
+
+
+/* Parsing args */
+static char *   in_filename;
+static char *   out_filename;
+
+static char *   in_filename_names[] = { "in", NULL };
+static char *   out_filename_names[] = { "out", NULL };
+
+
+/* Parsing table */
+static struct optionx parse_table[] = {
+    { 'i', in_filename_names, NULL,
+      &in_filename, 0, REQUIRED, &store_str, false,
+      "The IMS file to convert (binascii or binary IMS container)" },
+    { 'o', out_filename_names, NULL,
+      &out_filename, 0, REQUIRED, &store_str, false,
+      "The converted IMS file" },
+    { 0, NULL, NULL, NULL, 0, 0, NULL, 0, NULL }
+};
+
+static char all_args[] = "i:o:";
+
+
+/**
+ * @brief Convert a binary IMS container to binascii
+ *
+ * Every record and index block CRC is checked before anything is written.
+ *
+ * @param in_name The binary IMS container
+ * @param out_name The binascii output file
+ * @param count Set to the number of IMS values converted
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int binary_to_binascii(const char * in_name, const char * out_name,
+                              uint64_t * count) {
+    int status;
+    ims_file_map map;
+    FILE * fp;
+    uint8_t ims[IMS_SIZE];
+    char line[IMS_LINE_SIZE];
+    uint64_t i;
+
+    status = ims_file_map_open(in_name, &map);
+    if (status != 0) {
+        return status;
+    }
+    status = ims_file_map_verify(&map);
+    if (status != 0) {
+        goto binary_to_binascii_err;
+    }
+
+    fp = fopen(out_name, "w");
+    if (!fp) {
+        fprintf(stderr, "ERROR: Can't create '%s'\n", out_name);
+        status = errno;
+        goto binary_to_binascii_err;
+    }
+
+    line[IMS_BINASCII_SIZE] = '\n';
+    for (i = 0; (i < map.num_records) && (status == 0); i++) {
+        status = ims_file_map_record(&map, i, ims);
+        if (status == 0) {
+            ims_to_binascii(ims, line);
+            if (fwrite(line, sizeof(line), 1, fp) != 1) {
+                fprintf(stderr, "ERROR: Can't write '%s'\n", out_name);
+                status = EIO;
+            }
+        }
+    }
+    if ((fclose(fp) != 0) && (status == 0)) {
+        fprintf(stderr, "ERROR: Can't write '%s'\n", out_name);
+        status = EIO;
+    }
+    *count = i;
+
+binary_to_binascii_err:
+    ims_file_map_close(&map);
+    return status;
+}
+
+
+/**
+ * @brief Convert a binascii IMS file to a binary IMS container
+ *
+ * @param in_name The binascii input file
+ * @param out_name The binary IMS container
+ * @param count Set to the number of IMS values converted
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int binascii_to_binary(const char * in_name, const char * out_name,
+                              uint64_t * count) {
+    int status = 0;
+    ims_file_writer * writer;
+    FILE * fp;
+    uint8_t ims[IMS_SIZE];
+    bool eof = false;
+
+    *count = 0;
+    fp = fopen(in_name, "r");
+    if (!fp) {
+        fprintf(stderr, "ERROR: Can't open '%s'\n", in_name);
+        return errno;
+    }
+
+    writer = ims_file_create(out_name);
+    if (!writer) {
+        fclose(fp);
+        return EIO;
+    }
+
+    while (status == 0) {
+        status = ims_read_binascii_line(fp, ims, &eof);
+        if ((status != 0) || eof) {
+            break;
+        }
+        status = ims_file_append(writer, ims);
+        if (status == 0) {
+            (*count)++;
+        }
+    }
+    if (status != 0) {
+        fprintf(stderr, "ERROR: '%s' IMS value %llu is unreadable\n",
+                in_name, (unsigned long long)*count + 1);
+    }
+    fclose(fp);
+
+    if (ims_file_close(writer) != 0) {
+        status = (status != 0)? status : EIO;
+    }
+    return status;
+}
+
+
+/**
+ * @brief Post-process and validate the command line args
+ *
+ * @param argc The number of elements in argv or parsed_argv (std. unix argc)
+ *
+ * @returns 0 on success, 1 if there were warnings, 2 on failure
+ */
+int postprocess_args(int argc) {
+    int status = PROGRAM_SUCCESS;
+
+    if (optind < argc) {
+        fprintf(stderr, "ERROR: dangling arguments\n");
+        status = PROGRAM_ERROR;
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Entry point for the ims-convert application
+ *
+ * @param argc The number of elements in argv or parsed_argv (std. unix argc)
+ * @param argv The unix argument vector - an array of pointers to strings.
+ *
+ * @returns 0 on success, 1 if there were warnings, 2 on failure
+ */
+int main(int argc, char * argv[]) {
+    struct argparse * parse_tbl = NULL;
+    int program_status = PROGRAM_SUCCESS;
+    int status;
+    bool binary;
+    uint64_t count = 0;
+
+    /* Parse the command line arguments */
+    parse_tbl = new_argparse(parse_table, argv[0], NULL, NULL, NULL, NULL);
+    if (parse_tbl) {
+        if (!parse_args(argc, argv, all_args, parse_tbl)) {
+            program_status = parser_help? PROGRAM_SUCCESS : PROGRAM_ERROR;
+        }
+        parse_tbl = free_argparse(parse_tbl);
+
+        /* Perform any argument validation/post-processing */
+        if (program_status == PROGRAM_SUCCESS) {
+            program_status = postprocess_args(argc);
+        }
+    } else {
+        program_status = PROGRAM_ERROR;
+    }
+
+    if ((program_status == PROGRAM_SUCCESS) && !parser_help) {
+        binary = ims_file_is_binary(in_filename);
+        if (binary) {
+            status = binary_to_binascii(in_filename, out_filename, &count);
+        } else {
+            status = binascii_to_binary(in_filename, out_filename, &count);
+        }
+        if (status == 0) {
+            printf("Converted %llu IMS values (%s to %s)\n",
+                   (unsigned long long)count,
+                   binary? "binary" : "binascii",
+                   binary? "binascii" : "binary");
+        } else {
+            fprintf(stderr, "ERROR: IMS conversion failed (err %d)\n", status);
+            program_status = PROGRAM_ERROR;
+        }
+    }
+
+    return program_status;
+}
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the code for "ims-db-migrate" a Linux
+ * command-line app used to convert a key database with the original
+ * TEXT-keyed schema (EP_UIDs as 16 hex digits) into a new database with the
+ * current BLOB-keyed WITHOUT ROWID schema (see db_schema.h).
+ *
+ * The old database is only read. Its rows are streamed in EP_UID order, so
+ * the new table is built by appending to its primary key B-tree, all in one
+ * transaction; the new database is removed again if anything fails.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sqlite3.h>
+#include "util.h"
+#include "parse_support.h"
+#include "db_schema.h"
+
+
+/* Program return values */
+#define PROGRAM_SUCCESS     0
+#define PROGRAM_WARNINGS    1
+#define PROGRAM_ERROR       2
+
+
+/* Parsing args */
+static char *   in_db_name;
+static char *   out_db_name;
+
+static char *   in_db_name_names[] = { "in", NULL };
+static char *   out_db_name_names[] = { "out", NULL };
+
+
+/* Parsing table */
+static struct optionx parse_table[] = {
+    { 'i', in_db_name_names, NULL,
+      &in_db_name, 0, REQUIRED, &store_str, false,
+      "The TEXT-keyed key database to migrate" },
+    { 'o', out_db_name_names, NULL,
+      &out_db_name, 0, REQUIRED, &store_str, false,
+      "The new BLOB-keyed key database (must not exist)" },
+    { 0, NULL, NULL, NULL, 0, 0, NULL, 0, NULL }
+};
+
+static char all_args[] = "i:o:";
+
+static const char * select_stmt =
+    "SELECT ep_uid, epvk, esvk, erpk_mod FROM pub_keys ORDER BY ep_uid";
+static const char * insert_stmt =
+    "INSERT INTO pub_keys(ep_uid, epvk, esvk, erpk_mod) VALUES (?, ?, ?, ?)";
+
+
+/**
+ * @brief Run a simple SQL statement on a database
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+static int db_exec(sqlite3 * db, const char * sql) {
+    char * errmsg = NULL;
+    int status = 0;
+
+    if (sqlite3_exec(db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: '%s' failed: %s\n", sql,
+                errmsg? errmsg : sqlite3_errmsg(db));
+        status = EIO;
+    }
+    sqlite3_free(errmsg);
+    return status;
+}
+
+
+/**
+ * @brief Count the keysets in a database
+ *
+ * @param db The database
+ * @param count Set to the number of rows in pub_keys
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+static int count_keysets(sqlite3 * db, uint64_t * count) {
+    int status = 0;
+    sqlite3_stmt * stmt = NULL;
+
+    if ((sqlite3_prepare_v2(db, "SELECT count(*) FROM pub_keys", -1, &stmt,
+                            NULL) != SQLITE_OK) ||
+        (sqlite3_step(stmt) != SQLITE_ROW)) {
+        fprintf(stderr, "ERROR: Can't count keysets: %s\n",
+                sqlite3_errmsg(db));
+        status = EIO;
+    } else {
+        *count = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return status;
+}
+
+
+/**
+ * @brief Copy every keyset from the old database into the new one
+ *
+ * @param in The TEXT-keyed database
+ * @param out The (empty) BLOB-keyed database
+ * @param num_copied Set to the number of keysets copied
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int migrate_keysets(sqlite3 * in, sqlite3 * out,
+                           uint64_t * num_copied) {
+    int status = 0;
+    int step;
+    int column;
+    sqlite3_stmt * select = NULL;
+    sqlite3_stmt * insert = NULL;
+    uint8_t ep_uid[DB_EP_UID_SIZE];
+
+    *num_copied = 0;
+    if (sqlite3_prepare_v2(in, select_stmt, -1, &select, NULL) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't read '%s': %s\n", in_db_name,
+                sqlite3_errmsg(in));
+        return EIO;
+    }
+    if (sqlite3_prepare_v2(out, insert_stmt, -1, &insert, NULL) !=
+        SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't prepare insert: %s\n",
+                sqlite3_errmsg(out));
+        sqlite3_finalize(select);
+        return EIO;
+    }
+
+    while ((status == 0) && ((step = sqlite3_step(select)) == SQLITE_ROW)) {
+        if (!db_column_ep_uid(select, 0, DB_SCHEMA_TEXT_KEY, ep_uid)) {
+            fprintf(stderr, "ERROR: malformed EP_UID '%s' in '%s'\n",
+                    (const char *)sqlite3_column_text(select, 0), in_db_name);
+            status = EIO;
+            break;
+        }
+        db_bind_ep_uid(insert, 1, DB_SCHEMA_BLOB_KEY, ep_uid);
+        for (column = 1; column <= 3; column++) {
+            sqlite3_bind_blob(insert, column + 1,
+                              sqlite3_column_blob(select, column),
+                              sqlite3_column_bytes(select, column),
+                              SQLITE_STATIC);
+        }
+        if (sqlite3_step(insert) != SQLITE_DONE) {
+            fprintf(stderr, "ERROR: Can't insert keyset: %s\n",
+                    sqlite3_errmsg(out));
+            status = EIO;
+        } else {
+            (*num_copied)++;
+        }
+        sqlite3_reset(insert);
+        sqlite3_clear_bindings(insert);
+    }
+    if ((status == 0) && (step != SQLITE_DONE)) {
+        fprintf(stderr, "ERROR: Can't read '%s': %s\n", in_db_name,
+                sqlite3_errmsg(in));
+        status = EIO;
+    }
+
+    sqlite3_finalize(insert);
+    sqlite3_finalize(select);
+    return status;
+}
+
+
+/**
+ * @brief Get a file's size in KiB (for the summary)
+ *
+ * @param name The file
+ *
+ * @returns The size, or 0 if it can't be found.
+ */
+static unsigned long long file_kib(const char * name) {
+    struct stat st;
+
+    return (stat(name, &st) == 0)? (unsigned long long)st.st_size / 1024 : 0;
+}
+
+
+/**
+ * @brief Post-process and validate the command line args
+ *
+ * @param argc The number of elements in argv or parsed_argv (std. unix argc)
+ *
+ * @returns 0 on success, 1 if there were warnings, 2 on failure
+ */
+int postprocess_args(int argc) {
+    int status = PROGRAM_SUCCESS;
+
+    if (optind < argc) {
+        fprintf(stderr, "ERROR: dangling arguments\n");
+        status = PROGRAM_ERROR;
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Entry point for the ims-db-migrate application
+ *
+ * @param argc The number of elements in argv or parsed_argv (std. unix argc)
+ * @param argv The unix argument vector - an array of pointers to strings.
+ *
+ * @returns 0 on success, 1 if there were warnings, 2 on failure
+ */
+int main(int argc, char * argv[]) {
+    struct argparse * parse_tbl = NULL;
+    int program_status = PROGRAM_SUCCESS;
+    int status = 0;
+    int version;
+    sqlite3 * in = NULL;
+    sqlite3 * out = NULL;
+    uint64_t num_in = 0;
+    uint64_t num_copied = 0;
+    uint64_t num_out = 0;
+
+    /* Parse the command line arguments */
+    parse_tbl = new_argparse(parse_table, argv[0], NULL, NULL, NULL, NULL);
+    if (parse_tbl) {
+        if (!parse_args(argc, argv, all_args, parse_tbl)) {
+            program_status = parser_help? PROGRAM_SUCCESS : PROGRAM_ERROR;
+        }
+        parse_tbl = free_argparse(parse_tbl);
+
+        /* Perform any argument validation/post-processing */
+        if (program_status == PROGRAM_SUCCESS) {
+            program_status = postprocess_args(argc);
+        }
+    } else {
+        program_status = PROGRAM_ERROR;
+    }
+    if ((program_status != PROGRAM_SUCCESS) || parser_help) {
+        return program_status;
+    }
+
+    /* The old database must use the TEXT-keyed schema */
+    if (sqlite3_open_v2(in_db_name, &in, SQLITE_OPEN_READONLY, NULL) !=
+        SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't open database '%s': %s\n",
+                in_db_name, sqlite3_errmsg(in));
+        status = EIO;
+    } else if (db_schema_version(in, &version) != 0) {
+        status = EIO;
+    } else if (version != DB_SCHEMA_TEXT_KEY) {
+        fprintf(stderr, "ERROR: '%s' %s\n", in_db_name,
+                (version == DB_SCHEMA_NONE)? "has no keysets table" :
+                "already uses the current schema");
+        status = EINVAL;
+    } else {
+        status = count_keysets(in, &num_in);
+    }
+
+    /* The new one must not exist yet */
+    if (status == 0) {
+        if (access(out_db_name, F_OK) == 0) {
+            fprintf(stderr, "ERROR: '%s' already exists\n", out_db_name);
+            status = EEXIST;
+        } else if (sqlite3_open_v2(out_db_name, &out,
+                                   SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                                   NULL) != SQLITE_OK) {
+            fprintf(stderr, "ERROR: Can't create database '%s': %s\n",
+                    out_db_name, sqlite3_errmsg(out));
+            status = EIO;
+        } else {
+            status = db_schema_create(out);
+        }
+    }
+
+    /* Copy everything in one transaction, and check nothing was lost */
+    if (status == 0) {
+        status = db_exec(out, "BEGIN");
+    }
+    if (status == 0) {
+        status = migrate_keysets(in, out, &num_copied);
+    }
+    if (status == 0) {
+        status = db_exec(out, "COMMIT");
+    } else if (out && !sqlite3_get_autocommit(out)) {
+        db_exec(out, "ROLLBACK");
+    }
+    if (status == 0) {
+        status = count_keysets(out, &num_out);
+        if ((status == 0) && ((num_copied != num_in) || (num_out != num_in))) {
+            fprintf(stderr,
+                    "ERROR: '%s' holds %llu keysets but %llu were migrated\n",
+                    in_db_name, (unsigned long long)num_in,
+                    (unsigned long long)num_out);
+            status = EIO;
+        }
+    }
+
+    sqlite3_close(in);
+    if (out) {
+        sqlite3_close(out);
+        if (status != 0) {
+            unlink(out_db_name);
+        }
+    }
+
+    if (status == 0) {
+        printf("Migrated %llu keysets: '%s' %llu KiB -> '%s' %llu KiB\n",
+               (unsigned long long)num_out, in_db_name, file_kib(in_db_name),
+               out_db_name, file_kib(out_db_name));
+    } else {
+        fprintf(stderr, "ERROR: Key database migration failed (err %d)\n",
+                status);
+        program_status = PROGRAM_ERROR;
+    }
+
+    return program_status;
+}
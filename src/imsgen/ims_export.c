@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the code for "ims-export" a Linux command-line
+ * app used to export the keysets (EP_UID, EPVK, ESVK and ERPK modulus) in a
+ * key database, for delivery to an HSM.
+ *
+ * All of the keysets, or those in an EP_UID range, are read in one scan of
+ * the database's EP_UID index and streamed, in EP_UID order, through a
+ * fixed-size buffer into either:
+ *
+ *   binary: A 16-byte header, the magic "IMSKEYS\n" then a little-endian
+ *           uint32 version (1) and uint32 flags (0), followed by one record
+ *           per keyset: the 8-byte EP_UID, then the EPVK, ESVK and ERPK
+ *           modulus, each as a little-endian uint16 length and its bytes.
+ *   csv:    A "ep_uid,epvk,esvk,erpk_mod" header line, then one line per
+ *           keyset with each field in lower-case hex.
+ *
+ * The output is hashed as it is written, and a manifest is written beside
+ * it: '#' comment lines describing the export, then the SHA-256 line in
+ * sha256sum format, so "sha256sum -c <manifest>" checks the delivery. The
+ * export is removed again if anything fails.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include "util.h"
+#include "parse_support.h"
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "crypto.h"
+#include "db.h"
+#include "db_schema.h"
+#include "ims_stats.h"
+
+
+/* Program return values */
+#define PROGRAM_SUCCESS     0
+#define PROGRAM_WARNINGS    1
+#define PROGRAM_ERROR       2
+
+/* Binary export format */
+#define EXPORT_MAGIC        "IMSKEYS\n"
+#define EXPORT_MAGIC_SIZE   8
+#define EXPORT_VERSION      1
+#define EXPORT_HEADER_SIZE  16
+
+/* Output is written (and hashed) in chunks of this size */
+#define EXPORT_BUFFER_SIZE  (1024 * 1024)
+
+/* The most one keyset can take in either format (3 blobs of <= 256 bytes) */
+#define EXPORT_RECORD_MAX   2048
+
+/* The manifest's default name is the export's, plus this */
+#define EXPORT_MANIFEST_SUFFIX  ".sha256"
+
+
+/* Parsing args */
+static char *   database_name;
+static char *   out_filename;
+static char *   manifest_filename;
+static char *   format_name;
+static char *   first_ep_uid_hex;
+static char *   last_ep_uid_hex;
+static bool     csv;
+static uint8_t  first_ep_uid[DB_EP_UID_SIZE];
+static uint8_t  last_ep_uid[DB_EP_UID_SIZE];
+
+static char *   database_name_names[] = { "db", "database", NULL };
+static char *   out_filename_names[] = { "out", NULL };
+static char *   manifest_filename_names[] = { "manifest", NULL };
+static char *   format_name_names[] = { "format", NULL };
+static char *   first_ep_uid_hex_names[] = { "first", NULL };
+static char *   last_ep_uid_hex_names[] = { "last", NULL };
+
+
+/* Parsing table */
+static struct optionx parse_table[] = {
+    { 'd', database_name_names, NULL,
+      &database_name, 0, REQUIRED, &store_str, false,
+      "The key database to export" },
+    { 'o', out_filename_names, NULL,
+      &out_filename, 0, REQUIRED, &store_str, false,
+      "The export file" },
+    { 'm', manifest_filename_names, "file",
+      &manifest_filename, 0, OPTIONAL, &store_str, false,
+      "The SHA-256 manifest (<export file>" EXPORT_MANIFEST_SUFFIX ")" },
+    { 'f', format_name_names, "name",
+      &format_name, 0, OPTIONAL, &store_str, false,
+      "The export format: binary or csv (binary)" },
+    { 'F', first_ep_uid_hex_names, "ep_uid",
+      &first_ep_uid_hex, 0, OPTIONAL, &store_str, false,
+      "Export only keysets from this EP_UID (16 hex digits) on" },
+    { 'L', last_ep_uid_hex_names, "ep_uid",
+      &last_ep_uid_hex, 0, OPTIONAL, &store_str, false,
+      "Export only keysets up to this EP_UID (16 hex digits)" },
+    { 0, NULL, NULL, NULL, 0, 0, NULL, 0, NULL }
+};
+
+static char all_args[] = "d:o:m:f:F:L:";
+
+
+/* The export stream: a buffer, flushed (and hashed) as it fills */
+typedef struct {
+    int         fd;
+    uint8_t *   buf;
+    size_t      used;
+    uint64_t    bytes;              /* Written so far */
+    uint64_t    num_keysets;
+    uint8_t     first[DB_EP_UID_SIZE];
+    uint8_t     last[DB_EP_UID_SIZE];
+} export_stream;
+
+
+/**
+ * @brief Write out (and hash) everything buffered
+ *
+ * @param stream The export stream
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int export_flush(export_stream * stream) {
+    size_t done = 0;
+    ssize_t written;
+
+    hash_update(stream->buf, stream->used);
+    while (done < stream->used) {
+        written = write(stream->fd, stream->buf + done, stream->used - done);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "ERROR: Can't write '%s' (err %d)\n",
+                    out_filename, errno);
+            return errno;
+        }
+        done += written;
+    }
+    stream->bytes += stream->used;
+    stream->used = 0;
+
+    return 0;
+}
+
+
+/**
+ * @brief Append a little-endian uint16 length and its blob
+ *
+ * @returns A pointer to the byte after the blob.
+ */
+static uint8_t * put_blob(uint8_t * p, mcl_octet * blob) {
+    p[0] = (uint8_t)blob->len;
+    p[1] = (uint8_t)(blob->len >> 8);
+    memcpy(&p[2], blob->val, blob->len);
+    return p + 2 + blob->len;
+}
+
+
+/**
+ * @brief Append bytes as lower-case hex
+ *
+ * @returns A pointer to the byte after the hex digits.
+ */
+static uint8_t * put_hex(uint8_t * p, const uint8_t * data, size_t len) {
+    static const char digits[] = "0123456789abcdef";
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        *p++ = digits[data[i] >> 4];
+        *p++ = digits[data[i] & 0x0f];
+    }
+    return p;
+}
+
+
+/**
+ * @brief Append one keyset to the export (a db_keyset_fn)
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int export_keyset(void * cookie,
+                         const uint8_t * ep_uid,
+                         mcl_octet * epvk,
+                         mcl_octet * esvk,
+                         mcl_octet * erpk_mod) {
+    export_stream * stream = cookie;
+    uint8_t * p;
+    int status;
+
+    if (stream->used + EXPORT_RECORD_MAX > EXPORT_BUFFER_SIZE) {
+        status = export_flush(stream);
+        if (status != 0) {
+            return status;
+        }
+    }
+
+    p = stream->buf + stream->used;
+    if (csv) {
+        p = put_hex(p, ep_uid, DB_EP_UID_SIZE);
+        *p++ = ',';
+        p = put_hex(p, (uint8_t *)epvk->val, epvk->len);
+        *p++ = ',';
+        p = put_hex(p, (uint8_t *)esvk->val, esvk->len);
+        *p++ = ',';
+        p = put_hex(p, (uint8_t *)erpk_mod->val, erpk_mod->len);
+        *p++ = '\n';
+    } else {
+        memcpy(p, ep_uid, DB_EP_UID_SIZE);
+        p = put_blob(p + DB_EP_UID_SIZE, epvk);
+        p = put_blob(p, esvk);
+        p = put_blob(p, erpk_mod);
+    }
+    stream->used = p - stream->buf;
+
+    if (stream->num_keysets == 0) {
+        memcpy(stream->first, ep_uid, DB_EP_UID_SIZE);
+    }
+    memcpy(stream->last, ep_uid, DB_EP_UID_SIZE);
+    stream->num_keysets++;
+
+    return 0;
+}
+
+
+/**
+ * @brief Start the export with its header
+ *
+ * @param stream The export stream
+ */
+static void export_header(export_stream * stream) {
+    static const char csv_header[] = "ep_uid,epvk,esvk,erpk_mod\n";
+    uint8_t * p = stream->buf;
+
+    if (csv) {
+        memcpy(p, csv_header, sizeof(csv_header) - 1);
+        stream->used = sizeof(csv_header) - 1;
+    } else {
+        memcpy(p, EXPORT_MAGIC, EXPORT_MAGIC_SIZE);
+        memset(&p[EXPORT_MAGIC_SIZE], 0,
+               EXPORT_HEADER_SIZE - EXPORT_MAGIC_SIZE);
+        p[EXPORT_MAGIC_SIZE] = EXPORT_VERSION;
+        stream->used = EXPORT_HEADER_SIZE;
+    }
+}
+
+
+/**
+ * @brief Write the manifest for a finished export
+ *
+ * @param stream The export stream
+ * @param digest The export's SHA-256
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int write_manifest(const export_stream * stream,
+                          const uint8_t * digest) {
+    char first[DB_EP_UID_HEX_LEN + 1];
+    char last[DB_EP_UID_HEX_LEN + 1];
+    char * out_copy;
+    FILE * fp;
+    int i;
+    int status = 0;
+
+    fp = fopen(manifest_filename, "w");
+    if (!fp) {
+        fprintf(stderr, "ERROR: Can't create manifest '%s'\n",
+                manifest_filename);
+        return errno;
+    }
+
+    /* The digest line names the export as it sits beside the manifest */
+    out_copy = strdup(out_filename);
+    if (!out_copy) {
+        fclose(fp);
+        return ENOMEM;
+    }
+    fprintf(fp, "# ims-export of '%s'\n", database_name);
+    fprintf(fp, "# format: %s\n", csv? "csv" : "binary");
+    fprintf(fp, "# keysets: %llu\n", (unsigned long long)stream->num_keysets);
+    fprintf(fp, "# bytes: %llu\n", (unsigned long long)stream->bytes);
+    if (stream->num_keysets > 0) {
+        db_ep_uid_to_hex(stream->first, first);
+        db_ep_uid_to_hex(stream->last, last);
+        fprintf(fp, "# ep_uid: %s..%s\n", first, last);
+    }
+    for (i = 0; i < SHA256_HASH_DIGEST_SIZE; i++) {
+        fprintf(fp, "%02x", digest[i]);
+    }
+    fprintf(fp, "  %s\n", basename(out_copy));
+    free(out_copy);
+
+    if ((fflush(fp) != 0) || (fsync(fileno(fp)) != 0)) {
+        fprintf(stderr, "ERROR: Can't write manifest '%s'\n",
+                manifest_filename);
+        status = EIO;
+    }
+    if (fclose(fp) != 0) {
+        status = EIO;
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Post-process and validate the command line args
+ *
+ * @param argc The number of elements in argv or parsed_argv (std. unix argc)
+ *
+ * @returns 0 on success, 1 if there were warnings, 2 on failure
+ */
+int postprocess_args(int argc) {
+    int status = PROGRAM_SUCCESS;
+
+    if (optind < argc) {
+        fprintf(stderr, "ERROR: dangling arguments\n");
+        status = PROGRAM_ERROR;
+    }
+
+    if (format_name && (strcmp(format_name, "csv") == 0)) {
+        csv = true;
+    } else if (format_name && (strcmp(format_name, "binary") != 0)) {
+        fprintf(stderr, "ERROR: --format must be binary or csv\n");
+        status = PROGRAM_ERROR;
+    }
+
+    if (first_ep_uid_hex &&
+        !db_hex_to_ep_uid(first_ep_uid_hex, strlen(first_ep_uid_hex),
+                          first_ep_uid)) {
+        fprintf(stderr, "ERROR: --first must be 16 hex digits\n");
+        status = PROGRAM_ERROR;
+    }
+    if (last_ep_uid_hex &&
+        !db_hex_to_ep_uid(last_ep_uid_hex, strlen(last_ep_uid_hex),
+                          last_ep_uid)) {
+        fprintf(stderr, "ERROR: --last must be 16 hex digits\n");
+        status = PROGRAM_ERROR;
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Entry point for the ims-export application
+ *
+ * @param argc The number of elements in argv or parsed_argv (std. unix argc)
+ * @param argv The unix argument vector - an array of pointers to strings.
+ *
+ * @returns 0 on success, 1 if there were warnings, 2 on failure
+ */
+int main(int argc, char * argv[]) {
+    struct argparse * parse_tbl = NULL;
+    int program_status = PROGRAM_SUCCESS;
+    int status = 0;
+    bool db_open = false;
+    char * default_manifest = NULL;
+    uint8_t digest[SHA256_HASH_DIGEST_SIZE];
+    export_stream stream;
+    uint64_t start;
+    double elapsed;
+
+    /* Parse the command line arguments */
+    parse_tbl = new_argparse(parse_table, argv[0], NULL, NULL, NULL, NULL);
+    if (parse_tbl) {
+        if (!parse_args(argc, argv, all_args, parse_tbl)) {
+            program_status = parser_help? PROGRAM_SUCCESS : PROGRAM_ERROR;
+        }
+        parse_tbl = free_argparse(parse_tbl);
+
+        /* Perform any argument validation/post-processing */
+        if (program_status == PROGRAM_SUCCESS) {
+            program_status = postprocess_args(argc);
+        }
+    } else {
+        program_status = PROGRAM_ERROR;
+    }
+    if ((program_status != PROGRAM_SUCCESS) || parser_help) {
+        return program_status;
+    }
+
+    if (!manifest_filename) {
+        default_manifest = malloc(strlen(out_filename) +
+                                  sizeof(EXPORT_MANIFEST_SUFFIX));
+        if (!default_manifest) {
+            return PROGRAM_ERROR;
+        }
+        sprintf(default_manifest, "%s%s", out_filename,
+                EXPORT_MANIFEST_SUFFIX);
+        manifest_filename = default_manifest;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    stream.fd = -1;
+    stream.buf = malloc(EXPORT_BUFFER_SIZE);
+    if (!stream.buf) {
+        fprintf(stderr, "ERROR: Can't allocate the export buffer\n");
+        status = ENOMEM;
+    }
+
+    /* Only export a database that is there (db_init would create one) */
+    if (status == 0) {
+        if (access(database_name, R_OK) != 0) {
+            fprintf(stderr, "ERROR: Can't open database '%s'\n",
+                    database_name);
+            status = ENOENT;
+        } else {
+            status = db_init(database_name);
+            db_open = (status == 0);
+        }
+    }
+
+    if (status == 0) {
+        stream.fd = open(out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (stream.fd < 0) {
+            fprintf(stderr, "ERROR: Can't create '%s'\n", out_filename);
+            status = errno;
+        }
+    }
+
+    /* One ordered scan, streamed out through the buffer */
+    start = ims_stats_now();
+    if (status == 0) {
+        hash_start();
+        export_header(&stream);
+        status = db_scan_keysets(first_ep_uid_hex? first_ep_uid : NULL,
+                                 last_ep_uid_hex? last_ep_uid : NULL,
+                                 export_keyset, &stream);
+    }
+    if (status == 0) {
+        status = export_flush(&stream);
+    }
+    if ((status == 0) && (fsync(stream.fd) != 0)) {
+        fprintf(stderr, "ERROR: Can't write '%s' (err %d)\n", out_filename,
+                errno);
+        status = EIO;
+    }
+    if (stream.fd >= 0) {
+        if ((close(stream.fd) != 0) && (status == 0)) {
+            status = EIO;
+        }
+    }
+    elapsed = (ims_stats_now() - start) / 1e9;
+
+    if (status == 0) {
+        hash_final(digest);
+        status = write_manifest(&stream, digest);
+    }
+    if (db_open) {
+        db_deinit();
+    }
+
+    if (status == 0) {
+        printf("Exported %llu keysets to '%s' (%llu KiB in %.1f s, "
+               "%.1f MiB/s), manifest '%s'\n",
+               (unsigned long long)stream.num_keysets, out_filename,
+               (unsigned long long)stream.bytes / 1024, elapsed,
+               (elapsed > 0)? stream.bytes / elapsed / (1024 * 1024) : 0.0,
+               manifest_filename);
+    } else {
+        if (stream.fd >= 0) {
+            unlink(out_filename);
+            unlink(manifest_filename);
+        }
+        fprintf(stderr, "ERROR: Keyset export failed (err %d)\n", status);
+        program_status = PROGRAM_ERROR;
+    }
+
+    free(stream.buf);
+    free(default_manifest);
+
+    return program_status;
+}
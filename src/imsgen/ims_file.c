@@ -0,0 +1,791 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the IMS file format support: the Toshiba
+ * binascii line format and the binary IMS container (see ims_file.h for
+ * the container layout).
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "mcl_ecdh.h"
+#include "mcl_rand.h"
+#include "mcl_rsa.h"
+#include "crypto.h"
+#include "ims_common.h"
+#include "ims_file.h"
+
+/* Header field offsets */
+#define HDR_VERSION         8
+#define HDR_RECORD_SIZE     12
+#define HDR_NUM_RECORDS     16
+#define HDR_INDEX_OFFSET    24
+#define HDR_INDEX_BLOCK     32
+#define HDR_FLAGS           36
+#define HDR_CRC             60
+
+/* Trailer field offsets */
+#define TRL_NUM_BLOCKS      8
+#define TRL_CRC             12
+
+/* CRC32C (Castagnoli), reflected */
+#define CRC32C_POLY         0x82f63b78
+
+static uint32_t crc32c_table[256];
+static bool     crc32c_table_valid;
+
+
+/**
+ * @brief Build the CRC32C lookup table
+ */
+static void crc32c_init(void) {
+    uint32_t crc;
+    int i;
+    int bit;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 1)? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[i] = crc;
+    }
+    crc32c_table_valid = true;
+}
+
+
+/**
+ * @brief Compute (or continue) a CRC32C (Castagnoli)
+ *
+ * @param crc The CRC so far (0 to start)
+ * @param data The data to add
+ * @param length The length of the data in bytes
+ *
+ * @returns The updated CRC.
+ */
+uint32_t crc32c(uint32_t crc, const uint8_t * data, size_t length) {
+    if (!crc32c_table_valid) {
+        crc32c_init();
+    }
+
+    crc = ~crc;
+    while (length-- > 0) {
+        crc = crc32c_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+/* Little-endian field accessors */
+static void put_le32(uint8_t * buf, uint32_t value) {
+    buf[0] = value;
+    buf[1] = value >> 8;
+    buf[2] = value >> 16;
+    buf[3] = value >> 24;
+}
+
+static void put_le64(uint8_t * buf, uint64_t value) {
+    put_le32(buf, (uint32_t)value);
+    put_le32(buf + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t get_le32(const uint8_t * buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t * buf) {
+    return get_le32(buf) | ((uint64_t)get_le32(buf + 4) << 32);
+}
+
+
+/**
+ * @brief Format an IMS value as a binascii line (without the newline)
+ *
+ * The line is MSb-to-LSb, starting from IMS[34].
+ *
+ * @param ims The 35-byte IMS value
+ * @param line The IMS_BINASCII_SIZE-character output buffer
+ */
+void ims_to_binascii(const uint8_t * ims, char * line) {
+    int byte_index;
+    int bit;
+    uint8_t byte;
+
+    for (byte_index = IMS_SIZE - 1; byte_index >= 0; byte_index--) {
+        byte = ims[byte_index];
+        for (bit = 0; bit < 8; bit++) {
+            *line++ = (byte & BYTE_MASK_MSB)? '1' : '0';
+            byte <<= 1;
+        }
+    }
+}
+
+
+/**
+ * @brief Parse a binascii line into an IMS value
+ *
+ * @param line The IMS_BINASCII_SIZE characters to parse
+ * @param ims The 35-byte IMS output value
+ *
+ * @returns Zero if successful, EIO if the line holds anything but '0'/'1'.
+ */
+int ims_from_binascii(const char * line, uint8_t * ims) {
+    int byte_index;
+    int bit;
+    uint8_t byte;
+
+    for (byte_index = IMS_SIZE - 1; byte_index >= 0; byte_index--) {
+        byte = 0;
+        for (bit = 0; bit < 8; bit++) {
+            byte <<= 1;
+            if (*line == '1') {
+                byte |= 1;
+            } else if (*line != '0') {
+                fprintf(stderr, "ERROR: IMS file contains garbage (%c)\n",
+                        *line);
+                return EIO;
+            }
+            line++;
+        }
+        ims[byte_index] = byte;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Read the next IMS value from a binascii IMS file
+ *
+ * @param fp The binascii file
+ * @param ims The 35-byte IMS output value
+ * @param eof Set true (and ims untouched) at the end of the file
+ *
+ * @returns Zero if successful, EIO on a malformed line or read error.
+ */
+int ims_read_binascii_line(FILE * fp, uint8_t * ims, bool * eof) {
+    char line[IMS_LINE_SIZE + 2];   /* (room for a CR and the NUL) */
+
+    *eof = false;
+    if (!fgets(line, sizeof(line), fp)) {
+        if (ferror(fp)) {
+            fprintf(stderr, "ERROR: Can't read IMS file\n");
+            return EIO;
+        }
+        *eof = true;
+        return 0;
+    }
+    if (strcspn(line, "\r\n") != IMS_BINASCII_SIZE) {
+        fprintf(stderr, "ERROR: IMS file line is not an IMS value\n");
+        return EIO;
+    }
+
+    return ims_from_binascii(line, ims);
+}
+
+
+/**
+ * @brief Determine if a file is a binary IMS container
+ *
+ * @param filename The file to check
+ *
+ * @returns True if it starts with the container magic, false otherwise.
+ */
+bool ims_file_is_binary(const char * filename) {
+    char magic[IMS_FILE_MAGIC_SIZE];
+    bool binary = false;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd != -1) {
+        binary = (read(fd, magic, sizeof(magic)) == sizeof(magic)) &&
+                 (memcmp(magic, IMS_FILE_MAGIC, sizeof(magic)) == 0);
+        close(fd);
+    }
+
+    return binary;
+}
+
+
+/**
+ * @brief Build a container header
+ *
+ * @param header The IMS_FILE_HEADER_SIZE-byte buffer to fill in
+ * @param num_records The number of records
+ * @param index_offset The offset of the index (0 if not yet written)
+ * @param flags The header flags
+ */
+static void ims_file_header(uint8_t * header,
+                            uint64_t num_records,
+                            uint64_t index_offset,
+                            uint32_t flags) {
+    memset(header, 0, IMS_FILE_HEADER_SIZE);
+    memcpy(header, IMS_FILE_MAGIC, IMS_FILE_MAGIC_SIZE);
+    put_le32(&header[HDR_VERSION], IMS_FILE_VERSION);
+    put_le32(&header[HDR_RECORD_SIZE], IMS_SIZE);
+    put_le64(&header[HDR_NUM_RECORDS], num_records);
+    put_le64(&header[HDR_INDEX_OFFSET], index_offset);
+    put_le32(&header[HDR_INDEX_BLOCK], IMS_FILE_INDEX_BLOCK);
+    put_le32(&header[HDR_FLAGS], flags);
+    put_le32(&header[HDR_CRC], crc32c(0, header, HDR_CRC));
+}
+
+
+/**
+ * @brief Write a buffer in full
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int write_all(int fd, const uint8_t * buf, size_t length) {
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, buf, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        buf += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Create a binary IMS container
+ *
+ * @param filename The name of the file to create (truncated if it exists)
+ *
+ * @returns A writer if successful, NULL otherwise.
+ */
+ims_file_writer * ims_file_create(const char * filename) {
+    ims_file_writer * writer;
+    uint8_t header[IMS_FILE_HEADER_SIZE];
+
+    writer = calloc(1, sizeof(*writer));
+    if (!writer) {
+        fprintf(stderr, "ERROR: Can't allocate IMS file writer\n");
+        return NULL;
+    }
+
+    writer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd == -1) {
+        fprintf(stderr, "ERROR: Can't create IMS file '%s' (err %d)\n",
+                filename, errno);
+        free(writer);
+        return NULL;
+    }
+
+    /* An unfinalized header, so a crash leaves a recoverable file */
+    ims_file_header(header, 0, 0, 0);
+    if (write_all(writer->fd, header, sizeof(header)) != 0) {
+        fprintf(stderr, "ERROR: Can't write IMS file '%s' (err %d)\n",
+                filename, errno);
+        close(writer->fd);
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+
+/**
+ * @brief Write out any buffered records
+ *
+ * @param writer The writer
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_flush(ims_file_writer * writer) {
+    int status;
+
+    status = write_all(writer->fd, writer->buffer, writer->buffered);
+    if (status != 0) {
+        fprintf(stderr, "ERROR: Can't write IMS file (err %d)\n", status);
+    }
+    writer->buffered = 0;
+
+    return status;
+}
+
+
+/**
+ * @brief Append an IMS value to a binary IMS container
+ *
+ * @param writer The writer
+ * @param ims The 35-byte IMS value
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_append(ims_file_writer * writer, const uint8_t * ims) {
+    int status = 0;
+    uint8_t * record;
+    uint32_t * index;
+    uint64_t block;
+
+    if (writer->buffered + IMS_FILE_RECORD_SIZE > sizeof(writer->buffer)) {
+        status = ims_file_flush(writer);
+        if (status != 0) {
+            return status;
+        }
+    }
+
+    record = &writer->buffer[writer->buffered];
+    memcpy(record, ims, IMS_SIZE);
+    put_le32(&record[IMS_SIZE], crc32c(0, ims, IMS_SIZE));
+    writer->block_crc = crc32c(writer->block_crc, record,
+                               IMS_FILE_RECORD_SIZE);
+    writer->buffered += IMS_FILE_RECORD_SIZE;
+    writer->num_records++;
+
+    /* Close off the index block once it's full */
+    if ((writer->num_records % IMS_FILE_INDEX_BLOCK) == 0) {
+        block = writer->num_records / IMS_FILE_INDEX_BLOCK - 1;
+        if (block >= writer->index_max) {
+            writer->index_max = (writer->index_max)? writer->index_max * 2 : 64;
+            index = realloc(writer->index,
+                            writer->index_max * sizeof(*writer->index));
+            if (!index) {
+                fprintf(stderr, "ERROR: Can't grow IMS file index\n");
+                return ENOMEM;
+            }
+            writer->index = index;
+        }
+        writer->index[block] = writer->block_crc;
+        writer->block_crc = 0;
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Write out any buffered records and wait until they are on disk
+ *
+ * @param writer The writer
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_sync(ims_file_writer * writer) {
+    int status;
+
+    status = ims_file_flush(writer);
+    if ((status == 0) && (fdatasync(writer->fd) != 0)) {
+        status = errno;
+        fprintf(stderr, "ERROR: Can't sync IMS file (err %d)\n", status);
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Reopen a binary IMS container to append to it
+ *
+ * Keeps the first num_records records (checking their CRCs), drops
+ * anything after them (including the index of a finalized container) and
+ * marks the container unfinalized again.
+ *
+ * @param filename The container to reopen
+ * @param num_records The number of records to keep
+ *
+ * @returns A writer positioned after the kept records if successful, NULL
+ *          otherwise.
+ */
+ims_file_writer * ims_file_reopen(const char * filename,
+                                  uint64_t num_records) {
+    ims_file_writer * writer;
+    ims_file_map map;
+    uint8_t header[IMS_FILE_HEADER_SIZE];
+    const uint8_t * record;
+    uint32_t * index;
+    uint64_t i;
+    off_t size;
+    int status;
+
+    writer = calloc(1, sizeof(*writer));
+    if (!writer) {
+        fprintf(stderr, "ERROR: Can't allocate IMS file writer\n");
+        return NULL;
+    }
+    writer->fd = -1;
+
+    /* Rebuild the index block CRCs from the records being kept */
+    status = ims_file_map_open(filename, &map);
+    if (status != 0) {
+        goto ims_file_reopen_err;
+    }
+    if (map.num_records < num_records) {
+        fprintf(stderr, "ERROR: IMS file '%s' holds only %llu of %llu "
+                "records\n", filename, (unsigned long long)map.num_records,
+                (unsigned long long)num_records);
+        status = EIO;
+    }
+    for (i = 0; (i < num_records) && (status == 0); i++) {
+        record = map.base + IMS_FILE_HEADER_SIZE + i * IMS_FILE_RECORD_SIZE;
+        if (get_le32(&record[IMS_SIZE]) != crc32c(0, record, IMS_SIZE)) {
+            fprintf(stderr, "ERROR: IMS record %llu is corrupt\n",
+                    (unsigned long long)i);
+            status = EIO;
+            break;
+        }
+        writer->block_crc = crc32c(writer->block_crc, record,
+                                   IMS_FILE_RECORD_SIZE);
+        writer->num_records++;
+        if ((writer->num_records % IMS_FILE_INDEX_BLOCK) == 0) {
+            if (writer->num_records / IMS_FILE_INDEX_BLOCK >
+                writer->index_max) {
+                writer->index_max = (writer->index_max)?
+                                    writer->index_max * 2 : 64;
+                index = realloc(writer->index,
+                                writer->index_max * sizeof(*writer->index));
+                if (!index) {
+                    fprintf(stderr, "ERROR: Can't grow IMS file index\n");
+                    status = ENOMEM;
+                    break;
+                }
+                writer->index = index;
+            }
+            writer->index[writer->num_records / IMS_FILE_INDEX_BLOCK - 1] =
+                writer->block_crc;
+            writer->block_crc = 0;
+        }
+    }
+    ims_file_map_close(&map);
+    if (status != 0) {
+        goto ims_file_reopen_err;
+    }
+
+    /* Drop everything after them, and unfinalize the header */
+    writer->fd = open(filename, O_WRONLY);
+    size = IMS_FILE_HEADER_SIZE + num_records * IMS_FILE_RECORD_SIZE;
+    ims_file_header(header, 0, 0, 0);
+    if ((writer->fd == -1) || (ftruncate(writer->fd, size) != 0) ||
+        (pwrite(writer->fd, header, sizeof(header), 0) != sizeof(header)) ||
+        (lseek(writer->fd, size, SEEK_SET) != size)) {
+        fprintf(stderr, "ERROR: Can't reopen IMS file '%s' (err %d)\n",
+                filename, errno);
+        goto ims_file_reopen_err;
+    }
+
+    return writer;
+
+ims_file_reopen_err:
+    if (writer->fd != -1) {
+        close(writer->fd);
+    }
+    free(writer->index);
+    free(writer);
+    return NULL;
+}
+
+
+/**
+ * @brief Finish a binary IMS container: write the index and final header
+ *
+ * Frees the writer whether or not it succeeds.
+ *
+ * @param writer The writer
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_close(ims_file_writer * writer) {
+    int status;
+    uint8_t header[IMS_FILE_HEADER_SIZE];
+    uint8_t trailer[IMS_FILE_TRAILER_SIZE];
+    uint8_t entry[4];
+    uint64_t num_blocks;
+    uint64_t index_offset;
+    uint64_t block;
+    uint32_t index_crc = 0;
+
+    if (!writer) {
+        return 0;
+    }
+
+    num_blocks = (writer->num_records + IMS_FILE_INDEX_BLOCK - 1) /
+                 IMS_FILE_INDEX_BLOCK;
+    index_offset = IMS_FILE_HEADER_SIZE +
+                   writer->num_records * IMS_FILE_RECORD_SIZE;
+
+    /* Records, then the index (staged through the record buffer) */
+    status = ims_file_flush(writer);
+    for (block = 0; (block < num_blocks) && (status == 0); block++) {
+        put_le32(entry, (block < writer->num_records / IMS_FILE_INDEX_BLOCK)?
+                        writer->index[block] : writer->block_crc);
+        index_crc = crc32c(index_crc, entry, sizeof(entry));
+        if (writer->buffered + sizeof(entry) > sizeof(writer->buffer)) {
+            status = ims_file_flush(writer);
+        }
+        memcpy(&writer->buffer[writer->buffered], entry, sizeof(entry));
+        writer->buffered += sizeof(entry);
+    }
+    if (status == 0) {
+        status = ims_file_flush(writer);
+    }
+
+    /* Trailer */
+    if (status == 0) {
+        memcpy(trailer, IMS_FILE_INDEX_MAGIC, IMS_FILE_MAGIC_SIZE);
+        put_le32(&trailer[TRL_NUM_BLOCKS], (uint32_t)num_blocks);
+        put_le32(&trailer[TRL_CRC], index_crc);
+        status = write_all(writer->fd, trailer, sizeof(trailer));
+    }
+
+    /* Finally, the header - only now is the container valid */
+    if (status == 0) {
+        ims_file_header(header, writer->num_records, index_offset,
+                        IMS_FILE_FINALIZED);
+        if ((pwrite(writer->fd, header, sizeof(header), 0) !=
+             sizeof(header)) || (fsync(writer->fd) != 0)) {
+            status = errno;
+        }
+    }
+    if (status != 0) {
+        fprintf(stderr, "ERROR: Can't finish IMS file (err %d)\n", status);
+    }
+
+    if ((close(writer->fd) != 0) && (status == 0)) {
+        status = errno;
+    }
+    free(writer->index);
+    free(writer);
+
+    return status;
+}
+
+
+/**
+ * @brief Map a binary IMS container for reading
+ *
+ * Checks the header and, for a finalized container, the index trailer.
+ *
+ * @param filename The container to open
+ * @param map The mapping to fill in
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_map_open(const char * filename, ims_file_map * map) {
+    int status = 0;
+    struct stat file_stat;
+    const uint8_t * header;
+    const uint8_t * trailer;
+    uint64_t index_offset;
+    uint64_t num_blocks;
+
+    memset(map, 0, sizeof(*map));
+    map->fd = open(filename, O_RDONLY);
+    if (map->fd == -1) {
+        fprintf(stderr, "ERROR: Can't open IMS file '%s'\n", filename);
+        return errno;
+    }
+    if (fstat(map->fd, &file_stat) != 0) {
+        fprintf(stderr, "ERROR: Can't find IMS file '%s'\n", filename);
+        status = errno;
+        goto map_open_err;
+    }
+    map->size = file_stat.st_size;
+    if (map->size < IMS_FILE_HEADER_SIZE) {
+        fprintf(stderr, "ERROR: IMS file '%s' is truncated\n", filename);
+        status = EIO;
+        goto map_open_err;
+    }
+
+    map->base = mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+    if (map->base == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Can't map IMS file '%s' (err %d)\n",
+                filename, errno);
+        map->base = NULL;
+        status = errno;
+        goto map_open_err;
+    }
+    madvise((void *)map->base, map->size, MADV_RANDOM);
+
+    /* Header */
+    header = map->base;
+    if ((memcmp(header, IMS_FILE_MAGIC, IMS_FILE_MAGIC_SIZE) != 0) ||
+        (get_le32(&header[HDR_CRC]) != crc32c(0, header, HDR_CRC)) ||
+        (get_le32(&header[HDR_VERSION]) != IMS_FILE_VERSION) ||
+        (get_le32(&header[HDR_RECORD_SIZE]) != IMS_SIZE) ||
+        (get_le32(&header[HDR_INDEX_BLOCK]) != IMS_FILE_INDEX_BLOCK)) {
+        fprintf(stderr, "ERROR: '%s' has a bad IMS file header\n", filename);
+        status = EIO;
+        goto map_open_err;
+    }
+    map->finalized = (get_le32(&header[HDR_FLAGS]) & IMS_FILE_FINALIZED) != 0;
+
+    if (map->finalized) {
+        /* The record count, index and trailer must all agree */
+        map->num_records = get_le64(&header[HDR_NUM_RECORDS]);
+        index_offset = get_le64(&header[HDR_INDEX_OFFSET]);
+        num_blocks = (map->num_records + IMS_FILE_INDEX_BLOCK - 1) /
+                     IMS_FILE_INDEX_BLOCK;
+        trailer = map->base + map->size - IMS_FILE_TRAILER_SIZE;
+        if ((index_offset != IMS_FILE_HEADER_SIZE +
+                             map->num_records * IMS_FILE_RECORD_SIZE) ||
+            (map->size != index_offset + num_blocks * 4 +
+                          IMS_FILE_TRAILER_SIZE) ||
+            (memcmp(trailer, IMS_FILE_INDEX_MAGIC,
+                    IMS_FILE_MAGIC_SIZE) != 0) ||
+            (get_le32(&trailer[TRL_NUM_BLOCKS]) != num_blocks) ||
+            (get_le32(&trailer[TRL_CRC]) !=
+             crc32c(0, map->base + index_offset, num_blocks * 4))) {
+            fprintf(stderr, "ERROR: '%s' has a bad IMS file index\n",
+                    filename);
+            status = EIO;
+            goto map_open_err;
+        }
+    } else {
+        /* Never closed: take whatever whole records made it out */
+        map->num_records = (map->size - IMS_FILE_HEADER_SIZE) /
+                           IMS_FILE_RECORD_SIZE;
+        fprintf(stderr, "Warning: IMS file '%s' was not closed, "
+                "recovered %llu records\n",
+                filename, (unsigned long long)map->num_records);
+    }
+
+    return 0;
+
+map_open_err:
+    ims_file_map_close(map);
+    return status;
+}
+
+
+/**
+ * @brief Fetch a record from a mapped binary IMS container
+ *
+ * @param map The mapping
+ * @param index Which IMS value to fetch (zero-based)
+ * @param ims The 35-byte IMS output value
+ *
+ * @returns Zero if successful, EINVAL if index is out of range, EIO if the
+ *          record's CRC doesn't match.
+ */
+int ims_file_map_record(const ims_file_map * map, uint64_t index,
+                        uint8_t * ims) {
+    const uint8_t * record;
+
+    if (index >= map->num_records) {
+        return EINVAL;
+    }
+
+    record = map->base + IMS_FILE_HEADER_SIZE + index * IMS_FILE_RECORD_SIZE;
+    if (get_le32(&record[IMS_SIZE]) != crc32c(0, record, IMS_SIZE)) {
+        fprintf(stderr, "ERROR: IMS record %llu is corrupt\n",
+                (unsigned long long)index);
+        return EIO;
+    }
+    memcpy(ims, record, IMS_SIZE);
+
+    return 0;
+}
+
+
+/**
+ * @brief Check every record and index block CRC of a mapped container
+ *
+ * @param map The mapping
+ *
+ * @returns Zero if everything matches, EIO otherwise.
+ */
+int ims_file_map_verify(const ims_file_map * map) {
+    const uint8_t * records = map->base + IMS_FILE_HEADER_SIZE;
+    const uint8_t * record;
+    const uint8_t * index;
+    uint64_t i;
+    uint64_t block;
+    uint64_t block_records;
+    int status = 0;
+
+    for (i = 0; i < map->num_records; i++) {
+        record = records + i * IMS_FILE_RECORD_SIZE;
+        if (get_le32(&record[IMS_SIZE]) != crc32c(0, record, IMS_SIZE)) {
+            fprintf(stderr, "ERROR: IMS record %llu is corrupt\n",
+                    (unsigned long long)i);
+            status = EIO;
+        }
+    }
+
+    if (map->finalized) {
+        index = records + map->num_records * IMS_FILE_RECORD_SIZE;
+        for (block = 0; block * IMS_FILE_INDEX_BLOCK < map->num_records;
+             block++) {
+            block_records = map->num_records - block * IMS_FILE_INDEX_BLOCK;
+            if (block_records > IMS_FILE_INDEX_BLOCK) {
+                block_records = IMS_FILE_INDEX_BLOCK;
+            }
+            if (get_le32(&index[block * 4]) !=
+                crc32c(0, records + block * IMS_FILE_INDEX_BLOCK *
+                                    IMS_FILE_RECORD_SIZE,
+                       block_records * IMS_FILE_RECORD_SIZE)) {
+                fprintf(stderr, "ERROR: IMS index block %llu is corrupt\n",
+                        (unsigned long long)block);
+                status = EIO;
+            }
+        }
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Unmap a binary IMS container
+ *
+ * @param map The mapping
+ */
+void ims_file_map_close(ims_file_map * map) {
+    if (map->base) {
+        munmap((void *)map->base, map->size);
+        map->base = NULL;
+    }
+    if (map->fd != -1) {
+        close(map->fd);
+        map->fd = -1;
+    }
+}
@@ -0,0 +1,280 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the header information for the IMS file
+ * formats: the Toshiba binascii format (one line of 280 '0'/'1' characters
+ * per IMS, MSb first) and the binary IMS container.
+ *
+ * Binary container layout (all integers little-endian):
+ *
+ *   Header (64 bytes)
+ *       0  magic "IMSBIN\r\n"
+ *       8  u32 version (1)
+ *      12  u32 IMS size (35)
+ *      16  u64 number of records
+ *      24  u64 offset of the index
+ *      32  u32 records per index block
+ *      36  u32 flags (IMS_FILE_FINALIZED once the index is written)
+ *      40  reserved (zero)
+ *      60  u32 CRC32C of bytes 0..59
+ *   Records, from offset 64
+ *      35  bytes IMS (in memory order, IMS[0] first)
+ *       4  bytes CRC32C of those 35 bytes
+ *   Index, from the index offset
+ *          u32 CRC32C of each block of records (records per block as above)
+ *          Trailer: magic "IMSINDEX", u32 number of blocks, u32 CRC32C of
+ *          the block CRCs
+ *
+ * A container that was never closed (flags == 0) still holds every record
+ * written up to the last flush; readers recover the count from its size.
+ *
+ */
+
+#ifndef _IMS_FILE_H
+#define _IMS_FILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* binascii: 8 characters per IMS byte, plus the newline */
+#define IMS_BINASCII_SIZE           (IMS_SIZE * 8)
+#define IMS_LINE_SIZE               (IMS_BINASCII_SIZE + 1)
+
+#define IMS_FILE_MAGIC              "IMSBIN\r\n"
+#define IMS_FILE_MAGIC_SIZE         8
+#define IMS_FILE_VERSION            1
+#define IMS_FILE_HEADER_SIZE        64
+#define IMS_FILE_RECORD_SIZE        (IMS_SIZE + 4)
+#define IMS_FILE_INDEX_BLOCK        4096
+#define IMS_FILE_INDEX_MAGIC        "IMSINDEX"
+#define IMS_FILE_TRAILER_SIZE       16
+#define IMS_FILE_FINALIZED          0x00000001
+
+/* Size of the binary writer's buffer */
+#define IMS_FILE_WRITE_BUFFER       (64 * 1024)
+
+
+/**
+ * @brief Binary IMS container writer
+ */
+typedef struct {
+    int        fd;
+    uint64_t   num_records;
+    uint32_t   block_crc;       /* CRC32C of the current index block so far */
+    uint32_t * index;           /* CRC32C of each completed index block */
+    uint64_t   index_max;
+    size_t     buffered;
+    uint8_t    buffer[IMS_FILE_WRITE_BUFFER];
+} ims_file_writer;
+
+
+/**
+ * @brief A binary IMS container, mapped for reading
+ */
+typedef struct {
+    int             fd;
+    const uint8_t * base;
+    size_t          size;
+    uint64_t        num_records;
+    bool            finalized;
+} ims_file_map;
+
+
+/**
+ * @brief Compute (or continue) a CRC32C (Castagnoli)
+ *
+ * @param crc The CRC so far (0 to start)
+ * @param data The data to add
+ * @param length The length of the data in bytes
+ *
+ * @returns The updated CRC.
+ */
+uint32_t crc32c(uint32_t crc, const uint8_t * data, size_t length);
+
+
+/**
+ * @brief Format an IMS value as a binascii line (without the newline)
+ *
+ * @param ims The 35-byte IMS value
+ * @param line The IMS_BINASCII_SIZE-character output buffer
+ */
+void ims_to_binascii(const uint8_t * ims, char * line);
+
+
+/**
+ * @brief Parse a binascii line into an IMS value
+ *
+ * @param line The IMS_BINASCII_SIZE characters to parse
+ * @param ims The 35-byte IMS output value
+ *
+ * @returns Zero if successful, EIO if the line holds anything but '0'/'1'.
+ */
+int ims_from_binascii(const char * line, uint8_t * ims);
+
+
+/**
+ * @brief Read the next IMS value from a binascii IMS file
+ *
+ * @param fp The binascii file
+ * @param ims The 35-byte IMS output value
+ * @param eof Set true (and ims untouched) at the end of the file
+ *
+ * @returns Zero if successful, EIO on a malformed line or read error.
+ */
+int ims_read_binascii_line(FILE * fp, uint8_t * ims, bool * eof);
+
+
+/**
+ * @brief Determine if a file is a binary IMS container
+ *
+ * @param filename The file to check
+ *
+ * @returns True if it starts with the container magic, false otherwise.
+ */
+bool ims_file_is_binary(const char * filename);
+
+
+/**
+ * @brief Create a binary IMS container
+ *
+ * @param filename The name of the file to create (truncated if it exists)
+ *
+ * @returns A writer if successful, NULL otherwise.
+ */
+ims_file_writer * ims_file_create(const char * filename);
+
+
+/**
+ * @brief Append an IMS value to a binary IMS container
+ *
+ * @param writer The writer
+ * @param ims The 35-byte IMS value
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_append(ims_file_writer * writer, const uint8_t * ims);
+
+
+/**
+ * @brief Write out any buffered records
+ *
+ * @param writer The writer
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_flush(ims_file_writer * writer);
+
+
+/**
+ * @brief Write out any buffered records and wait until they are on disk
+ *
+ * @param writer The writer
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_sync(ims_file_writer * writer);
+
+
+/**
+ * @brief Reopen a binary IMS container to append to it
+ *
+ * Keeps the first num_records records (checking their CRCs), drops
+ * anything after them (including the index of a finalized container) and
+ * marks the container unfinalized again.
+ *
+ * @param filename The container to reopen
+ * @param num_records The number of records to keep
+ *
+ * @returns A writer positioned after the kept records if successful, NULL
+ *          otherwise.
+ */
+ims_file_writer * ims_file_reopen(const char * filename,
+                                  uint64_t num_records);
+
+
+/**
+ * @brief Finish a binary IMS container: write the index and final header
+ *
+ * Frees the writer whether or not it succeeds.
+ *
+ * @param writer The writer
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_close(ims_file_writer * writer);
+
+
+/**
+ * @brief Map a binary IMS container for reading
+ *
+ * Checks the header and, for a finalized container, the index trailer.
+ *
+ * @param filename The container to open
+ * @param map The mapping to fill in
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_file_map_open(const char * filename, ims_file_map * map);
+
+
+/**
+ * @brief Fetch a record from a mapped binary IMS container
+ *
+ * @param map The mapping
+ * @param index Which IMS value to fetch (zero-based)
+ * @param ims The 35-byte IMS output value
+ *
+ * @returns Zero if successful, EINVAL if index is out of range, EIO if the
+ *          record's CRC doesn't match.
+ */
+int ims_file_map_record(const ims_file_map * map, uint64_t index,
+                        uint8_t * ims);
+
+
+/**
+ * @brief Check every record and index block CRC of a mapped container
+ *
+ * @param map The mapping
+ *
+ * @returns Zero if everything matches, EIO otherwise.
+ */
+int ims_file_map_verify(const ims_file_map * map);
+
+
+/**
+ * @brief Unmap a binary IMS container
+ *
+ * @param map The mapping
+ */
+void ims_file_map_close(ims_file_map * map);
+
+#endif /* !_IMS_FILE_H */
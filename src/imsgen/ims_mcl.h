@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ *
+ * @brief: This file declares the decorated MIRACL functions imsgen calls.
+ *
+ * The MIRACL libraries are built with CONFIG_DECORATOR (see
+ * src/vendors/MIRACL/ara/Decorator.mk), which appends the curve name to
+ * each function (the RSA size for RSA padding) so that the C488, C25519
+ * and RSA2048 builds can be linked together.
+ * The MIRACL headers only declare the undecorated names.
+ *
+ */
+
+#ifndef _IMS_MCL_H
+#define _IMS_MCL_H
+
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "mcl_rand.h"
+#include "mcl_rsa.h"
+
+/* ECC on C488 (EPVK) and C25519 (ESVK), from mcl_ecdh.h */
+extern int MCL_ECP_FIXED_BASE_INIT_C488(void);
+extern int MCL_ECP_KEY_PAIR_GENERATE_FIXED_C488(csprng *R, mcl_octet *s,
+                                                mcl_octet *W);
+extern int MCL_ECP_PUBLIC_KEY_VALIDATE_C488(int f, mcl_octet *W);
+extern int MCL_ECPSP_DSA_C488(int h, csprng *R, mcl_octet *s, mcl_octet *M,
+                              mcl_octet *c, mcl_octet *d);
+extern int MCL_ECPVP_DSA_C488(int h, mcl_octet *W, mcl_octet *M,
+                              mcl_octet *c, mcl_octet *d);
+
+extern int MCL_ECP_FIXED_BASE_INIT_C25519(void);
+extern int MCL_ECP_KEY_PAIR_GENERATE_FIXED_C25519(csprng *R, mcl_octet *s,
+                                                  mcl_octet *W);
+extern int MCL_ECP_PUBLIC_KEY_VALIDATE_C25519(int f, mcl_octet *W);
+extern int MCL_ECPSP_DSA_C25519(int h, csprng *R, mcl_octet *s,
+                                mcl_octet *M, mcl_octet *c, mcl_octet *d);
+extern int MCL_ECPVP_DSA_C25519(int h, mcl_octet *W, mcl_octet *M,
+                                mcl_octet *c, mcl_octet *d);
+
+/* Finite-field arithmetic of the C25519 build (ERRK P/Q), from mcl_ff.h */
+extern void MCL_FF_copy_C25519(mcl_chunk x[][MCL_BS], mcl_chunk y[][MCL_BS],
+                               int n);
+extern void MCL_FF_init_C25519(mcl_chunk x[][MCL_BS], sign32 m, int n);
+extern int MCL_FF_parity_C25519(mcl_chunk x[][MCL_BS]);
+extern int MCL_FF_comp_C25519(mcl_chunk x[][MCL_BS], mcl_chunk y[][MCL_BS],
+                              int n);
+extern void MCL_FF_add_C25519(mcl_chunk x[][MCL_BS], mcl_chunk y[][MCL_BS],
+                              mcl_chunk z[][MCL_BS], int n);
+extern void MCL_FF_inc_C25519(mcl_chunk x[][MCL_BS], int m, int n);
+extern void MCL_FF_dec_C25519(mcl_chunk x[][MCL_BS], int m, int n);
+extern void MCL_FF_norm_C25519(mcl_chunk x[][MCL_BS], int n);
+extern void MCL_FF_shr_C25519(mcl_chunk x[][MCL_BS], int n);
+extern void MCL_FF_toOctet_C25519(mcl_octet *S, mcl_chunk x[][MCL_BS], int n);
+extern void MCL_FF_fromOctet_C25519(mcl_chunk x[][MCL_BS], mcl_octet *S,
+                                    int n);
+extern void MCL_FF_mul_C25519(mcl_chunk x[][MCL_BS], mcl_chunk y[][MCL_BS],
+                              mcl_chunk z[][MCL_BS], int n);
+extern void MCL_FF_invmodp_C25519(mcl_chunk x[][MCL_BS],
+                                  mcl_chunk y[][MCL_BS],
+                                  mcl_chunk z[][MCL_BS], int n);
+extern int MCL_FF_cfactor_C25519(mcl_chunk x[][MCL_BS], sign32 s, int n);
+
+/* The same with caller-owned scratch space, for one thread per mcl_ff_ws */
+extern void MCL_FF_ws_init_C25519(mcl_ff_ws *ws);
+extern int MCL_FF_cfactor_ws_C25519(mcl_chunk x[][MCL_BS], sign32 s, int n,
+                                    mcl_ff_ws *ws);
+extern int MCL_FF_prime_ws_C25519(mcl_chunk x[][MCL_BS], csprng *R, int n,
+                                  mcl_ff_ws *ws);
+
+/* RSA-2048 encryption and padding, from mcl_rsa.h */
+extern int MCL_PKCS15_RSA2048(int h, mcl_octet *M, mcl_octet *W);
+extern int MCL_OAEP_ENCODE_RSA2048(int h, mcl_octet *M, csprng *R,
+                                   mcl_octet *P, mcl_octet *F);
+extern int MCL_OAEP_DECODE_RSA2048(int h, mcl_octet *P, mcl_octet *F);
+extern void MCL_RSA_ENCRYPT_RSA2048(MCL_rsa_public_key *PUB, mcl_octet *F,
+                                    mcl_octet *G);
+extern void MCL_RSA_DECRYPT_RSA2048(MCL_rsa_private_key *PRIV, mcl_octet *G,
+                                    mcl_octet *F);
+
+#endif /* !_IMS_MCL_H */
@@ -0,0 +1,574 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the code for "ims-merge" a Linux command-line
+ * app used to combine the IMS files and key databases of several sharded
+ * ("imsgen --shard i/N") runs into a single IMS file and database.
+ *
+ * Each shard database is streamed in EP_UID order (its primary key index),
+ * and the streams are merged, so duplicate EP_UIDs across shards are found
+ * in a single pass over all rows without any per-row lookups. The IMS files
+ * are concatenated in the order the shards are given.
+ *
+ * Shard databases may use either key schema (see db_schema.h); the merged
+ * database keeps its own, and a new one gets the current schema.
+ *
+ */
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sqlite3.h>
+#include "util.h"
+#include "parse_support.h"
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "mcl_ecdh.h"
+#include "mcl_rand.h"
+#include "mcl_rsa.h"
+#include "crypto.h"
+#include "ims_common.h"
+#include "ims_file.h"
+#include "db_schema.h"
+
+
+/* Program return values */
+#define PROGRAM_SUCCESS     0
+#define PROGRAM_WARNINGS    1
+#define PROGRAM_ERROR       2
+
+/* The most shards that can be merged in one run */
+#define MERGE_MAX_SHARDS    256
+
+
+/**
+ * A shard being merged: its key database, streamed in EP_UID order
+ */
+typedef struct {
+    const char *    ims_name;
+    const char *    db_name;
+    sqlite3 *       db;
+    sqlite3_stmt *  select;
+    int             version;    /* The database's schema version */
+    bool            more;       /* select is positioned on a row */
+    uint8_t         ep_uid[DB_EP_UID_SIZE];     /* ...with this EP_UID */
+    uint64_t        num_rows;
+} merge_shard;
+
+
+/* Parsing args */
+static int      binary_out = 0;
+static char *   ims_filename;
+static char *   database_name;
+
+static char *   binary_out_names[] = { "binary", NULL };
+static char *   ims_filename_names[] = { "out", "ims", NULL };
+static char *   database_name_names[] = { "db", "database", NULL };
+
+
+/* Parsing table */
+static struct optionx parse_table[] = {
+    { 'o', ims_filename_names, NULL,
+      &ims_filename, 0, REQUIRED, &store_str, false,
+      "The name of the merged IMS output file" },
+    { 'd', database_name_names, NULL,
+      &database_name, 0, REQUIRED, &store_str, false,
+      "The (new or empty) database to receive the merged keysets" },
+    { 'B', binary_out_names, NULL,
+      &binary_out, 0, STORE_TRUE, NULL, false,
+      "Write the IMS file as a binary IMS container" },
+    { 0, NULL, NULL, NULL, 0, 0, NULL, 0, NULL }
+};
+
+static char all_args[] = "o:d:B";
+
+static merge_shard shards[MERGE_MAX_SHARDS];
+static uint32_t num_shards;
+static int out_version;
+
+static const char * select_stmt =
+    "SELECT ep_uid, epvk, esvk, erpk_mod FROM pub_keys ORDER BY ep_uid";
+static const char * insert_stmt =
+    "INSERT INTO pub_keys(ep_uid, epvk, esvk, erpk_mod) VALUES (?, ?, ?, ?)";
+
+
+/**
+ * @brief Advance a shard's EP_UID-ordered stream
+ *
+ * @param shard The shard
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+static int shard_step(merge_shard * shard) {
+    int status;
+
+    status = sqlite3_step(shard->select);
+    shard->more = (status == SQLITE_ROW);
+    if ((status != SQLITE_ROW) && (status != SQLITE_DONE)) {
+        fprintf(stderr, "ERROR: Can't read '%s': %s\n", shard->db_name,
+                sqlite3_errmsg(shard->db));
+        return EIO;
+    }
+    if (shard->more &&
+        !db_column_ep_uid(shard->select, 0, shard->version, shard->ep_uid)) {
+        fprintf(stderr, "ERROR: malformed EP_UID in '%s'\n", shard->db_name);
+        return EIO;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Open a shard's key database and position it on its first row
+ *
+ * @param shard The shard
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int shard_open(merge_shard * shard) {
+    if (sqlite3_open_v2(shard->db_name, &shard->db, SQLITE_OPEN_READONLY,
+                        NULL) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't open database '%s': %s\n",
+                shard->db_name, sqlite3_errmsg(shard->db));
+        return EIO;
+    }
+    if (db_schema_version(shard->db, &shard->version) != 0) {
+        return EIO;
+    }
+    if (shard->version == DB_SCHEMA_NONE) {
+        fprintf(stderr, "ERROR: '%s' has no keysets table\n", shard->db_name);
+        return EIO;
+    }
+    if (sqlite3_prepare_v2(shard->db, select_stmt, -1, &shard->select,
+                           NULL) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't read '%s': %s\n", shard->db_name,
+                sqlite3_errmsg(shard->db));
+        return EIO;
+    }
+    return shard_step(shard);
+}
+
+
+/**
+ * @brief Close a shard's key database
+ *
+ * @param shard The shard
+ */
+static void shard_close(merge_shard * shard) {
+    sqlite3_finalize(shard->select);
+    shard->select = NULL;
+    sqlite3_close(shard->db);
+    shard->db = NULL;
+}
+
+
+/**
+ * @brief Run a simple SQL statement on the output database
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+static int out_exec(sqlite3 * out, const char * sql) {
+    char * errmsg = NULL;
+    int status = 0;
+
+    if (sqlite3_exec(out, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: '%s' failed: %s\n", sql,
+                errmsg? errmsg : sqlite3_errmsg(out));
+        status = EIO;
+    }
+    sqlite3_free(errmsg);
+    return status;
+}
+
+
+/**
+ * @brief Copy the current row of a shard into the output database
+ *
+ * @returns Zero if successful, EIO otherwise.
+ */
+static int merge_row(sqlite3 * out, sqlite3_stmt * insert,
+                     merge_shard * shard) {
+    int status = 0;
+    int column;
+
+    db_bind_ep_uid(insert, 1, out_version, shard->ep_uid);
+    for (column = 1; column <= 3; column++) {
+        sqlite3_bind_blob(insert, column + 1,
+                          sqlite3_column_blob(shard->select, column),
+                          sqlite3_column_bytes(shard->select, column),
+                          SQLITE_TRANSIENT);
+    }
+    if (sqlite3_step(insert) != SQLITE_DONE) {
+        fprintf(stderr, "ERROR: Can't insert keyset: %s\n",
+                sqlite3_errmsg(out));
+        status = EIO;
+    }
+    sqlite3_reset(insert);
+    sqlite3_clear_bindings(insert);
+
+    return status;
+}
+
+
+/**
+ * @brief Merge the shard key databases into the output database
+ *
+ * An N-way merge of the shards' EP_UID-ordered streams: each step takes
+ * the smallest current EP_UID, so equal EP_UIDs from different shards
+ * surface together. The merge runs in a single transaction which is left
+ * open for the caller to commit or roll back.
+ *
+ * @param out The output database
+ * @param num_merged Set to the number of keysets merged
+ * @param num_duplicates Set to the number of duplicate EP_UIDs found
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int merge_keysets(sqlite3 * out, uint64_t * num_merged,
+                         uint64_t * num_duplicates) {
+    int status = 0;
+    sqlite3_stmt * insert = NULL;
+    merge_shard * min;
+    char uid_hex[DB_EP_UID_HEX_LEN + 1];
+    uint32_t i;
+
+    *num_merged = 0;
+    *num_duplicates = 0;
+    if (sqlite3_prepare_v2(out, insert_stmt, -1, &insert, NULL) !=
+        SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't prepare insert: %s\n",
+                sqlite3_errmsg(out));
+        return EIO;
+    }
+
+    while (status == 0) {
+        /* Find the smallest current EP_UID */
+        min = NULL;
+        for (i = 0; i < num_shards; i++) {
+            if (shards[i].more &&
+                (!min || (memcmp(shards[i].ep_uid, min->ep_uid,
+                                 DB_EP_UID_SIZE) < 0))) {
+                min = &shards[i];
+            }
+        }
+        if (!min) {
+            break;
+        }
+
+        /* Keep it, and report (and skip) the same EP_UID elsewhere */
+        status = merge_row(out, insert, min);
+        for (i = 0; (i < num_shards) && (status == 0); i++) {
+            if ((&shards[i] != min) && shards[i].more) {
+                if (memcmp(shards[i].ep_uid, min->ep_uid,
+                           DB_EP_UID_SIZE) == 0) {
+                    db_ep_uid_to_hex(shards[i].ep_uid, uid_hex);
+                    fprintf(stderr,
+                            "ERROR: EP_UID %s is in both '%s' and '%s'\n",
+                            uid_hex, min->db_name, shards[i].db_name);
+                    (*num_duplicates)++;
+                    shards[i].num_rows++;
+                    status = shard_step(&shards[i]);
+                }
+            }
+        }
+        if (status == 0) {
+            (*num_merged)++;
+            min->num_rows++;
+            status = shard_step(min);
+        }
+    }
+
+    sqlite3_finalize(insert);
+    return status;
+}
+
+
+/**
+ * @brief Append a shard's IMS file to the merged IMS file
+ *
+ * @param shard The shard
+ * @param fp_out The binascii output (if writer is NULL)
+ * @param writer The binary container output
+ * @param count Set to the number of IMS values appended
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int merge_ims(merge_shard * shard, FILE * fp_out,
+                     ims_file_writer * writer, uint64_t * count) {
+    int status = 0;
+    ims_file_map map;
+    FILE * fp = NULL;
+    uint8_t ims[IMS_SIZE];
+    char line[IMS_LINE_SIZE];
+    bool binary;
+    bool mapped = false;
+    bool eof = false;
+    uint64_t i;
+
+    *count = 0;
+    binary = ims_file_is_binary(shard->ims_name);
+    if (binary) {
+        status = ims_file_map_open(shard->ims_name, &map);
+        mapped = (status == 0);
+    } else {
+        fp = fopen(shard->ims_name, "r");
+        if (!fp) {
+            fprintf(stderr, "ERROR: Can't open '%s'\n", shard->ims_name);
+            status = errno;
+        }
+    }
+
+    line[IMS_BINASCII_SIZE] = '\n';
+    for (i = 0; status == 0; i++) {
+        if (binary) {
+            if (i >= map.num_records) {
+                break;
+            }
+            status = ims_file_map_record(&map, i, ims);
+        } else {
+            status = ims_read_binascii_line(fp, ims, &eof);
+            if (eof) {
+                break;
+            }
+        }
+        if (status != 0) {
+            fprintf(stderr, "ERROR: '%s' IMS value %llu is unreadable\n",
+                    shard->ims_name, (unsigned long long)i + 1);
+        } else if (writer) {
+            status = ims_file_append(writer, ims);
+        } else {
+            ims_to_binascii(ims, line);
+            if (fwrite(line, sizeof(line), 1, fp_out) != 1) {
+                fprintf(stderr, "ERROR: Can't write '%s'\n", ims_filename);
+                status = EIO;
+            }
+        }
+        if (status == 0) {
+            (*count)++;
+        }
+    }
+
+    if (mapped) {
+        ims_file_map_close(&map);
+    } else if (fp) {
+        fclose(fp);
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Post-process and validate the command line args
+ *
+ * The positional args are the shards, as IMS file/database pairs.
+ *
+ * @param argc The number of elements in argv or parsed_argv (std. unix argc)
+ * @param argv The unix argument vector
+ *
+ * @returns 0 on success, 1 if there were warnings, 2 on failure
+ */
+int postprocess_args(int argc, char * argv[]) {
+    int status = PROGRAM_SUCCESS;
+    int i;
+
+    if ((optind >= argc) || (((argc - optind) % 2) != 0)) {
+        fprintf(stderr,
+                "ERROR: shards must be given as <ims file> <database> pairs\n");
+        status = PROGRAM_ERROR;
+    } else if ((argc - optind) / 2 > MERGE_MAX_SHARDS) {
+        fprintf(stderr, "ERROR: at most %d shards can be merged\n",
+                MERGE_MAX_SHARDS);
+        status = PROGRAM_ERROR;
+    } else {
+        for (i = optind; i < argc; i += 2) {
+            shards[num_shards].ims_name = argv[i];
+            shards[num_shards].db_name = argv[i + 1];
+            num_shards++;
+        }
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Entry point for the ims-merge application
+ *
+ * @param argc The number of elements in argv or parsed_argv (std. unix argc)
+ * @param argv The unix argument vector - an array of pointers to strings.
+ *
+ * @returns 0 on success, 1 if there were warnings, 2 on failure
+ */
+int main(int argc, char * argv[]) {
+    struct argparse * parse_tbl = NULL;
+    int program_status = PROGRAM_SUCCESS;
+    int status = 0;
+    sqlite3 * out = NULL;
+    sqlite3_stmt * count_stmt = NULL;
+    FILE * fp_out = NULL;
+    ims_file_writer * writer = NULL;
+    uint64_t num_merged = 0;
+    uint64_t num_duplicates = 0;
+    uint64_t num_ims = 0;
+    uint64_t count;
+    uint32_t i;
+
+    /* Parse the command line arguments */
+    parse_tbl = new_argparse(parse_table, argv[0], NULL, NULL,
+                             "<ims file> <database>...", NULL);
+    if (parse_tbl) {
+        if (!parse_args(argc, argv, all_args, parse_tbl)) {
+            program_status = parser_help? PROGRAM_SUCCESS : PROGRAM_ERROR;
+        }
+        parse_tbl = free_argparse(parse_tbl);
+
+        /* Perform any argument validation/post-processing */
+        if (program_status == PROGRAM_SUCCESS) {
+            program_status = postprocess_args(argc, argv);
+        }
+    } else {
+        program_status = PROGRAM_ERROR;
+    }
+    if ((program_status != PROGRAM_SUCCESS) || parser_help) {
+        return program_status;
+    }
+
+    /* The output database must be new or empty */
+    if (sqlite3_open_v2(database_name, &out,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                        NULL) != SQLITE_OK) {
+        fprintf(stderr, "ERROR: Can't open database '%s': %s\n",
+                database_name, sqlite3_errmsg(out));
+        status = EIO;
+    } else if (db_schema_version(out, &out_version) != 0) {
+        status = EIO;
+    } else if (out_version == DB_SCHEMA_NONE) {
+        status = db_schema_create(out);
+        out_version = DB_SCHEMA_CURRENT;
+    }
+    if (status == 0) {
+        if ((sqlite3_prepare_v2(out, "SELECT count(*) FROM pub_keys", -1,
+                                &count_stmt, NULL) != SQLITE_OK) ||
+            (sqlite3_step(count_stmt) != SQLITE_ROW)) {
+            fprintf(stderr, "ERROR: Can't read '%s': %s\n", database_name,
+                    sqlite3_errmsg(out));
+            status = EIO;
+        } else if (sqlite3_column_int64(count_stmt, 0) != 0) {
+            fprintf(stderr, "ERROR: '%s' is not empty\n", database_name);
+            status = EEXIST;
+        }
+    }
+    sqlite3_finalize(count_stmt);
+
+    /* Merge the keysets, checking EP_UID uniqueness across the shards */
+    for (i = 0; (i < num_shards) && (status == 0); i++) {
+        status = shard_open(&shards[i]);
+    }
+    if (status == 0) {
+        status = out_exec(out, "BEGIN");
+    }
+    if (status == 0) {
+        status = merge_keysets(out, &num_merged, &num_duplicates);
+        if ((status == 0) && (num_duplicates > 0)) {
+            fprintf(stderr, "ERROR: %llu duplicate EP_UID%s across shards\n",
+                    (unsigned long long)num_duplicates,
+                    (num_duplicates == 1)? "" : "s");
+            status = EEXIST;
+        }
+    }
+
+    /* Concatenate the IMS files in shard order */
+    if (status == 0) {
+        if (binary_out) {
+            writer = ims_file_create(ims_filename);
+            status = writer? 0 : EIO;
+        } else {
+            fp_out = fopen(ims_filename, "w");
+            if (!fp_out) {
+                fprintf(stderr, "ERROR: Can't create '%s'\n", ims_filename);
+                status = errno;
+            }
+        }
+    }
+    for (i = 0; (i < num_shards) && (status == 0); i++) {
+        status = merge_ims(&shards[i], fp_out, writer, &count);
+        if ((status == 0) && (count != shards[i].num_rows)) {
+            fprintf(stderr,
+                    "ERROR: '%s' holds %llu IMS values but '%s' %llu keysets\n",
+                    shards[i].ims_name, (unsigned long long)count,
+                    shards[i].db_name,
+                    (unsigned long long)shards[i].num_rows);
+            status = EIO;
+        }
+        num_ims += count;
+    }
+    if (writer && (ims_file_close(writer) != 0) && (status == 0)) {
+        status = EIO;
+    }
+    if (fp_out && (fclose(fp_out) != 0) && (status == 0)) {
+        fprintf(stderr, "ERROR: Can't write '%s'\n", ims_filename);
+        status = EIO;
+    }
+
+    /* All or nothing */
+    if (out) {
+        if (status == 0) {
+            status = out_exec(out, "COMMIT");
+        } else if (!sqlite3_get_autocommit(out)) {
+            out_exec(out, "ROLLBACK");
+        }
+    }
+    if ((status != 0) && (writer || fp_out)) {
+        unlink(ims_filename);
+    }
+    for (i = 0; i < num_shards; i++) {
+        shard_close(&shards[i]);
+    }
+    sqlite3_close(out);
+
+    if (status == 0) {
+        printf("Merged %llu keysets and %llu IMS values from %u shard%s\n",
+               (unsigned long long)num_merged, (unsigned long long)num_ims,
+               num_shards, (num_shards == 1)? "" : "s");
+    } else {
+        fprintf(stderr, "ERROR: IMS merge failed (err %d)\n", status);
+        program_status = PROGRAM_ERROR;
+    }
+
+    return program_status;
+}
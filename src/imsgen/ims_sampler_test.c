@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the statistical test of the IMS candidate
+ * samplers run by "imsgen_test --sampler-test".
+ *
+ * The rejection-free constant-weight sampler must produce exactly the
+ * distribution the original rejection sampler does: uniform over all
+ * strings of the required Hamming weight. The test draws the same number
+ * of samples from each and runs chi-square tests of:
+ *
+ *   - an 8-bit, weight-4 string against the uniform distribution over all
+ *     70 such strings (the whole distribution, small enough to tabulate),
+ *   - the weight of the first byte of a 256-bit, weight-128 IMS candidate
+ *     against its hypergeometric distribution,
+ *   - the frequency of each of the 256 candidate bit positions,
+ *   - each sampler's histograms against the other's (homogeneity).
+ *
+ * Statistics are converted to normal deviates with the Wilson-Hilferty
+ * approximation; any deviate beyond SAMPLER_TEST_MAX_Z fails the test.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "util.h"
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "mcl_ecdh.h"
+#include "mcl_rand.h"
+#include "mcl_rsa.h"
+#include "crypto.h"
+#include "ims_common.h"
+#include "ims_test.h"
+
+/* The small, fully tabulated case: 8-bit strings of weight 4 (70 of them) */
+#define SMALL_BITS          8
+#define SMALL_WEIGHT        4
+#define SMALL_CELLS         70
+
+/* The IMS candidate */
+#define CANDIDATE_BITS      (IMS_HAMMING_SIZE * 8)
+
+/* Histogram of the Hamming weight of the first candidate byte (0..8) */
+#define FIRST_BYTE_CELLS    9
+
+/* Fail on a normal deviate beyond this (one-sided p ~ 3e-5) */
+#define SAMPLER_TEST_MAX_Z  4.0
+
+/* Fewest samples for which every expected cell count is at least 5 */
+#define SAMPLER_TEST_MIN_SAMPLES    0x1000
+
+
+/* A candidate sampler under test */
+typedef void (*sampler_fn)(csprng * rng, uint8_t * buf, uint32_t num_bits,
+                           uint32_t weight, uint64_t * rand_bytes);
+
+/* Everything tallied for one sampler */
+typedef struct {
+    const char * name;
+    sampler_fn   sample;
+    uint64_t     small[SMALL_CELLS];
+    uint64_t     first_byte[FIRST_BYTE_CELLS];
+    uint64_t     position[CANDIDATE_BITS];
+    uint64_t     small_rand_bytes;
+    uint64_t     rand_bytes;
+} sampler_tally;
+
+
+/**
+ * @brief Convert a chi-square statistic to a normal deviate
+ *
+ * Wilson-Hilferty: (x/df)^(1/3) is close to normal with mean
+ * 1 - 2/(9 df) and variance 2/(9 df).
+ */
+static double chi2_z(double chi2, uint32_t df) {
+    double v = 2.0 / (9.0 * df);
+
+    return (cbrt(chi2 / df) - (1.0 - v)) / sqrt(v);
+}
+
+
+/**
+ * @brief Report one chi-square test
+ *
+ * @returns True if it passed, false otherwise.
+ */
+static bool chi2_report(const char * sampler, const char * test,
+                        double chi2, uint32_t df) {
+    double z = chi2_z(chi2, df);
+    bool pass = (z <= SAMPLER_TEST_MAX_Z);
+
+    printf("  %-14s %-26s chi2 %10.2f  df %3u  z %6.2f  %s\n",
+           sampler, test, chi2, df, z, pass? "ok" : "FAIL");
+    return pass;
+}
+
+
+/**
+ * @brief Chi-square goodness of fit of observed counts to expected counts
+ */
+static double chi2_fit(const uint64_t * observed, const double * expected,
+                       uint32_t cells) {
+    double chi2 = 0.0;
+    double d;
+    uint32_t i;
+
+    for (i = 0; i < cells; i++) {
+        d = observed[i] - expected[i];
+        chi2 += d * d / expected[i];
+    }
+    return chi2;
+}
+
+
+/**
+ * @brief Chi-square homogeneity of two equal-sized samples
+ *
+ * @param df Set to the degrees of freedom (non-empty cells - 1)
+ */
+static double chi2_homogeneity(const uint64_t * a, const uint64_t * b,
+                               uint32_t cells, uint32_t * df) {
+    double chi2 = 0.0;
+    double d;
+    uint32_t used = 0;
+    uint32_t i;
+
+    for (i = 0; i < cells; i++) {
+        if (a[i] + b[i] > 0) {
+            d = (double)a[i] - (double)b[i];
+            chi2 += d * d / (double)(a[i] + b[i]);
+            used++;
+        }
+    }
+    *df = (used > 1)? used - 1 : 1;
+    return chi2;
+}
+
+
+/**
+ * @brief log(n choose k)
+ */
+static double log_choose(uint32_t n, uint32_t k) {
+    return lgamma(n + 1.0) - lgamma(k + 1.0) - lgamma(n - k + 1.0);
+}
+
+
+/**
+ * @brief Draw num_samples from a sampler and tally them
+ */
+static void sampler_run(sampler_tally * tally, csprng * rng,
+                        const int * small_rank, uint32_t num_samples) {
+    uint8_t candidate[IMS_HAMMING_SIZE];
+    uint8_t small;
+    uint32_t sample;
+    uint32_t bit;
+
+    for (sample = 0; sample < num_samples; sample++) {
+        tally->sample(rng, &small, SMALL_BITS, SMALL_WEIGHT,
+                      &tally->small_rand_bytes);
+        tally->small[small_rank[small]]++;
+
+        tally->sample(rng, candidate, CANDIDATE_BITS, IMS_HAMMING_WEIGHT,
+                      &tally->rand_bytes);
+        tally->first_byte[hamming_weight(candidate, 1)]++;
+        for (bit = 0; bit < CANDIDATE_BITS; bit++) {
+            if (candidate[bit / 8] & (0x80 >> (bit % 8))) {
+                tally->position[bit]++;
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Compare the rejection-free IMS candidate sampler with the original
+ * rejection sampler
+ *
+ * @param prng_seed_file Filename from which to read the seed
+ * @param prng_seed_string Raw seed string
+ * @param num_samples The number of samples to draw from each sampler
+ *
+ * @returns Zero if every test passed, EINVAL for too few samples, EIO if a
+ *          test failed, errno otherwise.
+ */
+int test_ims_sampler(const char * prng_seed_file,
+                     const char * prng_seed_string,
+                     uint32_t num_samples) {
+    static sampler_tally tallies[2] = {
+        { "constant", ims_sample_constant_weight },
+        { "rejection", ims_sample_rejection },
+    };
+    static ims_context ctx;
+    int small_rank[1 << SMALL_BITS];
+    double small_expected[SMALL_CELLS];
+    double first_byte_expected[FIRST_BYTE_CELLS];
+    double log_total;
+    double chi2;
+    double d;
+    uint32_t df;
+    uint32_t cells;
+    uint32_t i;
+    uint32_t t;
+    bool pass = true;
+    int status;
+
+    if (num_samples < SAMPLER_TEST_MIN_SAMPLES) {
+        fprintf(stderr, "ERROR: --sampler-test needs at least %u samples\n",
+                SAMPLER_TEST_MIN_SAMPLES);
+        return EINVAL;
+    }
+
+    status = ims_common_init(prng_seed_file, prng_seed_string);
+    if (status != 0) {
+        return status;
+    }
+    ims_context_init(&ctx);
+
+    /* Rank the weight-4 bytes 0..69, and expect each equally often */
+    for (i = 0, cells = 0; i < (1 << SMALL_BITS); i++) {
+        uint8_t byte = i;
+
+        small_rank[i] = -1;
+        if (hamming_weight(&byte, 1) == SMALL_WEIGHT) {
+            small_rank[i] = cells++;
+        }
+    }
+    for (i = 0; i < SMALL_CELLS; i++) {
+        small_expected[i] = (double)num_samples / SMALL_CELLS;
+    }
+
+    /* The first candidate byte's weight is hypergeometric */
+    log_total = log_choose(CANDIDATE_BITS, IMS_HAMMING_WEIGHT);
+    for (i = 0; i < FIRST_BYTE_CELLS; i++) {
+        first_byte_expected[i] = num_samples *
+            exp(log_choose(8, i) +
+                log_choose(CANDIDATE_BITS - 8, IMS_HAMMING_WEIGHT - i) -
+                log_total);
+    }
+
+    printf("Sampler test: %u samples from each sampler\n", num_samples);
+    for (t = 0; t < 2; t++) {
+        sampler_tally * tally = &tallies[t];
+
+        memset(tally->small, 0, sizeof(tally->small));
+        memset(tally->first_byte, 0, sizeof(tally->first_byte));
+        memset(tally->position, 0, sizeof(tally->position));
+        tally->small_rand_bytes = 0;
+        tally->rand_bytes = 0;
+        sampler_run(tally, &ctx.rng, small_rank, num_samples);
+
+        pass &= chi2_report(tally->name, "8-bit weight-4 uniform",
+                            chi2_fit(tally->small, small_expected,
+                                     SMALL_CELLS),
+                            SMALL_CELLS - 1);
+        pass &= chi2_report(tally->name, "first byte hypergeometric",
+                            chi2_fit(tally->first_byte, first_byte_expected,
+                                     FIRST_BYTE_CELLS),
+                            FIRST_BYTE_CELLS - 1);
+
+        /**
+         * Each position is set half the time. The 256 counts always sum
+         * to 128 * num_samples, so the statistic is 256/255 times a
+         * chi-square with 255 degrees of freedom.
+         */
+        for (i = 0, chi2 = 0.0; i < CANDIDATE_BITS; i++) {
+            d = tally->position[i] - num_samples / 2.0;
+            chi2 += 4.0 * d * d / num_samples;
+        }
+        pass &= chi2_report(tally->name, "bit position frequency",
+                            chi2 * (CANDIDATE_BITS - 1) / CANDIDATE_BITS,
+                            CANDIDATE_BITS - 1);
+    }
+
+    chi2 = chi2_homogeneity(tallies[0].small, tallies[1].small,
+                            SMALL_CELLS, &df);
+    pass &= chi2_report("both", "8-bit weight-4 homogeneity", chi2, df);
+    chi2 = chi2_homogeneity(tallies[0].first_byte, tallies[1].first_byte,
+                            FIRST_BYTE_CELLS, &df);
+    pass &= chi2_report("both", "first byte homogeneity", chi2, df);
+
+    for (t = 0; t < 2; t++) {
+        printf("  %-14s PRNG bytes per candidate %.1f (8-bit: %.2f)\n",
+               tallies[t].name,
+               (double)tallies[t].rand_bytes / num_samples,
+               (double)tallies[t].small_rand_bytes / num_samples);
+    }
+    if (tallies[0].rand_bytes >= tallies[1].rand_bytes) {
+        printf("  constant-weight sampler used no less randomness: FAIL\n");
+        pass = false;
+    }
+
+    ims_context_deinit(&ctx);
+    ims_common_deinit();
+
+    printf("Sampler test %s\n", pass? "passed" : "FAILED");
+    return pass? 0 : EIO;
+}
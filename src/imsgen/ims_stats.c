@@ -0,0 +1,201 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the imsgen per-stage instrumentation and its
+ * JSON report.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include "ims_stats.h"
+
+/* Report names, in ims_stage order */
+static const char * stage_names[IMS_NUM_STAGES] = {
+    "candidate",
+    "ep_uid",
+    "ep_uid_lookup",
+    "errk_search",
+    "errk_rsa",
+    "epvk",
+    "esvk",
+    "cross_check",
+    "db_insert",
+    "db_commit",
+};
+
+
+/**
+ * @brief Find the log2 histogram bucket for a value
+ */
+static uint32_t hist_bucket(uint32_t value) {
+    uint32_t bucket = 0;
+
+    while ((value > 0) && (bucket < IMS_STATS_HIST_BUCKETS - 1)) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+
+/**
+ * @brief Record the P and Q bias iterations of an accepted IMS
+ *
+ * @param stats The stats to update
+ * @param p_iterations The P bias offset (p_bias / odd_mod)
+ * @param q_iterations The Q bias offset (q_bias / odd_mod)
+ */
+void ims_stats_bias(ims_stats * stats, uint32_t p_iterations,
+                    uint32_t q_iterations) {
+    stats->pq_found++;
+    stats->p_bias_hist[hist_bucket(p_iterations)]++;
+    stats->q_bias_hist[hist_bucket(q_iterations)]++;
+    stats->p_bias_sum += p_iterations;
+    stats->q_bias_sum += q_iterations;
+}
+
+
+/**
+ * @brief Add one set of stats into another
+ *
+ * @param total The stats to add to
+ * @param stats The stats to add
+ */
+void ims_stats_add(ims_stats * total, const ims_stats * stats) {
+    const uint64_t * from = (const uint64_t *)stats;
+    uint64_t * to = (uint64_t *)total;
+    size_t i;
+
+    /* (ims_stats is nothing but uint64_t counters) */
+    for (i = 0; i < sizeof(*stats) / sizeof(uint64_t); i++) {
+        to[i] += from[i];
+    }
+}
+
+
+/**
+ * @brief Divide, yielding 0 rather than NaN for an empty denominator
+ */
+static double ratio(double numerator, double denominator) {
+    return (denominator != 0)? numerator / denominator : 0.0;
+}
+
+
+/**
+ * @brief Write a JSON array of histogram buckets
+ */
+static void write_hist(FILE * fp, const char * name, const uint64_t * hist,
+                       uint64_t sum, uint64_t count) {
+    int i;
+
+    fprintf(fp, "  \"%s\": {\n    \"log2_buckets\": [", name);
+    for (i = 0; i < IMS_STATS_HIST_BUCKETS; i++) {
+        fprintf(fp, "%s%llu", (i == 0)? "" : ", ",
+                (unsigned long long)hist[i]);
+    }
+    fprintf(fp, "],\n    \"mean\": %.3f\n  },\n", ratio(sum, count));
+}
+
+
+/**
+ * @brief Write a stats report as JSON
+ *
+ * The keys are always written in the same order, so reports from
+ * different builds can be diffed directly.
+ *
+ * @param fp Where to write the report
+ * @param stats The run's stats
+ * @param num_ims The number of IMS values requested
+ * @param num_jobs The number of generator threads
+ * @param elapsed_nsec The run's wall-clock time
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_stats_write_json(FILE * fp, const ims_stats * stats,
+                         uint32_t num_ims, uint32_t num_jobs,
+                         uint64_t elapsed_nsec) {
+    double elapsed = elapsed_nsec / 1e9;
+    int i;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"num_ims\": %u,\n", num_ims);
+    fprintf(fp, "  \"num_jobs\": %u,\n", num_jobs);
+    fprintf(fp, "  \"elapsed_sec\": %.3f,\n", elapsed);
+    fprintf(fp, "  \"ims_per_sec\": %.3f,\n", ratio(stats->accepted, elapsed));
+    fprintf(fp, "  \"candidates\": %llu,\n",
+            (unsigned long long)stats->candidates);
+    fprintf(fp, "  \"candidate_rand_bytes\": %llu,\n",
+            (unsigned long long)stats->candidate_rand_bytes);
+    fprintf(fp, "  \"accepted\": %llu,\n",
+            (unsigned long long)stats->accepted);
+    fprintf(fp, "  \"rejected\": {\n");
+    fprintf(fp, "    \"duplicate_ep_uid\": %llu,\n",
+            (unsigned long long)stats->rejected_duplicate);
+    fprintf(fp, "    \"pq_overflow\": %llu,\n",
+            (unsigned long long)stats->rejected_overflow);
+    fprintf(fp, "    \"pq_no_prime\": %llu,\n",
+            (unsigned long long)stats->rejected_no_prime);
+    fprintf(fp, "    \"key_validation\": %llu\n",
+            (unsigned long long)stats->rejected_key);
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"miller_rabin\": {\n");
+    fprintf(fp, "    \"calls\": %llu,\n", (unsigned long long)stats->mr_calls);
+    fprintf(fp, "    \"witnesses\": %llu,\n",
+            (unsigned long long)stats->mr_witnesses);
+    fprintf(fp, "    \"sieved_out\": %llu,\n",
+            (unsigned long long)stats->sieved_out);
+    fprintf(fp, "    \"memo_hits\": %llu,\n",
+            (unsigned long long)stats->memo_hits);
+    fprintf(fp, "    \"calls_per_ims\": %.3f\n",
+            ratio(stats->mr_calls, stats->accepted));
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"pq_found\": %llu,\n",
+            (unsigned long long)stats->pq_found);
+    write_hist(fp, "p_bias_iterations", stats->p_bias_hist,
+               stats->p_bias_sum, stats->pq_found);
+    write_hist(fp, "q_bias_iterations", stats->q_bias_hist,
+               stats->q_bias_sum, stats->pq_found);
+    fprintf(fp, "  \"stages\": {\n");
+    for (i = 0; i < IMS_NUM_STAGES; i++) {
+        /* (summed across threads, so may exceed elapsed_sec) */
+        fprintf(fp, "    \"%s\": { \"calls\": %llu, \"sec\": %.6f, "
+                "\"usec_per_call\": %.3f }%s\n",
+                stage_names[i], (unsigned long long)stats->stage_calls[i],
+                stats->stage_nsec[i] / 1e9,
+                ratio(stats->stage_nsec[i] / 1e3, stats->stage_calls[i]),
+                (i == IMS_NUM_STAGES - 1)? "" : ",");
+    }
+    fprintf(fp, "  }\n");
+    fprintf(fp, "}\n");
+
+    return ferror(fp)? EIO : 0;
+}
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the header information for the imsgen
+ * per-stage instrumentation: monotonic-clock stage timers, rejection and
+ * Miller-Rabin counters, and the P/Q bias iteration distributions.
+ *
+ * Each IMS working context (and the keyset writer) keeps its own
+ * ims_stats, so recording never contends between threads; the totals are
+ * summed with ims_stats_add() for reporting.
+ *
+ */
+
+#ifndef _IMS_STATS_H
+#define _IMS_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* The timed stages of IMS generation */
+typedef enum {
+    IMS_STAGE_CANDIDATE,        /* ims_generate_candidate */
+    IMS_STAGE_EP_UID,           /* calculate_epuid_es3 */
+    IMS_STAGE_EP_UID_LOOKUP,    /* db_ep_uid_exists */
+    IMS_STAGE_ERRK_SEARCH,      /* P/Q sieve and Miller-Rabin loops */
+    IMS_STAGE_ERRK_RSA,         /* RSA CRT parameters and ERPK_MOD */
+    IMS_STAGE_EPVK,             /* calc_epsk + calc_epvk */
+    IMS_STAGE_ESVK,             /* calc_essk + calc_esvk */
+    IMS_STAGE_CROSS_CHECK,      /* Big-number cross-check replays */
+    IMS_STAGE_DB_INSERT,        /* keyset writer INSERTs */
+    IMS_STAGE_DB_COMMIT,        /* keyset writer COMMITs */
+    IMS_NUM_STAGES
+} ims_stage;
+
+/* log2 buckets for the P/Q bias iteration histograms (0, 1, 2-3 ... 4095) */
+#define IMS_STATS_HIST_BUCKETS      13
+
+/* Seconds between imsgen's periodic throughput lines */
+#define IMS_STATS_INTERVAL_SEC      10
+
+typedef struct {
+    uint64_t stage_calls[IMS_NUM_STAGES];
+    uint64_t stage_nsec[IMS_NUM_STAGES];
+
+    uint64_t candidates;            /* Hamming-weight-valid candidates */
+    uint64_t candidate_rand_bytes;  /* PRNG bytes drawn for candidates */
+    uint64_t accepted;              /* IMS values emitted */
+    uint64_t rejected_duplicate;    /* EP_UID already in the database */
+    uint64_t rejected_overflow;     /* P or Q + bias would overflow */
+    uint64_t rejected_no_prime;     /* No prime P/Q pair in the window */
+    uint64_t rejected_key;          /* EPVK/ESVK validation failed */
+
+    uint64_t mr_calls;              /* Backend primality tests */
+    uint64_t mr_witnesses;          /* ...and the witnesses they drew */
+    uint64_t sieved_out;            /* Candidates the sieve rejected */
+    uint64_t memo_hits;             /* Q candidates already tested */
+
+    uint64_t pq_found;              /* P/Q searches that succeeded */
+    uint64_t p_bias_hist[IMS_STATS_HIST_BUCKETS];
+    uint64_t q_bias_hist[IMS_STATS_HIST_BUCKETS];
+    uint64_t p_bias_sum;
+    uint64_t q_bias_sum;
+} ims_stats;
+
+
+/**
+ * @brief Read the monotonic clock
+ *
+ * @returns The time in nanoseconds (from an arbitrary epoch).
+ */
+static inline uint64_t ims_stats_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+/**
+ * @brief Charge the time since start to a stage
+ *
+ * @param stats The stats to update
+ * @param stage The stage
+ * @param start When the stage began (from ims_stats_now)
+ *
+ * @returns The current time, so that consecutive stages can chain.
+ */
+static inline uint64_t ims_stats_stage(ims_stats * stats, ims_stage stage,
+                                       uint64_t start) {
+    uint64_t now = ims_stats_now();
+
+    stats->stage_calls[stage]++;
+    stats->stage_nsec[stage] += now - start;
+    return now;
+}
+
+
+/**
+ * @brief Record the P and Q bias iterations of an accepted IMS
+ *
+ * @param stats The stats to update
+ * @param p_iterations The P bias offset (p_bias / odd_mod)
+ * @param q_iterations The Q bias offset (q_bias / odd_mod)
+ */
+void ims_stats_bias(ims_stats * stats, uint32_t p_iterations,
+                    uint32_t q_iterations);
+
+
+/**
+ * @brief Add one set of stats into another
+ *
+ * @param total The stats to add to
+ * @param stats The stats to add
+ */
+void ims_stats_add(ims_stats * total, const ims_stats * stats);
+
+
+/**
+ * @brief Write a stats report as JSON
+ *
+ * The keys are always written in the same order, so reports from
+ * different builds can be diffed directly.
+ *
+ * @param fp Where to write the report
+ * @param stats The run's stats
+ * @param num_ims The number of IMS values requested
+ * @param num_jobs The number of generator threads
+ * @param elapsed_nsec The run's wall-clock time
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int ims_stats_write_json(FILE * fp, const ims_stats * stats,
+                         uint32_t num_ims, uint32_t num_jobs,
+                         uint64_t elapsed_nsec);
+
+#endif /* !_IMS_STATS_H */
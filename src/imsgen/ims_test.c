@@ -35,6 +35,8 @@
  */
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -47,6 +49,7 @@
 #include <time.h>
 #include <getopt.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <openssl/evp.h>
 #include <sqlite3.h>
 #include "util.h"
@@ -55,20 +58,74 @@
 #include "mcl_ecdh.h"
 #include "mcl_rand.h"
 #include "mcl_rsa.h"
+#include "ims_mcl.h"
 #include "crypto.h"
 #include "db.h"
 #include "ims_common.h"
+#include "ims_file.h"
+#include "ims_stats.h"
 #include "ims_test.h"
 
 /* Uncomment the following define to enable IMS diagnostic messages */
 /*#define IMS_DEBUGMSG*/
 
 /**
- * Because IMS values are stored as binary ascii text with trailing newlines,
- * define contants for how much to read and how far to seek
+ * The IMS file under test, mapped: binascii text (one IMS_LINE_SIZE line
+ * per IMS), or a binary IMS container
  */
-#define IMS_BINASCII_SIZE    (IMS_SIZE * 8)
-#define IMS_LINE_SIZE   (IMS_BINASCII_SIZE + 1)
+typedef struct {
+    int          fd;
+    bool         binary;
+    const char * text;
+    size_t       text_size;
+    ims_file_map map;
+} ims_input;
+
+/**
+ * What verification found for one sampled IMS. The workers derive the keys
+ * and run the round-trips; the database comparison happens afterwards, in
+ * EP_UID order, against a digest of the derived public keys.
+ */
+typedef struct {
+    uint32_t index;                             /* Which IMS in the file */
+    int      status;                            /* Zero if it verified */
+    uint8_t  ep_uid[EP_UID_SIZE];
+    uint8_t  digest[SHA256_HASH_DIGEST_SIZE];   /* EPVK || ESVK || ERPK_MOD */
+} ims_verified;
+
+/* Indices handed to a verifier thread at a time */
+#define VERIFY_CHUNK            16
+
+/* Failures described in detail (the rest are only counted) */
+#define VERIFY_MAX_REPORTS      10
+
+typedef struct {
+    pthread_mutex_t   lock;
+    uint32_t          next;
+    uint32_t          num_ims;
+    bool              failed;
+    ims_verified *    verified;
+    const ims_input * input;
+    bool              ims_sample_compatibility;
+} verify_queue;
+
+typedef struct {
+    pthread_t      thread;
+    verify_queue * queue;
+    ims_context    ctx;
+} verify_worker;
+
+/* Merge-join state for the ordered database scan */
+typedef struct {
+    ims_verified * verified;    /* Sorted by EP_UID */
+    uint32_t       num_ims;
+    uint32_t       next;
+    uint32_t       num_rows;
+    uint8_t        last_ep_uid[EP_UID_SIZE];
+} verify_merge;
+
+/* Working context for sampling and for re-checking failures in detail */
+static ims_context test_ctx;
 
 
 /**
@@ -96,7 +153,7 @@ int ims_init(const char * prng_seed_file,
     if (status != 0) {
         goto ims_init_err;
     }
-    MCL_RAND_seed(&rng, prng_seed_length, prng_seed_buffer);
+    ims_context_init(&test_ctx);
 
     /* Open the key database */
     status = db_init(database_name);
@@ -157,57 +214,35 @@ void ims_deinit(void) {
     /* Close the key database */
     db_deinit();
 
+    ims_context_deinit(&test_ctx);
     ims_common_deinit();
 }
 
 
 /**
- * @brief Read the IMS as an ASCII binarray string
+ * @brief Fetch an IMS value from the mapped IMS file
  *
- * Reads the IMS value as a signle line binary array string, MSB-to-LSB
+ * Binascii lines hold the IMS as a single line binary array string,
+ * MSB-to-LSB.
  *
- * @param fd The file to read
- * @param offset Where in the file from which to read
+ * @param input The IMS file
+ * @param index Which IMS value to fetch (zero-based)
  * @param ims The IMS value to load
  *
  * @returns Zero if successful, errno otherwise.
  */
-int ims_read(int fd, off_t offset, uint8_t * ims) {
-    int status = 0;
-    char binascii_buf[IMS_BINASCII_SIZE];
-    int  i = 0;
-    int byte_index;
-    int bit;
-    uint8_t byte;
-
-    /* Seek to the desired entry and read the binascii */
-    if (lseek(fd, offset, SEEK_SET) < 0) {
-        fprintf(stderr, "ERROR: Can't seek to %u in IMS file (err %d)\n",
-                (uint32_t)offset, errno);
-        status = errno;
+static int ims_input_record(const ims_input * input, uint32_t index,
+                            uint8_t * ims) {
+    int status;
+    size_t offset = (size_t)index * IMS_LINE_SIZE;
+
+    if (input->binary) {
+        status = ims_file_map_record(&input->map, index, ims);
+    } else if (offset + IMS_BINASCII_SIZE > input->text_size) {
+        fprintf(stderr, "ERROR: Can't read IMS file at %zu\n", offset);
+        status = EIO;
     } else {
-        if (read(fd, binascii_buf, sizeof(binascii_buf)) <= 0) {
-            fprintf(stderr, "ERROR: Can't read IMS file (err %d)\n", errno);
-            status = errno;
-        } else {
-            /* Assemble the IMS byte-by-byte */
-            for (byte_index = IMS_SIZE - 1; byte_index >= 0; byte_index--) {
-                /* Assemble a byte */
-                byte = 0;
-                for (bit = 0; bit < 8; bit++) {
-                    byte <<= 1;
-                    if (binascii_buf[i] == '1') {
-                        byte |= 1;
-                    } else if (binascii_buf[i] != '0') {
-                        fprintf(stderr, "ERROR: IMS file contains garbage (%c)\n",
-                                binascii_buf[i]);
-                        return EIO;
-                    }
-                    i++;
-                }
-                ims[byte_index] =  byte;
-            }
-        }
+        status = ims_from_binascii(input->text + offset, ims);
     }
 #ifdef IMS_DEBUGMSG
     printf("ims_test read IMS:\n");
@@ -220,6 +255,7 @@ int ims_read(int fd, off_t offset, uint8_t * ims) {
 /**
  * @brief Calculate the Endpoint Rsa pRivate Key (ERRK)
  *
+ * @param ctx The working context (gets the RSA key pair)
  * @param y2 A pointer to the Y2 term used by all
  * @param ims A pointer to the ims (the upper 3 bytes will be modified)
  * @param erpk_mod A pointer to a buffer to store the modulus for ERPK
@@ -231,7 +267,8 @@ int ims_read(int fd, off_t offset, uint8_t * ims) {
  *
  * @returns Zero if successful, errno otherwise.
  */
-static int calc_errk(uint8_t * y2,
+static int calc_errk(ims_context * ctx,
+                     uint8_t * y2,
                      uint8_t * ims,
                      mcl_octet * erpk_mod,
                      mcl_octet * errk_d,
@@ -260,18 +297,19 @@ static int calc_errk(uint8_t * y2,
      *  ERRK_Q[0] |= 0x01
      *    :
      */
-    calc_errk_pq_bias_odd(y2, ims, &errk_p, &errk_q, ims_sample_compatibility);
+    calc_errk_pq_bias_odd(y2, ims, &ctx->errk_p, &ctx->errk_q,
+                          ims_sample_compatibility);
 
 
     /* Convert P & Q to FF format */
     if (ims_sample_compatibility) {
         /* Used in first 100 IMS samples */
-        ff_from_big_endian_octet(p_ff, &errk_p, MCL_HFLEN);
-        ff_from_big_endian_octet(q_ff, &errk_q, MCL_HFLEN);
+        ff_from_big_endian_octet(ctx->p_ff, &ctx->errk_p, MCL_HFLEN);
+        ff_from_big_endian_octet(ctx->q_ff, &ctx->errk_q, MCL_HFLEN);
     } else {
         /* Used subsequent to the first 100 IMS samples */
-        ff_from_little_endian_octet(p_ff, &errk_p, MCL_HFLEN);
-        ff_from_little_endian_octet(q_ff, &errk_q, MCL_HFLEN);
+        ff_from_little_endian_octet(ctx->p_ff, &ctx->errk_p, MCL_HFLEN);
+        ff_from_little_endian_octet(ctx->q_ff, &ctx->errk_q, MCL_HFLEN);
     }
 
 
@@ -282,8 +320,8 @@ static int calc_errk(uint8_t * y2,
 
 
     /* Bias P & Q */
-    MCL_FF_inc_C25519(p_ff, p_bias, MCL_HFLEN);
-    MCL_FF_inc_C25519(q_ff, q_bias, MCL_HFLEN);
+    MCL_FF_inc_C25519(ctx->p_ff, p_bias, MCL_HFLEN);
+    MCL_FF_inc_C25519(ctx->q_ff, q_bias, MCL_HFLEN);
 
     /**
      * Generate the public and private exponents
@@ -301,12 +339,13 @@ static int calc_errk(uint8_t * y2,
      *   - priv_key.dq  decrypting exponent mod (q-1)
      *   - priv_key.c   1/p mod q
      */
-    MCL_FF_copy_C25519(rsa_private.p, p_ff, MCL_HFLEN);
-    MCL_FF_copy_C25519(rsa_private.q, q_ff, MCL_HFLEN);
-    rsa_secret(&rsa_private, &rsa_public, ERPK_EXPONENT, ims_sample_compatibility);
+    MCL_FF_copy_C25519(ctx->rsa_private.p, ctx->p_ff, MCL_HFLEN);
+    MCL_FF_copy_C25519(ctx->rsa_private.q, ctx->q_ff, MCL_HFLEN);
+    rsa_secret(&ctx->rsa_private, &ctx->rsa_public, ERPK_EXPONENT,
+               ims_sample_compatibility);
 
     /* Convert the calculated FF nums back into octets for later use */
-    MCL_FF_toOctet_C25519(erpk_mod, rsa_public.n, MCL_FFLEN);
+    MCL_FF_toOctet_C25519(erpk_mod, ctx->rsa_public.n, MCL_FFLEN);
 
     return status;
 }
@@ -328,11 +367,11 @@ int test_rsa_sign_roundtrip(MCL_rsa_private_key * private_key,
                             csprng * rng) {
     int status = 0;
     char * test_string = "Hello world";
-    static char m[MCL_RFS];
-    //static char e[MCL_RFS];
-    static char c[MCL_RFS];
-    static char s[MCL_RFS];
-    static char ml[MCL_RFS];
+    char m[MCL_RFS];
+    //char e[MCL_RFS];
+    char c[MCL_RFS];
+    char s[MCL_RFS];
+    char ml[MCL_RFS];
     mcl_octet M={0, sizeof(m), m};
     //mcl_octet E={0, sizeof(e), e};
     mcl_octet S={0,sizeof(s),s};
@@ -382,10 +421,10 @@ int test_rsa_roundtrip(MCL_rsa_private_key * private_key,
     int status = 0;
     int test_len;
     char * test_string = "Hello world";
-    static char m[MCL_RFS];
-    static char e[MCL_RFS];
-    static char c[MCL_RFS];
-    static char ml[MCL_RFS];
+    char m[MCL_RFS];
+    char e[MCL_RFS];
+    char c[MCL_RFS];
+    char ml[MCL_RFS];
     mcl_octet M={0, sizeof(m), m};
     mcl_octet E={0, sizeof(e), e};
     mcl_octet C={0, sizeof(c), c};
@@ -426,21 +465,20 @@ int test_rsa_roundtrip(MCL_rsa_private_key * private_key,
  * verification key.
  * This code is borrowed from MIRACL's ...MIRACL/src/tests/test_ecdh.c
  *
- * @param pub A pointer to the public key
- * @param priv A pointer to the private key
- * @param test_string The string to encode/decode
+ * @param ctx The working context holding the keys (and PRNG)
+ * @param primary If true, test EPSK/EPVK, otherwise ESSK/ESVK
  *
  * @returns Zero if successful, -1 otherwise.
  */
-int test_ecc_sign_roundtrip(bool primary) {
+int test_ecc_sign_roundtrip(ims_context * ctx, bool primary) {
     int status = -1;
     int mcl_status;
     int i;
     char * key_name = primary? "Primary" : "Secondary";
     /* NOTE: CS, DS need to be sized to max(EPSK_SIZE, ESSK_SIZE) */
-    static char m[32];
-    static char cs[128];
-    static char ds[128];
+    char m[32];
+    char cs[128];
+    char ds[128];
     mcl_octet M={0,sizeof(m),m};
     mcl_octet CS={0,sizeof(cs),cs};
     mcl_octet DS={0,sizeof(ds),ds};
@@ -458,10 +496,12 @@ int test_ecc_sign_roundtrip(bool primary) {
      * signature components: CS & DS
      */
     if (primary) {
-        mcl_status = MCL_ECPSP_DSA_C488(MCL_HASH_TYPE_ECC, &rng, &epsk, &M,
+        mcl_status = MCL_ECPSP_DSA_C488(MCL_HASH_TYPE_ECC, &ctx->rng,
+                                        &ctx->epsk, &M,
                                         &CS, &DS);
     } else {
-        mcl_status = MCL_ECPSP_DSA_C25519(MCL_HASH_TYPE_ECC, &rng, &essk, &M,
+        mcl_status = MCL_ECPSP_DSA_C25519(MCL_HASH_TYPE_ECC, &ctx->rng,
+                                          &ctx->essk, &M,
                                           &CS, &DS);
 
     }
@@ -474,10 +514,10 @@ int test_ecc_sign_roundtrip(bool primary) {
      * epvk and the two components, CS & DS generated from signing M above.
      */
     if (primary) {
-        mcl_status = MCL_ECPVP_DSA_C488(MCL_HASH_TYPE_ECC, &epvk, &M,
+        mcl_status = MCL_ECPVP_DSA_C488(MCL_HASH_TYPE_ECC, &ctx->epvk, &M,
                                         &CS, &DS);
     } else {
-        mcl_status = MCL_ECPVP_DSA_C25519(MCL_HASH_TYPE_ECC, &esvk, &M,
+        mcl_status = MCL_ECPVP_DSA_C25519(MCL_HASH_TYPE_ECC, &ctx->esvk, &M,
                                           &CS, &DS);
     }
     if (mcl_status != 0) {
@@ -503,10 +543,86 @@ int test_ecc_sign_roundtrip(bool primary) {
 }
 
 
+/**
+ * @brief Derive the keys for an IMS value
+ *
+ * @param ctx The working context, which gets the EP_UID and the keys
+ * @param ims A pointer to the IMS
+ * @param ims_sample_compatibility If true, extracted keys are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, extracted keys use
+ *        the correct form.
+ */
+static void derive_ims_keys(ims_context * ctx, uint8_t * ims,
+                            bool ims_sample_compatibility) {
+    /**
+     * Calculate the Endpoint Unique ID (EP_UID) from the IMS (used to look
+     * up the keys from the database).
+     */
+    calculate_epuid_es3(ims, &ctx->ep_uid);
+    ctx->ep_uid.len = EP_UID_SIZE;
+
+    /* Calculate "Y2", used in generating EPSK, MPDK, ERRK, EPCK, ERGS */
+    calculate_y2(ims, ctx->y2);
+
+    /* Calculate ERRK/ERPK, EPSK/EPVK and  ESSK/ESVK */
+    calc_epsk(ctx->y2, &ctx->epsk);
+    calc_epvk(&ctx->epsk, &ctx->epvk);
+    calc_essk(ctx->y2, &ctx->essk, ims_sample_compatibility);
+    calc_esvk(&ctx->essk, &ctx->esvk);
+    calc_errk(ctx, ctx->y2, ims, &ctx->erpk_mod, &ctx->errk_d,
+              ims_sample_compatibility);
+}
+
+
+/**
+ * @brief Check that the keys in a context sign and verify
+ *
+ * Verify RSA and primary and secondary ECC signing work
+ *
+ * @param ctx The working context holding the derived keys
+ *
+ * @returns Zero if successful, -1 otherwise.
+ */
+static int test_ims_roundtrips(ims_context * ctx) {
+    int status;
+
+    status = test_rsa_sign_roundtrip(&ctx->rsa_private, &ctx->rsa_public,
+                                     &ctx->rng);
+    if (status == 0) {
+        status = test_ecc_sign_roundtrip(ctx, true);
+    }
+    if (status == 0) {
+        status = test_ecc_sign_roundtrip(ctx, false);
+    }
+
+    return status;
+}
+
+
+/**
+ * @brief Digest a set of public keys
+ *
+ * @param epvk The EPVK
+ * @param esvk The ESVK
+ * @param erpk_mod The modulus for ERPK
+ * @param digest Set to sha256(EPVK || ESVK || ERPK_MOD)
+ */
+static void digest_keys(mcl_octet * epvk, mcl_octet * esvk,
+                        mcl_octet * erpk_mod, uint8_t * digest) {
+    hash_start();
+    hash_update((uint8_t *)epvk->val, epvk->len);
+    hash_update((uint8_t *)esvk->val, esvk->len);
+    hash_update((uint8_t *)erpk_mod->val, erpk_mod->len);
+    hash_final(digest);
+}
+
+
 /**
  * @brief Test an IMS value
  *
- * Test an IMS value...
+ * Derives the keys, looks them up in the database by EP_UID and checks
+ * that they sign and verify. Reports exactly what failed.
  *
  * @param ims A pointer to the IMS
  * @param ims_sample_compatibility If true, extracted keys are
@@ -518,96 +634,293 @@ int test_ecc_sign_roundtrip(bool primary) {
  */
 int test_ims(uint8_t * ims, bool ims_sample_compatibility) {
     int status = 0;
-    static uint8_t  epvk_buf_db[EPVK_SIZE];
-    static uint8_t  esvk_buf_db[ESVK_SIZE];
-    static uint8_t  erpk_mod_buf_db[ERRK_PQ_SIZE*2];
+    uint8_t  epvk_buf_db[EPVK_SIZE];
+    uint8_t  esvk_buf_db[ESVK_SIZE];
+    uint8_t  erpk_mod_buf_db[ERRK_PQ_SIZE*2];
     mcl_octet epvk_db = {0, sizeof(epvk_buf_db), epvk_buf_db};
     mcl_octet esvk_db = {0, sizeof(esvk_buf_db), esvk_buf_db};
     mcl_octet erpk_mod_db = {0, sizeof(erpk_mod_buf_db), erpk_mod_buf_db};
 
-    /**
-     * Calculate the Endpoint Unique ID (EP_UID) from the IMS (used to look
-     * up the keys from the database).
-     */
-    calculate_epuid_es3(ims, &ep_uid);
-    ep_uid.len = EP_UID_SIZE;
-
-    /* Calculate "Y2", used in generating EPSK, MPDK, ERRK, EPCK, ERGS */
-    calculate_y2(ims, y2);
-
-    /* Calculate ERRK/ERPK, EPSK/EPVK and  ESSK/ESVK */
-    calc_epsk(y2, &epsk);
-    calc_epvk(&epsk, &epvk);
-    calc_essk(y2, &essk, ims_sample_compatibility);
-    calc_esvk(&essk, &esvk);
-    calc_errk(y2, ims, &erpk_mod, &errk_d, ims_sample_compatibility);
+    derive_ims_keys(&test_ctx, ims, ims_sample_compatibility);
 
     /* Compare the calculated public keys with those from the database */
-    status = db_get_keyset(&ep_uid, &epvk_db, &esvk_db, &erpk_mod_db);
+    status = db_get_keyset(&test_ctx.ep_uid, &epvk_db, &esvk_db, &erpk_mod_db);
     if (status != SQLITE_OK) {
         fprintf(stderr, "ERROR: Can't find EP_UID in db\n");
-        display_binary_data(ep_uid.val, ep_uid.len, true, "epu_id ");
+        display_binary_data(test_ctx.ep_uid.val, test_ctx.ep_uid.len, true, "epu_id ");
         status = -1;
     } else {
-        if (!MCL_OCT_comp(&epvk, &epvk_db)) {
+        if (!MCL_OCT_comp(&test_ctx.epvk, &epvk_db)) {
             fprintf(stderr, "ERROR: extracted EPVK doesn't match db:\n");
-            display_binary_data(ep_uid.val, ep_uid.len, true, "epu_id ");
-            display_binary_data(epvk.val, epvk.len, true, "epvk     ");
+            display_binary_data(test_ctx.ep_uid.val, test_ctx.ep_uid.len, true, "epu_id ");
+            display_binary_data(test_ctx.epvk.val, test_ctx.epvk.len, true, "epvk     ");
             status = -1;
         }
-        if (!MCL_OCT_comp(&esvk, &esvk_db)) {
+        if (!MCL_OCT_comp(&test_ctx.esvk, &esvk_db)) {
             fprintf(stderr, "ERROR: extracted ESVK doesn't match db:\n");
-            display_binary_data(ep_uid.val, ep_uid.len, true, "epu_id ");
-            display_binary_data(esvk.val, esvk.len, true, "esvk     ");
+            display_binary_data(test_ctx.ep_uid.val, test_ctx.ep_uid.len, true, "epu_id ");
+            display_binary_data(test_ctx.esvk.val, test_ctx.esvk.len, true, "esvk     ");
             status = -1;
         }
-        if (!MCL_OCT_comp(&erpk_mod, &erpk_mod_db)) {
+        if (!MCL_OCT_comp(&test_ctx.erpk_mod, &erpk_mod_db)) {
             fprintf(stderr, "ERROR: extracted ERPK_MOD doesn't match db\n");
-            display_binary_data(ep_uid.val, ep_uid.len, true, "epu_id ");
-            display_binary_data(erpk_mod.val, erpk_mod.len, true, "erpk_mod ");
+            display_binary_data(test_ctx.ep_uid.val, test_ctx.ep_uid.len, true, "epu_id ");
+            display_binary_data(test_ctx.erpk_mod.val, test_ctx.erpk_mod.len, true, "erpk_mod ");
             status = -1;
         }
     }
 
-    /**
-     * Verify RSA and primary and secondary ECC signing work
-     */
     if (status == 0) {
-        status = test_rsa_sign_roundtrip(&rsa_private, &rsa_public, &rng);
+        status = test_ims_roundtrips(&test_ctx);
     }
-    if (status == 0) {
-        status = test_ecc_sign_roundtrip(true);
+
+    return status;
+}
+
+
+/**
+ * @brief Verifier thread
+ *
+ * Takes VERIFY_CHUNK sampled indices at a time, derives each IMS's keys in
+ * its own context, runs the sign-verify round-trips and records the EP_UID
+ * and key digest for the database pass. Stops taking work once anything
+ * has failed.
+ *
+ * @param arg The verify_worker descriptor
+ */
+static void * verify_worker_thread(void * arg) {
+    verify_worker * worker = arg;
+    verify_queue * queue = worker->queue;
+    ims_context * ctx = &worker->ctx;
+    ims_verified * verified;
+    uint32_t first;
+    uint32_t last;
+    uint32_t i;
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        first = queue->next;
+        last = (queue->num_ims - first < VERIFY_CHUNK)?
+               queue->num_ims : first + VERIFY_CHUNK;
+        queue->next = last;
+        if (queue->failed) {
+            last = first;
+        }
+        pthread_mutex_unlock(&queue->lock);
+        if (first >= last) {
+            break;
+        }
+
+        for (i = first; i < last; i++) {
+            verified = &queue->verified[i];
+            verified->status = ims_input_record(queue->input, verified->index,
+                                                ctx->ims);
+            if (verified->status == 0) {
+                derive_ims_keys(ctx, ctx->ims,
+                                queue->ims_sample_compatibility);
+                memcpy(verified->ep_uid, ctx->ep_uid.val, EP_UID_SIZE);
+                digest_keys(&ctx->epvk, &ctx->esvk, &ctx->erpk_mod,
+                            verified->digest);
+                verified->status = test_ims_roundtrips(ctx);
+            }
+            if (verified->status != 0) {
+                fprintf(stderr, "ERROR: IMS[%u] failed verification\n",
+                        verified->index);
+                pthread_mutex_lock(&queue->lock);
+                queue->failed = true;
+                pthread_mutex_unlock(&queue->lock);
+            }
+        }
     }
-    if (status == 0) {
-        status = test_ecc_sign_roundtrip(false);
+
+    return NULL;
+}
+
+
+/**
+ * @brief Verify a set of IMS values across a pool of threads
+ *
+ * @param input The IMS file
+ * @param verified The IMS indices to verify; gets each one's outcome
+ * @param num_ims The number of entries in verified
+ * @param num_jobs The number of verifier threads
+ * @param ims_sample_compatibility If true, generate IMS values that are
+ *        compatible with the original (incorrect) 100 sample values sent
+ *        to Toshiba 2016/01/14. If false, generate the IMS value using
+ *        the correct form.
+ *
+ * @returns Zero if every IMS was derived and round-tripped, -1 if one
+ *          failed, errno otherwise.
+ */
+static int verify_pool(const ims_input * input, ims_verified * verified,
+                       uint32_t num_ims, uint32_t num_jobs,
+                       bool ims_sample_compatibility) {
+    int status = 0;
+    verify_queue queue;
+    verify_worker * workers;
+    uint32_t num_started = 0;
+    uint32_t i;
+
+    workers = calloc(num_jobs, sizeof(*workers));
+    if (!workers) {
+        fprintf(stderr, "ERROR: Can't allocate %u verifiers\n", num_jobs);
+        return ENOMEM;
     }
 
+    memset(&queue, 0, sizeof(queue));
+    pthread_mutex_init(&queue.lock, NULL);
+    queue.num_ims = num_ims;
+    queue.verified = verified;
+    queue.input = input;
+    queue.ims_sample_compatibility = ims_sample_compatibility;
+
+    for (i = 0; i < num_jobs; i++) {
+        workers[i].queue = &queue;
+        ims_context_init_stream(&workers[i].ctx, "verify", i);
+        if (pthread_create(&workers[i].thread, NULL, verify_worker_thread,
+                           &workers[i]) != 0) {
+            fprintf(stderr, "ERROR: Can't start verifier %u\n", i);
+            status = EAGAIN;
+            break;
+        }
+        num_started++;
+    }
+
+    /* If some failed to start, the others still drain the queue */
+    if (status != 0) {
+        pthread_mutex_lock(&queue.lock);
+        queue.failed = true;
+        pthread_mutex_unlock(&queue.lock);
+    }
+    for (i = 0; i < num_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for (i = 0; i < num_jobs; i++) {
+        ims_context_deinit(&workers[i].ctx);
+    }
+    if ((status == 0) && queue.failed) {
+        status = -1;
+    }
+
+    pthread_mutex_destroy(&queue.lock);
+    free(workers);
     return status;
 }
 
 
 /**
- * @brief Read and verify an IMS value
+ * @brief Order verified IMS values by EP_UID
+ */
+static int verified_compare(const void * a, const void * b) {
+    return memcmp(((const ims_verified *)a)->ep_uid,
+                  ((const ims_verified *)b)->ep_uid, EP_UID_SIZE);
+}
+
+
+/**
+ * @brief Merge one database keyset with the verified IMS values
  *
- * @param ims_fd The file descriptor of the IMS file
- * @param index Which IMS value to verify (zero-based)
- * @param sample_compatibility_mode If true, generate IMS values that are
+ * The database cursor and the verified values are both in EP_UID order;
+ * any verified value the cursor steps over has no keyset.
+ *
+ * @returns Zero to continue the scan, ECANCELED once every verified value
+ *          has been matched, EIO if the database isn't in EP_UID order.
+ */
+static int verify_merge_keyset(void * cookie,
+                               const uint8_t * ep_uid,
+                               mcl_octet * epvk,
+                               mcl_octet * esvk,
+                               mcl_octet * erpk_mod) {
+    verify_merge * merge = cookie;
+    ims_verified * verified;
+    uint8_t digest[SHA256_HASH_DIGEST_SIZE];
+    int order;
+
+    if ((merge->num_rows++ > 0) &&
+        (memcmp(ep_uid, merge->last_ep_uid, EP_UID_SIZE) < 0)) {
+        fprintf(stderr, "ERROR: key database isn't in EP_UID order\n");
+        return EIO;
+    }
+    memcpy(merge->last_ep_uid, ep_uid, EP_UID_SIZE);
+
+    while (merge->next < merge->num_ims) {
+        verified = &merge->verified[merge->next];
+        order = memcmp(verified->ep_uid, ep_uid, EP_UID_SIZE);
+        if (order > 0) {
+            /* This keyset wasn't sampled */
+            return 0;
+        }
+        if (order < 0) {
+            /* The cursor has passed this EP_UID */
+            verified->status = ENOENT;
+        } else {
+            digest_keys(epvk, esvk, erpk_mod, digest);
+            if (memcmp(digest, verified->digest, sizeof(digest)) != 0) {
+                verified->status = EBADMSG;
+            }
+        }
+        merge->next++;
+    }
+
+    return ECANCELED;
+}
+
+
+/**
+ * @brief Compare the verified IMS values' keys with the key database
+ *
+ * Sorts the verified values by EP_UID and merges them with one ordered
+ * pass over the database, then re-checks each failure on its own to
+ * report which key differs.
+ *
+ * @param input The IMS file
+ * @param verified The verified IMS values (reordered)
+ * @param num_ims The number of entries in verified
+ * @param ims_sample_compatibility If true, generate IMS values that are
  *        compatible with the original (incorrect) 100 sample values sent
  *        to Toshiba 2016/01/14. If false, generate the IMS value using
  *        the correct form.
  *
- * @returns Zero if the IMS value verified, errno or -1 otherwise.
+ * @returns Zero if every keyset matched, -1 if one didn't, errno otherwise.
  */
-int read_verify_ims(const int ims_fd, const uint32_t index,
-                 bool sample_compatibility_mode) {
-    off_t offset;
+static int verify_against_db(const ims_input * input,
+                             ims_verified * verified,
+                             uint32_t num_ims,
+                             bool ims_sample_compatibility) {
     int status;
+    verify_merge merge = { verified, num_ims, 0, 0 };
+    uint32_t num_failed = 0;
+    uint32_t i;
 
-    offset = index * IMS_LINE_SIZE;
-    printf("IMS[%u]\n", index);
-    status = ims_read(ims_fd, offset, ims);
-    if (status == 0) {
-        status = test_ims(ims, sample_compatibility_mode);
+    qsort(verified, num_ims, sizeof(*verified), verified_compare);
+    status = db_scan_keysets(NULL, NULL, verify_merge_keyset, &merge);
+    if (status == ECANCELED) {
+        status = 0;
+    }
+    if (status != 0) {
+        return status;
+    }
+    for (i = merge.next; i < num_ims; i++) {
+        verified[i].status = ENOENT;
+    }
+
+    for (i = 0; i < num_ims; i++) {
+        if (verified[i].status == 0) {
+            continue;
+        }
+        if (num_failed++ < VERIFY_MAX_REPORTS) {
+            fprintf(stderr, "ERROR: IMS[%u] doesn't match the key db\n",
+                    verified[i].index);
+            if (ims_input_record(input, verified[i].index,
+                                 test_ctx.ims) == 0) {
+                test_ims(test_ctx.ims, ims_sample_compatibility);
+            }
+        }
+    }
+    if (num_failed > 0) {
+        fprintf(stderr, "ERROR: %u of %u IMS values don't match the key db\n",
+                num_failed, num_ims);
+        status = -1;
     }
 
     return status;
@@ -622,22 +935,141 @@ int read_verify_ims(const int ims_fd, const uint32_t index,
 uint32_t rand32(void) {
     uint32_t r;
 
-    r = (MCL_RAND_byte(&rng) << 24) |
-        (MCL_RAND_byte(&rng) << 16) |
-        (MCL_RAND_byte(&rng) << 8) |
-        MCL_RAND_byte(&rng);
+    r = (MCL_RAND_byte(&test_ctx.rng) << 24) |
+        (MCL_RAND_byte(&test_ctx.rng) << 16) |
+        (MCL_RAND_byte(&test_ctx.rng) << 8) |
+        MCL_RAND_byte(&test_ctx.rng);
+    return r;
+}
+
+
+/**
+ * @brief Choose which IMS values to verify
+ *
+ * Floyd's algorithm draws num_ims distinct indices with exactly num_ims
+ * random numbers, using a bitmap of the file for membership, and the
+ * indices come out in file order.
+ *
+ * @param num_available The number of IMS values in the file
+ * @param verified Gets the num_ims chosen indices, ascending
+ * @param num_ims The number of indices to choose (<= num_available)
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int choose_sample(uint32_t num_available, ims_verified * verified,
+                         uint32_t num_ims) {
+    uint64_t * chosen;
+    uint32_t i;
+    uint32_t j;
+    uint32_t r;
+
+    chosen = calloc((num_available + 63) / 64, sizeof(*chosen));
+    if (!chosen) {
+        fprintf(stderr, "ERROR: Can't allocate the sample set\n");
+        return ENOMEM;
+    }
+
+    for (j = num_available - num_ims; j < num_available; j++) {
+        r = rand32() % (j + 1);
+        if (chosen[r / 64] & ((uint64_t)1 << (r % 64))) {
+            r = j;
+        }
+        chosen[r / 64] |= (uint64_t)1 << (r % 64);
+    }
+
+    for (i = 0, j = 0; i < num_available; i++) {
+        if (chosen[i / 64] & ((uint64_t)1 << (i % 64))) {
+            verified[j++].index = i;
+        }
+    }
+
+    free(chosen);
+    return 0;
+}
+
+
+/**
+ * @brief Map the IMS file under test
+ *
+ * @param ims_filename The name of the IMS input file
+ * @param input The mapping to fill in
+ * @param num_available Set to the number of IMS values in the file
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+static int ims_input_open(const char * ims_filename, ims_input * input,
+                          uint32_t * num_available) {
+    int status = 0;
+    struct stat ims_stat = {0};
+    void * text;
+
+    input->fd = -1;
+    input->binary = ims_file_is_binary(ims_filename);
+    if (input->binary) {
+        /* Map the container; its header gives the record count */
+        status = ims_file_map_open(ims_filename, &input->map);
+        *num_available = (uint32_t)input->map.num_records;
+        return status;
+    }
+
+    input->fd = open(ims_filename, O_RDONLY);
+    if (input->fd == -1) {
+        fprintf(stderr, "ERROR: Can't open IMS file '%s'\n", ims_filename);
+        status = errno;
+    } else if (fstat(input->fd, &ims_stat) != 0) {
+        fprintf(stderr, "ERROR: Can't find IMS file '%s'\n", ims_filename);
+        status = errno;
+    } else if (ims_stat.st_size > 0) {
+        text = mmap(NULL, ims_stat.st_size, PROT_READ, MAP_SHARED,
+                    input->fd, 0);
+        if (text == MAP_FAILED) {
+            fprintf(stderr, "ERROR: Can't map IMS file '%s'\n", ims_filename);
+            status = errno;
+        } else {
+            input->text = text;
+            input->text_size = ims_stat.st_size;
+        }
+    }
+
+    /* Determine how many IMS values are in the file. */
+    *num_available = input->text_size / (IMS_LINE_SIZE);
+    return status;
+}
+
+
+/**
+ * @brief Unmap the IMS file under test
+ *
+ * @param input The mapping
+ */
+static void ims_input_close(ims_input * input) {
+    if (input->binary) {
+        ims_file_map_close(&input->map);
+    } else {
+        if (input->text) {
+            munmap((void *)input->text, input->text_size);
+            input->text = NULL;
+        }
+        if (input->fd != -1) {
+            close(input->fd);
+            input->fd = -1;
+        }
+    }
 }
 
 
 /**
  * @brief Test a representative sample of IMS values
  *
- * Reads a random sampling of N IMS values, extracts the key values
- * from them and verifies that sample text can be encrypted-decrypted
- * with them.
+ * Chooses a random sampling of N IMS values (or takes all of them),
+ * derives their keys and verifies that sample text can be signed and
+ * verified with them across num_jobs threads, then compares the derived
+ * public keys with the key database in one ordered pass. The IMS file may
+ * be binascii or a binary IMS container.
  *
  * @param ims_filename The name of the IMS input file
  * @param num_ims The number of IMS values to test
+ * @param num_jobs The number of verifier threads
  * @param sample_compatibility_mode If true, generate IMS values that are
  *        compatible with the original (incorrect) 100 sample values sent
  *        to Toshiba 2016/01/14. If false, generate the IMS value using
@@ -646,91 +1078,63 @@ uint32_t rand32(void) {
  * @returns Zero if all tested IMS values verify, errno or -1 otherwise.
  */
 int test_ims_set(const char * ims_filename, uint32_t num_ims,
-                 bool sample_compatibility_mode) {
+                 uint32_t num_jobs, bool sample_compatibility_mode) {
     int status = 0;
-    int ims_fd;
+    ims_input input = {-1};
+    uint32_t num_available_ims = 0;
     uint32_t i;
-    uint32_t j;
-    uint32_t index;
-    uint32_t r;
-    bool unique;
-    off_t offset;
-    int num_available_ims;
-    int * test_set = NULL;
-    struct stat ims_stat = {0};
+    ims_verified * verified = NULL;
+    uint64_t start;
 
-    ims_fd = open(ims_filename, O_RDONLY);
-    if (open(ims_filename, O_RDONLY) == -1) {
-        fprintf(stderr, "ERROR: Can't open IMS file '%s'\n", ims_filename);
-        status = errno;
-    } else {
-        if (fstat(ims_fd, &ims_stat) != 0) {
-            fprintf(stderr, "ERROR: Can't find IMS file '%s'\n", ims_filename);
-            status = errno;
-        } else {
-            /* Determine how many IMS values are in the file. */
-            num_available_ims = ims_stat.st_size / (IMS_LINE_SIZE);
-            if (num_ims > num_available_ims) {
-                fprintf(stderr, "Warning: IMS file only contains %d entr%s\n",
-                        num_available_ims,
-                        (num_available_ims == 1)? "y" : "ies");
-                num_ims = num_available_ims;
-            }
+    status = ims_input_open(ims_filename, &input, &num_available_ims);
 
-            printf("Test %d of %d IMS values%s\n", num_ims, num_available_ims,
-                    sample_compatibility_mode?
-                            " (compatible with initial 100 IMS samples)" :
-                            "");
-
-            if (num_ims >= num_available_ims) {
-                /* Sequentially scan all IMS */
-                for (i = 0; (i < num_ims) && (status == 0); i++) {
-                    status = read_verify_ims(ims_fd, i,
-                                             sample_compatibility_mode);
-                }
-            } else {
-                /* Randomly draw and verify N IMS values from the IMS file */
-                test_set = calloc(num_ims, sizeof(*test_set));
-                if (test_set) {
-                    /* Randomly draw N unique IMS values */
-                    /* Create a set of unique indices */
-                    for (i = 0; (i < num_ims) && (status == 0); i++) {
-                        do {
-                            unique = true;
-                            /* Draw a random index and check for uniqueness */
-                            r = rand32() % num_available_ims;
-                            for (j = 0; j < i; j++) {
-                                if (r == test_set[j]) {
-                                    /* Duplicate, draw again */
-                                    unique = false;
-                                    break;
-                                }
-                            }
-                        } while (!unique);
-                        test_set[i] = r;
-                    }
-                    /* Process the set of unique indices */
-                    for (i = 0; (i < num_ims) && (status == 0); i++) {
-                        status = read_verify_ims(ims_fd, test_set[i],
-                                                 sample_compatibility_mode);
-                    }
-                    free(test_set);
-                } else {
-                    /* Draw N IMS values, with some risk of duplication */
-                    fprintf(stderr,
-                            "Warning: random sampling may have duplicates\n");
-                    for (i = 0; (i < num_ims) && (status == 0); i++) {
-                        /* Randomly draw IMS */
-                        status = read_verify_ims(ims_fd,
-                                                 rand32() % num_available_ims,
-                                                 sample_compatibility_mode);
-                     }
-                }
+    if (status == 0) {
+        if (num_ims > num_available_ims) {
+            fprintf(stderr, "Warning: IMS file only contains %u entr%s\n",
+                    num_available_ims,
+                    (num_available_ims == 1)? "y" : "ies");
+            num_ims = num_available_ims;
+        }
+
+        printf("Test %u of %u IMS values%s\n", num_ims, num_available_ims,
+                sample_compatibility_mode?
+                        " (compatible with initial 100 IMS samples)" :
+                        "");
+
+        verified = calloc((num_ims > 0)? num_ims : 1, sizeof(*verified));
+        if (!verified) {
+            fprintf(stderr, "ERROR: Can't allocate %u IMS results\n", num_ims);
+            status = ENOMEM;
+        }
+    }
+
+    if (status == 0) {
+        if (num_ims >= num_available_ims) {
+            /* Sequentially scan all IMS */
+            for (i = 0; i < num_ims; i++) {
+                verified[i].index = i;
             }
+        } else {
+            /* Randomly draw N unique IMS values from the IMS file */
+            status = choose_sample(num_available_ims, verified, num_ims);
         }
+    }
 
-        close (ims_fd);
+    if (status == 0) {
+        start = ims_stats_now();
+        status = verify_pool(&input, verified, num_ims, num_jobs,
+                             sample_compatibility_mode);
+        if (status == 0) {
+            status = verify_against_db(&input, verified, num_ims,
+                                       sample_compatibility_mode);
+        }
+        printf("Checked %u IMS values with %u thread%s in %.1f s\n",
+               num_ims, num_jobs, (num_jobs == 1)? "" : "s",
+               (ims_stats_now() - start) / 1e9);
     }
 
+    free(verified);
+    ims_input_close(&input);
+
     return status;
 }
@@ -69,10 +69,12 @@ void ims_deinit(void);
  *
  * Reads a random sampling of N IMS values, extracts the key values
  * from them and verifies that sample text can be encrypted-decrypted
- * with them.
+ * with them, spread across num_jobs threads, then compares the keys with
+ * the key database in a single ordered pass.
  *
  * @param ims_filename The name of the IMS input file
  * @param num_ims The number of IMS values to test
+ * @param num_jobs The number of verifier threads
  * @param ims_sample_compatibility If true, generate IMS values that are
  *        compatible with the original (incorrect) 100 sample values sent
  *        to Toshiba 2016/01/14. If false, generate the IMS value using
@@ -81,6 +83,45 @@ void ims_deinit(void);
  * @returns Zero if all tested IMS values verify, errno otherwise.
  */
 int test_ims_set(const char * ims_filename, uint32_t num_ims,
-                 bool ims_sample_compatibility);
+                 uint32_t num_jobs, bool ims_sample_compatibility);
+
+
+/**
+ * @brief Compare the rejection-free IMS candidate sampler with the original
+ * rejection sampler
+ *
+ * Draws num_samples from each and checks both against the exact uniform
+ * constant-weight distribution, and against each other, with chi-square
+ * tests.
+ *
+ * @param prng_seed_file Filename from which to read the seed
+ * @param prng_seed_string Raw seed string
+ * @param num_samples The number of samples to draw from each sampler
+ *
+ * @returns Zero if every test passed, EINVAL for too few samples, EIO if a
+ *          test failed, errno otherwise.
+ */
+int test_ims_sampler(const char * prng_seed_file,
+                     const char * prng_seed_string,
+                     uint32_t num_samples);
+
+
+/**
+ * @brief Check the EP_UID set's Bloom filter as the set grows
+ *
+ * Grows the set from its smallest size with num_keys random EP_UIDs,
+ * measures the false-positive rate at evenly spaced fill levels, and
+ * checks that every EP_UID added is found.
+ *
+ * @param prng_seed_file Filename from which to read the seed
+ * @param prng_seed_string Raw seed string
+ * @param num_keys The number of EP_UIDs to add
+ *
+ * @returns Zero if every check passed, EINVAL for too few EP_UIDs, EIO if
+ *          a check failed, errno otherwise.
+ */
+int test_uid_set(const char * prng_seed_file,
+                 const char * prng_seed_string,
+                 uint32_t num_keys);
 
 #endif /* !_IMS_TEST_H */
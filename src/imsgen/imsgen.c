@@ -59,10 +59,30 @@
 #define PROGRAM_WARNINGS    1
 #define PROGRAM_ERROR       2
 
+/* Default keysets per database transaction */
+#define DB_BATCH_SIZE_DEFAULT   256
+
 
 /* Parsing args */
 static int      sample_compatibility_mode = 0;
 static int      num_ims;
+static int      num_jobs = 1;
+static int      db_batch_size = DB_BATCH_SIZE_DEFAULT;
+static int      db_wal = 0;
+static int      binary_out = 0;
+static int      indexed = 0;
+static uint32_t first_index = 0;
+static int      rejection_sampler = 0;
+static int      resume = 0;
+static int      checkpoint_interval = IMS_CHECKPOINT_INTERVAL_SEC;
+static char *   bignum_backend;
+static char *   cross_check_backend;
+static int      cross_check_every = 1;
+static char *   shard_spec;
+static char *   stats_filename;
+static uint32_t shard_index;
+static uint32_t shard_count;
+static uint64_t index_base;
 static char *   database_name;
 static char *   ims_filename;
 static char *   prng_seed_filename;
@@ -70,6 +90,20 @@ static char *   prng_seed_string;
 
 static char *   sample_compatibility_mode_names[] = { "compatibility", NULL };
 static char *   num_ims_names[] = { "num", "num-ims", NULL };
+static char *   num_jobs_names[] = { "jobs", NULL };
+static char *   db_batch_size_names[] = { "db-batch", NULL };
+static char *   db_wal_names[] = { "db-wal", NULL };
+static char *   binary_out_names[] = { "binary", NULL };
+static char *   indexed_names[] = { "indexed", NULL };
+static char *   first_index_names[] = { "first-index", NULL };
+static char *   shard_names[] = { "shard", NULL };
+static char *   rejection_sampler_names[] = { "rejection-sampler", NULL };
+static char *   resume_names[] = { "resume", NULL };
+static char *   checkpoint_interval_names[] = { "checkpoint-interval", NULL };
+static char *   bignum_backend_names[] = { "bignum", NULL };
+static char *   cross_check_backend_names[] = { "cross-check", NULL };
+static char *   cross_check_every_names[] = { "cross-check-every", NULL };
+static char *   stats_filename_names[] = { "stats", NULL };
 static char *   database_name_names[] = { "db", "database", NULL };
 static char *   ims_filename_names[] = { "out", "ims", NULL };
 static char *   prng_seed_filename_names[] = { "seed-file", NULL };
@@ -81,6 +115,50 @@ static struct optionx parse_table[] = {
     { 'n', num_ims_names, NULL,
       &num_ims, 0, REQUIRED, &store_hex, false,
       "The number of IMS values to generate" },
+    { 'j', num_jobs_names, "num",
+      &num_jobs, 1, DEFAULT_VAL, &store_hex, false,
+      "The number of IMS generator threads (1)" },
+    { 'b', db_batch_size_names, "num",
+      &db_batch_size, DB_BATCH_SIZE_DEFAULT, DEFAULT_VAL, &store_hex, false,
+      "The most keysets committed per database transaction (256)" },
+    { 'w', db_wal_names, NULL,
+      &db_wal, 0, STORE_TRUE, NULL, false,
+      "Use WAL journaling and synchronous=NORMAL for the database" },
+    { 'B', binary_out_names, NULL,
+      &binary_out, 0, STORE_TRUE, NULL, false,
+      "Write the IMS file as a binary IMS container (see ims-convert)" },
+    { 'x', indexed_names, NULL,
+      &indexed, 0, STORE_TRUE, NULL, false,
+      "Derive each IMS from its own per-index sub-seed" },
+    { 'k', first_index_names, "num",
+      &first_index, 0, DEFAULT_VAL, &store_hex, false,
+      "With --indexed, the index of the first IMS generated (0, at most "
+      "0xffffffff)" },
+    { 'S', shard_names, "i/N",
+      &shard_spec, 0, OPTIONAL, &store_str, false,
+      "Generate shard i of N of the --num IMS values (implies --indexed)" },
+    { 'R', rejection_sampler_names, NULL,
+      &rejection_sampler, 0, STORE_TRUE, NULL, false,
+      "Draw IMS candidates with the original rejection sampler" },
+    { 'r', resume_names, NULL,
+      &resume, 0, STORE_TRUE, NULL, false,
+      "Resume the interrupted run checkpointed in <ims file>.ckpt" },
+    { 'K', checkpoint_interval_names, "sec",
+      &checkpoint_interval, IMS_CHECKPOINT_INTERVAL_SEC, DEFAULT_VAL,
+      &store_hex, false,
+      "Seconds between checkpoints, 0 for none (5)" },
+    { 'N', bignum_backend_names, "name",
+      &bignum_backend, 0, OPTIONAL, &store_str, false,
+      "The ERRK big-number backend: mcl or openssl (mcl)" },
+    { 'C', cross_check_backend_names, "name",
+      &cross_check_backend, 0, OPTIONAL, &store_str, false,
+      "Replay ERRK searches on this backend and stop on any mismatch" },
+    { 'E', cross_check_every_names, "num",
+      &cross_check_every, 1, DEFAULT_VAL, &store_hex, false,
+      "With --cross-check, replay every num'th search per thread (1)" },
+    { 'T', stats_filename_names, "file",
+      &stats_filename, 0, OPTIONAL, &store_str, false,
+      "Write a JSON per-stage timing report to file ('-' for stdout)" },
     { 'c', sample_compatibility_mode_names, NULL,
       &sample_compatibility_mode, 0, STORE_TRUE, NULL, false,
       "100-IMS sample backward compatibility" },
@@ -99,7 +177,7 @@ static struct optionx parse_table[] = {
      { 0, NULL, NULL, NULL, 0, 0, NULL, 0, NULL }
 };
 
-static char all_args[] = "s:o:d:n:c";
+static char all_args[] = "s:o:d:n:j:b:wBxk:S:RrK:N:C:E:T:c";
 
 
 /**
@@ -122,6 +200,82 @@ int postprocess_args(int argc) {
         status = PROGRAM_ERROR;
     }
 
+    if (num_jobs < 1) {
+        fprintf(stderr, "ERROR: --jobs must be >= 1\n");
+        status = PROGRAM_ERROR;
+    }
+
+    if (db_batch_size < 1) {
+        fprintf(stderr, "ERROR: --db-batch must be >= 1\n");
+        status = PROGRAM_ERROR;
+    }
+
+    /**
+     * --first-index is parsed as 32 bits, but IMS indices are 64-bit, so
+     * a shard's slice is added and the range computed without overflow.
+     */
+    index_base = first_index;
+    if (shard_spec && (num_ims >= 1)) {
+        char trailing;
+
+        if ((sscanf(shard_spec, "%u/%u%c", &shard_index, &shard_count,
+                    &trailing) != 2) ||
+            (shard_count < 1) || (shard_index >= shard_count)) {
+            fprintf(stderr, "ERROR: --shard must be i/N, with 0 <= i < N\n");
+            status = PROGRAM_ERROR;
+        } else {
+            /**
+             * Shard i takes its slice of the --num index range, so shards
+             * never share a PRNG stream and, concatenated in order by
+             * ims-merge, reproduce the unsharded --indexed run.
+             */
+            indexed = 1;
+            index_base += ((uint64_t)num_ims * shard_index) / shard_count;
+            num_ims = (uint32_t)(((uint64_t)num_ims * (shard_index + 1)) /
+                                 shard_count) -
+                      (uint32_t)(((uint64_t)num_ims * shard_index) /
+                                 shard_count);
+            if (num_ims < 1) {
+                fprintf(stderr, "ERROR: --shard %s has no IMS values\n",
+                        shard_spec);
+                status = PROGRAM_ERROR;
+            }
+        }
+    }
+
+    if (cross_check_every < 1) {
+        fprintf(stderr, "ERROR: --cross-check-every must be >= 1\n");
+        status = PROGRAM_ERROR;
+    }
+
+    if ((cross_check_every != 1) && !cross_check_backend) {
+        fprintf(stderr, "ERROR: --cross-check-every requires --cross-check\n");
+        status = PROGRAM_ERROR;
+    }
+
+    if (sample_compatibility_mode && bignum_backend &&
+        (strcmp(bignum_backend, IMS_BIGNUM_DEFAULT) != 0)) {
+        fprintf(stderr, "ERROR: --compatibility requires --bignum %s\n",
+                IMS_BIGNUM_DEFAULT);
+        status = PROGRAM_ERROR;
+    }
+
+    if (checkpoint_interval < 0) {
+        fprintf(stderr, "ERROR: --checkpoint-interval must be >= 0\n");
+        status = PROGRAM_ERROR;
+    }
+
+    if (resume && (checkpoint_interval == 0)) {
+        fprintf(stderr, "ERROR: --resume needs checkpoints "
+                "(--checkpoint-interval > 0)\n");
+        status = PROGRAM_ERROR;
+    }
+
+    if ((first_index != 0) && !indexed) {
+        fprintf(stderr, "ERROR: --first-index requires --indexed\n");
+        status = PROGRAM_ERROR;
+    }
+
     if ((prng_seed_filename && prng_seed_string) ||
         (!prng_seed_filename && !prng_seed_string)) {
         fprintf(stderr, "ERROR: You must specify one of --seed or --seed-file\n");
@@ -143,6 +297,7 @@ int main(int argc, char * argv[]) {
     bool success = true;
     struct argparse * parse_tbl = NULL;
     int program_status = PROGRAM_SUCCESS;
+    int status;
     uint32_t count;
 
     /* Parse the command line arguments */
@@ -166,21 +321,51 @@ int main(int argc, char * argv[]) {
                 sample_compatibility_mode?
                         " (compatible with initial 100 IMS samples)" :
                         "");
+        if (shard_spec) {
+            printf("Shard %u of %u: IMS indices %llu..%llu\n",
+                   shard_index, shard_count, (unsigned long long)index_base,
+                   (unsigned long long)(index_base + num_ims - 1));
+        }
         /* Open the DB, IMS file, etc.  */
-        if (ims_init(prng_seed_filename, prng_seed_string, ims_filename, database_name) != 0) {
+        ims_set_checkpoint((uint32_t)checkpoint_interval, resume);
+        if (ims_init(prng_seed_filename, prng_seed_string, ims_filename,
+                     database_name, db_batch_size, db_wal, binary_out,
+                     num_ims) != 0) {
             fprintf(stderr, "ERROR: IMS generation initialization failed\n");
             program_status = PROGRAM_ERROR;
         } else {
-            /* Generate N IMS values */
-            for (count = 0; count < num_ims; count++) {
-                printf("IMS %d/%d\n", count + 1, num_ims);
-                if (ims_generate(sample_compatibility_mode) != 0) {
-                    fprintf(stderr,
-                            "ERROR: created only %u of %u IMS values\n",
-                            count, num_ims);
-                    program_status = PROGRAM_ERROR;
-                    break;
-                }
+            ims_set_index_mode(indexed, index_base);
+            ims_set_rejection_sampler(rejection_sampler);
+            status = ims_set_bignum(bignum_backend, cross_check_backend,
+                                    cross_check_every);
+            if ((status == 0) && cross_check_backend) {
+                printf("Cross-checking the %s big-number backend against "
+                       "%s (every %d P/Q searches)\n",
+                       bignum_backend? bignum_backend : IMS_BIGNUM_DEFAULT,
+                       cross_check_backend, cross_check_every);
+            }
+
+            /* Generate N IMS values (across the worker threads if asked) */
+            if (status != 0) {
+                count = 0;
+            } else if (num_jobs > 1) {
+                status = ims_generate_batch(num_ims, num_jobs,
+                                            sample_compatibility_mode, &count);
+            } else {
+                status = ims_generate_set(num_ims, sample_compatibility_mode,
+                                          &count);
+            }
+            if (status != 0) {
+                fprintf(stderr,
+                        "ERROR: created only %u of %u IMS values\n",
+                        count, num_ims);
+                program_status = PROGRAM_ERROR;
+            }
+
+            /* Report where the time went */
+            if (stats_filename && (ims_write_stats(stats_filename) != 0) &&
+                (program_status == PROGRAM_SUCCESS)) {
+                program_status = PROGRAM_WARNINGS;
             }
 
             /* Close the DB, IMS file */
@@ -63,6 +63,9 @@
 /* Parsing args */
 static int      sample_compatibility_mode = 0;
 static int      num_ims;
+static int      num_jobs = 1;
+static int      sampler_samples = 0;
+static int      uid_set_keys = 0;
 static char *   database_name;
 static char *   ims_filename;
 static char *   prng_seed_filename;
@@ -70,6 +73,9 @@ static char *   prng_seed_string;
 
 static char *   sample_compatibility_mode_names[] = { "compatibility", NULL };
 static char *   num_ims_names[] = { "num", "num-ims", NULL };
+static char *   num_jobs_names[] = { "jobs", NULL };
+static char *   sampler_samples_names[] = { "sampler-test", NULL };
+static char *   uid_set_keys_names[] = { "uid-set-test", NULL };
 static char *   database_name_names[] = { "db", "database", NULL };
 static char *   ims_filename_names[] = { "in", "ims", NULL };
 static char *   prng_seed_filename_names[] = { "seed-file", NULL };
@@ -85,21 +91,30 @@ static struct optionx parse_table[] = {
       &prng_seed_string, 0, OPTIONAL, &store_str, false,
       "The PRNG seed string (hex digits)" },
     { 'i', ims_filename_names, NULL,
-      &ims_filename, 0, REQUIRED, &store_str, false,
+      &ims_filename, 0, OPTIONAL, &store_str, false,
       "The name of the IMS input file" },
     { 'd', database_name_names, NULL,
-      &database_name, 0, REQUIRED, &store_str, false,
+      &database_name, 0, OPTIONAL, &store_str, false,
       "The name of the certificate database" },
     { 'n', num_ims_names, NULL,
-      &num_ims, 0, REQUIRED, &store_hex, false,
+      &num_ims, 0, DEFAULT_VAL, &store_hex, false,
       "The number of IMS values to test" },
+    { 'j', num_jobs_names, "num",
+      &num_jobs, 1, DEFAULT_VAL, &store_hex, false,
+      "The number of verifier threads (1)" },
+    { 'p', sampler_samples_names, "num",
+      &sampler_samples, 0, DEFAULT_VAL, &store_hex, false,
+      "Instead, test the IMS candidate samplers with num samples each" },
+    { 'u', uid_set_keys_names, "num",
+      &uid_set_keys, 0, DEFAULT_VAL, &store_hex, false,
+      "Instead, test the EP_UID set's Bloom filter with num EP_UIDs" },
     { 'c', sample_compatibility_mode_names, NULL,
       &sample_compatibility_mode, 0, STORE_TRUE, NULL, false,
       "100-IMS sample backward compatibility" },
     { 0, NULL, NULL, NULL, 0, 0, NULL, 0, NULL }
 };
 
-static char all_args[] = "s:i:n:d:c";
+static char all_args[] = "s:i:n:j:d:p:u:c";
 
 
 /**
@@ -117,9 +132,26 @@ int postprocess_args(int argc) {
         status = PROGRAM_ERROR;
     }
 
-    if (num_ims < 1) {
-        fprintf(stderr, "ERROR: --num must be >= 1\n");
+    if ((sampler_samples != 0) && (uid_set_keys != 0)) {
+        fprintf(stderr, "ERROR: --sampler-test and --uid-set-test are "
+                "exclusive\n");
         status = PROGRAM_ERROR;
+    } else if ((sampler_samples == 0) && (uid_set_keys == 0)) {
+        /* Verifying an IMS file */
+        if (num_ims < 1) {
+            fprintf(stderr, "ERROR: --num must be >= 1\n");
+            status = PROGRAM_ERROR;
+        }
+
+        if (num_jobs < 1) {
+            fprintf(stderr, "ERROR: --jobs must be >= 1\n");
+            status = PROGRAM_ERROR;
+        }
+
+        if (!ims_filename || !database_name) {
+            fprintf(stderr, "ERROR: You must specify --in and --db\n");
+            status = PROGRAM_ERROR;
+        }
     }
 
     if ((prng_seed_filename && prng_seed_string) ||
@@ -163,14 +195,33 @@ int main(int argc, char * argv[]) {
     }
 
 
-    if (program_status == PROGRAM_SUCCESS) {
+    if ((program_status == PROGRAM_SUCCESS) && (sampler_samples != 0)) {
+        /* Check the IMS candidate samplers' distributions */
+        status = test_ims_sampler(prng_seed_filename, prng_seed_string,
+                                  sampler_samples);
+        if (status != 0) {
+            fprintf(stderr, "ERROR: Failed IMS sampler test (err %d)\n",
+                    status);
+            program_status = PROGRAM_ERROR;
+        }
+    } else if ((program_status == PROGRAM_SUCCESS) && (uid_set_keys != 0)) {
+        /* Check the EP_UID set's Bloom filter */
+        status = test_uid_set(prng_seed_filename, prng_seed_string,
+                              uid_set_keys);
+        if (status != 0) {
+            fprintf(stderr, "ERROR: Failed EP_UID set test (err %d)\n",
+                    status);
+            program_status = PROGRAM_ERROR;
+        }
+    } else if (program_status == PROGRAM_SUCCESS) {
         /* Open the DB, IMS file, etc.  */
         if (ims_init(prng_seed_filename, prng_seed_string, database_name) != 0) {
             fprintf(stderr, "ERROR: IMS generation initialization failed\n");
             program_status = PROGRAM_ERROR;
         } else {
             /* Test N IMS values */
-            status = test_ims_set(ims_filename, num_ims, sample_compatibility_mode);
+            status = test_ims_set(ims_filename, num_ims, num_jobs,
+                                  sample_compatibility_mode);
             if (status != 0) {
                 fprintf(stderr, "ERROR: Failed IMS verification (err %d)\n", status);
                 program_status = PROGRAM_ERROR;
@@ -0,0 +1,333 @@
+/**
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the in-memory EP_UID set used by imsgen's
+ * uniqueness checks.
+ *
+ * EP_UIDs are 8-byte truncated SHA-256 digests, so each one is kept as a
+ * uint64_t in an open-addressed (linear probing) hash table. The table is
+ * fronted by a Bloom filter: almost every fresh candidate is rejected by
+ * the filter without touching the table, and a filter hit is confirmed
+ * (or refuted) by the table, so the set never answers wrongly.
+ *
+ * The set is not thread safe; imsgen only uses it from the thread that
+ * emits IMS values.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "uid_set.h"
+
+/* Keep the table at most 3/4 full */
+#define UID_SET_MIN_SLOTS       1024
+#define UID_SET_LOAD_NUM        3
+#define UID_SET_LOAD_DEN        4
+
+/* Bloom filter sizing: ~1% false positives with the table 3/4 full */
+#define UID_BLOOM_BITS_PER_KEY  10
+#define UID_BLOOM_HASHES        7
+
+typedef struct {
+    uint64_t * slots;           /* Zero marks an empty slot */
+    uint64_t   num_slots;       /* Always a power of 2 */
+    uint64_t   entries;
+    bool       has_zero;        /* The all-zero EP_UID is kept out of band */
+    uint64_t * bloom;
+    uint64_t   bloom_bits;      /* Always a power of 2 */
+    uint64_t   lookups;
+    uint64_t   bloom_passes;
+    uint64_t   false_positives;
+} uid_set;
+
+static uid_set set;
+
+
+/**
+ * @brief Convert an EP_UID into its 64-bit key
+ */
+static uint64_t uid_key(const uint8_t * ep_uid) {
+    uint64_t key = 0;
+    int i;
+
+    for (i = 0; i < UID_SET_KEY_SIZE; i++) {
+        key = (key << 8) | ep_uid[i];
+    }
+    return key;
+}
+
+
+/**
+ * @brief Scramble a key (EP_UIDs are already uniform; this is cheap
+ * insurance against structured test data)
+ */
+static uint64_t uid_mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+
+/**
+ * @brief Round up to a power of 2
+ */
+static uint64_t round_pow2(uint64_t n) {
+    uint64_t p = 1;
+
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+
+/**
+ * @brief Set a key's bits in the Bloom filter
+ */
+static void bloom_add(uint64_t hash) {
+    uint64_t h1 = hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    int i;
+
+    for (i = 0; i < UID_BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + i * h2) & (set.bloom_bits - 1);
+        set.bloom[bit / 64] |= 1ULL << (bit % 64);
+    }
+}
+
+
+/**
+ * @brief Test a key's bits in the Bloom filter
+ *
+ * @returns False if the key is certainly absent, true if it may be present
+ */
+static bool bloom_test(uint64_t hash) {
+    uint64_t h1 = hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    int i;
+
+    for (i = 0; i < UID_BLOOM_HASHES; i++) {
+        uint64_t bit = (h1 + i * h2) & (set.bloom_bits - 1);
+        if ((set.bloom[bit / 64] & (1ULL << (bit % 64))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Insert a non-zero key into the table (no growth check)
+ *
+ * @returns True if it was added, false if it was already there.
+ */
+static bool table_insert(uint64_t * slots, uint64_t num_slots, uint64_t key) {
+    uint64_t i = uid_mix(key) & (num_slots - 1);
+
+    while (slots[i] != 0) {
+        if (slots[i] == key) {
+            return false;
+        }
+        i = (i + 1) & (num_slots - 1);
+    }
+    slots[i] = key;
+    return true;
+}
+
+
+/**
+ * @brief (Re)size the table and the Bloom filter for a capacity
+ *
+ * The filter is sized for the most keys the table takes before it grows,
+ * not for the capacity asked for, which round_pow2 can nearly double.
+ *
+ * @returns Zero if successful, errno otherwise (the set is unchanged).
+ */
+static int uid_set_resize(uint64_t capacity) {
+    uint64_t num_slots = round_pow2(capacity * UID_SET_LOAD_DEN /
+                                    UID_SET_LOAD_NUM + 1);
+    uint64_t bloom_bits;
+    uint64_t * slots;
+    uint64_t * bloom;
+    uint64_t i;
+
+    if (num_slots < UID_SET_MIN_SLOTS) {
+        num_slots = UID_SET_MIN_SLOTS;
+    }
+    bloom_bits = round_pow2(num_slots * UID_SET_LOAD_NUM / UID_SET_LOAD_DEN *
+                            UID_BLOOM_BITS_PER_KEY);
+    slots = calloc(num_slots, sizeof(*slots));
+    bloom = calloc(bloom_bits / 64, sizeof(*bloom));
+    if (!slots || !bloom) {
+        free(slots);
+        free(bloom);
+        return ENOMEM;
+    }
+
+    /* Move the keys across and rebuild the filter */
+    free(set.bloom);
+    set.bloom = bloom;
+    set.bloom_bits = bloom_bits;
+    for (i = 0; i < set.num_slots; i++) {
+        if (set.slots[i] != 0) {
+            table_insert(slots, num_slots, set.slots[i]);
+            bloom_add(uid_mix(set.slots[i]));
+        }
+    }
+    if (set.has_zero) {
+        bloom_add(uid_mix(0));
+    }
+    free(set.slots);
+    set.slots = slots;
+    set.num_slots = num_slots;
+
+    return 0;
+}
+
+
+/**
+ * @brief Create the (empty) EP_UID set
+ *
+ * @param capacity The number of EP_UIDs expected; the set grows past it
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int uid_set_init(uint64_t capacity) {
+    uid_set_deinit();
+    return uid_set_resize(capacity);
+}
+
+
+/**
+ * @brief Free the EP_UID set
+ */
+void uid_set_deinit(void) {
+    free(set.slots);
+    free(set.bloom);
+    memset(&set, 0, sizeof(set));
+}
+
+
+/**
+ * @brief Add an EP_UID to the set
+ *
+ * @param ep_uid The 8-byte EP_UID
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int uid_set_add(const uint8_t * ep_uid) {
+    uint64_t key = uid_key(ep_uid);
+    int status;
+
+    if (!set.slots) {
+        return EINVAL;
+    }
+
+    if (key == 0) {
+        if (!set.has_zero) {
+            set.has_zero = true;
+            set.entries++;
+        }
+    } else {
+        if ((set.entries + 1) * UID_SET_LOAD_DEN >
+            set.num_slots * UID_SET_LOAD_NUM) {
+            status = uid_set_resize(set.entries + 1);
+            if (status != 0) {
+                return status;
+            }
+        }
+        if (table_insert(set.slots, set.num_slots, key)) {
+            set.entries++;
+        }
+    }
+    bloom_add(uid_mix(key));
+
+    return 0;
+}
+
+
+/**
+ * @brief Determine if an EP_UID is in the set
+ *
+ * @param ep_uid The 8-byte EP_UID
+ *
+ * @returns True if the EP_UID is in the set, false if it isn't.
+ */
+bool uid_set_contains(const uint8_t * ep_uid) {
+    uint64_t key = uid_key(ep_uid);
+    uint64_t hash = uid_mix(key);
+    uint64_t i;
+    bool found = false;
+
+    set.lookups++;
+    if (!set.slots || !bloom_test(hash)) {
+        return false;
+    }
+    set.bloom_passes++;
+
+    if (key == 0) {
+        found = set.has_zero;
+    } else {
+        for (i = hash & (set.num_slots - 1); set.slots[i] != 0;
+             i = (i + 1) & (set.num_slots - 1)) {
+            if (set.slots[i] == key) {
+                found = true;
+                break;
+            }
+        }
+    }
+    if (!found) {
+        set.false_positives++;
+    }
+
+    return found;
+}
+
+
+/**
+ * @brief Fetch the set's usage figures
+ *
+ * @param stats Filled in with the current figures
+ */
+void uid_set_get_stats(uid_set_stats * stats) {
+    stats->entries = set.entries;
+    stats->table_bytes = set.num_slots * sizeof(*set.slots);
+    stats->bloom_bytes = set.bloom_bits / 8;
+    stats->lookups = set.lookups;
+    stats->bloom_passes = set.bloom_passes;
+    stats->false_positives = set.false_positives;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *
+ * @brief: This file contains the header information for the in-memory
+ * EP_UID set used by imsgen's uniqueness checks.
+ *
+ */
+
+#ifndef _UID_SET_H
+#define _UID_SET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Size of the EP_UIDs the set holds */
+#define UID_SET_KEY_SIZE    8
+
+
+/**
+ * @brief Usage figures for the EP_UID set
+ */
+typedef struct {
+    uint64_t entries;           /* EP_UIDs held */
+    size_t   table_bytes;       /* Hash table footprint */
+    size_t   bloom_bytes;       /* Bloom filter footprint */
+    uint64_t lookups;           /* uid_set_contains calls */
+    uint64_t bloom_passes;      /* ...that got past the Bloom filter */
+    uint64_t false_positives;   /* ...and then missed in the table */
+} uid_set_stats;
+
+
+/**
+ * @brief Create the (empty) EP_UID set
+ *
+ * @param capacity The number of EP_UIDs expected; the set grows past it
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int uid_set_init(uint64_t capacity);
+
+
+/**
+ * @brief Free the EP_UID set
+ */
+void uid_set_deinit(void);
+
+
+/**
+ * @brief Add an EP_UID to the set
+ *
+ * @param ep_uid The 8-byte EP_UID
+ *
+ * @returns Zero if successful, errno otherwise.
+ */
+int uid_set_add(const uint8_t * ep_uid);
+
+
+/**
+ * @brief Determine if an EP_UID is in the set
+ *
+ * @param ep_uid The 8-byte EP_UID
+ *
+ * @returns True if the EP_UID is in the set, false if it isn't.
+ */
+bool uid_set_contains(const uint8_t * ep_uid);
+
+
+/**
+ * @brief Fetch the set's usage figures
+ *
+ * @param stats Filled in with the current figures
+ */
+void uid_set_get_stats(uid_set_stats * stats);
+
+#endif /* !_UID_SET_H */
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2015 Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ *
+ * @brief: This file contains the test of the in-memory EP_UID set run by
+ * "imsgen_test --uid-set-test".
+ *
+ * The set starts at its smallest and grows as random EP_UIDs are added.
+ * At evenly spaced fill levels, absent EP_UIDs are looked up to measure
+ * the Bloom filter's false-positive rate, which must stay near its ~1%
+ * target whatever the table's size. Finally every EP_UID added must still
+ * be found.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "mcl_arch.h"
+#include "mcl_oct.h"
+#include "mcl_ecdh.h"
+#include "mcl_rand.h"
+#include "mcl_rsa.h"
+#include "crypto.h"
+#include "ims_common.h"
+#include "uid_set.h"
+#include "ims_test.h"
+
+/* Fewest EP_UIDs that take the set through a few resizes */
+#define UID_SET_TEST_MIN_KEYS   0x1000
+
+/* Fill levels at which the false-positive rate is measured */
+#define UID_SET_TEST_STEPS      32
+
+/* Absent EP_UIDs looked up at each fill level */
+#define UID_SET_TEST_PROBES     0x10000
+
+/* Fail on a false-positive rate above this (twice the filter's target) */
+#define UID_SET_TEST_MAX_FP     0.02
+
+
+/**
+ * @brief Draw a random EP_UID
+ */
+static void random_ep_uid(csprng * rng, uint8_t * ep_uid) {
+    int i;
+
+    for (i = 0; i < UID_SET_KEY_SIZE; i++) {
+        ep_uid[i] = MCL_RAND_byte(rng);
+    }
+}
+
+
+/**
+ * @brief Check the EP_UID set's Bloom filter as the set grows
+ *
+ * @param prng_seed_file Filename from which to read the seed
+ * @param prng_seed_string Raw seed string
+ * @param num_keys The number of EP_UIDs to add
+ *
+ * @returns Zero if every check passed, EINVAL for too few EP_UIDs, EIO if
+ *          a check failed, errno otherwise.
+ */
+int test_uid_set(const char * prng_seed_file,
+                 const char * prng_seed_string,
+                 uint32_t num_keys) {
+    static ims_context ctx;
+    uint8_t * keys;
+    uint8_t probe[UID_SET_KEY_SIZE];
+    uid_set_stats before;
+    uid_set_stats after;
+    double rate;
+    uint32_t added = 0;
+    uint32_t missing = 0;
+    uint32_t step;
+    uint32_t i;
+    bool pass = true;
+    int status;
+
+    if (num_keys < UID_SET_TEST_MIN_KEYS) {
+        fprintf(stderr, "ERROR: --uid-set-test needs at least %u EP_UIDs\n",
+                UID_SET_TEST_MIN_KEYS);
+        return EINVAL;
+    }
+
+    keys = malloc((size_t)num_keys * UID_SET_KEY_SIZE);
+    if (!keys) {
+        return ENOMEM;
+    }
+    status = ims_common_init(prng_seed_file, prng_seed_string);
+    if (status != 0) {
+        free(keys);
+        return status;
+    }
+    ims_context_init(&ctx);
+
+    /* Start from the smallest set, so every size is reached by growing */
+    status = uid_set_init(0);
+    if (status != 0) {
+        goto test_uid_set_err;
+    }
+
+    printf("EP_UID set test: %u EP_UIDs\n", num_keys);
+    for (step = 1; step <= UID_SET_TEST_STEPS; step++) {
+        uint32_t target = (uint32_t)(((uint64_t)num_keys * step) /
+                                     UID_SET_TEST_STEPS);
+
+        for (; added < target; added++) {
+            random_ep_uid(&ctx.rng, &keys[added * UID_SET_KEY_SIZE]);
+            status = uid_set_add(&keys[added * UID_SET_KEY_SIZE]);
+            if (status != 0) {
+                goto test_uid_set_err;
+            }
+        }
+
+        uid_set_get_stats(&before);
+        for (i = 0; i < UID_SET_TEST_PROBES; i++) {
+            random_ep_uid(&ctx.rng, probe);
+            uid_set_contains(probe);
+        }
+        uid_set_get_stats(&after);
+        rate = (double)(after.false_positives - before.false_positives) /
+               (double)(after.lookups - before.lookups);
+        printf("  %10u EP_UIDs  table %7zu KiB  Bloom %6zu KiB  "
+               "false positives %7.4f%%  %s\n",
+               added, after.table_bytes / 1024, after.bloom_bytes / 1024,
+               rate * 100.0, (rate <= UID_SET_TEST_MAX_FP)? "ok" : "FAIL");
+        if (rate > UID_SET_TEST_MAX_FP) {
+            pass = false;
+        }
+    }
+
+    for (i = 0; i < num_keys; i++) {
+        if (!uid_set_contains(&keys[i * UID_SET_KEY_SIZE])) {
+            missing++;
+        }
+    }
+    if (missing != 0) {
+        printf("  %u EP_UIDs added but not found: FAIL\n", missing);
+        pass = false;
+    }
+
+test_uid_set_err:
+    uid_set_deinit();
+    ims_context_deinit(&ctx);
+    ims_common_deinit();
+    free(keys);
+
+    if (status != 0) {
+        return status;
+    }
+    printf("EP_UID set test %s\n", pass? "passed" : "FAILED");
+    return pass? 0 : EIO;
+}
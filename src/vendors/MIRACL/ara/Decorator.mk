@@ -83,6 +83,8 @@ DRFLAGS+= -D MCL_PBKDF2=MCL_PBKDF2_$(DREC)
 DRFLAGS+= -D MCL_AES_CBC_IV0_ENCRYPT=MCL_AES_CBC_IV0_ENCRYPT_$(DREC)
 DRFLAGS+= -D MCL_AES_CBC_IV0_DECRYPT=MCL_AES_CBC_IV0_DECRYPT_$(DREC)
 DRFLAGS+= -D MCL_ECP_KEY_PAIR_GENERATE=MCL_ECP_KEY_PAIR_GENERATE_$(DREC)
+DRFLAGS+= -D MCL_ECP_FIXED_BASE_INIT=MCL_ECP_FIXED_BASE_INIT_$(DREC)
+DRFLAGS+= -D MCL_ECP_KEY_PAIR_GENERATE_FIXED=MCL_ECP_KEY_PAIR_GENERATE_FIXED_$(DREC)
 DRFLAGS+= -D MCL_ECP_PUBLIC_KEY_VALIDATE=MCL_ECP_PUBLIC_KEY_VALIDATE_$(DREC)
 DRFLAGS+= -D MCL_ECPSVDP_DH=MCL_ECPSVDP_DH_$(DREC)
 DRFLAGS+= -D MCL_ECP_ECIES_ENCRYPT=MCL_ECP_ECIES_ENCRYPT_$(DREC)
@@ -112,6 +114,8 @@ DRFLAGS+= -D MCL_ECP_dbl=MCL_ECP_dbl_$(DREC)
 DRFLAGS+= -D MCL_ECP_pinmul=MCL_ECP_pinmul_$(DREC)
 DRFLAGS+= -D MCL_ECP_mul=MCL_ECP_mul_$(DREC)
 DRFLAGS+= -D MCL_ECP_mul2=MCL_ECP_mul2_$(DREC)
+DRFLAGS+= -D MCL_ECP_gen_precompute=MCL_ECP_gen_precompute_$(DREC)
+DRFLAGS+= -D MCL_ECP_gen_mul=MCL_ECP_gen_mul_$(DREC)
 DRFLAGS+= -D MCL_FF_copy=MCL_FF_copy_$(DREC)
 DRFLAGS+= -D MCL_FF_init=MCL_FF_init_$(DREC)
 DRFLAGS+= -D MCL_FF_zero=MCL_FF_zero_$(DREC)
@@ -144,6 +148,26 @@ DRFLAGS+= -D MCL_FF_pow=MCL_FF_pow_$(DREC)
 DRFLAGS+= -D MCL_FF_cfactor=MCL_FF_cfactor_$(DREC)
 DRFLAGS+= -D MCL_FF_prime=MCL_FF_prime_$(DREC)
 DRFLAGS+= -D MCL_FF_pow2=MCL_FF_pow2_$(DREC)
+DRFLAGS+= -D MCL_FF_ws_init=MCL_FF_ws_init_$(DREC)
+DRFLAGS+= -D MCL_FF_mul_ws=MCL_FF_mul_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_sqr_ws=MCL_FF_sqr_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_dmod_ws=MCL_FF_dmod_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_invmodp_ws=MCL_FF_invmodp_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_randomnum_ws=MCL_FF_randomnum_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_skpow_ws=MCL_FF_skpow_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_skspow_ws=MCL_FF_skspow_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_power_ws=MCL_FF_power_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_pow_ws=MCL_FF_pow_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_cfactor_ws=MCL_FF_cfactor_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_prime_ws=MCL_FF_prime_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_pow2_ws=MCL_FF_pow2_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_prime_rounds=MCL_FF_prime_rounds_$(DREC)
+DRFLAGS+= -D MCL_FF_prime_rounds_ws=MCL_FF_prime_rounds_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_prime_fips_rounds=MCL_FF_prime_fips_rounds_$(DREC)
+DRFLAGS+= -D MCL_FF_skpow_ladder=MCL_FF_skpow_ladder_$(DREC)
+DRFLAGS+= -D MCL_FF_skpow_ladder_ws=MCL_FF_skpow_ladder_ws_$(DREC)
+DRFLAGS+= -D MCL_FF_pubpow=MCL_FF_pubpow_$(DREC)
+DRFLAGS+= -D MCL_FF_pubpow_ws=MCL_FF_pubpow_ws_$(DREC)
 DRFLAGS+= -D MCL_FP_iszilch=MCL_FP_iszilch_$(DREC)
 DRFLAGS+= -D MCL_FP_nres=MCL_FP_nres_$(DREC)
 DRFLAGS+= -D MCL_FP_redc=MCL_FP_redc_$(DREC)
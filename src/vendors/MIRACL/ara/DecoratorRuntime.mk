@@ -3,6 +3,8 @@ DRFLAGS:= -D MCL_CREATE_CSPRNG_DREC1=MCL_CREATE_CSPRNG_$(DREC1)
 DRFLAGS+= -D MCL_KDF2_DREC1=MCL_KDF2_$(DREC1)
 DRFLAGS+= -D MCL_PBKDF2_DREC1=MCL_PBKDF2_$(DREC1)
 DRFLAGS+= -D MCL_ECP_KEY_PAIR_GENERATE_DREC1=MCL_ECP_KEY_PAIR_GENERATE_$(DREC1)
+DRFLAGS+= -D MCL_ECP_FIXED_BASE_INIT_DREC1=MCL_ECP_FIXED_BASE_INIT_$(DREC1)
+DRFLAGS+= -D MCL_ECP_KEY_PAIR_GENERATE_FIXED_DREC1=MCL_ECP_KEY_PAIR_GENERATE_FIXED_$(DREC1)
 DRFLAGS+= -D MCL_ECP_PUBLIC_KEY_VALIDATE_DREC1=MCL_ECP_PUBLIC_KEY_VALIDATE_$(DREC1)
 DRFLAGS+= -D MCL_ECPSVDP_DH_DREC1=MCL_ECPSVDP_DH_$(DREC1)
 DRFLAGS+= -D MCL_ECP_ECIES_ENCRYPT_DREC1=MCL_ECP_ECIES_ENCRYPT_$(DREC1)
@@ -14,6 +16,8 @@ DRFLAGS+= -D MCL_CREATE_CSPRNG_DREC2=MCL_CREATE_CSPRNG_$(DREC2)
 DRFLAGS+= -D MCL_KDF2_DREC2=MCL_KDF2_$(DREC2)
 DRFLAGS+= -D MCL_PBKDF2_DREC2=MCL_PBKDF2_$(DREC2)
 DRFLAGS+= -D MCL_ECP_KEY_PAIR_GENERATE_DREC2=MCL_ECP_KEY_PAIR_GENERATE_$(DREC2)
+DRFLAGS+= -D MCL_ECP_FIXED_BASE_INIT_DREC2=MCL_ECP_FIXED_BASE_INIT_$(DREC2)
+DRFLAGS+= -D MCL_ECP_KEY_PAIR_GENERATE_FIXED_DREC2=MCL_ECP_KEY_PAIR_GENERATE_FIXED_$(DREC2)
 DRFLAGS+= -D MCL_ECP_PUBLIC_KEY_VALIDATE_DREC2=MCL_ECP_PUBLIC_KEY_VALIDATE_$(DREC2)
 DRFLAGS+= -D MCL_ECPSVDP_DH_DREC2=MCL_ECPSVDP_DH_$(DREC2)
 DRFLAGS+= -D MCL_ECP_ECIES_ENCRYPT_DREC2=MCL_ECP_ECIES_ENCRYPT_$(DREC2)
@@ -5,6 +5,7 @@ LIBCORE_SRC += $(LIB_DIR)/mcl_hash.c
 LIBCORE_SRC += $(LIB_DIR)/mcl_oct.c
 LIBCORE_SRC += $(LIB_DIR)/mcl_rand.c
 LIBCORE_SRC += $(LIB_DIR)/mcl_x509.c
+LIBCORE_SRC += $(LIB_DIR)/mcl_mont.c
 
 LIBCURVE_SRC := $(LIB_DIR)/mcl_rom.c
 LIBCURVE_SRC += $(LIB_DIR)/mcl_big.c
@@ -32,6 +33,9 @@ endif
 # Benchmark tests
 BENCH_SRC := $(BENCH_DIR)/time_ecdh.c
 BENCH_SRC += $(BENCH_DIR)/time_rsa.c
+BENCH_SRC += $(BENCH_DIR)/time_hash.c
+BENCH_SRC += $(BENCH_DIR)/time_mont.c
+BENCH_SRC += $(BENCH_DIR)/time_suite.c
 
 # Tests with three curves
 RTEST_SRC := $(TEST_DIR)/test_runtime.c
@@ -70,6 +70,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 #define OFB8  21 /**< Output Feedback - 8 bytes */
 #define OFB16 29 /**< Output Feedback - 16 bytes */
 
+#define MCL_AES_TABLE 0 /**< Portable T-table rounds */
+#define MCL_AES_NI 1 /**< AES-NI rounds, and PCLMULQDQ GHASH in GCM */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MCL_AES_X86 1 /**< AES-NI and PCLMULQDQ paths are built */
+#else
+#define MCL_AES_X86 0
+#endif
+
 /**
 	@brief AES instance
 */
@@ -77,12 +86,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 typedef struct {
 int Nk,Nr;
 int mode;          /**< AES mode of operation */
+int kernel;        /**< MCL_AES_TABLE or MCL_AES_NI, fixed by MCL_AES_init */
 unsign32 fkey[60]; /**< subkeys for encrypton */
 unsign32 rkey[60]; /**< subkeys for decrypton */
 char f[16];        /**< buffer for chaining vector */
 } mcl_aes;
 
 /* AES functions */
+/**	@brief Choose the kernel for later AES instances
+ *
+	The default picks AES-NI when the CPU has both AES-NI and PCLMULQDQ.
+	Forcing a kernel the CPU lacks falls back to MCL_AES_TABLE.
+	Not thread safe - set it before any instances are initialised.
+	@param kernel MCL_AES_TABLE, MCL_AES_NI, or -1 for the default
+ */
+extern void MCL_AES_select(int kernel);
+/**	@brief Find the best kernel this CPU runs
+ *
+	@return MCL_AES_NI or MCL_AES_TABLE
+ */
+extern int MCL_AES_best(void);
 /**	@brief Reset AES mode or IV
  *
 	@param A an instance of the AES
@@ -159,6 +159,21 @@ extern int MCL_AES_CBC_IV0_DECRYPT(mcl_octet *K,mcl_octet *C,mcl_octet *P);
 	@return 0 or an error code
  */
 extern int  MCL_ECP_KEY_PAIR_GENERATE(csprng *R,mcl_octet *s,mcl_octet *W);
+/**	@brief Precompute the fixed base table for the curve generator
+ *
+	Speeds up MCL_ECP_KEY_PAIR_GENERATE_FIXED. Only Edwards curves on hosted builds have the table. Not thread safe - call once, before generating any keys.
+	@return 1 if the table is ready, 0 if this curve/target has none
+ */
+extern int  MCL_ECP_FIXED_BASE_INIT(void);
+/**	@brief Generate an ECC public/private key pair using the fixed base table
+ *
+	Same output as MCL_ECP_KEY_PAIR_GENERATE. Falls back to it if MCL_ECP_FIXED_BASE_INIT has not built a table.
+	@param R is a pointer to a cryptographically secure random number generator
+	@param s the private key, an output internally randomly generated if R!=NULL, otherwise must be provided as an input
+	@param W the output public key, which is s.G, where G is a fixed generator
+	@return 0 or an error code
+ */
+extern int  MCL_ECP_KEY_PAIR_GENERATE_FIXED(csprng *R,mcl_octet *s,mcl_octet *W);
 /**	@brief Validate an ECC public key
  *
 	@param f if = 0 just does some simple checks, else tests that W is of the correct order
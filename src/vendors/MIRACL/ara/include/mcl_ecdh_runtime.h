@@ -106,6 +106,8 @@ extern void MCL_PBKDF2_DREC1(int h,mcl_octet *P,mcl_octet *S,int rep,int len,mcl
 extern void MCL_AES_CBC_IV0_ENCRYPT_DREC1(mcl_octet *K,mcl_octet *P,mcl_octet *C);
 extern int MCL_AES_CBC_IV0_DECRYPT_DREC1(mcl_octet *K,mcl_octet *C,mcl_octet *P);
 extern int  MCL_ECP_KEY_PAIR_GENERATE_DREC1(csprng *R,mcl_octet *s,mcl_octet *W);
+extern int  MCL_ECP_FIXED_BASE_INIT_DREC1(void);
+extern int  MCL_ECP_KEY_PAIR_GENERATE_FIXED_DREC1(csprng *R,mcl_octet *s,mcl_octet *W);
 extern int  MCL_ECP_PUBLIC_KEY_VALIDATE_DREC1(int f,mcl_octet *W);
 extern int MCL_ECPSVDP_DH_DREC1(mcl_octet *s,mcl_octet *W,mcl_octet *K);
 extern void MCL_ECP_ECIES_ENCRYPT_DREC1(int h,mcl_octet *P1,mcl_octet *P2,csprng *R,mcl_octet *W,mcl_octet *M,int len,mcl_octet *V,mcl_octet *C,mcl_octet *T);
@@ -151,6 +153,8 @@ extern void MCL_PBKDF2_DREC2(int h,mcl_octet *P,mcl_octet *S,int rep,int len,mcl
 extern void MCL_AES_CBC_IV0_ENCRYPT_DREC2(mcl_octet *K,mcl_octet *P,mcl_octet *C);
 extern int MCL_AES_CBC_IV0_DECRYPT_DREC2(mcl_octet *K,mcl_octet *C,mcl_octet *P);
 extern int  MCL_ECP_KEY_PAIR_GENERATE_DREC2(csprng *R,mcl_octet *s,mcl_octet *W);
+extern int  MCL_ECP_FIXED_BASE_INIT_DREC2(void);
+extern int  MCL_ECP_KEY_PAIR_GENERATE_FIXED_DREC2(csprng *R,mcl_octet *s,mcl_octet *W);
 extern int  MCL_ECP_PUBLIC_KEY_VALIDATE_DREC2(int f,mcl_octet *W);
 extern int MCL_ECPSVDP_DH_DREC2(mcl_octet *s,mcl_octet *W,mcl_octet *K);
 extern void MCL_ECP_ECIES_ENCRYPT_DREC2(int h,mcl_octet *P1,mcl_octet *P2,csprng *R,mcl_octet *W,mcl_octet *M,int len,mcl_octet *V,mcl_octet *C,mcl_octet *T);
@@ -250,5 +250,18 @@ extern void MCL_ECP_mul(MCL_ECP *P,MCL_BIG b);
 	@param f MCL_BIG number multiplier
  */
 extern void MCL_ECP_mul2(MCL_ECP *P,MCL_ECP *Q,MCL_BIG e,MCL_BIG f);
+/**	@brief Precomputes the fixed base table for the curve generator G
+ *
+	Only Edwards curves on hosted builds have the table. Not thread safe - call once before any use of MCL_ECP_gen_mul.
+	@return 1 if the table is ready, 0 if this curve/target has none
+ */
+extern int MCL_ECP_gen_precompute(void);
+/**	@brief Multiplies the curve generator G by a MCL_BIG, side-channel resistant
+ *
+	Uses the fixed base table if MCL_ECP_gen_precompute has built it, otherwise MCL_ECP_mul. The result is the same either way.
+	@param P MCL_ECP instance, on exit =e*G
+	@param e MCL_BIG number multiplier
+ */
+extern void MCL_ECP_gen_mul(MCL_ECP *P,MCL_BIG e);
 
 #endif
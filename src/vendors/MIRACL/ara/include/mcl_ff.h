@@ -63,6 +63,34 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 
 #include "mcl_oct.h"
 
+#define MCL_FF_PRIME_ROUNDS 10 /**< Miller-Rabin rounds of MCL_FF_prime */
+#define MCL_FF_WINDOW 4 /**< Window width, in bits, of the windowed exponentiations */
+
+/* The workspace is sized by MCL_FFLEN, so only single field builds have it */
+#ifdef MCL_FFLEN
+#define MCL_FF_WS_BIGS (13*MCL_FFLEN) /**< MCL_BIGs of scratch: MCL_FF_prime with a full window for n<=MCL_HFLEN, and every routine for n<=MCL_FFLEN */
+
+#ifdef __GNUC__
+#define MCL_FF_WS_ALIGN __attribute__((aligned(64))) /**< Start the scratch on a cache line */
+#else
+#define MCL_FF_WS_ALIGN
+#endif
+
+/**
+	@brief FF scratch workspace
+
+	Temporaries for the _ws routines below are taken from w and given back before
+	each routine returns, so one workspace serves any number of calls, but only one
+	thread at a time. It avoids the per-call stack arrays, so it may be declared
+	static or thread-local where thread stacks are small.
+*/
+typedef struct
+{
+	mcl_chunk w[MCL_FF_WS_BIGS][MCL_BS] MCL_FF_WS_ALIGN; /**< scratch MCL_BIGs */
+	int top; /**< first free MCL_BIG of w */
+} mcl_ff_ws;
+#endif
+
 /* Finite Field Prototypes */
 /**	@brief Copy one FF element of given length to another
  *
@@ -248,6 +276,8 @@ extern void MCL_FF_random(mcl_chunk x[][MCL_BS],csprng *R,int n);
 extern void MCL_FF_randomnum(mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],csprng *R,int n);
 /**	@brief Calculate r=x^e mod m, side channel resistant
  *
+	Fixed window of MCL_FF_WINDOW bits (narrower if the workspace is short). Every
+	table lookup reads the whole table.
 	@param r FF instance, on exit = x^e mod p
 	@param x FF instance
 	@param e FF exponent
@@ -255,6 +285,16 @@ extern void MCL_FF_randomnum(mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],csprng
 	@param n size of FF in MCL_BIGs
  */
 extern void MCL_FF_skpow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk m[][MCL_BS],int n);
+/**	@brief Calculate r=x^e mod m, side channel resistant
+ *
+	Montgomery ladder. Slower than MCL_FF_skpow, but needs the least workspace
+	@param r FF instance, on exit = x^e mod p
+	@param x FF instance
+	@param e FF exponent
+	@param m FF modulus
+	@param n size of FF in MCL_BIGs
+ */
+extern void MCL_FF_skpow_ladder(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk m[][MCL_BS],int n);
 /**	@brief Calculate r=x^e mod m, side channel resistant
  *
 	For short MCL_BIG exponent
@@ -275,8 +315,20 @@ extern void MCL_FF_skspow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,
 	@param n size of FF in MCL_BIGs
  */
 extern void MCL_FF_power(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk m[][MCL_BS],int n);
+/**	@brief Calculate r=x^e mod m for a public exponent
+ *
+	Not side channel resistant - for public e and m only, such as an RSA public key.
+	Cheaper than MCL_FF_power for a large m, as x enters the Montgomery domain without a division
+	@param r FF instance, on exit = x^e mod p
+	@param x FF instance
+	@param e positive integer exponent
+	@param m FF modulus
+	@param n size of FF in MCL_BIGs
+ */
+extern void MCL_FF_pubpow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk m[][MCL_BS],int n);
 /**	@brief Calculate r=x^e mod m
  *
+	Sliding window over the odd powers of x. Not side channel resistant
 	@param r FF instance, on exit = x^e mod p
 	@param x FF instance
 	@param e FF exponent
@@ -301,6 +353,28 @@ extern int MCL_FF_cfactor(mcl_chunk x[][MCL_BS],sign32 s,int n);
 	@return 1 if x is (almost certainly) prime, else return 0
  */
 extern int MCL_FF_prime(mcl_chunk x[][MCL_BS],csprng *R,int n);
+/**	@brief Test if an FF is prime, with a given number of rounds
+ *
+	Uses Miller-Rabin Method after trial division. The Montgomery constants for x are
+	found once, and every exponentiation and squaring stays in the Montgomery domain,
+	using a fixed window of MCL_FF_WINDOW bits (narrower if the workspace is short).
+	Draws witnesses from R exactly as MCL_FF_prime does, one round at a time.
+	@param x FF instance to be tested
+	@param R an instance of a Cryptographically Secure Random Number Generator
+	@param rounds number of Miller-Rabin rounds, see MCL_FF_prime_fips_rounds
+	@param n size of FF in MCL_BIGs
+	@return 1 if x is (almost certainly) prime, else return 0
+ */
+extern int MCL_FF_prime_rounds(mcl_chunk x[][MCL_BS],csprng *R,int rounds,int n);
+/**	@brief Miller-Rabin rounds for a random RSA prime
+ *
+	The fewest rounds FIPS 186-4 Table C.3 allows after trial division when no Lucas
+	test follows: 7 for 512-bit, 5 for 1024-bit and 4 for 1536-bit primes.
+	Smaller primes get MCL_FF_PRIME_ROUNDS.
+	@param n size of the prime in MCL_BIGs
+	@return the number of rounds
+ */
+extern int MCL_FF_prime_fips_rounds(int n);
 /**	@brief Calculate r=x^e.y^f mod m
  *
 	@param r FF instance, on exit = x^e.y^f mod p
@@ -313,6 +387,47 @@ extern int MCL_FF_prime(mcl_chunk x[][MCL_BS],csprng *R,int n);
  */
 extern void MCL_FF_pow2(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk y[][MCL_BS],MCL_BIG f,mcl_chunk m[][MCL_BS],int n);
 
+#ifdef MCL_FFLEN
+/* Workspace variants. Each behaves exactly as the routine above it is named for, but
+   takes its temporaries from ws, which must have been set up by MCL_FF_ws_init. n must
+   not exceed MCL_FFLEN. */
+/**	@brief Prepare an FF workspace for use
+ *
+	@param ws the workspace, on exit empty
+ */
+extern void MCL_FF_ws_init(mcl_ff_ws *ws);
+/**	@brief As MCL_FF_mul, using workspace ws */
+extern void MCL_FF_mul_ws(mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],mcl_chunk z[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_sqr, using workspace ws */
+extern void MCL_FF_sqr_ws(mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_dmod, using workspace ws */
+extern void MCL_FF_dmod_ws(mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],mcl_chunk z[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_invmodp, using workspace ws */
+extern void MCL_FF_invmodp_ws(mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],mcl_chunk z[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_randomnum, using workspace ws */
+extern void MCL_FF_randomnum_ws(mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],csprng *R,int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_skpow, using workspace ws */
+extern void MCL_FF_skpow_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk m[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_skpow_ladder, using workspace ws */
+extern void MCL_FF_skpow_ladder_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk m[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_skspow, using workspace ws */
+extern void MCL_FF_skspow_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk m[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_power, using workspace ws */
+extern void MCL_FF_power_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk m[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_pubpow, using workspace ws */
+extern void MCL_FF_pubpow_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk m[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_pow, using workspace ws */
+extern void MCL_FF_pow_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk m[][MCL_BS],int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_cfactor, using workspace ws */
+extern int MCL_FF_cfactor_ws(mcl_chunk x[][MCL_BS],sign32 s,int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_prime, using workspace ws */
+extern int MCL_FF_prime_ws(mcl_chunk x[][MCL_BS],csprng *R,int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_prime_rounds, using workspace ws */
+extern int MCL_FF_prime_rounds_ws(mcl_chunk x[][MCL_BS],csprng *R,int rounds,int n,mcl_ff_ws *ws);
+/**	@brief As MCL_FF_pow2, using workspace ws */
+extern void MCL_FF_pow2_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk y[][MCL_BS],MCL_BIG f,mcl_chunk m[][MCL_BS],int n,mcl_ff_ws *ws);
+#endif
+
 
 
 
@@ -74,6 +74,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 
 typedef struct {
 unsign32 table[128][4]; /**< 2k byte table */
+uchar hpow[4][16];	/**< H, H^2, H^3, H^4 byte reversed, for the carry-less multiply path */
 uchar stateX[16];	/**< GCM Internal State */
 uchar Y_0[16];		/**< GCM Internal State */
 unsign32 lenA[2];	/**< GCM 64-bit length of header */
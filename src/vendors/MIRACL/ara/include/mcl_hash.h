@@ -62,6 +62,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 #define MCL_SHA384 48 /**< SHA-384 hashing */
 #define MCL_SHA512 64 /**< SHA-512 hashing */
 
+#define MCL_HASH_KERNEL_AUTO 0   /**< Best SHA-256 kernel the CPU supports */
+#define MCL_HASH_KERNEL_SCALAR 1 /**< Portable SHA-256 kernel */
+#define MCL_HASH_KERNEL_SHANI 2  /**< x86 SHA extensions SHA-256 kernel */
+
+#define MCL_HASH_MULTI_AUTO 0    /**< Widest multi-buffer SHA-256 kernel the CPU supports */
+#define MCL_HASH_MULTI_SCALAR 1  /**< One message at a time through MCL_HASH256_update */
+#define MCL_HASH_MULTI_SSE 2     /**< 4 lanes of 128-bit SIMD */
+#define MCL_HASH_MULTI_AVX2 3    /**< 8 lanes of 256-bit SIMD */
+#define MCL_HASH_MULTI_AVX512 4  /**< 16 lanes of 512-bit SIMD */
+
 /**
 	@brief SHA256/384/512 hash function instance
 */
@@ -115,6 +125,44 @@ extern void MCL_HASH256_init(mcl_hash256 *H);
 	@param b byte to be included in hash
  */
 extern void MCL_HASH256_process(mcl_hash256 *H,int b);
+/**	@brief Add a run of bytes to the hash
+ *
+	Equivalent to calling MCL_HASH256_process for each byte, but whole
+	64-byte blocks are compressed directly.
+	@param H an instance SHA256
+	@param b bytes to be included in hash
+	@param n number of bytes
+ */
+extern void MCL_HASH256_update(mcl_hash256 *H,const char *b,int n);
+/**	@brief Select the SHA-256 block compression kernel
+ *
+	Kernels the CPU does not support fall back to the best one it does.
+	Without a call, the first hash picks the best kernel. Not thread safe -
+	a threaded program should call this once, before its threads hash.
+	@param k MCL_HASH_KERNEL_AUTO, MCL_HASH_KERNEL_SCALAR or MCL_HASH_KERNEL_SHANI
+	@return the kernel now in use
+ */
+extern int MCL_HASH256_kernel(int k);
+/**	@brief Hash several equal-length messages at once
+ *
+	Messages are hashed side by side in SIMD lanes. The digests are identical
+	to hashing each message on its own.
+	@param n number of messages
+	@param m array of n pointers to the messages
+	@param len length in bytes of every message
+	@param h array of n pointers to 32-byte output digests
+ */
+extern void MCL_HASH256_multi(int n,const char **m,int len,char **h);
+/**	@brief Select the multi-buffer SHA-256 kernel
+ *
+	Kernels the CPU does not support fall back to the best one it does.
+	Without a call, the first MCL_HASH256_multi picks the best kernel. Not
+	thread safe - a threaded program should call this once, before its
+	threads hash.
+	@param k one of the MCL_HASH_MULTI_ values
+	@return the kernel now in use
+ */
+extern int MCL_HASH256_multi_kernel(int k);
 /**	@brief Generate 32-byte hash
  *
 	@param H an instance SHA256
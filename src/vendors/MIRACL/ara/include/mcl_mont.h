@@ -0,0 +1,134 @@
+/*************************************************************************
+                                                                         *
+Copyright (c) 2015>, MIRACL Ltd                                          *
+All rights reserved.                                                     *
+                                                                         *
+This file is derived from the MIRACL for Ara SDK.                        *
+                                                                         *
+The MIRACL for Ara SDK provides developers with an                       *
+extensive and efficient set of cryptographic functions.                  *
+For further information about its features and functionalities           *
+please refer to https://www.miracl.com                                   *
+                                                                         *
+Redistribution and use in source and binary forms, with or without       *
+modification, are permitted provided that the following conditions are   *
+met:                                                                     *
+                                                                         *
+ 1. Redistributions of source code must retain the above copyright       *
+    notice, this list of conditions and the following disclaimer.        *
+                                                                         *
+ 2. Redistributions in binary form must reproduce the above copyright    *
+    notice, this list of conditions and the following disclaimer in the  *
+    documentation and/or other materials provided with the distribution. *
+                                                                         *
+ 3. Neither the name of the copyright holder nor the names of its        *
+    contributors may be used to endorse or promote products derived      *
+    from this software without specific prior written permission.        *
+                                                                         *
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS  *
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED    *
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A          *
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT       *
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,   *
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED *
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR   *
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   *
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     *
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       *
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
+                                                                         *
+**************************************************************************/
+
+/* ARA vectorised Montgomery multiplication header file */
+
+/**
+ * @file mcl_mont.h
+ * @brief Vectorised Montgomery multiplication for 1024 and 2048-bit moduli
+ *
+ * AVX2 (radix 2^28) and AVX-512 IFMA (radix 2^52) kernels, chosen at run time.
+ * Numbers cross this interface as little-endian arrays of 64-bit words. The
+ * Montgomery radix R=2^rbits is the kernel's own, so residues from one
+ * kernel mean nothing to another, or to the MCL_FF routines.
+ *
+ */
+
+#ifndef MCL_MONT_H
+#define MCL_MONT_H
+
+#include "mcl_arch.h"
+
+#define MCL_MONT_SCALAR 0 /**< No vector kernel - use the MCL_FF code */
+#define MCL_MONT_AVX2 1 /**< AVX2, 28-bit limbs */
+#define MCL_MONT_IFMA 2 /**< AVX-512 IFMA, 52-bit limbs */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MCL_MONT_VECTOR 1 /**< Vector kernels are built */
+#define MCL_MONT_LIMBS 80 /**< Room for a padded 2048-bit modulus in 28-bit limbs */
+#define MCL_MONT_WORDS 40 /**< Room for a 2048-bit number in 64-bit words */
+#define MCL_MONT_ALIGN __attribute__((aligned(64))) /**< Kernels load the modulus a cache line at a time */
+#else
+#define MCL_MONT_VECTOR 0
+#define MCL_MONT_LIMBS 1
+#define MCL_MONT_WORDS 1
+#define MCL_MONT_ALIGN
+#endif
+
+/**
+	@brief Montgomery context for one modulus
+*/
+
+typedef struct {
+unsign64 p[MCL_MONT_LIMBS] MCL_MONT_ALIGN; /**< Modulus in kernel limbs, zero padded */
+unsign64 rr[MCL_MONT_WORDS];	/**< R^2 mod p, in words */
+unsign64 k0;	/**< -1/p mod 2^radix */
+int kernel;	/**< MCL_MONT_AVX2 or MCL_MONT_IFMA */
+int radix;	/**< Bits per limb */
+int k;		/**< Limbs per number, so R=2^(radix*k) */
+int nw;		/**< Words per number */
+} mcl_mont;
+
+/**	@brief Choose the kernel for later contexts
+ *
+	The default picks the fastest kernel the CPU runs. Forcing a kernel the CPU
+	lacks, or one for a size it doesn't handle, falls back to MCL_MONT_SCALAR.
+	Not thread safe - set it before any contexts are made.
+	@param kernel MCL_MONT_SCALAR, MCL_MONT_AVX2, MCL_MONT_IFMA, or -1 for the default
+ */
+extern void MCL_MONT_select(int kernel);
+/**	@brief Find the best kernel this CPU runs
+ *
+	@return MCL_MONT_IFMA, MCL_MONT_AVX2 or MCL_MONT_SCALAR
+ */
+extern int MCL_MONT_best(void);
+/**	@brief Find the kernel a new context of a given size would use
+ *
+	@param bits the modulus size, 1024 or 2048 for a vector kernel
+	@return the kernel, MCL_MONT_SCALAR if none suits
+ */
+extern int MCL_MONT_kernel(int bits);
+/**	@brief Set up a Montgomery context
+ *
+	@param M the context
+	@param p the odd modulus, in bits/64+1 words
+	@param bits the modulus size, 1024 or 2048
+	@return the kernel chosen, MCL_MONT_SCALAR if none suits and M is unusable
+ */
+extern int MCL_MONT_init(mcl_mont *M,const unsign64 *p,int bits);
+/**	@brief Montgomery multiplication
+ *
+	r, a and b are M->nw words, a and b below 2^bits. r may be a or b.
+	@param M the context
+	@param r on exit = a.b/R mod p, below 2^bits, and below p if p>=2^(bits-2)
+	@param a the multiplicand
+	@param b the multiplier
+ */
+extern void MCL_MONT_mul(const mcl_mont *M,unsign64 *r,const unsign64 *a,const unsign64 *b);
+/**	@brief Montgomery squaring
+ *
+	@param M the context
+	@param r on exit = a^2/R mod p
+	@param a the number to square
+ */
+extern void MCL_MONT_sqr(const mcl_mont *M,unsign64 *r,const unsign64 *a);
+
+#endif
@@ -0,0 +1,148 @@
+/*************************************************************************
+                                                                         *
+Copyright (c) 2015>, MIRACL Ltd                                          *
+All rights reserved.                                                     *
+                                                                         *
+This file is derived from the MIRACL for Ara SDK.                        *
+                                                                         *
+The MIRACL for Ara SDK provides developers with an                       *
+extensive and efficient set of cryptographic functions.                  *
+For further information about its features and functionalities           *
+please refer to https://www.miracl.com                                   *
+                                                                         *
+Redistribution and use in source and binary forms, with or without       *
+modification, are permitted provided that the following conditions are   *
+met:                                                                     *
+                                                                         *
+ 1. Redistributions of source code must retain the above copyright       *
+    notice, this list of conditions and the following disclaimer.        *
+                                                                         *
+ 2. Redistributions in binary form must reproduce the above copyright    *
+    notice, this list of conditions and the following disclaimer in the  *
+    documentation and/or other materials provided with the distribution. *
+                                                                         *
+ 3. Neither the name of the copyright holder nor the names of its        *
+    contributors may be used to endorse or promote products derived      *
+    from this software without specific prior written permission.        *
+                                                                         *
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS  *
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED    *
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A          *
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT       *
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,   *
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED *
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR   *
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   *
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     *
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       *
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
+                                                                         *
+**************************************************************************/
+
+/**
+ * @file mcl_rsp.h
+ * @brief Parallel runner for NIST CAVS response (.rsp) vector files
+ *
+ * A .rsp file is mapped into memory and split into records, each a run of
+ * "Name = value" lines ending at a blank line. "[Name = value]" lines set
+ * parameters for the records after them, and '#' lines are comments.
+ * Records point into the mapped file, so nothing is copied. The records
+ * are then shared out between threads, and each is handed to a check
+ * function. Failures are reported in file order with their line numbers,
+ * and a file with no test cases at all fails.
+ *
+ * Host only - uses mmap and POSIX threads.
+ *
+ */
+
+#ifndef MCL_RSP_H
+#define MCL_RSP_H
+
+#define MCL_RSP_FIELDS 16 /**< Most fields in one record or section */
+#define MCL_RSP_MSG 160   /**< Longest failure message */
+#define MCL_RSP_SKIP -1   /**< Check result for a record that is not a test case */
+
+/**
+	@brief One "Name = value" field. Neither string is NUL terminated.
+*/
+
+typedef struct {
+const char *name;	/**< Field name */
+int nlen;		/**< Length of name */
+const char *val;	/**< Field value, empty for a bare word such as FAIL */
+int vlen;		/**< Length of value */
+} mcl_rsp_field;
+
+/**
+	@brief A run of [Name = value] lines
+*/
+
+typedef struct {
+int n;			/**< Number of fields */
+mcl_rsp_field f[MCL_RSP_FIELDS]; /**< Fields, in file order */
+} mcl_rsp_section;
+
+/**
+	@brief One test case
+*/
+
+typedef struct {
+const char *file;	/**< File it came from */
+int line;		/**< Line of its first field */
+int n;			/**< Number of fields */
+mcl_rsp_field f[MCL_RSP_FIELDS]; /**< Fields, in file order */
+const mcl_rsp_section *sec; /**< Parameters in force, or NULL */
+} mcl_rsp_record;
+
+/**	@brief Check one record
+ *
+	Called from several threads at once, so must not touch shared state.
+	@param r the record
+	@param arg as given to MCL_RSP_run
+	@param msg room for MCL_RSP_MSG bytes of failure message
+	@return 0 if the record passes, MCL_RSP_SKIP if it is not a test case,
+	otherwise it fails
+ */
+typedef int (*mcl_rsp_check)(const mcl_rsp_record *r,void *arg,char *msg);
+
+/**	@brief Find a field of a record, or failing that of its section
+ *
+	@param r the record
+	@param name the field name
+	@param len if not NULL, set to the length of the value
+	@return the value, not NUL terminated, or NULL if there is no such field
+ */
+extern const char *MCL_RSP_value(const mcl_rsp_record *r,const char *name,int *len);
+/**	@brief Decode a hex field
+ *
+	@param r the record
+	@param name the field name
+	@param b the decoded bytes
+	@param max the size of b
+	@return the number of bytes, or -1 if the field is missing, too long or not hex
+ */
+extern int MCL_RSP_hex(const mcl_rsp_record *r,const char *name,char *b,int max);
+/**	@brief Decode a decimal field
+ *
+	@param r the record
+	@param name the field name
+	@param v the value
+	@return 0, or -1 if the field is missing or not a number
+ */
+extern int MCL_RSP_int(const mcl_rsp_record *r,const char *name,int *v);
+/**	@brief Check every record of a vector file
+ *
+	Failures are printed as "file:line: message". A file in which no record
+	is a test case counts as one failure, so an empty or mistaken file can't
+	pass.
+	@param file the .rsp file
+	@param threads the number of threads, or 0 for one per online CPU
+	@param check the check function
+	@param arg passed to check
+	@param cases if not NULL, set to the number of records checked, not
+	counting those the check skipped
+	@return the number of failures, or -1 if the file can't be read
+ */
+extern int MCL_RSP_run(const char *file,int threads,mcl_rsp_check check,void *arg,int *cases);
+
+#endif
@@ -121,6 +121,26 @@ static void test()
   totalTime = MCL_end_time(t1);
   printf("MCL_ECP_KEY_PAIR_GENERATE: Iterations %d Total %d usecs Iteration %d usecs \r\n", nIter, totalTime, totalTime/nIter);
 
+  t1 = MCL_start_time();
+  MCL_ECP_FIXED_BASE_INIT();
+  totalTime = MCL_end_time(t1);
+  printf("MCL_ECP_FIXED_BASE_INIT: Total %d usecs \r\n", totalTime);
+
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) {
+    /* Same key pair, from the fixed base table */
+    MCL_ECP_KEY_PAIR_GENERATE_FIXED(NULL,&S0,&W0);
+  }
+  totalTime = MCL_end_time(t1);
+  printf("MCL_ECP_KEY_PAIR_GENERATE_FIXED: Iterations %d Total %d usecs Iteration %d usecs \r\n", nIter, totalTime, totalTime/nIter);
+
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) {
+    res=MCL_ECP_PUBLIC_KEY_VALIDATE(0,&W0);
+  }
+  totalTime = MCL_end_time(t1);
+  printf("MCL_ECP_PUBLIC_KEY_VALIDATE(0): Iterations %d Total %d usecs Iteration %d usecs \r\n", nIter, totalTime, totalTime/nIter);
+
   t1 = MCL_start_time();
   for (i=0; i<nIter; i++) {
     res=MCL_ECP_PUBLIC_KEY_VALIDATE(1,&W0);
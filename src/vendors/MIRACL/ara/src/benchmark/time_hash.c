@@ -0,0 +1,189 @@
+/*************************************************************************
+                                                                         *
+Copyright (c) 2015>, MIRACL Ltd                                          *
+All rights reserved.                                                     *
+                                                                         *
+This file is derived from the MIRACL for Ara SDK.                        *
+                                                                         *
+The MIRACL for Ara SDK provides developers with an                       *
+extensive and efficient set of cryptographic functions.                  *
+For further information about its features and functionalities           *
+please refer to https://www.miracl.com                                   *
+                                                                         *
+Redistribution and use in source and binary forms, with or without       *
+modification, are permitted provided that the following conditions are   *
+met:                                                                     *
+                                                                         *
+ 1. Redistributions of source code must retain the above copyright       *
+    notice, this list of conditions and the following disclaimer.        *
+                                                                         *
+ 2. Redistributions in binary form must reproduce the above copyright    *
+    notice, this list of conditions and the following disclaimer in the  *
+    documentation and/or other materials provided with the distribution. *
+                                                                         *
+ 3. Neither the name of the copyright holder nor the names of its        *
+    contributors may be used to endorse or promote products derived      *
+    from this software without specific prior written permission.        *
+                                                                         *
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS  *
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED    *
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A          *
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT       *
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,   *
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED *
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR   *
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   *
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     *
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       *
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
+                                                                         *
+**************************************************************************/
+
+
+/* Time SHA-256 API Functions */
+
+
+#include "mcl_arch.h"
+#include "mcl_hash.h"
+#include "mcl_utils.h"
+
+const int nIter = ITERATIONS;
+
+/* Size of the message hashed by each iteration */
+#define MSG_BYTES (64*1024)
+
+/* Multi-buffer runs split the same data into 64-byte messages, the shape
+   of the imsgen key derivation hashes */
+#define MB_LEN 64
+#define MB_COUNT (MSG_BYTES/MB_LEN)
+
+static char msg[MSG_BYTES];
+static char mbdigest[MB_COUNT][32];
+
+static void report(char *name,unsigned int totalTime)
+{
+  double mbps=0.0;
+
+  if (totalTime>0) mbps=((double)nIter*MSG_BYTES)/totalTime;
+  printf("%s: Iterations %d Total %d usecs Iteration %d usecs %.1f MB/s \r\n", name, nIter, totalTime, totalTime/nIter, mbps);
+}
+
+static void test()
+{
+  int i,j,k;
+  char digest[32];
+  const char *mptr[MB_COUNT];
+  char *dptr[MB_COUNT];
+  char *mbname[]={"","scalar","SSE","AVX2","AVX-512"};
+  char name[64];
+  mcl_hash256 sh256;
+
+#ifdef MCL_BUILD_ARM
+  unsigned int t1;
+#else
+  double t1;
+#endif			
+  unsigned int totalTime;
+
+  for (i=0; i<MSG_BYTES; i++) msg[i]=(char)i;
+
+  printf("Hashing %d bytes a byte at a time\r\n", MSG_BYTES);
+  MCL_HASH256_kernel(MCL_HASH_KERNEL_SCALAR);
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) {
+    MCL_HASH256_init(&sh256);
+    for (j=0; j<MSG_BYTES; j++) MCL_HASH256_process(&sh256,msg[j]);
+    MCL_HASH256_hash(&sh256,digest);
+  }
+  totalTime = MCL_end_time(t1);
+  report("MCL_HASH256_process",totalTime);
+
+  printf("Hashing %d bytes in bulk (portable kernel)\r\n", MSG_BYTES);
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) {
+    MCL_HASH256_init(&sh256);
+    MCL_HASH256_update(&sh256,msg,MSG_BYTES);
+    MCL_HASH256_hash(&sh256,digest);
+  }
+  totalTime = MCL_end_time(t1);
+  report("MCL_HASH256_update (scalar)",totalTime);
+
+  if (MCL_HASH256_kernel(MCL_HASH_KERNEL_SHANI)==MCL_HASH_KERNEL_SHANI) {
+    printf("Hashing %d bytes in bulk (SHA extensions)\r\n", MSG_BYTES);
+    t1 = MCL_start_time();
+    for (i=0; i<nIter; i++) {
+      MCL_HASH256_init(&sh256);
+      MCL_HASH256_update(&sh256,msg,MSG_BYTES);
+      MCL_HASH256_hash(&sh256,digest);
+    }
+    totalTime = MCL_end_time(t1);
+    report("MCL_HASH256_update (SHA-NI)",totalTime);
+  } else {
+    printf("SHA extensions not supported\r\n");
+  }
+  MCL_HASH256_kernel(MCL_HASH_KERNEL_AUTO);
+
+  for (j=0; j<MB_COUNT; j++) {
+    mptr[j]=&msg[j*MB_LEN];
+    dptr[j]=mbdigest[j];
+  }
+  for (k=MCL_HASH_MULTI_SCALAR; k<=MCL_HASH_MULTI_AVX512; k++) {
+    if (MCL_HASH256_multi_kernel(k)!=k) continue;
+    printf("Hashing %d %d-byte messages (%s multi-buffer)\r\n", MB_COUNT, MB_LEN, mbname[k]);
+    t1 = MCL_start_time();
+    for (i=0; i<nIter; i++) {
+      MCL_HASH256_multi(MB_COUNT,mptr,MB_LEN,dptr);
+    }
+    totalTime = MCL_end_time(t1);
+    sprintf(name,"MCL_HASH256_multi (%s)",mbname[k]);
+    report(name,totalTime);
+  }
+  MCL_HASH256_multi_kernel(MCL_HASH_MULTI_AUTO);
+}
+
+#ifdef MCL_BUILD_ARM
+/* Thread handle */
+static os_thread_t test_thread;
+/* Buffer to be used as stack */
+static os_thread_stack_define(test_stack, 8 * 1024);
+
+/* create shadow yield thread */
+static int create_test_thread()
+{
+	int ret;
+	ret = os_thread_create(
+		/* thread handle */
+		&test_thread,
+		/* thread name */
+		"test",
+		/* entry function */
+		test,
+		/* argument */
+		0,
+		/* stack */
+		&test_stack,
+		/* priority */
+		OS_PRIO_3);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to create shadow yield thread: %d\r\n", ret);
+		return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+#endif
+
+int main()
+{   
+#ifdef MCL_BUILD_ARM
+  /* Initialize console on uart0 */
+  wmstdio_init(UART0_ID, 0);
+#endif
+
+#ifdef MCL_BUILD_ARM
+  create_test_thread();
+#else
+  test();
+#endif
+
+  return 0;
+}
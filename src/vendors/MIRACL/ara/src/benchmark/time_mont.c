@@ -0,0 +1,186 @@
+/*************************************************************************
+                                                                         *
+Copyright (c) 2015>, MIRACL Ltd                                          *
+All rights reserved.                                                     *
+                                                                         *
+This file is derived from the MIRACL for Ara SDK.                        *
+                                                                         *
+The MIRACL for Ara SDK provides developers with an                       *
+extensive and efficient set of cryptographic functions.                  *
+For further information about its features and functionalities           *
+please refer to https://www.miracl.com                                   *
+                                                                         *
+Redistribution and use in source and binary forms, with or without       *
+modification, are permitted provided that the following conditions are   *
+met:                                                                     *
+                                                                         *
+ 1. Redistributions of source code must retain the above copyright       *
+    notice, this list of conditions and the following disclaimer.        *
+                                                                         *
+ 2. Redistributions in binary form must reproduce the above copyright    *
+    notice, this list of conditions and the following disclaimer in the  *
+    documentation and/or other materials provided with the distribution. *
+                                                                         *
+ 3. Neither the name of the copyright holder nor the names of its        *
+    contributors may be used to endorse or promote products derived      *
+    from this software without specific prior written permission.        *
+                                                                         *
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS  *
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED    *
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A          *
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT       *
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,   *
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED *
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR   *
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   *
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     *
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       *
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
+                                                                         *
+**************************************************************************/
+
+
+/* Time the Montgomery kernels, and the exponentiations that use them */
+
+
+#include "mcl_rsa.h"
+#include "mcl_utils.h"
+#include "mcl_mont.h"
+
+const int nIter = ITERATIONS;
+
+/* multiplications per timed run, so the clock is worth reading */
+#define MULS 10000
+
+static const char *names[]={"scalar","AVX2","AVX-512 IFMA"};
+
+/* p is an RSA prime or modulus of n MCL_BIGs */
+static void time_size(csprng *RNG,mcl_chunk p[][MCL_BS],int n)
+{
+  int i,j,k,bits=MCL_BIGBITS*n;
+  mcl_chunk x[MCL_FFLEN][MCL_BS],e[MCL_FFLEN][MCL_BS],r[MCL_FFLEN][MCL_BS];
+  char b[MCL_MONT_WORDS*8];
+  mcl_octet P={0,sizeof(b),b};
+  unsign64 pw[MCL_MONT_WORDS],a[MCL_MONT_WORDS],c[MCL_MONT_WORDS];
+  mcl_mont M;
+#ifdef MCL_BUILD_ARM
+  unsigned int t1;
+#else
+  double t1;
+#endif
+  unsigned int totalTime;
+
+  MCL_FF_randomnum(x,p,RNG,n);
+  MCL_FF_randomnum(e,p,RNG,n);
+
+  for (k=MCL_MONT_SCALAR;k<=MCL_MONT_best();k++)
+  {
+    MCL_MONT_select(k);
+    if (k!=MCL_MONT_SCALAR)
+    {
+/* the kernel on its own, big-endian octets to little-endian words */
+      P.len=0;
+      MCL_FF_toOctet(&P,p,n);
+      for (i=0;i<MCL_MONT_WORDS;i++) pw[i]=a[i]=0;
+      for (i=0;i<P.len;i++) pw[i/8]|=(unsign64)(unsigned char)P.val[P.len-1-i]<<(8*(i%8));
+      MCL_MONT_init(&M,pw,bits);
+      for (i=0;i<bits/64;i++) a[i]=pw[i]>>1;
+      for (i=0;i<bits/64;i++) c[i]=pw[i]>>2;
+
+      t1 = MCL_start_time();
+      for (i=0; i<nIter; i++)
+        for (j=0;j<MULS;j++) MCL_MONT_mul(&M,a,a,c);
+      totalTime = MCL_end_time(t1);
+      printf("MCL_MONT_mul %d %s: Iterations %d Total %d usecs Multiplication %d nsecs \r\n", bits, names[k], nIter*MULS, totalTime, (int)(1000.0*totalTime/((double)nIter*MULS)));
+
+      t1 = MCL_start_time();
+      for (i=0; i<nIter; i++)
+        for (j=0;j<MULS;j++) MCL_MONT_sqr(&M,a,a);
+      totalTime = MCL_end_time(t1);
+      printf("MCL_MONT_sqr %d %s: Iterations %d Total %d usecs Squaring %d nsecs \r\n", bits, names[k], nIter*MULS, totalTime, (int)(1000.0*totalTime/((double)nIter*MULS)));
+    }
+
+    t1 = MCL_start_time();
+    for (i=0; i<nIter; i++) MCL_FF_skpow(r,x,e,p,n);
+    totalTime = MCL_end_time(t1);
+    printf("MCL_FF_skpow %d %s: Iterations %d Total %d usecs Iteration %d usecs \r\n", bits, names[k], nIter, totalTime, totalTime/nIter);
+
+    t1 = MCL_start_time();
+    for (i=0; i<nIter; i++) MCL_FF_pow(r,x,e,p,n);
+    totalTime = MCL_end_time(t1);
+    printf("MCL_FF_pow %d %s: Iterations %d Total %d usecs Iteration %d usecs \r\n", bits, names[k], nIter, totalTime, totalTime/nIter);
+  }
+  MCL_MONT_select(-1);
+}
+
+static void test()
+{
+  char seed[32];
+  MCL_rsa_public_key pub;
+  MCL_rsa_private_key priv;
+  csprng RNG;
+  mcl_octet SEED={0,sizeof(seed),seed};
+
+  /* fake random seed source */
+  char* seedHex = "d50f4137faff934edfa309c110522f6f5c0ccb0d64e5bf4bf8ef79d1fe21031a";
+  MCL_hex2bin(seedHex, SEED.val, 64);
+  SEED.len=32;
+
+  /* initialise strong RNG */
+  MCL_RSA_CREATE_CSPRNG(&RNG,&SEED);
+
+  printf("Best Montgomery kernel: %s\r\n", names[MCL_MONT_best()]);
+  MCL_RSA_KEY_PAIR(&RNG,65537,&priv,&pub);
+  time_size(&RNG,priv.p,MCL_HFLEN);
+  time_size(&RNG,pub.n,MCL_FFLEN);
+
+  MCL_RSA_KILL_CSPRNG(&RNG);
+  MCL_RSA_PRIVATE_KEY_KILL(&priv);
+}
+
+#ifdef MCL_BUILD_ARM
+/* Thread handle */
+static os_thread_t test_thread;
+/* Buffer to be used as stack */
+static os_thread_stack_define(test_stack, 8 * 1024);
+
+/* create shadow yield thread */
+static int create_test_thread()
+{
+	int ret;
+	ret = os_thread_create(
+		/* thread handle */
+		&test_thread,
+		/* thread name */
+		"test",
+		/* entry function */
+		test,
+		/* argument */
+		0,
+		/* stack */
+		&test_stack,
+		/* priority */
+		OS_PRIO_3);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to create shadow yield thread: %d\r\n", ret);
+		return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+#endif
+
+int main()
+{
+#ifdef MCL_BUILD_ARM
+  /* Initialize console on uart0 */
+  wmstdio_init(UART0_ID, 0);
+#endif
+
+#ifdef MCL_BUILD_ARM
+  create_test_thread();
+#else
+  test();
+#endif
+
+  return 0;
+}
@@ -48,6 +48,48 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 
 const int nIter = ITERATIONS;
 
+/* the windowed and public exponent paths against the routines they replace */
+static void time_pow(MCL_rsa_private_key *priv,MCL_rsa_public_key *pub,csprng *RNG)
+{
+  int i;
+  mcl_chunk x[MCL_FFLEN][MCL_BS],r[MCL_FFLEN][MCL_BS];
+#ifdef MCL_BUILD_ARM
+  unsigned int t1;
+#else
+  double t1;
+#endif
+  unsigned int totalTime;
+
+  MCL_FF_randomnum(x,priv->p,RNG,MCL_HFLEN);
+
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) MCL_FF_skpow_ladder(r,x,priv->dp,priv->p,MCL_HFLEN);
+  totalTime = MCL_end_time(t1);
+  printf("MCL_FF_skpow_ladder: Iterations %d Total %d usecs Iteration %d usecs \r\n", nIter, totalTime, totalTime/nIter);
+
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) MCL_FF_skpow(r,x,priv->dp,priv->p,MCL_HFLEN);
+  totalTime = MCL_end_time(t1);
+  printf("MCL_FF_skpow: Iterations %d Total %d usecs Iteration %d usecs \r\n", nIter, totalTime, totalTime/nIter);
+
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) MCL_FF_pow(r,x,priv->dp,priv->p,MCL_HFLEN);
+  totalTime = MCL_end_time(t1);
+  printf("MCL_FF_pow: Iterations %d Total %d usecs Iteration %d usecs \r\n", nIter, totalTime, totalTime/nIter);
+
+  MCL_FF_randomnum(x,pub->n,RNG,MCL_FFLEN);
+
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) MCL_FF_power(r,x,pub->e,pub->n,MCL_FFLEN);
+  totalTime = MCL_end_time(t1);
+  printf("MCL_FF_power: Iterations %d Total %d usecs Iteration %d usecs \r\n", nIter, totalTime, totalTime/nIter);
+
+  t1 = MCL_start_time();
+  for (i=0; i<nIter; i++) MCL_FF_pubpow(r,x,pub->e,pub->n,MCL_FFLEN);
+  totalTime = MCL_end_time(t1);
+  printf("MCL_FF_pubpow: Iterations %d Total %d usecs Iteration %d usecs \r\n", nIter, totalTime, totalTime/nIter);
+}
+
 static void test()
 {
   int i;
@@ -119,6 +161,8 @@ static void test()
   printf("Plaintext= "); 
   MCL_OCT_output_string(&ML);
   printf("\r\n");
+
+  time_pow(&priv,&pub,&RNG);
 }
 
 #ifdef MCL_BUILD_ARM
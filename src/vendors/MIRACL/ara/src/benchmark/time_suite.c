@@ -0,0 +1,608 @@
+/*************************************************************************
+                                                                         *
+Copyright (c) 2015>, MIRACL Ltd                                          *
+All rights reserved.                                                     *
+                                                                         *
+This file is derived from the MIRACL for Ara SDK.                        *
+                                                                         *
+The MIRACL for Ara SDK provides developers with an                       *
+extensive and efficient set of cryptographic functions.                  *
+For further information about its features and functionalities           *
+please refer to https://www.miracl.com                                   *
+                                                                         *
+Redistribution and use in source and binary forms, with or without       *
+modification, are permitted provided that the following conditions are   *
+met:                                                                     *
+                                                                         *
+ 1. Redistributions of source code must retain the above copyright       *
+    notice, this list of conditions and the following disclaimer.        *
+                                                                         *
+ 2. Redistributions in binary form must reproduce the above copyright    *
+    notice, this list of conditions and the following disclaimer in the  *
+    documentation and/or other materials provided with the distribution. *
+                                                                         *
+ 3. Neither the name of the copyright holder nor the names of its        *
+    contributors may be used to endorse or promote products derived      *
+    from this software without specific prior written permission.        *
+                                                                         *
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS  *
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED    *
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A          *
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT       *
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,   *
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED *
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR   *
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   *
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     *
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       *
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
+                                                                         *
+**************************************************************************/
+
+
+/* Benchmark harness - hashing, RNG, AES, the FF arithmetic, RSA and ECC of
+   this configuration in one run.
+
+   Each benchmark is warmed up, then run in batches sized so one batch takes
+   at least TARGET_USECS, and timed over a number of batches. The per-op time
+   is reported as min/median/90th/99th percentile/max over the batches, with
+   TSC cycles and GB/s where they apply.
+
+   time_suite [--samples N] [--filter S] [--json FILE] [--compare FILE] [--threshold PCT] [--aes table]
+
+   --json writes the results as JSON, one benchmark per line. --compare reads
+   such a file back as the baseline, and flags every benchmark whose median
+   is more than PCT percent (default 10) slower than the baseline's; the exit
+   status is then 1. --aes table forces the portable AES and GHASH code in
+   place of AES-NI and PCLMULQDQ. */
+
+#ifndef MCL_BUILD_ARM
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+
+#include "mcl_ecdh.h"
+#include "mcl_rsa.h"
+#include "mcl_gcm.h"
+#include "mcl_utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define SUITE_TSC 1 /**< Cycles come from the time stamp counter */
+#endif
+
+const int nIter = ITERATIONS;
+
+#define TARGET_USECS 5000 /**< Shortest timed batch */
+#define MAX_SAMPLES 101   /**< Most batches timed per benchmark */
+#define MAX_BENCH 32      /**< Most benchmarks in one run */
+#define BULK_BYTES 16384  /**< Message size of the throughput benchmarks */
+
+/* A benchmark runs its operation reps times */
+typedef struct
+{
+  char name[32];
+  int bytes; /* bytes processed per op, 0 if not a throughput benchmark */
+  void (*run)(int reps);
+} bench;
+
+typedef struct
+{
+  char name[32];
+  int bytes;
+  int batch;
+  int samples;
+  double ns[5]; /* min, median, 90th, 99th percentile, max, per op */
+  double cycles; /* median, 0 if unknown */
+} result;
+
+static bench benches[MAX_BENCH];
+static int nbench;
+static result results[MAX_BENCH];
+static int nresults;
+static double tns[MAX_SAMPLES],tcy[MAX_SAMPLES];
+
+/* state shared by the benchmarks */
+static csprng RNG;
+static char bulk[BULK_BYTES],bulk_out[BULK_BYTES];
+static char key[32],iv[12],tag[16];
+static int aes_kernel=-1;
+static MCL_rsa_public_key pub;
+static MCL_rsa_private_key priv;
+static mcl_chunk ffx[MCL_HFLEN][MCL_BS],ffr[MCL_HFLEN][MCL_BS];
+static char rm[MCL_RFS],rc[MCL_RFS],rs[MCL_RFS],rv[MCL_RFS];
+static mcl_octet RM={0,sizeof(rm),rm};
+static mcl_octet RC={0,sizeof(rc),rc};
+static mcl_octet RS={0,sizeof(rs),rs};
+static mcl_octet RV={0,sizeof(rv),rv};
+static char s0[MCL_EGS],s1[MCL_EGS],w0[2*MCL_EFS+1],w1[2*MCL_EFS+1],z0[MCL_EFS],cs[MCL_EGS],ds[MCL_EGS],em[32];
+static mcl_octet S0={0,sizeof(s0),s0};
+static mcl_octet S1={0,sizeof(s1),s1};
+static mcl_octet W0={0,sizeof(w0),w0};
+static mcl_octet W1={0,sizeof(w1),w1};
+static mcl_octet Z0={0,sizeof(z0),z0};
+static mcl_octet CS={0,sizeof(cs),cs};
+static mcl_octet DS={0,sizeof(ds),ds};
+static mcl_octet EM={0,sizeof(em),em};
+
+#if MCL_CHOICE==MCL_NIST256
+#define CURVE_NAME "NIST256"
+#elif MCL_CHOICE==MCL_C25519
+#define CURVE_NAME "C25519"
+#elif MCL_CHOICE==MCL_C41417
+#define CURVE_NAME "C41417"
+#elif MCL_CHOICE==MCL_NIST384
+#define CURVE_NAME "NIST384"
+#elif MCL_CHOICE==MCL_NIST521
+#define CURVE_NAME "NIST521"
+#else
+#define CURVE_NAME "C448"
+#endif
+
+static void run_sha256(int reps)
+{
+  char h[32];
+  mcl_hash256 sh;
+  while (reps--) {
+    MCL_HASH256_init(&sh);
+    MCL_HASH256_update(&sh,bulk,BULK_BYTES);
+    MCL_HASH256_hash(&sh,h);
+  }
+}
+
+static void run_sha384(int reps)
+{
+  int i;
+  char h[48];
+  mcl_hash384 sh;
+  while (reps--) {
+    MCL_HASH384_init(&sh);
+    for (i=0; i<BULK_BYTES; i++) MCL_HASH384_process(&sh,bulk[i]);
+    MCL_HASH384_hash(&sh,h);
+  }
+}
+
+static void run_sha512(int reps)
+{
+  int i;
+  char h[64];
+  mcl_hash512 sh;
+  while (reps--) {
+    MCL_HASH512_init(&sh);
+    for (i=0; i<BULK_BYTES; i++) MCL_HASH512_process(&sh,bulk[i]);
+    MCL_HASH512_hash(&sh,h);
+  }
+}
+
+static void run_rand(int reps)
+{
+  int i;
+  while (reps--)
+    for (i=0; i<BULK_BYTES; i++) bulk_out[i]=(char)MCL_RAND_byte(&RNG);
+}
+
+static void run_aes_cbc(int reps)
+{
+  int i;
+  mcl_aes a;
+  while (reps--) {
+    MCL_AES_init(&a,CBC,16,key,iv);
+    memcpy(bulk_out,bulk,BULK_BYTES);
+    for (i=0; i<BULK_BYTES; i+=16) MCL_AES_encrypt(&a,&bulk_out[i]);
+    MCL_AES_end(&a);
+  }
+}
+
+static void run_aes_gcm(int reps)
+{
+  mcl_gcm g;
+  while (reps--) {
+    MCL_GCM_init(&g,16,key,12,iv);
+    MCL_GCM_add_plain(&g,bulk_out,bulk,BULK_BYTES);
+    MCL_GCM_finish(&g,tag);
+  }
+}
+
+static void run_aes_gcm_decrypt(int reps)
+{
+  mcl_gcm g;
+  while (reps--) {
+    MCL_GCM_init(&g,16,key,12,iv);
+    MCL_GCM_add_cipher(&g,bulk_out,bulk,BULK_BYTES);
+    MCL_GCM_finish(&g,tag);
+  }
+}
+
+static void run_aes256_gcm(int reps)
+{
+  mcl_gcm g;
+  while (reps--) {
+    MCL_GCM_init(&g,32,key,12,iv);
+    MCL_GCM_add_plain(&g,bulk_out,bulk,BULK_BYTES);
+    MCL_GCM_finish(&g,tag);
+  }
+}
+
+static void run_ghash(int reps)
+{
+  mcl_gcm g;
+  while (reps--) {
+    MCL_GCM_init(&g,16,key,12,iv);
+    MCL_GCM_add_header(&g,bulk,BULK_BYTES);
+    MCL_GCM_finish(&g,tag);
+  }
+}
+
+static void run_ff_prime(int reps)
+{
+  while (reps--) MCL_FF_prime(priv.p,&RNG,MCL_HFLEN);
+}
+
+static void run_ff_pow(int reps)
+{
+  while (reps--) MCL_FF_pow(ffr,ffx,priv.dp,priv.p,MCL_HFLEN);
+}
+
+static void run_rsa_sign(int reps)
+{
+  while (reps--) {
+    MCL_PKCS15(MCL_HASH_TYPE_RSA,&RM,&RC);
+    MCL_RSA_DECRYPT(&priv,&RC,&RS);
+  }
+}
+
+static void run_rsa_verify(int reps)
+{
+  while (reps--) {
+    MCL_PKCS15(MCL_HASH_TYPE_RSA,&RM,&RC);
+    MCL_RSA_ENCRYPT(&pub,&RS,&RV);
+    if (!MCL_OCT_comp(&RC,&RV)) printf("RSA signature is INVALID\r\n");
+  }
+}
+
+static void run_ecp_keygen(int reps)
+{
+  while (reps--) MCL_ECP_KEY_PAIR_GENERATE(&RNG,&S1,&W1);
+}
+
+static void run_ecdh(int reps)
+{
+  while (reps--) MCL_ECPSVDP_DH(&S0,&W1,&Z0);
+}
+
+static void run_ecdsa_sign(int reps)
+{
+  while (reps--) MCL_ECPSP_DSA(MCL_HASH_TYPE_ECC,&RNG,&S0,&EM,&CS,&DS);
+}
+
+static void run_ecdsa_verify(int reps)
+{
+  while (reps--)
+    if (MCL_ECPVP_DSA(MCL_HASH_TYPE_ECC,&W0,&EM,&CS,&DS)!=0) printf("ECDSA signature is INVALID\r\n");
+}
+
+static void add(const char *name,int bytes,void (*run)(int))
+{
+  if (nbench>=MAX_BENCH) return;
+  strncpy(benches[nbench].name,name,sizeof(benches[nbench].name)-1);
+  benches[nbench].bytes=bytes;
+  benches[nbench].run=run;
+  nbench++;
+}
+
+static void setup()
+{
+  int i;
+  char seed[32],name[32];
+  mcl_octet SEED={0,sizeof(seed),seed};
+
+  /* fake random seed source */
+  char* seedHex = "d50f4137faff934edfa309c110522f6f5c0ccb0d64e5bf4bf8ef79d1fe21031a";
+  MCL_hex2bin(seedHex, SEED.val, 64);
+  SEED.len=32;
+  MCL_CREATE_CSPRNG(&RNG,&SEED);
+
+  for (i=0; i<BULK_BYTES; i++) bulk[i]=(char)i;
+  for (i=0; i<32; i++) key[i]=(char)(i*7);
+  for (i=0; i<12; i++) iv[i]=(char)(i*13);
+
+  printf("Generating keys\r\n");
+  MCL_RSA_KEY_PAIR(&RNG,65537,&priv,&pub);
+  MCL_FF_randomnum(ffx,priv.p,&RNG,MCL_HFLEN);
+  MCL_OCT_jstring(&RM,(char *)"Hello World\n");
+  MCL_PKCS15(MCL_HASH_TYPE_RSA,&RM,&RC);
+  MCL_RSA_DECRYPT(&priv,&RC,&RS);
+
+  MCL_ECP_KEY_PAIR_GENERATE(&RNG,&S0,&W0);
+  MCL_ECP_KEY_PAIR_GENERATE(&RNG,&S1,&W1);
+  MCL_OCT_jstring(&EM,(char *)"Hello World\n");
+  MCL_ECPSP_DSA(MCL_HASH_TYPE_ECC,&RNG,&S0,&EM,&CS,&DS);
+
+  add("sha256",BULK_BYTES,run_sha256);
+  add("sha384",BULK_BYTES,run_sha384);
+  add("sha512",BULK_BYTES,run_sha512);
+  add("rand_byte",BULK_BYTES,run_rand);
+  add("aes128_cbc",BULK_BYTES,run_aes_cbc);
+  add("aes128_gcm",BULK_BYTES,run_aes_gcm);
+  add("aes128_gcm_decrypt",BULK_BYTES,run_aes_gcm_decrypt);
+  add("aes256_gcm",BULK_BYTES,run_aes256_gcm);
+  add("ghash",BULK_BYTES,run_ghash);
+  sprintf(name,"ff%d_prime",MCL_HFLEN*MCL_BIGBITS);
+  add(name,0,run_ff_prime);
+  sprintf(name,"ff%d_pow",MCL_HFLEN*MCL_BIGBITS);
+  add(name,0,run_ff_pow);
+  sprintf(name,"rsa%d_sign",MCL_FFLEN*MCL_BIGBITS);
+  add(name,0,run_rsa_sign);
+  sprintf(name,"rsa%d_verify",MCL_FFLEN*MCL_BIGBITS);
+  add(name,0,run_rsa_verify);
+  add(CURVE_NAME "_keygen",0,run_ecp_keygen);
+  add(CURVE_NAME "_dh",0,run_ecdh);
+  add(CURVE_NAME "_dsa_sign",0,run_ecdsa_sign);
+  add(CURVE_NAME "_dsa_verify",0,run_ecdsa_verify);
+}
+
+static unsign64 cycles()
+{
+#ifdef SUITE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static void sort(double *v,int n)
+{
+  int i,j;
+  double t;
+  for (i=1; i<n; i++)
+    for (j=i; j>0 && v[j-1]>v[j]; j--) {
+      t=v[j]; v[j]=v[j-1]; v[j-1]=t;
+    }
+}
+
+/* nearest rank percentile of n sorted values */
+static double percentile(double *v,int n,int pct)
+{
+  int k=(pct*n+99)/100;
+  if (k<1) k=1;
+  return v[k-1];
+}
+
+static void measure(bench *b,int samples,result *r)
+{
+  int i,batch=1;
+  unsign64 c0;
+#ifdef MCL_BUILD_ARM
+  unsigned int t1,t;
+#else
+  double t1,t;
+#endif
+
+  /* warm up, and double the batch until it runs for long enough */
+  b->run(1);
+  for (;;) {
+    t1 = MCL_start_time();
+    b->run(batch);
+    t = MCL_end_time(t1);
+    if (t>=TARGET_USECS || batch>=(1<<24)) break;
+    batch*=2;
+  }
+
+  for (i=0; i<samples; i++) {
+    c0=cycles();
+    t1 = MCL_start_time();
+    b->run(batch);
+    t = MCL_end_time(t1);
+    tcy[i]=(double)(cycles()-c0)/batch;
+    tns[i]=1000.0*t/batch;
+  }
+  sort(tns,samples);
+  sort(tcy,samples);
+
+  strcpy(r->name,b->name);
+  r->bytes=b->bytes;
+  r->batch=batch;
+  r->samples=samples;
+  r->ns[0]=tns[0];
+  r->ns[1]=percentile(tns,samples,50);
+  r->ns[2]=percentile(tns,samples,90);
+  r->ns[3]=percentile(tns,samples,99);
+  r->ns[4]=tns[samples-1];
+  r->cycles=percentile(tcy,samples,50);
+}
+
+static const char *aes_name()
+{
+  return (aes_kernel==MCL_AES_NI)?"aes-ni":"table";
+}
+
+static double mbps(result *r)
+{
+  if (r->bytes==0 || r->ns[1]<=0) return 0.0;
+  return 1000.0*r->bytes/r->ns[1]; /* bytes/ns is GB/s */
+}
+
+static void report(result *r)
+{
+  printf("%-20s %10.0f %10.0f %10.0f %10.0f %10.0f", r->name, r->ns[0], r->ns[1], r->ns[2], r->ns[3], r->ns[4]);
+  if (r->cycles>0) printf(" %12.0f",r->cycles);
+  else printf(" %12s","-");
+  if (r->bytes) printf(" %9.3f",mbps(r)/1000.0);
+  else printf(" %9s","-");
+  printf("\r\n");
+}
+
+#ifndef MCL_BUILD_ARM
+static int write_json(const char *file)
+{
+  int i;
+  result *r;
+  FILE *fp=fopen(file,"w");
+  if (fp==NULL) {
+    printf("Cannot write %s\r\n",file);
+    return -1;
+  }
+  fprintf(fp,"{\"curve\":\"%s\",\"chunk\":%d,\"rsa_bits\":%d,\"aes\":\"%s\",\"cycles\":\"%s\",\"results\":[\n",
+          CURVE_NAME, MCL_CHUNK, MCL_FFLEN*MCL_BIGBITS, aes_name(), (results[0].cycles>0)?"tsc":"none");
+  for (i=0; i<nresults; i++) {
+    r=&results[i];
+    fprintf(fp,"{\"name\":\"%s\",\"bytes\":%d,\"batch\":%d,\"samples\":%d,"
+               "\"ns_min\":%.1f,\"ns_p50\":%.1f,\"ns_p90\":%.1f,\"ns_p99\":%.1f,\"ns_max\":%.1f,"
+               "\"cycles_p50\":%.0f,\"mb_s\":%.2f}%s\n",
+            r->name, r->bytes, r->batch, r->samples, r->ns[0], r->ns[1], r->ns[2], r->ns[3], r->ns[4],
+            r->cycles, mbps(r), (i<nresults-1)?",":"");
+  }
+  fprintf(fp,"]}\n");
+  fclose(fp);
+  return 0;
+}
+
+/* Compare the medians with a baseline written by --json. Returns the number of regressions, or -1 */
+static int compare(const char *file,double threshold)
+{
+  int i,found,bad=0;
+  char line[512],*p,*q;
+  double base,pct;
+  FILE *fp=fopen(file,"r");
+  if (fp==NULL) {
+    printf("Cannot read %s\r\n",file);
+    return -1;
+  }
+  printf("\r\nCompared with %s\r\n",file);
+  printf("%-20s %12s %12s %8s\r\n","benchmark","base ns","now ns","change");
+  for (i=0; i<nresults; i++) {
+    found=0;
+    rewind(fp);
+    while (fgets(line,sizeof(line),fp)!=NULL) {
+      if ((p=strstr(line,"\"name\":\""))==NULL) continue;
+      p+=8;
+      if ((q=strchr(p,'"'))==NULL) continue;
+      if ((size_t)(q-p)!=strlen(results[i].name) || strncmp(p,results[i].name,q-p)!=0) continue;
+      if ((p=strstr(line,"\"ns_p50\":"))==NULL) continue;
+      base=strtod(p+9,NULL);
+      found=1;
+      break;
+    }
+    if (!found || base<=0) {
+      printf("%-20s %12s %12.0f %8s\r\n",results[i].name,"-",results[i].ns[1],"new");
+      continue;
+    }
+    pct=100.0*(results[i].ns[1]-base)/base;
+    printf("%-20s %12.0f %12.0f %+7.1f%%%s\r\n",results[i].name,base,results[i].ns[1],pct,
+           (pct>threshold)?"  REGRESSION":"");
+    if (pct>threshold) bad++;
+  }
+  fclose(fp);
+  return bad;
+}
+#endif
+
+static int suite(int samples,const char *filter)
+{
+  int i;
+
+  if (samples<1) samples=1;
+  if (samples>MAX_SAMPLES) samples=MAX_SAMPLES;
+
+  aes_kernel=(aes_kernel==MCL_AES_TABLE)?MCL_AES_TABLE:MCL_AES_best();
+  setup();
+  printf("%s, %d-bit chunks, %s AES, %d samples of at least %d usecs each\r\n", CURVE_NAME, MCL_CHUNK, aes_name(), samples, TARGET_USECS);
+  printf("%-20s %10s %10s %10s %10s %10s %12s %9s\r\n","benchmark","min ns","median ns","p90 ns","p99 ns","max ns","cycles/op","GB/s");
+  for (i=0; i<nbench; i++) {
+    if (filter!=NULL && strstr(benches[i].name,filter)==NULL) continue;
+    measure(&benches[i],samples,&results[nresults]);
+    report(&results[nresults]);
+    nresults++;
+  }
+
+  MCL_KILL_CSPRNG(&RNG);
+  MCL_RSA_PRIVATE_KEY_KILL(&priv);
+  return 0;
+}
+
+#ifdef MCL_BUILD_ARM
+static void test()
+{
+  suite(nIter,NULL);
+}
+
+/* Thread handle */
+static os_thread_t test_thread;
+/* Buffer to be used as stack */
+static os_thread_stack_define(test_stack, 8 * 1024);
+
+/* create shadow yield thread */
+static int create_test_thread()
+{
+	int ret;
+	ret = os_thread_create(
+		/* thread handle */
+		&test_thread,
+		/* thread name */
+		"test",
+		/* entry function */
+		test,
+		/* argument */
+		0,
+		/* stack */
+		&test_stack,
+		/* priority */
+		OS_PRIO_3);
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to create shadow yield thread: %d\r\n", ret);
+		return -WM_FAIL;
+	}
+	return WM_SUCCESS;
+}
+
+int main()
+{
+  /* Initialize console on uart0 */
+  wmstdio_init(UART0_ID, 0);
+  create_test_thread();
+  return 0;
+}
+#else
+static void usage()
+{
+  printf("usage: time_suite [--samples N] [--filter S] [--json FILE] [--compare FILE] [--threshold PCT] [--aes table]\r\n");
+}
+
+int main(int argc,char **argv)
+{
+  int i,samples=nIter,bad;
+  const char *filter=NULL,*json=NULL,*base=NULL;
+  double threshold=10.0;
+
+  for (i=1; i<argc; i++) {
+    if (i+1<argc && strcmp(argv[i],"--samples")==0) samples=atoi(argv[++i]);
+    else if (i+1<argc && strcmp(argv[i],"--filter")==0) filter=argv[++i];
+    else if (i+1<argc && strcmp(argv[i],"--json")==0) json=argv[++i];
+    else if (i+1<argc && strcmp(argv[i],"--compare")==0) base=argv[++i];
+    else if (i+1<argc && strcmp(argv[i],"--threshold")==0) threshold=atof(argv[++i]);
+    else if (i+1<argc && strcmp(argv[i],"--aes")==0 && strcmp(argv[i+1],"table")==0) {
+      MCL_AES_select(MCL_AES_TABLE);
+      aes_kernel=MCL_AES_TABLE;
+      i++;
+    }
+    else {
+      usage();
+      return 2;
+    }
+  }
+
+  suite(samples,filter);
+  if (json!=NULL && write_json(json)!=0) return 2;
+  if (base!=NULL) {
+    bad=compare(base,threshold);
+    if (bad<0) return 2;
+    if (bad>0) {
+      printf("%d benchmark(s) more than %.1f%% slower than the baseline\r\n",bad,threshold);
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif
@@ -277,6 +277,71 @@ static unsign32 InvMixCol(unsign32 x)
     return y;
 }
 
+static int selected=-1;
+
+void MCL_AES_select(int kernel)
+{
+    selected=kernel;
+}
+
+#if MCL_AES_X86
+
+#include <immintrin.h>
+
+#define NI __attribute__((target("aes,pclmul,ssse3")))
+
+int MCL_AES_best(void)
+{
+    static int best=-1;
+    if (best<0)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3")) best=MCL_AES_NI;
+        else best=MCL_AES_TABLE;
+    }
+    return best;
+}
+
+/* The key schedules are already AES-NI's: on a little-endian machine the
+   packed words are the round key bytes in order, and rkey is the equivalent
+   inverse cipher schedule that aesdec wants */
+NI static void ni_encrypt(const mcl_aes *a,uchar *buff)
+{
+    int i;
+    const __m128i *k=(const __m128i *)a->fkey;
+    __m128i s=_mm_xor_si128(_mm_loadu_si128((const __m128i *)buff),_mm_loadu_si128(k));
+    for (i=1;i<a->Nr;i++) s=_mm_aesenc_si128(s,_mm_loadu_si128(k+i));
+    s=_mm_aesenclast_si128(s,_mm_loadu_si128(k+a->Nr));
+    _mm_storeu_si128((__m128i *)buff,s);
+}
+
+NI static void ni_decrypt(const mcl_aes *a,uchar *buff)
+{
+    int i;
+    const __m128i *k=(const __m128i *)a->rkey;
+    __m128i s=_mm_xor_si128(_mm_loadu_si128((const __m128i *)buff),_mm_loadu_si128(k));
+    for (i=1;i<a->Nr;i++) s=_mm_aesdec_si128(s,_mm_loadu_si128(k+i));
+    s=_mm_aesdeclast_si128(s,_mm_loadu_si128(k+a->Nr));
+    _mm_storeu_si128((__m128i *)buff,s);
+}
+
+#else
+
+int MCL_AES_best(void)
+{
+    return MCL_AES_TABLE;
+}
+
+#endif
+
+static int current_kernel()
+{
+    int best=MCL_AES_best();
+    if (selected<0) return best;
+    if (selected>best) return MCL_AES_TABLE;
+    return selected;
+}
+
 /* SU= 8 */
 /* reset cipher */
 void MCL_AES_reset(mcl_aes *a,int mode,char *iv)
@@ -313,6 +378,7 @@ int MCL_AES_init(mcl_aes* a,int mode,int nk,char *key,char *iv)
 	nr=6+nk;
 
     a->Nk=nk; a->Nr=nr;
+    a->kernel=current_kernel();
 
     MCL_AES_reset(a,mode,iv);
 
@@ -360,6 +426,14 @@ void MCL_AES_ecb_encrypt(mcl_aes *a,uchar *buff)
     int i,j,k;
     unsign32 p[4],q[4],*x,*y,*t;
 
+#if MCL_AES_X86
+    if (a->kernel==MCL_AES_NI)
+    {
+        ni_encrypt(a,buff);
+        return;
+    }
+#endif
+
     for (i=j=0;i<NB;i++,j+=4)
     {
         p[i]=pack((uchar *)&buff[j]);
@@ -427,6 +501,14 @@ void MCL_AES_ecb_decrypt(mcl_aes *a,uchar *buff)
     int i,j,k;
     unsign32 p[4],q[4],*x,*y,*t;
 
+#if MCL_AES_X86
+    if (a->kernel==MCL_AES_NI)
+    {
+        ni_decrypt(a,buff);
+        return;
+    }
+#endif
+
     for (i=j=0;i<NB;i++,j+=4)
     {
         p[i]=pack((uchar *)&buff[j]);
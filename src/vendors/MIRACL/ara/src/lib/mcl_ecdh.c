@@ -361,23 +361,12 @@ int MCL_AES_CBC_IV0_DECRYPT(mcl_octet *k,mcl_octet *c,mcl_octet *m)
     return 1;
 }
 
-/* Calculate a public/private EC GF(p) key pair. W=S.G mod EC(p),
- * where S is the secret key and W is the public key
- * and G is fixed generator.
- * If RNG is NULL then the private key is provided externally in S
- * otherwise it is generated randomly internally */
-int MCL_ECP_KEY_PAIR_GENERATE(csprng *RNG,mcl_octet* S,mcl_octet *W)
+/* Key pair generation, using either the generic or the fixed base multiplication */
+static int ECP_key_pair_generate(csprng *RNG,mcl_octet* S,mcl_octet *W,int fixed)
 {
     mcl_chunk r[MCL_BS],gx[MCL_BS],gy[MCL_BS],s[MCL_BS];
     MCL_ECP G;
     int res=0;
-	MCL_BIG_rcopy(gx,MCL_CURVE_Gx);
-#if MCL_CURVETYPE!=MCL_MONTGOMERY
-	MCL_BIG_rcopy(gy,MCL_CURVE_Gy);
-    MCL_ECP_set(&G,gx,gy);
-#else
-    MCL_ECP_set(&G,gx);
-#endif
 
 	MCL_BIG_rcopy(r,MCL_CURVE_Order);
     if (RNG!=NULL)
@@ -388,7 +377,19 @@ int MCL_ECP_KEY_PAIR_GENERATE(csprng *RNG,mcl_octet* S,mcl_octet *W)
 		MCL_BIG_mod(s,r);
 	}
 
-    MCL_ECP_mul(&G,s);
+	if (fixed)
+		MCL_ECP_gen_mul(&G,s);
+	else
+	{
+		MCL_BIG_rcopy(gx,MCL_CURVE_Gx);
+#if MCL_CURVETYPE!=MCL_MONTGOMERY
+		MCL_BIG_rcopy(gy,MCL_CURVE_Gy);
+		MCL_ECP_set(&G,gx,gy);
+#else
+		MCL_ECP_set(&G,gx);
+#endif
+		MCL_ECP_mul(&G,s);
+	}
 #if MCL_CURVETYPE!=MCL_MONTGOMERY
     MCL_ECP_get(gx,gy,&G);
 #else
@@ -411,6 +412,31 @@ int MCL_ECP_KEY_PAIR_GENERATE(csprng *RNG,mcl_octet* S,mcl_octet *W)
     return res;
 }
 
+/* Calculate a public/private EC GF(p) key pair. W=S.G mod EC(p),
+ * where S is the secret key and W is the public key
+ * and G is fixed generator.
+ * If RNG is NULL then the private key is provided externally in S
+ * otherwise it is generated randomly internally */
+int MCL_ECP_KEY_PAIR_GENERATE(csprng *RNG,mcl_octet* S,mcl_octet *W)
+{
+	return ECP_key_pair_generate(RNG,S,W,0);
+}
+
+/* Build the fixed base table for G used by MCL_ECP_KEY_PAIR_GENERATE_FIXED.
+ * Not thread safe - call once, before generating any keys.
+ * Returns 1 if the table is ready, 0 if this curve/target has none */
+int MCL_ECP_FIXED_BASE_INIT(void)
+{
+	return MCL_ECP_gen_precompute();
+}
+
+/* As MCL_ECP_KEY_PAIR_GENERATE, with the same output, but calculates S.G
+ * from the fixed base table (if MCL_ECP_FIXED_BASE_INIT has built one) */
+int MCL_ECP_KEY_PAIR_GENERATE_FIXED(csprng *RNG,mcl_octet* S,mcl_octet *W)
+{
+	return ECP_key_pair_generate(RNG,S,W,1);
+}
+
 /* validate public key. Set full=true for fuller check */
 int MCL_ECP_PUBLIC_KEY_VALIDATE(int full,mcl_octet *W)
 {
@@ -1067,6 +1067,120 @@ void MCL_ECP_mul2(MCL_ECP *P,MCL_ECP *Q,MCL_BIG e,MCL_BIG f)
 
 #endif
 
+/* Set P=G, the fixed curve generator */
+static void ECP_generator(MCL_ECP *P)
+{
+	mcl_chunk gx[MCL_BS];
+#if MCL_CURVETYPE!=MCL_MONTGOMERY
+	mcl_chunk gy[MCL_BS];
+	MCL_BIG_rcopy(gx,MCL_CURVE_Gx);
+	MCL_BIG_rcopy(gy,MCL_CURVE_Gy);
+	MCL_ECP_set(P,gx,gy);
+#else
+	MCL_BIG_rcopy(gx,MCL_CURVE_Gx);
+	MCL_ECP_set(P,gx);
+#endif
+}
+
+#if MCL_CURVETYPE==MCL_EDWARDS && !defined(MCL_BUILD_ARM)
+
+/* Fixed base table for G. Window i holds the affine points j.16^i.G for j=1..8,
+   enough for a scalar of MCL_MODBYTES bytes in signed 4-bit digits (plus a carry).
+   The Edwards addition law is complete, so e.G is one constant time table
+   look-up and one addition per digit, with no doublings at all.
+   Too big for embedded targets, so hosted builds only */
+#define MCL_ECP_GWINDOWS (2*MCL_MODBYTES+1)
+static MCL_ECP gtable[MCL_ECP_GWINDOWS][8];
+static int gtable_ready=0;
+
+/* Build the fixed base table for G. Not thread safe - call once before use */
+int MCL_ECP_gen_precompute(void)
+{
+	int i,j;
+	MCL_ECP B;
+
+	if (gtable_ready) return 1;
+	ECP_generator(&B);
+	for (i=0;i<MCL_ECP_GWINDOWS;i++)
+	{ /* B=16^i.G */
+		MCL_ECP_copy(&gtable[i][0],&B);
+		for (j=1;j<8;j++)
+		{
+			MCL_ECP_copy(&gtable[i][j],&gtable[i][j-1]);
+			MCL_ECP_add(&gtable[i][j],&B);
+		}
+		MCL_ECP_copy(&B,&gtable[i][7]);
+		MCL_ECP_dbl(&B);
+		MCL_ECP_affine(&B);
+		for (j=0;j<8;j++) MCL_ECP_affine(&gtable[i][j]);
+	}
+	gtable_ready=1;
+	return 1;
+}
+
+/* Set P=e.G using the fixed base table, side-channel resistant. Same result as MCL_ECP_mul */
+void MCL_ECP_gen_mul(MCL_ECP *P,MCL_BIG e)
+{
+	int i,j,d,carry;
+	sign32 m,babs;
+	char b[MCL_MODBYTES];
+	sign8 w[MCL_ECP_GWINDOWS];
+	mcl_chunk t[MCL_BS];
+	MCL_ECP Q,MQ;
+
+	if (!gtable_ready)
+	{
+		ECP_generator(P);
+		MCL_ECP_mul(P,e);
+		return;
+	}
+
+/* convert exponent to signed 4-bit digits, -8..7 (the last is a 0 or 1 carry) */
+	MCL_BIG_copy(t,e); MCL_BIG_norm(t);
+	MCL_BIG_toBytes(b,t);
+	carry=0;
+	for (i=0;i<2*MCL_MODBYTES;i++)
+	{
+		d=(((unsigned char)b[MCL_MODBYTES-1-i/2])>>(4*(i&1)))&0xf;
+		d+=carry;
+		carry=(d+8)>>4;
+		w[i]=(sign8)(d-(carry<<4));
+	}
+	w[2*MCL_MODBYTES]=(sign8)carry;
+
+	MCL_ECP_inf(P);
+	for (i=0;i<MCL_ECP_GWINDOWS;i++)
+	{ /* Q=w[i].16^i.G - O for a zero digit */
+		m=((sign32)w[i])>>31;
+		babs=(w[i]^m)-m;
+		MCL_ECP_inf(&Q);
+		for (j=0;j<8;j++)
+			ECP_cmove(&Q,&gtable[i][j],teq(babs,j+1));
+		MCL_ECP_copy(&MQ,&Q);
+		MCL_FP_neg(MQ.x,MQ.x);
+		MCL_BIG_norm(MQ.x);
+		ECP_cmove(&Q,&MQ,(int)(m&1));
+		MCL_ECP_add(P,&Q);
+	}
+	MCL_ECP_affine(P);
+}
+
+#else
+
+/* No fixed base table on this curve/target - plain variable base multiplication */
+int MCL_ECP_gen_precompute(void)
+{
+	return 0;
+}
+
+void MCL_ECP_gen_mul(MCL_ECP *P,MCL_BIG e)
+{
+	ECP_generator(P);
+	MCL_ECP_mul(P,e);
+}
+
+#endif
+
 #ifdef HAS_MAIN
 
 int main()
@@ -45,6 +45,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 #include "mcl_config.h"
 #include "mcl_big.h"
 #include "mcl_ff.h"
+#include "mcl_mont.h"
 
 #define MCL_MODBYTES (1+(MCL_MBITS-1)/8) /**< Number of bytes in MCL_Modulus */
 #define MCL_NLEN (1+((MCL_MBITS-1)/MCL_BASEBITS))	/**< Number of words in MCL_BIG. */
@@ -60,6 +61,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 #define P_FEXCESS ((mcl_chunk)1<<(MCL_BASEBITS*MCL_NLEN-P_MCL_MBITS))
 #define P_TBITS (P_MCL_MBITS%MCL_BASEBITS)
 
+#if MCL_MONT_VECTOR && !defined(MCL_DEBUG_NORM)
+#define FF_MONT_VECTOR /**< Exponentiations may use the mcl_mont.h kernels */
+#endif
+
 /* set x = x mod 2^m */
 static void MCL_BIG_mod2m(MCL_BIG x,int m)
 {
@@ -506,26 +511,42 @@ static void FF_karmul_upper(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chun
     FF_rnorm(z,nd2,n);
 }
 
+/* Take k MCL_BIGs from the workspace. Callers give them back by restoring ws->top */
+static mcl_chunk (*FF_take(mcl_ff_ws *ws,int k))[MCL_BS]
+{
+	mcl_chunk (*w)[MCL_BS]=&ws->w[ws->top];
+	ws->top+=k;
+	return w;
+}
+
+void MCL_FF_ws_init(mcl_ff_ws *ws)
+{
+	ws->top=0;
+}
+
 /* z=x*y */
-void MCL_FF_mul(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],int n)
+void MCL_FF_mul_ws(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-#ifndef C99
-	mcl_chunk t[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk t[2*n][MCL_BS];
-#endif
+	int top=ws->top;
+	mcl_chunk (*t)[MCL_BS]=FF_take(ws,2*n);
 	FF_karmul(z,0,x,0,y,0,t,0,n);
+	ws->top=top;
+}
+
+void MCL_FF_mul(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_mul_ws(z,x,y,n,&ws);
 }
 
 /* return low part of product */
-static void FF_lmul(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],int n)
+static void FF_lmul(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-#ifndef C99
-	mcl_chunk t[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk t[2*n][MCL_BS];
-#endif
+	int top=ws->top;
+	mcl_chunk (*t)[MCL_BS]=FF_take(ws,2*n);
 	FF_karmul_lower(z,0,x,0,y,0,t,0,n);
+	ws->top=top;
 }
 
 /* Set b=b mod c */
@@ -555,26 +576,28 @@ void MCL_FF_mod(mcl_chunk b[][MCL_BS],mcl_chunk c[][MCL_BS],int n)
 }
 
 /* z=x^2 */
-void MCL_FF_sqr(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],int n)
+void MCL_FF_sqr_ws(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-#ifndef C99
-	mcl_chunk t[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk t[2*n][MCL_BS];
-#endif
+	int top=ws->top;
+	mcl_chunk (*t)[MCL_BS]=FF_take(ws,2*n);
 	FF_karsqr(z,0,x,0,t,0,n);
+	ws->top=top;
+}
+
+void MCL_FF_sqr(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_sqr_ws(z,x,n,&ws);
 }
 
 /* r=t mod modulus, N is modulus, ND is Montgomery Constant */
-static void FF_reduce(mcl_chunk r[][MCL_BS],mcl_chunk T[][MCL_BS],mcl_chunk N[][MCL_BS],mcl_chunk ND[][MCL_BS],int n)
+static void FF_reduce(mcl_chunk r[][MCL_BS],mcl_chunk T[][MCL_BS],mcl_chunk N[][MCL_BS],mcl_chunk ND[][MCL_BS],int n,mcl_ff_ws *ws)
 { /* fast karatsuba Montgomery reduction */
-#ifndef C99
-	mcl_chunk t[2*MCL_FFLEN][MCL_BS];
-	mcl_chunk m[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk t[2*n][MCL_BS];
-	mcl_chunk m[n][MCL_BS];
-#endif
+	int top=ws->top;
+	mcl_chunk (*t)[MCL_BS]=FF_take(ws,2*n);
+	mcl_chunk (*m)[MCL_BS]=FF_take(ws,n);
+
 	FF_sducopy(r,T,n);  /* keep top half of T */
 	FF_karmul_lower(m,0,T,0,ND,0,t,0,n);  /* m=T.(1/N) mod R */
 
@@ -584,22 +607,19 @@ static void FF_reduce(mcl_chunk r[][MCL_BS],mcl_chunk T[][MCL_BS],mcl_chunk N[][
 	MCL_FF_add(r,r,N,n);
 	MCL_FF_sub(r,r,m,n);
 	MCL_FF_norm(r,n);
+	ws->top=top;
 }
 
 
 /* Set r=a mod b */
 /* a is of length - 2*n */
 /* r,b is of length - n */
-void MCL_FF_dmod(mcl_chunk r[][MCL_BS],mcl_chunk a[][MCL_BS],mcl_chunk b[][MCL_BS],int n)
+void MCL_FF_dmod_ws(mcl_chunk r[][MCL_BS],mcl_chunk a[][MCL_BS],mcl_chunk b[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-	int k; 
-#ifndef C99	
-	mcl_chunk m[2*MCL_FFLEN][MCL_BS];
-	mcl_chunk x[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk m[2*n][MCL_BS];
-	mcl_chunk x[2*n][MCL_BS];
-#endif
+	int k,top=ws->top; 
+	mcl_chunk (*m)[MCL_BS]=FF_take(ws,2*n);
+	mcl_chunk (*x)[MCL_BS]=FF_take(ws,2*n);
+
 	MCL_FF_copy(x,a,2*n);
 	MCL_FF_norm(x,2*n);
 	FF_dsucopy(m,b,n); k=MCL_BIGBITS*n;
@@ -619,17 +639,28 @@ void MCL_FF_dmod(mcl_chunk r[][MCL_BS],mcl_chunk a[][MCL_BS],mcl_chunk b[][MCL_B
 	}
 	MCL_FF_copy(r,x,n);
 	MCL_FF_mod(r,b,n);
+	ws->top=top;
+}
+
+void MCL_FF_dmod(mcl_chunk r[][MCL_BS],mcl_chunk a[][MCL_BS],mcl_chunk b[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_dmod_ws(r,a,b,n,&ws);
 }
 
 /* Set r=1/a mod p. Binary method - a<p on entry */
 
-void MCL_FF_invmodp(mcl_chunk r[][MCL_BS],mcl_chunk a[][MCL_BS],mcl_chunk p[][MCL_BS],int n)
+void MCL_FF_invmodp_ws(mcl_chunk r[][MCL_BS],mcl_chunk a[][MCL_BS],mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-#ifndef C99
-	mcl_chunk u[MCL_FFLEN][MCL_BS],v[MCL_FFLEN][MCL_BS],x1[MCL_FFLEN][MCL_BS],x2[MCL_FFLEN][MCL_BS],t[MCL_FFLEN][MCL_BS],one[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk u[n][MCL_BS],v[n][MCL_BS],x1[n][MCL_BS],x2[n][MCL_BS],t[n][MCL_BS],one[n][MCL_BS];
-#endif
+	int top=ws->top;
+	mcl_chunk (*u)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*v)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*x1)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*x2)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*t)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*one)[MCL_BS]=FF_take(ws,n);
+
 	MCL_FF_copy(u,a,n);
 	MCL_FF_copy(v,p,n);
 	MCL_FF_one(one,n);
@@ -689,43 +720,47 @@ void MCL_FF_invmodp(mcl_chunk r[][MCL_BS],mcl_chunk a[][MCL_BS],mcl_chunk p[][MC
 		MCL_FF_copy(r,x1,n);
 	else
 		MCL_FF_copy(r,x2,n);
+	ws->top=top;
+}
+
+void MCL_FF_invmodp(mcl_chunk r[][MCL_BS],mcl_chunk a[][MCL_BS],mcl_chunk p[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_invmodp_ws(r,a,p,n,&ws);
 }
 
 /* nesidue mod m */
-static void FF_nres(mcl_chunk a[][MCL_BS],mcl_chunk m[][MCL_BS],int n)
+static void FF_nres(mcl_chunk a[][MCL_BS],mcl_chunk m[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-#ifndef C99
-	mcl_chunk d[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk d[2*n][MCL_BS];
-#endif
+	int top=ws->top;
+	mcl_chunk (*d)[MCL_BS]=FF_take(ws,2*n);
 
 	FF_dsucopy(d,a,n);
-	MCL_FF_dmod(a,d,m,n);
+	MCL_FF_dmod_ws(a,d,m,n,ws);
+	ws->top=top;
 }
 
-static void FF_redc(mcl_chunk a[][MCL_BS],mcl_chunk m[][MCL_BS],mcl_chunk ND[][MCL_BS],int n)
+static void FF_redc(mcl_chunk a[][MCL_BS],mcl_chunk m[][MCL_BS],mcl_chunk ND[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-#ifndef C99
-	mcl_chunk d[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk d[2*n][MCL_BS];
-#endif
+	int top=ws->top;
+	mcl_chunk (*d)[MCL_BS]=FF_take(ws,2*n);
+
 	MCL_FF_mod(a,m,n);
 	FF_dscopy(d,a,n);
-	FF_reduce(a,d,m,ND,n);
+	FF_reduce(a,d,m,ND,n,ws);
 	MCL_FF_mod(a,m,n);
+	ws->top=top;
 }
 
 /* U=1/a mod 2^m - Arazi & Qi */
-static void FF_invmod2m(mcl_chunk U[][MCL_BS],mcl_chunk a[][MCL_BS],int n)
+static void FF_invmod2m(mcl_chunk U[][MCL_BS],mcl_chunk a[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-	int i;
-#ifndef C99
-	mcl_chunk t1[MCL_FFLEN][MCL_BS],b[MCL_FFLEN][MCL_BS],c[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk t1[n][MCL_BS],b[n][MCL_BS],c[n][MCL_BS];
-#endif
+	int i,top=ws->top;
+	mcl_chunk (*t1)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*b)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*c)[MCL_BS]=FF_take(ws,n);
+
 	MCL_FF_zero(U,n);
 	MCL_BIG_copy(U[0],a[0]);
 	MCL_BIG_invmod2m(U[0]);
@@ -733,18 +768,19 @@ static void FF_invmod2m(mcl_chunk U[][MCL_BS],mcl_chunk a[][MCL_BS],int n)
 	for (i=1;i<n;i<<=1)
 	{
 		MCL_FF_copy(b,a,i);
-		MCL_FF_mul(t1,U,b,i); MCL_FF_shrw(t1,i); // top half to bottom half, top half=0
+		MCL_FF_mul_ws(t1,U,b,i,ws); MCL_FF_shrw(t1,i); // top half to bottom half, top half=0
 
 		MCL_FF_copy(c,a,2*i); MCL_FF_shrw(c,i); // top half of c
-		FF_lmul(b,U,c,i); // should set top half of b=0
+		FF_lmul(b,U,c,i,ws); // should set top half of b=0
 		MCL_FF_add(t1,t1,b,i);  MCL_FF_norm(t1,2*i);
-		FF_lmul(b,t1,U,i); MCL_FF_copy(t1,b,i);
+		FF_lmul(b,t1,U,i,ws); MCL_FF_copy(t1,b,i);
 		MCL_FF_one(b,i); MCL_FF_shlw(b,i);
 		MCL_FF_sub(t1,b,t1,2*i); MCL_FF_norm(t1,2*i);
 		MCL_FF_shlw(t1,i);
 		MCL_FF_add(U,U,t1,2*i);
 	}
 	MCL_FF_norm(U,n);
+	ws->top=top;
 }
 
 void MCL_FF_random(mcl_chunk x[][MCL_BS],csprng *rng,int n)
@@ -759,28 +795,30 @@ void MCL_FF_random(mcl_chunk x[][MCL_BS],csprng *rng,int n)
 }
 
 /* generate random x mod p */
-void MCL_FF_randomnum(mcl_chunk x[][MCL_BS],mcl_chunk p[][MCL_BS],csprng *rng,int n)
+void MCL_FF_randomnum_ws(mcl_chunk x[][MCL_BS],mcl_chunk p[][MCL_BS],csprng *rng,int n,mcl_ff_ws *ws)
 {
-	int i;
-#ifndef C99
-	mcl_chunk d[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk d[2*n][MCL_BS];
-#endif
+	int i,top=ws->top;
+	mcl_chunk (*d)[MCL_BS]=FF_take(ws,2*n);
+
 	for (i=0;i<2*n;i++)
 	{
 		MCL_BIG_random(d[i],rng);
 	}
-	MCL_FF_dmod(x,d,p,n);
+	MCL_FF_dmod_ws(x,d,p,n,ws);
+	ws->top=top;
 }
 
-static void MCL_FF_modmul(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],mcl_chunk p[][MCL_BS],mcl_chunk ND[][MCL_BS],int n)
+void MCL_FF_randomnum(mcl_chunk x[][MCL_BS],mcl_chunk p[][MCL_BS],csprng *rng,int n)
 {
-#ifndef C99
-	mcl_chunk d[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk d[2*n][MCL_BS];
-#endif
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_randomnum_ws(x,p,rng,n,&ws);
+}
+
+static void MCL_FF_modmul(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],mcl_chunk p[][MCL_BS],mcl_chunk ND[][MCL_BS],int n,mcl_ff_ws *ws)
+{
+	int top=ws->top;
+	mcl_chunk (*d)[MCL_BS]=FF_take(ws,2*n);
 	mcl_chunk ex=P_EXCESS(x[n-1]);
 	mcl_chunk ey=P_EXCESS(y[n-1]);
 	if ((ex+1)*(ey+1)+1>=P_FEXCESS) 
@@ -790,17 +828,15 @@ static void MCL_FF_modmul(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk
 #endif
 		MCL_FF_mod(x,p,n); 
 	}
-	MCL_FF_mul(d,x,y,n);
-	FF_reduce(z,d,p,ND,n);
+	MCL_FF_mul_ws(d,x,y,n,ws);
+	FF_reduce(z,d,p,ND,n,ws);
+	ws->top=top;
 }
 
-static void MCL_FF_modsqr(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk p[][MCL_BS],mcl_chunk ND[][MCL_BS],int n)
+static void MCL_FF_modsqr(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk p[][MCL_BS],mcl_chunk ND[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-#ifndef C99
-	mcl_chunk d[2*MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk d[2*n][MCL_BS];
-#endif
+	int top=ws->top;
+	mcl_chunk (*d)[MCL_BS]=FF_take(ws,2*n);
 	mcl_chunk ex=P_EXCESS(x[n-1]);
 	if ((ex+1)*(ex+1)+1>=P_FEXCESS) 
 	{
@@ -809,160 +845,476 @@ static void MCL_FF_modsqr(mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk
 #endif
 		MCL_FF_mod(x,p,n); 
 	}
-	MCL_FF_sqr(d,x,n);
-	FF_reduce(z,d,p,ND,n);
+	MCL_FF_sqr_ws(d,x,n,ws);
+	FF_reduce(z,d,p,ND,n,ws);
+	ws->top=top;
 }
 
-/* r=x^e mod p using side-channel resistant Montgomery Ladder, for large e */
-void MCL_FF_skpow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk p[][MCL_BS],int n)
+#ifdef FF_MONT_VECTOR
+
+/* add v into w from word k up */
+static void FF_wadd(unsign64 *w,int nw,int k,unsign64 v)
 {
-	int i,b;
-#ifndef C99
-	mcl_chunk R0[MCL_FFLEN][MCL_BS],R1[MCL_FFLEN][MCL_BS],ND[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk R0[n][MCL_BS],R1[n][MCL_BS],ND[n][MCL_BS];
+	for (;k<nw && v!=0;k++)
+	{
+		w[k]+=v;
+		v=(w[k]<v);
+	}
+}
+
+/* w=x as nw little-endian 64-bit words. x must be normalised */
+static void FF_towords(unsign64 *w,int nw,mcl_chunk x[][MCL_BS],int n)
+{
+	int i,j,k,bit,off;
+	unsign64 v;
+	for (k=0;k<nw;k++) w[k]=0;
+	for (i=0;i<n;i++)
+		for (j=0;j<MCL_BS;j++)
+		{
+			v=(unsign64)x[i][j];
+			bit=MCL_BIGBITS*i+MCL_BASEBITS*j;
+			k=bit>>6; off=bit&63;
+			FF_wadd(w,nw,k,v<<off);
+			if (off) FF_wadd(w,nw,k+1,v>>(64-off));
+		}
+}
+
+/* x=w, from nw little-endian 64-bit words */
+static void FF_fromwords(mcl_chunk x[][MCL_BS],int n,const unsign64 *w,int nw)
+{
+	int i,j,k,bit,off,width;
+	unsign64 v;
+	for (i=0;i<n;i++)
+		for (j=0;j<MCL_BS;j++)
+		{
+			bit=MCL_BIGBITS*i+MCL_BASEBITS*j;
+			k=bit>>6; off=bit&63;
+			v=(k<nw)?w[k]>>off:0;
+			if (off && k+1<nw) v|=w[k+1]<<(64-off);
+			width=(j<MCL_BS-1)?MCL_BASEBITS:MCL_BIGBITS-MCL_BASEBITS*(MCL_BS-1);
+			if (i<n-1 || j<MCL_BS-1) v&=((unsign64)1<<width)-1; /* top word of top MCL_BIG takes the rest */
+			x[i][j]=(mcl_chunk)v;
+		}
+}
+
 #endif
-	FF_invmod2m(ND,p,n);	
 
-	MCL_FF_one(R0,n);
-	MCL_FF_copy(R1,x,n);
-	FF_nres(R0,p,n);
-	FF_nres(R1,p,n);
+/* Montgomery arithmetic mod p, through a vector kernel where mcl_mont.h has one for this size,
+   else the karatsuba code above. The kernels have their own R, so residues only mean anything
+   to the context that made them */
+typedef struct
+{
+	mcl_chunk (*p)[MCL_BS];
+	mcl_chunk (*ND)[MCL_BS];
+	int n;
+	mcl_ff_ws *ws;
+#ifdef FF_MONT_VECTOR
+	mcl_mont V;
+#endif
+} FF_mont;
 
-	for (i=8*MCL_MODBYTES*n-1;i>=0;i--)
+/* Takes n MCL_BIGs of ws, for the life of the context */
+static void FF_mont_init(FF_mont *M,mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
+{
+	M->p=p;
+	M->n=n;
+	M->ws=ws;
+	M->ND=FF_take(ws,n);
+#ifdef FF_MONT_VECTOR
+	M->V.kernel=MCL_MONT_SCALAR;
+	if (MCL_MONT_kernel(MCL_BIGBITS*n)!=MCL_MONT_SCALAR)
 	{
-		b=MCL_BIG_bit(e[i/MCL_BIGBITS],i%MCL_BIGBITS);
-		MCL_FF_modmul(r,R0,R1,p,ND,n);
+		unsign64 w[MCL_MONT_WORDS];
+		MCL_FF_norm(p,n);
+		FF_towords(w,MCL_BIGBITS*n/64+1,p,n);
+		if (MCL_MONT_init(&M->V,w,MCL_BIGBITS*n)!=MCL_MONT_SCALAR) return;
+	}
+#endif
+	FF_invmod2m(M->ND,p,n,ws);
+}
 
-		FF_cswap(R0,R1,b,n);
-		MCL_FF_modsqr(R0,R0,p,ND,n);
+#ifdef FF_MONT_VECTOR
+/* z=x.y/R mod p through the kernel, or z=x.w/R mod p if y is NULL */
+static void FF_mont_vmul(FF_mont *M,mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS],const unsign64 *w)
+{
+	unsign64 a[MCL_MONT_WORDS],b[MCL_MONT_WORDS];
+	int n=M->n,nw=M->V.nw;
+	MCL_FF_norm(x,n);
+	FF_towords(a,nw,x,n);
+	if (y==x) MCL_MONT_sqr(&M->V,a,a);
+	else
+	{
+		if (y!=NULL)
+		{
+			MCL_FF_norm(y,n);
+			FF_towords(b,nw,y,n);
+			w=b;
+		}
+		MCL_MONT_mul(&M->V,a,a,w);
+	}
+	FF_fromwords(z,n,a,nw);
+}
+#endif
 
-		MCL_FF_copy(R1,r,n);
-		FF_cswap(R0,R1,b,n);
+/* a=a.R mod p */
+static void FF_mont_nres(FF_mont *M,mcl_chunk a[][MCL_BS])
+{
+#ifdef FF_MONT_VECTOR
+	if (M->V.kernel!=MCL_MONT_SCALAR) {FF_mont_vmul(M,a,a,NULL,M->V.rr); return;}
+#endif
+	FF_nres(a,M->p,M->n,M->ws);
+}
+
+/* a=a/R mod p */
+static void FF_mont_redc(FF_mont *M,mcl_chunk a[][MCL_BS])
+{
+#ifdef FF_MONT_VECTOR
+	if (M->V.kernel!=MCL_MONT_SCALAR)
+	{
+		unsign64 one[MCL_MONT_WORDS]={1};
+		FF_mont_vmul(M,a,a,NULL,one);
+		return;
 	}
-	MCL_FF_copy(r,R0,n);
-	FF_redc(r,p,ND,n);
+#endif
+	FF_redc(a,M->p,M->ND,M->n,M->ws);
 }
 
-/* r=x^e mod p using side-channel resistant Montgomery Ladder, for short e */
-void MCL_FF_skspow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk p[][MCL_BS],int n)
+/* z=x.y/R mod p */
+static void FF_mont_mul(FF_mont *M,mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk y[][MCL_BS])
 {
-	int i,b;
-#ifndef C99
-	mcl_chunk R0[MCL_FFLEN][MCL_BS],R1[MCL_FFLEN][MCL_BS],ND[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk R0[n][MCL_BS],R1[n][MCL_BS],ND[n][MCL_BS];
+#ifdef FF_MONT_VECTOR
+	if (M->V.kernel!=MCL_MONT_SCALAR) {FF_mont_vmul(M,z,x,y,NULL); return;}
+#endif
+	MCL_FF_modmul(z,x,y,M->p,M->ND,M->n,M->ws);
+}
+
+/* z=x^2/R mod p */
+static void FF_mont_sqr(FF_mont *M,mcl_chunk z[][MCL_BS],mcl_chunk x[][MCL_BS])
+{
+#ifdef FF_MONT_VECTOR
+	if (M->V.kernel!=MCL_MONT_SCALAR) {FF_mont_vmul(M,z,x,x,NULL); return;}
 #endif
-	FF_invmod2m(ND,p,n);
+	MCL_FF_modsqr(z,x,M->p,M->ND,M->n,M->ws);
+}
+
+/* a=a.R mod p, with R^2 mod p found from a few doublings and squarings rather than a
+   division. Worth it where the exponent is short. Variable time in p */
+static void FF_mont_fnres(FF_mont *M,mcl_chunk a[][MCL_BS])
+{
+	int i,t,c,s,nb,n=M->n,top=M->ws->top;
+	mcl_chunk (*x)[MCL_BS];
+#ifdef FF_MONT_VECTOR
+	if (M->V.kernel!=MCL_MONT_SCALAR) {FF_mont_nres(M,a); return;}
+#endif
+	x=FF_take(M->ws,n);
+	MCL_FF_norm(M->p,n);
+	for (i=n-1;i>0 && MCL_BIG_iszilch(M->p[i]);i--) ;
+	t=i*MCL_BIGBITS+MCL_BIG_nbits(M->p[i])-1; /* 2^t<p, p being odd and above 1 */
+	nb=MCL_BIGBITS*n;
+	for (s=0;((nb>>s)&1)==0;s++) ;
+	c=nb>>s;
+
+/* x=R.2^c mod p, then square s times to R^2 */
+	MCL_FF_zero(x,n);
+	x[t/MCL_BIGBITS][(t%MCL_BIGBITS)/MCL_BASEBITS]=(mcl_chunk)1<<((t%MCL_BIGBITS)%MCL_BASEBITS);
+	for (;t<nb+c;t++)
+	{
+		MCL_FF_shl(x,n);
+		MCL_FF_norm(x,n);
+		if (MCL_FF_comp(x,M->p,n)>=0)
+		{
+			MCL_FF_sub(x,x,M->p,n);
+			MCL_FF_norm(x,n);
+		}
+	}
+	while (s--) FF_mont_sqr(M,x,x);
+	FF_mont_mul(M,a,a,x);
+	M->ws->top=top;
+}
+
+/* w bits of e from bit i up, bits at or beyond nb read as 0 */
+static int FF_window(mcl_chunk e[][MCL_BS],int i,int w,int nb)
+{
+	int j,k=0;
+	for (j=w-1;j>=0;j--)
+	{
+		k<<=1;
+		if (i+j<nb) k|=MCL_BIG_bit(e[(i+j)/MCL_BIGBITS],(i+j)%MCL_BIGBITS);
+	}
+	return k;
+}
+
+/* t=tab[k], reading every one of the 2^w entries so the access pattern doesn't depend on k */
+static void FF_select(mcl_chunk t[][MCL_BS],mcl_chunk tab[][MCL_BS],int k,int w,int n)
+{
+	int i,j,d;
+	for (i=0;i<(1<<w);i++)
+	{
+		d=(int)(((unsign32)((i^k)-1))>>31); /* 1 if i==k */
+		for (j=0;j<n;j++) MCL_BIG_cmove(t[j],tab[i*n+j],d);
+	}
+}
+
+/* r=x^e mod p for an nb bit e, side channel resistant. Fixed window, so every window
+   costs w squarings and one multiplication, whatever its bits */
+static void FF_skpow_window(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],int nb,mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
+{
+	int i,j,k,w,top=ws->top;
+	mcl_chunk (*acc)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*t)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*tab)[MCL_BS];
+	FF_mont M;
+
+	FF_mont_init(&M,p,n,ws);
+	for (w=MCL_FF_WINDOW;w>1 && ws->top+((1<<w)+6)*n>MCL_FF_WS_BIGS;w--) ;
+	tab=FF_take(ws,n<<w);
+
+/* tab[k]=x^k */
+	MCL_FF_one(tab,n);
+	MCL_FF_copy(&tab[n],x,n);
+	FF_mont_nres(&M,tab);
+	FF_mont_nres(&M,&tab[n]);
+	for (k=2;k<(1<<w);k++) FF_mont_mul(&M,&tab[k*n],&tab[(k-1)*n],&tab[n]);
+
+	j=((nb+w-1)/w-1)*w;
+	FF_select(acc,tab,FF_window(e,j,w,nb),w,n);
+	for (j-=w;j>=0;j-=w)
+	{
+		for (i=0;i<w;i++) FF_mont_sqr(&M,acc,acc);
+		FF_select(t,tab,FF_window(e,j,w,nb),w,n);
+		FF_mont_mul(&M,acc,acc,t);
+	}
+	MCL_FF_copy(r,acc,n);
+	FF_mont_redc(&M,r);
+	ws->top=top;
+}
+
+/* r=x^e mod p, side channel resistant, for large e */
+void MCL_FF_skpow_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
+{
+	FF_skpow_window(r,x,e,8*MCL_MODBYTES*n,p,n,ws);
+}
+
+void MCL_FF_skpow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk p[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_skpow_ws(r,x,e,p,n,&ws);
+}
+
+/* r=x^e mod p using side-channel resistant Montgomery Ladder, for large e. Needs the least workspace */
+void MCL_FF_skpow_ladder_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
+{
+	int i,b,top=ws->top;
+	mcl_chunk (*R0)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*R1)[MCL_BS]=FF_take(ws,n);
+	FF_mont M;
+
+	FF_mont_init(&M,p,n,ws);
+
 	MCL_FF_one(R0,n);
 	MCL_FF_copy(R1,x,n);
-	FF_nres(R0,p,n);
-	FF_nres(R1,p,n);
-	for (i=8*MCL_MODBYTES-1;i>=0;i--)
+	FF_mont_nres(&M,R0);
+	FF_mont_nres(&M,R1);
+
+	for (i=8*MCL_MODBYTES*n-1;i>=0;i--)
 	{
-		b=MCL_BIG_bit(e,i);
-		MCL_FF_modmul(r,R0,R1,p,ND,n);
+		b=MCL_BIG_bit(e[i/MCL_BIGBITS],i%MCL_BIGBITS);
+		FF_mont_mul(&M,r,R0,R1);
+
 		FF_cswap(R0,R1,b,n);
-		MCL_FF_modsqr(R0,R0,p,ND,n);
+		FF_mont_sqr(&M,R0,R0);
+
 		MCL_FF_copy(R1,r,n);
 		FF_cswap(R0,R1,b,n);
 	}
 	MCL_FF_copy(r,R0,n);
-	FF_redc(r,p,ND,n);
+	FF_mont_redc(&M,r);
+	ws->top=top;
+}
+
+void MCL_FF_skpow_ladder(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk p[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_skpow_ladder_ws(r,x,e,p,n,&ws);
+}
+
+/* r=x^e mod p, side channel resistant, for short e */
+void MCL_FF_skspow_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
+{
+	FF_skpow_window(r,x,(mcl_chunk (*)[MCL_BS])e,8*MCL_MODBYTES,p,n,ws);
+}
+
+void MCL_FF_skspow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk p[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_skspow_ws(r,x,e,p,n,&ws);
 }
 
 /* raise to an integer power - right-to-left method */
-void MCL_FF_power(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk p[][MCL_BS],int n)
+void MCL_FF_power_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-	int f=1;
-#ifndef C99
-	mcl_chunk w[MCL_FFLEN][MCL_BS],ND[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk w[n][MCL_BS],ND[n][MCL_BS];
-#endif
-	FF_invmod2m(ND,p,n);
+	int f=1,top=ws->top;
+	mcl_chunk (*w)[MCL_BS]=FF_take(ws,n);
+	FF_mont M;
+
+	FF_mont_init(&M,p,n,ws);
 
 	MCL_FF_copy(w,x,n);
-	FF_nres(w,p,n);
+	FF_mont_nres(&M,w);
 
 	if (e==2)
 	{
-		MCL_FF_modsqr(r,w,p,ND,n);
+		FF_mont_sqr(&M,r,w);
 	}
 	else for (;;)
 	{
 		if (e%2==1) 
 		{
 			if (f) MCL_FF_copy(r,w,n);
-			else MCL_FF_modmul(r,r,w,p,ND,n);
+			else FF_mont_mul(&M,r,r,w);
 			f=0;
 		}
 		e>>=1;
 		if (e==0) break;
-		MCL_FF_modsqr(w,w,p,ND,n);
+		FF_mont_sqr(&M,w,w);
 	}
 
-	FF_redc(r,p,ND,n);
+	FF_mont_redc(&M,r);
+	ws->top=top;
 }
 
-/* r=x^e mod p, faster but not side channel resistant */
-void MCL_FF_pow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk p[][MCL_BS],int n)
+void MCL_FF_power(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk p[][MCL_BS],int n)
 {
-	int i,b;
-#ifndef C99
-	mcl_chunk w[MCL_FFLEN][MCL_BS],ND[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk w[n][MCL_BS],ND[n][MCL_BS];
-#endif
-	FF_invmod2m(ND,p,n);
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_power_ws(r,x,e,p,n,&ws);
+}
+
+/* r=x^e mod p for a public integer e, such as an RSA public exponent. Not side channel
+   resistant. Left-to-right, and x goes into the Montgomery domain without a division */
+void MCL_FF_pubpow_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
+{
+	int i,top=ws->top;
+	mcl_chunk (*w)[MCL_BS]=FF_take(ws,n);
+	FF_mont M;
+
+	FF_mont_init(&M,p,n,ws);
 	MCL_FF_copy(w,x,n);
-	MCL_FF_one(r,n);
-	FF_nres(r,p,n);
-	FF_nres(w,p,n);
+	FF_mont_fnres(&M,w);
+	MCL_FF_copy(r,w,n);
+	for (i=30;i>=0 && (e>>i)!=1;i--) ;
+	for (i--;i>=0;i--)
+	{
+		FF_mont_sqr(&M,r,r);
+		if ((e>>i)&1) FF_mont_mul(&M,r,r,w);
+	}
+	FF_mont_redc(&M,r);
+	ws->top=top;
+}
 
-	for (i=8*MCL_MODBYTES*n-1;i>=0;i--)
+void MCL_FF_pubpow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],int e,mcl_chunk p[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_pubpow_ws(r,x,e,p,n,&ws);
+}
+
+/* r=x^e mod p, faster but not side channel resistant. Sliding window over the odd powers */
+void MCL_FF_pow_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
+{
+	int i,j,k,w,nb,f=1,top=ws->top;
+	mcl_chunk (*x2)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*tab)[MCL_BS];
+	FF_mont M;
+
+	FF_mont_init(&M,p,n,ws);
+	for (w=MCL_FF_WINDOW;w>1 && ws->top+((1<<(w-1))+6)*n>MCL_FF_WS_BIGS;w--) ;
+	tab=FF_take(ws,n<<(w-1));
+
+/* tab[k]=x^(2k+1) */
+	MCL_FF_copy(tab,x,n);
+	FF_mont_nres(&M,tab);
+	FF_mont_sqr(&M,x2,tab);
+	for (k=1;k<(1<<(w-1));k++) FF_mont_mul(&M,&tab[k*n],&tab[(k-1)*n],x2);
+
+	nb=8*MCL_MODBYTES*n;
+	for (i=nb-1;i>=0;)
 	{
-		MCL_FF_modsqr(r,r,p,ND,n);
-		b=MCL_BIG_bit(e[i/MCL_BIGBITS],i%MCL_BIGBITS);
-		if (b==1) MCL_FF_modmul(r,r,w,p,ND,n);
+		if (MCL_BIG_bit(e[i/MCL_BIGBITS],i%MCL_BIGBITS)==0)
+		{
+			if (!f) FF_mont_sqr(&M,r,r);
+			i--;
+			continue;
+		}
+/* widest window from bit i down to a set bit j, no more than w bits */
+		for (j=(i>=w-1)?i-w+1:0;MCL_BIG_bit(e[j/MCL_BIGBITS],j%MCL_BIGBITS)==0;j++) ;
+		k=FF_window(e,j,i-j+1,nb);
+		if (f) MCL_FF_copy(r,&tab[(k>>1)*n],n);
+		else
+		{
+			for (;i>=j;i--) FF_mont_sqr(&M,r,r);
+			FF_mont_mul(&M,r,r,&tab[(k>>1)*n]);
+		}
+		f=0;
+		i=j-1;
 	}
-	FF_redc(r,p,ND,n);
+	if (f) MCL_FF_one(r,n);
+	else FF_mont_redc(&M,r);
+	ws->top=top;
+}
+
+void MCL_FF_pow(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],mcl_chunk e[][MCL_BS],mcl_chunk p[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_pow_ws(r,x,e,p,n,&ws);
 }
 
 /* double exponentiation r=x^e.y^f mod p */
-void MCL_FF_pow2(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk y[][MCL_BS],MCL_BIG f,mcl_chunk p[][MCL_BS],int n)
+void MCL_FF_pow2_ws(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk y[][MCL_BS],MCL_BIG f,mcl_chunk p[][MCL_BS],int n,mcl_ff_ws *ws)
 {
-	int i,eb,fb;
-#ifndef C99
-	mcl_chunk xn[MCL_FFLEN][MCL_BS],yn[MCL_FFLEN][MCL_BS],xy[MCL_FFLEN][MCL_BS],ND[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk xn[n][MCL_BS],yn[n][MCL_BS],xy[n][MCL_BS],ND[n][MCL_BS];
-#endif
-	FF_invmod2m(ND,p,n);
+	int i,eb,fb,top=ws->top;
+	mcl_chunk (*xn)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*yn)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*xy)[MCL_BS]=FF_take(ws,n);
+	FF_mont M;
+
+	FF_mont_init(&M,p,n,ws);
 	MCL_FF_copy(xn,x,n);
 	MCL_FF_copy(yn,y,n);
-	FF_nres(xn,p,n);
-	FF_nres(yn,p,n);
-	MCL_FF_modmul(xy,xn,yn,p,ND,n);
+	FF_mont_nres(&M,xn);
+	FF_mont_nres(&M,yn);
+	FF_mont_mul(&M,xy,xn,yn);
 	MCL_FF_one(r,n);
-	FF_nres(r,p,n);
+	FF_mont_nres(&M,r);
 
 	for (i=8*MCL_MODBYTES-1;i>=0;i--)
 	{
 		eb=MCL_BIG_bit(e,i);
 		fb=MCL_BIG_bit(f,i);
-		MCL_FF_modsqr(r,r,p,ND,n);
+		FF_mont_sqr(&M,r,r);
 		if (eb==1)
 		{
-			if (fb==1) MCL_FF_modmul(r,r,xy,p,ND,n);
-			else MCL_FF_modmul(r,r,xn,p,ND,n);
+			if (fb==1) FF_mont_mul(&M,r,r,xy);
+			else FF_mont_mul(&M,r,r,xn);
 		}
 		else
 		{
-			if (fb==1) MCL_FF_modmul(r,r,yn,p,ND,n);
+			if (fb==1) FF_mont_mul(&M,r,r,yn);
 		}
 	}
-	FF_redc(r,p,ND,n);
+	FF_mont_redc(&M,r);
+	ws->top=top;
+}
+
+void MCL_FF_pow2(mcl_chunk r[][MCL_BS],mcl_chunk x[][MCL_BS],MCL_BIG e,mcl_chunk y[][MCL_BS],MCL_BIG f,mcl_chunk p[][MCL_BS],int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	MCL_FF_pow2_ws(r,x,e,y,f,p,n,&ws);
 }
 
 static sign32 igcd(sign32 x,sign32 y)
@@ -975,15 +1327,13 @@ static sign32 igcd(sign32 x,sign32 y)
 }
 
 /* quick and dirty check for common factor with s */
-int MCL_FF_cfactor(mcl_chunk w[][MCL_BS],sign32 s,int n)
+int MCL_FF_cfactor_ws(mcl_chunk w[][MCL_BS],sign32 s,int n,mcl_ff_ws *ws)
 {
-	int r;
+	int r,top=ws->top;
 	sign32 g;
-#ifndef C99
-	mcl_chunk x[MCL_FFLEN][MCL_BS],y[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk x[n][MCL_BS],y[n][MCL_BS];
-#endif
+	mcl_chunk (*x)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*y)[MCL_BS]=FF_take(ws,n);
+
 	MCL_FF_init(y,s,n);
 	MCL_FF_copy(x,w,n);
 	MCL_FF_norm(x,n);
@@ -1001,28 +1351,36 @@ int MCL_FF_cfactor(mcl_chunk w[][MCL_BS],sign32 s,int n)
 #else
 	g=(sign32)x[0][0];
 #endif
+	ws->top=top;
 	r=igcd(s,g);
 //printf("r= %d\n",r);
 	if (r>1) return 1;
 	return 0;
 }
 
-/* Miller-Rabin test for primality. Slow. */
-int MCL_FF_prime(mcl_chunk p[][MCL_BS],csprng *rng,int n)
+int MCL_FF_cfactor(mcl_chunk w[][MCL_BS],sign32 s,int n)
 {
-	int i,j,loop,s=0;
-#ifndef C99
-	mcl_chunk d[MCL_FFLEN][MCL_BS],x[MCL_FFLEN][MCL_BS],unity[MCL_FFLEN][MCL_BS],nm1[MCL_FFLEN][MCL_BS];
-#else
-	mcl_chunk d[n][MCL_BS],x[n][MCL_BS],unity[n][MCL_BS],nm1[n][MCL_BS];
-#endif
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	return MCL_FF_cfactor_ws(w,s,n,&ws);
+}
+
+/* Miller-Rabin test for primality, in the Montgomery domain throughout. Slow. */
+int MCL_FF_prime_rounds_ws(mcl_chunk p[][MCL_BS],csprng *rng,int rounds,int n,mcl_ff_ws *ws)
+{
+	int i,j,k,w,f,loop,nb,s=0,top=ws->top,r=1;
+	mcl_chunk (*d)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*nm1)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*y)[MCL_BS]=FF_take(ws,n);
+	mcl_chunk (*tab)[MCL_BS];
+	FF_mont M;
 	sign32 sf=4849845;/* 3*5*.. *19 */
 
 	MCL_FF_norm(p,n);
-	if (MCL_FF_cfactor(p,sf,n)) return 0;
+	if (MCL_FF_cfactor_ws(p,sf,n,ws)) {r=0; goto out;}
 
-	MCL_FF_one(unity,n);
-	MCL_FF_sub(nm1,p,unity,n);
+	MCL_FF_one(y,n);
+	MCL_FF_sub(nm1,p,y,n);
 	MCL_FF_norm(nm1,n);
 	MCL_FF_copy(d,nm1,n);
 
@@ -1031,26 +1389,81 @@ int MCL_FF_prime(mcl_chunk p[][MCL_BS],csprng *rng,int n)
 		MCL_FF_shr(d,n);
 		s++;
 	}
-	if (s==0) return 0;
-
-	for (i=0;i<10;i++)
+	if (s==0) {r=0; goto out;}
+
+/* Montgomery context, once per candidate. tab[k] holds x^k, tab[0] is unity,
+   all as Montgomery residues. Narrow the window if the workspace is short */
+	FF_mont_init(&M,p,n,ws);
+	for (w=MCL_FF_WINDOW;w>1 && ws->top+((1<<w)+6)*n>MCL_FF_WS_BIGS;w--) ;
+	tab=FF_take(ws,n<<w);
+	MCL_FF_one(tab,n);
+	FF_mont_nres(&M,tab);
+	FF_mont_nres(&M,nm1);
+	nb=8*MCL_MODBYTES*n;
+
+	for (i=0;i<rounds;i++)
 	{
-		MCL_FF_randomnum(x,p,rng,n);
-		MCL_FF_pow(x,x,d,p,n);
+		MCL_FF_randomnum_ws(&tab[n],p,rng,n,ws);
+		FF_mont_nres(&M,&tab[n]);
+		for (k=2;k<(1<<w);k++) FF_mont_mul(&M,&tab[k*n],&tab[(k-1)*n],&tab[n]);
+
+/* y=x^d, fixed window from the top. d is odd, so y is always set */
+		f=1;
+		for (j=((nb+w-1)/w-1)*w;j>=0;j-=w)
+		{
+			if (!f) for (k=0;k<w;k++) FF_mont_sqr(&M,y,y);
+			k=FF_window(d,j,w,nb);
+			if (k==0) continue;
+			if (f) MCL_FF_copy(y,&tab[k*n],n);
+			else FF_mont_mul(&M,y,y,&tab[k*n]);
+			f=0;
+		}
+		MCL_FF_mod(y,p,n);
 
-		if (MCL_FF_comp(x,unity,n)==0 || MCL_FF_comp(x,nm1,n)==0) continue;
+		if (MCL_FF_comp(y,tab,n)==0 || MCL_FF_comp(y,nm1,n)==0) continue;
 		loop=0;
 		for (j=1;j<s;j++)
 		{
-			MCL_FF_power(x,x,2,p,n);
-			if (MCL_FF_comp(x,unity,n)==0) return 0;
-			if (MCL_FF_comp(x,nm1,n)==0 ) {loop=1; break;}
+			FF_mont_sqr(&M,y,y);
+			MCL_FF_mod(y,p,n);
+			if (MCL_FF_comp(y,tab,n)==0) {r=0; goto out;}
+			if (MCL_FF_comp(y,nm1,n)==0) {loop=1; break;}
 		}
 		if (loop) continue;
-		return 0;
+		r=0;
+		break;
 	}
+out:
+	ws->top=top;
+	return r;
+}
 
-	return 1;
+int MCL_FF_prime_rounds(mcl_chunk p[][MCL_BS],csprng *rng,int rounds,int n)
+{
+	mcl_ff_ws ws;
+	MCL_FF_ws_init(&ws);
+	return MCL_FF_prime_rounds_ws(p,rng,rounds,n,&ws);
+}
+
+int MCL_FF_prime_ws(mcl_chunk p[][MCL_BS],csprng *rng,int n,mcl_ff_ws *ws)
+{
+	return MCL_FF_prime_rounds_ws(p,rng,MCL_FF_PRIME_ROUNDS,n,ws);
+}
+
+int MCL_FF_prime(mcl_chunk p[][MCL_BS],csprng *rng,int n)
+{
+	return MCL_FF_prime_rounds(p,rng,MCL_FF_PRIME_ROUNDS,n);
+}
+
+/* Fewest rounds FIPS 186-4 Table C.3 allows for random RSA primes of n MCL_BIGs,
+   after trial division and with no Lucas test */
+int MCL_FF_prime_fips_rounds(int n)
+{
+	int bits=MCL_BIGBITS*n;
+	if (bits>=1536) return 4;
+	if (bits>=1024) return 5;
+	if (bits>=512) return 7;
+	return MCL_FF_PRIME_ROUNDS;
 }
 
 /*
@@ -93,6 +93,129 @@ static void precompute(mcl_gcm *g,uchar *H)
 	}
 }
 
+#if MCL_AES_X86
+
+#include <immintrin.h>
+
+/* GHASH by carry-less multiplication, after Gueron & Kounavis, "Intel
+   Carry-Less Multiplication Instruction and its Usage for Computing the GCM
+   Mode", 2010. Blocks are byte reversed, so a field element is a bit reflected
+   128-bit integer; products are shifted left a bit before reduction. Four
+   blocks are hashed with H^4..H and share one reduction. */
+
+#define NI __attribute__((target("aes,pclmul,ssse3")))
+#define INLINE static inline __attribute__((always_inline))
+
+NI INLINE __m128i bswap(__m128i x)
+{
+	return _mm_shuffle_epi8(x,_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15));
+}
+
+NI INLINE __m128i load(const void *b)
+{
+	return _mm_loadu_si128((const __m128i *)b);
+}
+
+/* lo, mid and hi accumulate the unreduced product a.b */
+NI INLINE void clmul(__m128i a,__m128i b,__m128i *lo,__m128i *mid,__m128i *hi)
+{
+	*lo=_mm_xor_si128(*lo,_mm_clmulepi64_si128(a,b,0x00));
+	*hi=_mm_xor_si128(*hi,_mm_clmulepi64_si128(a,b,0x11));
+	*mid=_mm_xor_si128(*mid,_mm_xor_si128(_mm_clmulepi64_si128(a,b,0x10),_mm_clmulepi64_si128(a,b,0x01)));
+}
+
+NI INLINE __m128i reduce(__m128i lo,__m128i mid,__m128i hi)
+{
+	__m128i t2,t3,t4,t5,t6,t7,t8,t9;
+	t3=_mm_xor_si128(lo,_mm_slli_si128(mid,8));
+	t6=_mm_xor_si128(hi,_mm_srli_si128(mid,8));
+/* shift the 256-bit product left one bit */
+	t7=_mm_srli_epi32(t3,31); t8=_mm_srli_epi32(t6,31);
+	t3=_mm_slli_epi32(t3,1); t6=_mm_slli_epi32(t6,1);
+	t9=_mm_srli_si128(t7,12); t8=_mm_slli_si128(t8,4); t7=_mm_slli_si128(t7,4);
+	t3=_mm_or_si128(t3,t7); t6=_mm_or_si128(_mm_or_si128(t6,t8),t9);
+/* reduce modulo x^128+x^7+x^2+x+1 */
+	t7=_mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(t3,31),_mm_slli_epi32(t3,30)),_mm_slli_epi32(t3,25));
+	t8=_mm_srli_si128(t7,4); t7=_mm_slli_si128(t7,12);
+	t3=_mm_xor_si128(t3,t7);
+	t2=_mm_srli_epi32(t3,1); t4=_mm_srli_epi32(t3,2); t5=_mm_srli_epi32(t3,7);
+	t2=_mm_xor_si128(_mm_xor_si128(t2,t4),_mm_xor_si128(t5,t8));
+	return _mm_xor_si128(t6,_mm_xor_si128(t3,t2));
+}
+
+NI static void clmul_precompute(mcl_gcm *g,uchar *H)
+{ /* H, H^2, H^3, H^4 */
+	int i;
+	__m128i h=bswap(load(H)),p=h,lo,mid,hi;
+	_mm_storeu_si128((__m128i *)g->hpow[0],h);
+	for (i=1;i<4;i++)
+	{
+		lo=mid=hi=_mm_setzero_si128();
+		clmul(p,h,&lo,&mid,&hi);
+		p=reduce(lo,mid,hi);
+		_mm_storeu_si128((__m128i *)g->hpow[i],p);
+	}
+}
+
+NI static void clmul_gf2mul(mcl_gcm *g)
+{ /* X=H*X */
+	__m128i lo,mid,hi;
+	lo=mid=hi=_mm_setzero_si128();
+	clmul(bswap(load(g->stateX)),load(g->hpow[0]),&lo,&mid,&hi);
+	_mm_storeu_si128((__m128i *)g->stateX,bswap(reduce(lo,mid,hi)));
+}
+
+NI static void clmul_ghash4(mcl_gcm *g,const char *c)
+{ /* X=(X+C1)H^4+C2.H^3+C3.H^2+C4.H */
+	__m128i lo,mid,hi;
+	lo=mid=hi=_mm_setzero_si128();
+	clmul(bswap(_mm_xor_si128(load(g->stateX),load(c))),load(g->hpow[3]),&lo,&mid,&hi);
+	clmul(bswap(load(c+16)),load(g->hpow[2]),&lo,&mid,&hi);
+	clmul(bswap(load(c+32)),load(g->hpow[1]),&lo,&mid,&hi);
+	clmul(bswap(load(c+48)),load(g->hpow[0]),&lo,&mid,&hi);
+	_mm_storeu_si128((__m128i *)g->stateX,bswap(reduce(lo,mid,hi)));
+}
+
+NI static void ni_ctr4(mcl_gcm *g,uchar *B)
+{ /* encrypt four counter blocks, interleaved to keep the AES unit busy */
+	int i;
+	const __m128i *k=(const __m128i *)g->a.fkey;
+	__m128i r=load(k),s0,s1,s2,s3;
+	s0=_mm_xor_si128(load(B),r); s1=_mm_xor_si128(load(B+16),r);
+	s2=_mm_xor_si128(load(B+32),r); s3=_mm_xor_si128(load(B+48),r);
+	for (i=1;i<g->a.Nr;i++)
+	{
+		r=load(k+i);
+		s0=_mm_aesenc_si128(s0,r); s1=_mm_aesenc_si128(s1,r);
+		s2=_mm_aesenc_si128(s2,r); s3=_mm_aesenc_si128(s3,r);
+	}
+	r=load(k+g->a.Nr);
+	_mm_storeu_si128((__m128i *)B,_mm_aesenclast_si128(s0,r));
+	_mm_storeu_si128((__m128i *)(B+16),_mm_aesenclast_si128(s1,r));
+	_mm_storeu_si128((__m128i *)(B+32),_mm_aesenclast_si128(s2,r));
+	_mm_storeu_si128((__m128i *)(B+48),_mm_aesenclast_si128(s3,r));
+}
+
+static void counters4(mcl_gcm *g,uchar *B)
+{ /* next four counter blocks */
+	int i,k;
+	unsign32 counter;
+	for (k=0;k<4;k++)
+	{
+		counter=pack((uchar *)&(g->a.f[12]));
+		counter++;
+		unpack(counter,(uchar *)&(g->a.f[12]));
+		for (i=0;i<16;i++) B[16*k+i]=g->a.f[i];
+	}
+}
+
+static void addlen(unsign32 *len,unsign32 n)
+{
+	len[1]+=n; if (len[1]<n) len[0]++;
+}
+
+#endif
+
 /* SU= 32 */
 static void gf2mul(mcl_gcm *g)
 { /* gf2m mul - Z=H*X mod 2^128 */
@@ -100,6 +223,13 @@ static void gf2mul(mcl_gcm *g)
 	unsign32 P[4];
 	uchar b;
 
+#if MCL_AES_X86
+	if (g->a.kernel==MCL_AES_NI)
+	{
+		clmul_gf2mul(g);
+		return;
+	}
+#endif
 	P[0]=P[1]=P[2]=P[3]=0;
 	j=8; m=0;
 	for (i=0;i<128;i++)
@@ -162,6 +292,10 @@ void MCL_GCM_init(mcl_gcm* g,int nk,char *key,int niv,char *iv)
 
 	MCL_AES_init(&(g->a),ECB,nk,key,iv);
 	MCL_AES_ecb_encrypt(&(g->a),H);     /* E(K,0) */
+#if MCL_AES_X86
+	if (g->a.kernel==MCL_AES_NI) clmul_precompute(g,H);
+	else
+#endif
 	precompute(g,H);
 	
 	g->lenA[0]=g->lenC[0]=g->lenA[1]=g->lenC[1]=0;
@@ -189,6 +323,13 @@ int MCL_GCM_add_header(mcl_gcm* g,char *header,int len)
 	int i,j=0;
 	if (g->status!=MCL_GCM_ACCEPTING_HEADER) return 0;
 
+#if MCL_AES_X86
+	if (g->a.kernel==MCL_AES_NI)
+	{
+		for (;len-j>=64;j+=64) clmul_ghash4(g,&header[j]);
+		addlen(g->lenA,(unsign32)j);
+	}
+#endif
 	while (j<len)
 	{
 		for (i=0;i<16 && j<len;i++)
@@ -212,6 +353,20 @@ int MCL_GCM_add_plain(mcl_gcm *g,char *cipher,char *plain,int len)
 	if (g->status==MCL_GCM_ACCEPTING_HEADER) g->status=MCL_GCM_ACCEPTING_CIPHER;
 	if (g->status!=MCL_GCM_ACCEPTING_CIPHER) return 0;
 
+#if MCL_AES_X86
+	if (g->a.kernel==MCL_AES_NI)
+	{
+		uchar B4[64];
+		for (;len-j>=64;j+=64)
+		{
+			counters4(g,B4);
+			ni_ctr4(g,B4);
+			for (i=0;i<64;i++) cipher[j+i]=plain[j+i]^B4[i];
+			clmul_ghash4(g,&cipher[j]);
+		}
+		addlen(g->lenC,(unsign32)j);
+	}
+#endif
 	while (j<len)
 	{
 		counter=pack((uchar *)&(g->a.f[12]));
@@ -242,6 +397,20 @@ int MCL_GCM_add_cipher(mcl_gcm *g,char *plain,char *cipher,int len)
 	if (g->status==MCL_GCM_ACCEPTING_HEADER) g->status=MCL_GCM_ACCEPTING_CIPHER;
 	if (g->status!=MCL_GCM_ACCEPTING_CIPHER) return 0;
 
+#if MCL_AES_X86
+	if (g->a.kernel==MCL_AES_NI)
+	{
+		uchar B4[64];
+		for (;len-j>=64;j+=64)
+		{
+			clmul_ghash4(g,&cipher[j]); /* before plain can overwrite it */
+			counters4(g,B4);
+			ni_ctr4(g,B4);
+			for (i=0;i<64;i++) plain[j+i]=cipher[j+i]^B4[i];
+		}
+		addlen(g->lenC,(unsign32)j);
+	}
+#endif
 	while (j<len)
 	{
 		counter=pack((uchar *)&(g->a.f[12]));
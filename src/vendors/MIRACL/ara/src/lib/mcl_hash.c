@@ -52,6 +52,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 
 #include "mcl_arch.h"
 #include "mcl_hash.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(MCL_BUILD_ARM)
+#define MCL_HASH_X86
+#include <immintrin.h>
+#endif
 
 #define FIX
 
@@ -215,31 +221,145 @@ static const unsign32 K_256[64]={
 
 
 
-/* SU= 72 */
-static void MCL_HASH256_transform(mcl_hash256 *sh)
-{ /* basic transformation step */
+/* Portable block compression: process nblocks 64-byte blocks into h[] */
+/* SU= 300 */
+static void sha256_blocks_scalar(unsign32 *hh,const uchar *data,int nblocks)
+{
     unsign32 a,b,c,d,e,f,g,h,t1,t2;
+    unsign32 w[64];
     int j;
-    for (j=16;j<64;j++) 
-        sh->w[j]=theta1_256(sh->w[j-2])+sh->w[j-7]+theta0_256(sh->w[j-15])+sh->w[j-16];
 
-    a=sh->h[0]; b=sh->h[1]; c=sh->h[2]; d=sh->h[3]; 
-    e=sh->h[4]; f=sh->h[5]; g=sh->h[6]; h=sh->h[7];
+    while (nblocks-- > 0)
+    {
+        for (j=0;j<16;j++)
+            w[j]=((unsign32)data[4*j]<<24)|((unsign32)data[4*j+1]<<16)|
+                 ((unsign32)data[4*j+2]<<8)|(unsign32)data[4*j+3];
+        for (j=16;j<64;j++) 
+            w[j]=theta1_256(w[j-2])+w[j-7]+theta0_256(w[j-15])+w[j-16];
+        a=hh[0]; b=hh[1]; c=hh[2]; d=hh[3]; 
+        e=hh[4]; f=hh[5]; g=hh[6]; h=hh[7];
+        for (j=0;j<64;j++)
+        { /* 64 times - mush it up */
+            t1=h+Sig1_256(e)+Ch(e,f,g)+K_256[j]+w[j];
+            t2=Sig0_256(a)+Maj(a,b,c);
+            h=g; g=f; f=e;
+            e=d+t1;
+            d=c;
+            c=b;
+            b=a;
+            a=t1+t2;        
+        }
+        hh[0]+=a; hh[1]+=b; hh[2]+=c; hh[3]+=d; 
+        hh[4]+=e; hh[5]+=f; hh[6]+=g; hh[7]+=h; 
+        data+=64;
+    }
+}
 
-    for (j=0;j<64;j++)
-    { /* 64 times - mush it up */
-        t1=h+Sig1_256(e)+Ch(e,f,g)+K_256[j]+sh->w[j];
-        t2=Sig0_256(a)+Maj(a,b,c);
-        h=g; g=f; f=e;
-        e=d+t1;
-        d=c;
-        c=b;
-        b=a;
-        a=t1+t2;        
+#ifdef MCL_HASH_X86
+/* Intel SHA extensions block compression */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_blocks_shani(unsign32 *hh,const uchar *data,int nblocks)
+{
+    const __m128i MASK=_mm_set_epi64x(0x0c0d0e0f08090a0bULL,0x0405060700010203ULL);
+    __m128i STATE0,STATE1,ABEF_SAVE,CDGH_SAVE,MSG,TMP;
+    __m128i W[4];
+    int i;
+
+    /* Load the state, rearranged into the ABEF/CDGH order the rounds use */
+    TMP=_mm_loadu_si128((const __m128i *)&hh[0]);
+    STATE1=_mm_loadu_si128((const __m128i *)&hh[4]);
+    TMP=_mm_shuffle_epi32(TMP,0xB1);           /* CDAB */
+    STATE1=_mm_shuffle_epi32(STATE1,0x1B);     /* EFGH */
+    STATE0=_mm_alignr_epi8(TMP,STATE1,8);      /* ABEF */
+    STATE1=_mm_blend_epi16(STATE1,TMP,0xF0);   /* CDGH */
+
+    while (nblocks-- > 0)
+    {
+        ABEF_SAVE=STATE0;
+        CDGH_SAVE=STATE1;
+
+        for (i=0;i<4;i++)
+            W[i]=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data+16*i)),MASK);
+
+        /* 16 groups of 4 rounds; W[] is a ring of the last 16 schedule words */
+        for (i=0;i<16;i++)
+        {
+            MSG=_mm_add_epi32(W[i&3],_mm_loadu_si128((const __m128i *)&K_256[4*i]));
+            STATE1=_mm_sha256rnds2_epu32(STATE1,STATE0,MSG);
+            if (i<12)
+            { /* W[4i+16..4i+19] */
+                TMP=_mm_alignr_epi8(W[(i+3)&3],W[(i+2)&3],4);
+                W[i&3]=_mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(W[i&3],W[(i+1)&3]),TMP),W[(i+3)&3]);
+            }
+            MSG=_mm_shuffle_epi32(MSG,0x0E);
+            STATE0=_mm_sha256rnds2_epu32(STATE0,STATE1,MSG);
+        }
+
+        STATE0=_mm_add_epi32(STATE0,ABEF_SAVE);
+        STATE1=_mm_add_epi32(STATE1,CDGH_SAVE);
+        data+=64;
     }
 
-    sh->h[0]+=a; sh->h[1]+=b; sh->h[2]+=c; sh->h[3]+=d; 
-    sh->h[4]+=e; sh->h[5]+=f; sh->h[6]+=g; sh->h[7]+=h; 
+    /* Back to ABCD/EFGH order */
+    TMP=_mm_shuffle_epi32(STATE0,0x1B);        /* FEBA */
+    STATE1=_mm_shuffle_epi32(STATE1,0xB1);     /* DCHG */
+    STATE0=_mm_blend_epi16(TMP,STATE1,0xF0);   /* DCBA */
+    STATE1=_mm_alignr_epi8(STATE1,TMP,8);      /* HGFE */
+    _mm_storeu_si128((__m128i *)&hh[0],STATE0);
+    _mm_storeu_si128((__m128i *)&hh[4],STATE1);
+}
+#endif
+
+/* Kernel in use, resolved by MCL_HASH256_kernel or else on first use */
+static int sha256_kernel=MCL_HASH_KERNEL_AUTO;
+
+static int sha256_best_kernel(void)
+{
+#ifdef MCL_HASH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+        return MCL_HASH_KERNEL_SHANI;
+#endif
+    return MCL_HASH_KERNEL_SCALAR;
+}
+
+int MCL_HASH256_kernel(int kernel)
+{
+    int best=sha256_best_kernel();
+
+    if (kernel==MCL_HASH_KERNEL_AUTO || kernel>best) kernel=best;
+    sha256_kernel=kernel;
+    return sha256_kernel;
+}
+
+/* Compress whole blocks with the selected kernel */
+static void sha256_blocks(unsign32 *hh,const uchar *data,int nblocks)
+{
+    if (sha256_kernel==MCL_HASH_KERNEL_AUTO) sha256_kernel=sha256_best_kernel();
+#ifdef MCL_HASH_X86
+    if (sha256_kernel==MCL_HASH_KERNEL_SHANI)
+    {
+        sha256_blocks_shani(hh,data,nblocks);
+        return;
+    }
+#endif
+    sha256_blocks_scalar(hh,data,nblocks);
+}
+
+/* SU= 72 */
+static void MCL_HASH256_transform(mcl_hash256 *sh)
+{ /* basic transformation step - compress the 16 buffered words */
+    uchar block[64];
+    int j;
+
+    for (j=0;j<16;j++)
+    {
+        block[4*j]=(uchar)(sh->w[j]>>24);
+        block[4*j+1]=(uchar)(sh->w[j]>>16);
+        block[4*j+2]=(uchar)(sh->w[j]>>8);
+        block[4*j+3]=(uchar)sh->w[j];
+    }
+    sha256_blocks(sh->h,block,1);
 } 
 
 /* Initialise Hash function */
@@ -275,6 +395,37 @@ void MCL_HASH256_process(mcl_hash256 *sh,int byte)
     if ((sh->length[0]%512)==0) MCL_HASH256_transform(sh);
 }
 
+/* process a run of bytes */
+void MCL_HASH256_update(mcl_hash256 *sh,const char *buf,int len)
+{
+    const uchar *data=(const uchar *)buf;
+    int nblocks;
+
+    /* Top up any partial block a byte at a time */
+    while (len>0 && (sh->length[0]%512)!=0)
+    {
+        MCL_HASH256_process(sh,*data++);
+        len--;
+    }
+
+    /* Whole blocks go straight to the compression function */
+    nblocks=len/64;
+    if (nblocks>0)
+    {
+        sha256_blocks(sh->h,data,nblocks);
+        data+=64*nblocks;
+        len-=64*nblocks;
+        while (nblocks-- > 0)
+        { /* length += 512 bits, with carry */
+            sh->length[0]+=512;
+            if (sh->length[0]==0L) sh->length[1]++;
+        }
+    }
+
+    /* ...and the tail byte-by-byte */
+    while (len-- > 0) MCL_HASH256_process(sh,*data++);
+}
+
 /* SU= 24 */
 /* Generate 32-byte Hash */
 void MCL_HASH256_hash(mcl_hash256 *sh,char *digest)
@@ -295,6 +446,146 @@ void MCL_HASH256_hash(mcl_hash256 *sh,char *digest)
     MCL_HASH256_init(sh);
 }
 
+/* Multi-buffer SHA-256: independent equal-length messages hashed in SIMD lanes */
+
+#define SHA256_MAX_LANES 16
+
+#ifdef MCL_HASH_X86
+/* One block from each of L lanes. st[] is the transposed state, st[i*L+lane].
+   Written with GCC vector extensions so one body serves every lane width */
+#define SHA256_MB_KERNEL(NAME,L,TARGET) \
+typedef unsign32 NAME##_vec __attribute__((vector_size(4*L))); \
+__attribute__((target(TARGET))) \
+static void NAME(unsign32 *st,const uchar **blk) \
+{ \
+    NAME##_vec a,b,c,d,e,f,g,h,t1,t2; \
+    NAME##_vec w[64],s[8]; \
+    unsign32 x[L]; \
+    int i,j; \
+    for (j=0;j<16;j++) \
+    { /* gather word j of every lane */ \
+        for (i=0;i<L;i++) \
+            x[i]=((unsign32)blk[i][4*j]<<24)|((unsign32)blk[i][4*j+1]<<16)| \
+                 ((unsign32)blk[i][4*j+2]<<8)|(unsign32)blk[i][4*j+3]; \
+        memcpy(&w[j],x,sizeof(x)); \
+    } \
+    for (j=16;j<64;j++) \
+        w[j]=theta1_256(w[j-2])+w[j-7]+theta0_256(w[j-15])+w[j-16]; \
+    memcpy(s,st,sizeof(s)); \
+    a=s[0]; b=s[1]; c=s[2]; d=s[3]; \
+    e=s[4]; f=s[5]; g=s[6]; h=s[7]; \
+    for (j=0;j<64;j++) \
+    { \
+        t1=h+Sig1_256(e)+Ch(e,f,g)+K_256[j]+w[j]; \
+        t2=Sig0_256(a)+Maj(a,b,c); \
+        h=g; g=f; f=e; \
+        e=d+t1; \
+        d=c; \
+        c=b; \
+        b=a; \
+        a=t1+t2; \
+    } \
+    s[0]+=a; s[1]+=b; s[2]+=c; s[3]+=d; \
+    s[4]+=e; s[5]+=f; s[6]+=g; s[7]+=h; \
+    memcpy(st,s,sizeof(s)); \
+}
+
+SHA256_MB_KERNEL(sha256_mb_sse,4,"sse2")
+SHA256_MB_KERNEL(sha256_mb_avx2,8,"avx2")
+SHA256_MB_KERNEL(sha256_mb_avx512,16,"avx512f")
+#endif
+
+/* Multi-buffer kernel in use, resolved by MCL_HASH256_multi_kernel or else
+   on first use */
+static int sha256_multi_kernel=MCL_HASH_MULTI_AUTO;
+
+static int sha256_multi_best_kernel(void)
+{
+#ifdef MCL_HASH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return MCL_HASH_MULTI_AVX512;
+    if (__builtin_cpu_supports("avx2")) return MCL_HASH_MULTI_AVX2;
+    if (__builtin_cpu_supports("sse2")) return MCL_HASH_MULTI_SSE;
+#endif
+    return MCL_HASH_MULTI_SCALAR;
+}
+
+int MCL_HASH256_multi_kernel(int kernel)
+{
+    int best=sha256_multi_best_kernel();
+
+    if (kernel==MCL_HASH_MULTI_AUTO || kernel>best) kernel=best;
+    sha256_multi_kernel=kernel;
+    return sha256_multi_kernel;
+}
+
+/* SU= 2400 */
+void MCL_HASH256_multi(int n,const char **msg,int len,char **digest)
+{
+    static const unsign32 IV[8]={H0_256,H1_256,H2_256,H3_256,H4_256,H5_256,H6_256,H7_256};
+    void (*kernel)(unsign32 *,const uchar **)=NULL;
+    unsign32 st[8*SHA256_MAX_LANES];
+    uchar tail[SHA256_MAX_LANES][128];
+    const uchar *blk[SHA256_MAX_LANES];
+    mcl_hash256 sh;
+    int lanes=1,full,rem,ntail,lane,src,b,i,j,k;
+
+    if (sha256_multi_kernel==MCL_HASH_MULTI_AUTO) sha256_multi_kernel=sha256_multi_best_kernel();
+#ifdef MCL_HASH_X86
+    switch (sha256_multi_kernel)
+    {
+    case MCL_HASH_MULTI_SSE: kernel=sha256_mb_sse; lanes=4; break;
+    case MCL_HASH_MULTI_AVX2: kernel=sha256_mb_avx2; lanes=8; break;
+    case MCL_HASH_MULTI_AVX512: kernel=sha256_mb_avx512; lanes=16; break;
+    }
+#endif
+    if (kernel==NULL)
+    { /* one message at a time */
+        for (j=0;j<n;j++)
+        {
+            MCL_HASH256_init(&sh);
+            MCL_HASH256_update(&sh,msg[j],len);
+            MCL_HASH256_hash(&sh,digest[j]);
+        }
+        return;
+    }
+
+    full=len/64;            /* blocks read straight from the message */
+    rem=len%64;
+    ntail=(rem<56)? 1 : 2;  /* padded blocks built in tail[] */
+
+    for (j=0;j<n;j+=lanes)
+    {
+        for (lane=0;lane<lanes;lane++)
+        { /* idle lanes repeat the first message of the group */
+            src=(j+lane<n)? j+lane : j;
+            for (i=0;i<8;i++) st[i*lanes+lane]=IV[i];
+            memcpy(tail[lane],msg[src]+64*full,rem);
+            tail[lane][rem]=PAD;
+            memset(&tail[lane][rem+1],ZERO,64*ntail-rem-1);
+            for (i=0;i<4;i++)
+            { /* 64-bit bit length, big-endian; 32-bit len never reaches the top word */
+                tail[lane][64*ntail-1-i]=(uchar)(((unsign32)len<<3)>>(8*i));
+            }
+            tail[lane][64*ntail-5]=(uchar)((unsign32)len>>29);
+        }
+        for (b=0;b<full+ntail;b++)
+        {
+            for (lane=0;lane<lanes;lane++)
+            {
+                src=(j+lane<n)? j+lane : j;
+                blk[lane]=(b<full)? (const uchar *)msg[src]+64*b : tail[lane]+64*(b-full);
+            }
+            kernel(st,blk);
+        }
+        for (lane=0;lane<lanes && j+lane<n;lane++)
+        {
+            for (k=0;k<32;k++)
+                digest[j+lane][k]=(char)((st[(k/4)*lanes+lane]>>(8*(3-k%4))) & 0xffL);
+        }
+    }
+}
+
 
 #define H0_512 0x6a09e667f3bcc908 
 #define H1_512 0xbb67ae8584caa73b 
@@ -0,0 +1,333 @@
+/*************************************************************************
+                                                                         *
+Copyright (c) 2015>, MIRACL Ltd                                          *
+All rights reserved.                                                     *
+                                                                         *
+This file is derived from the MIRACL for Ara SDK.                        *
+                                                                         *
+The MIRACL for Ara SDK provides developers with an                       *
+extensive and efficient set of cryptographic functions.                  *
+For further information about its features and functionalities           *
+please refer to https://www.miracl.com                                   *
+                                                                         *
+Redistribution and use in source and binary forms, with or without       *
+modification, are permitted provided that the following conditions are   *
+met:                                                                     *
+                                                                         *
+ 1. Redistributions of source code must retain the above copyright       *
+    notice, this list of conditions and the following disclaimer.        *
+                                                                         *
+ 2. Redistributions in binary form must reproduce the above copyright    *
+    notice, this list of conditions and the following disclaimer in the  *
+    documentation and/or other materials provided with the distribution. *
+                                                                         *
+ 3. Neither the name of the copyright holder nor the names of its        *
+    contributors may be used to endorse or promote products derived      *
+    from this software without specific prior written permission.        *
+                                                                         *
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS  *
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED    *
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A          *
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT       *
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,   *
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED *
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR   *
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   *
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     *
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       *
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
+                                                                         *
+**************************************************************************/
+
+/*
+ * Vectorised Montgomery multiplication for 1024 and 2048-bit moduli
+ *
+ * Word-serial Montgomery multiplication, one limb of b at a time, with the
+ * accumulator held as a vector of unnormalised digits that shifts down one
+ * limb a step. Digits are only carried once, at the end, followed by one
+ * constant time subtraction of p.
+ *
+ * AVX-512 IFMA multiplies 52-bit limbs, giving the low and high halves of
+ * each product separately, eight limbs to a register.
+ * AVX2 only has 32x32 bit multiplies, so uses 28-bit limbs, four to a
+ * register. A digit takes at most 2^57 a step, so even 74 limbs (2048 bits)
+ * fit in 64 bits without intermediate carries.
+ *
+ * See Gueron & Krasnov, "Software Implementation of Modular Exponentiation,
+ * Using Advanced Vector Instructions Architectures", WAIFI 2012, and Drucker &
+ * Gueron, "Fast Modular Squaring with AVX512IFMA", 2018.
+ */
+
+#include "mcl_arch.h"
+#include "mcl_mont.h"
+
+static int selected=-1;
+
+void MCL_MONT_select(int kernel)
+{
+	selected=kernel;
+}
+
+#if MCL_MONT_VECTOR
+
+#include <immintrin.h>
+
+#define IFMA __attribute__((target("avx512f,avx512ifma")))
+#define AVX2 __attribute__((target("avx2")))
+#define INLINE static inline __attribute__((always_inline))
+
+int MCL_MONT_best(void)
+{
+	static int best=-1;
+	if (best<0)
+	{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma")) best=MCL_MONT_IFMA;
+		else if (__builtin_cpu_supports("avx2")) best=MCL_MONT_AVX2;
+		else best=MCL_MONT_SCALAR;
+	}
+	return best;
+}
+
+int MCL_MONT_kernel(int bits)
+{
+	int best;
+	if (bits!=1024 && bits!=2048) return MCL_MONT_SCALAR;
+	best=MCL_MONT_best();
+	if (selected<0) return best;
+	if (selected>best) return MCL_MONT_SCALAR;
+	return selected;
+}
+
+/* k limbs of radix bits from nw words, zero padded to pad limbs */
+static void to_limbs(unsign64 *l,int k,int pad,const unsign64 *w,int nw,int radix)
+{
+	int i,bit,word,off;
+	unsign64 v,mask=((unsign64)1<<radix)-1;
+	for (i=0;i<k;i++)
+	{
+		bit=i*radix; word=bit>>6; off=bit&63;
+		v=(word<nw)?w[word]>>off:0;
+		if (off+radix>64 && word+1<nw) v|=w[word+1]<<(64-off);
+		l[i]=v&mask;
+	}
+	for (;i<pad;i++) l[i]=0;
+}
+
+/* nw words from k normalised limbs */
+static void from_limbs(unsign64 *w,int nw,const unsign64 *l,int k,int radix)
+{
+	int i,bit,word,off;
+	for (i=0;i<nw;i++) w[i]=0;
+	for (i=0;i<k;i++)
+	{
+		bit=i*radix; word=bit>>6; off=bit&63;
+		if (word<nw) w[word]|=l[i]<<off;
+		if (off+radix>64 && word+1<nw) w[word+1]|=l[i]>>(64-off);
+	}
+}
+
+/* Carry the digits of t into limbs, then r=t-p if that doesn't go negative, else r=t */
+static void finish(unsign64 *r,unsign64 *t,const unsign64 *p,int k,int radix)
+{
+	int i;
+	unsign64 c=0,d,m,borrow=0,mask=((unsign64)1<<radix)-1;
+	for (i=0;i<k;i++)
+	{
+		c+=t[i];
+		t[i]=c&mask;
+		c>>=radix;
+	}
+	for (i=0;i<k;i++)
+	{
+		d=t[i]-p[i]-borrow;
+		r[i]=d&mask;
+		borrow=d>>63;
+	}
+	m=borrow-1; /* all ones if t>=p */
+	for (i=0;i<k;i++) r[i]=(r[i]&m)|(t[i]&~m);
+}
+
+/* t=a.b/2^(52k) as digits, nv registers of eight limbs */
+INLINE IFMA void ifma_amm(unsign64 *t,const unsign64 *a,const unsign64 *b,const unsign64 *p,unsign64 k0,int k,const int nv)
+{
+	__m512i A[5],P[5],X[5],bi,yv,z=_mm512_setzero_si512();
+	unsign64 x0,y,p0=p[0];
+	int i,v;
+	for (v=0;v<nv;v++)
+	{
+		A[v]=_mm512_loadu_si512(a+8*v);
+		P[v]=_mm512_load_si512(p+8*v);
+		X[v]=z;
+	}
+	for (i=0;i<k;i++)
+	{
+		bi=_mm512_set1_epi64(b[i]);
+		for (v=0;v<nv;v++) X[v]=_mm512_madd52lo_epu64(X[v],A[v],bi);
+		x0=_mm_cvtsi128_si64(_mm512_castsi512_si128(X[0]));
+		y=(x0*k0)&0xFFFFFFFFFFFFFULL;
+		yv=_mm512_set1_epi64(y);
+		for (v=0;v<nv;v++) X[v]=_mm512_madd52lo_epu64(X[v],P[v],yv);
+		x0=(x0+((p0*y)&0xFFFFFFFFFFFFFULL))>>52; /* bottom limb is now 0 mod 2^52 */
+
+		for (v=0;v<nv-1;v++) X[v]=_mm512_alignr_epi64(X[v+1],X[v],1);
+		X[nv-1]=_mm512_alignr_epi64(z,X[nv-1],1);
+		X[0]=_mm512_add_epi64(X[0],_mm512_maskz_set1_epi64(1,x0));
+
+		/* high halves were one limb up, so land in place after the shift */
+		for (v=0;v<nv;v++) X[v]=_mm512_madd52hi_epu64(X[v],A[v],bi);
+		for (v=0;v<nv;v++) X[v]=_mm512_madd52hi_epu64(X[v],P[v],yv);
+	}
+	for (v=0;v<nv;v++) _mm512_storeu_si512(t+8*v,X[v]);
+}
+
+static IFMA void ifma_mul(const mcl_mont *M,unsign64 *t,const unsign64 *a,const unsign64 *b)
+{
+	if (M->k==20) ifma_amm(t,a,b,M->p,M->k0,20,3);
+	else ifma_amm(t,a,b,M->p,M->k0,40,5);
+}
+
+/* t=a.b/2^(28k) as digits, nv registers of four limbs */
+INLINE AVX2 void avx2_amm(unsign64 *t,const unsign64 *a,const unsign64 *b,const unsign64 *p,unsign64 k0,int k,const int nv)
+{
+	__m256i A[19],P[19],X[19],R,Rn,bi,yv,z=_mm256_setzero_si256();
+	unsign64 x0,y,p0=p[0];
+	int i,v;
+	for (v=0;v<nv;v++)
+	{
+		A[v]=_mm256_loadu_si256((const __m256i *)(a+4*v));
+		P[v]=_mm256_load_si256((const __m256i *)(p+4*v));
+		X[v]=z;
+	}
+	for (i=0;i<k;i++)
+	{
+		bi=_mm256_set1_epi64x(b[i]);
+		for (v=0;v<nv;v++) X[v]=_mm256_add_epi64(X[v],_mm256_mul_epu32(A[v],bi));
+		x0=_mm_cvtsi128_si64(_mm256_castsi256_si128(X[0]));
+		y=(x0*k0)&0xFFFFFFF;
+		yv=_mm256_set1_epi64x(y);
+		for (v=0;v<nv;v++) X[v]=_mm256_add_epi64(X[v],_mm256_mul_epu32(P[v],yv));
+		x0=(x0+p0*y)>>28;
+
+		/* rotate each register down a limb, and fill its top from the next */
+		R=_mm256_permute4x64_epi64(X[0],0x39);
+		for (v=0;v<nv-1;v++)
+		{
+			Rn=_mm256_permute4x64_epi64(X[v+1],0x39);
+			X[v]=_mm256_blend_epi32(R,Rn,0xC0);
+			R=Rn;
+		}
+		X[nv-1]=_mm256_blend_epi32(R,z,0xC0);
+		X[0]=_mm256_add_epi64(X[0],_mm256_set_epi64x(0,0,0,(long long)x0));
+	}
+	for (v=0;v<nv;v++) _mm256_storeu_si256((__m256i *)(t+4*v),X[v]);
+}
+
+static AVX2 void avx2_mul(const mcl_mont *M,unsign64 *t,const unsign64 *a,const unsign64 *b)
+{
+	if (M->k==37) avx2_amm(t,a,b,M->p,M->k0,37,10);
+	else avx2_amm(t,a,b,M->p,M->k0,74,19);
+}
+
+/* r=a.b/R mod p, all in limbs */
+static void mont_limbs(const mcl_mont *M,unsign64 *r,const unsign64 *a,const unsign64 *b)
+{
+	unsign64 t[MCL_MONT_LIMBS];
+	if (M->kernel==MCL_MONT_IFMA) ifma_mul(M,t,a,b);
+	else avx2_mul(M,t,a,b);
+	finish(r,t,M->p,M->k,M->radix);
+}
+
+int MCL_MONT_init(mcl_mont *M,const unsign64 *p,int bits)
+{
+	int i,t,s,c,rbits,pad;
+	unsign64 inv,d,m,borrow,mask;
+	unsign64 x[MCL_MONT_LIMBS] MCL_MONT_ALIGN,y[MCL_MONT_LIMBS];
+
+	M->kernel=MCL_MONT_kernel(bits);
+	if (M->kernel==MCL_MONT_SCALAR) return M->kernel;
+	M->nw=bits/64+1;
+	for (t=64*M->nw-1;t>=0 && ((p[t>>6]>>(t&63))&1)==0;t--) ;
+	if ((p[0]&1)==0 || t<1) return M->kernel=MCL_MONT_SCALAR;
+
+	M->radix=(M->kernel==MCL_MONT_IFMA)?52:28;
+	M->k=(bits+2+M->radix-1)/M->radix; /* R>4.2^bits */
+	pad=(M->k+7)&~7;
+	mask=((unsign64)1<<M->radix)-1;
+	to_limbs(M->p,M->k,pad,p,M->nw,M->radix);
+	for (i=pad;i<MCL_MONT_LIMBS;i++) M->p[i]=0;
+
+	inv=p[0];
+	for (i=0;i<5;i++) inv*=2-p[0]*inv; /* Newton, 3 bits to 96 */
+	M->k0=(0-inv)&mask;
+
+/* R^2 mod p. Start at 2^t<p, double up to R.2^c, then square s times, where c.2^s=rbits */
+	rbits=M->radix*M->k;
+	for (s=0;((rbits>>s)&1)==0;s++) ;
+	c=rbits>>s;
+	for (i=0;i<pad;i++) x[i]=0;
+	x[t/M->radix]=(unsign64)1<<(t%M->radix);
+	for (;t<rbits+c;t++)
+	{
+		for (i=M->k-1;i>0;i--) x[i]=((x[i]<<1)&mask)|(x[i-1]>>(M->radix-1));
+		x[0]=(x[0]<<1)&mask;
+		borrow=0;
+		for (i=0;i<M->k;i++)
+		{
+			d=x[i]-M->p[i]-borrow;
+			y[i]=d&mask;
+			borrow=d>>63;
+		}
+		m=borrow-1;
+		for (i=0;i<M->k;i++) x[i]=(y[i]&m)|(x[i]&~m);
+	}
+	while (s--) mont_limbs(M,x,x,x);
+	from_limbs(M->rr,M->nw,x,M->k,M->radix);
+	return M->kernel;
+}
+
+void MCL_MONT_mul(const mcl_mont *M,unsign64 *r,const unsign64 *a,const unsign64 *b)
+{
+	unsign64 al[MCL_MONT_LIMBS] MCL_MONT_ALIGN,bl[MCL_MONT_LIMBS];
+	int pad=(M->k+7)&~7;
+	to_limbs(al,M->k,pad,a,M->nw,M->radix);
+	to_limbs(bl,M->k,pad,b,M->nw,M->radix);
+	mont_limbs(M,al,al,bl);
+	from_limbs(r,M->nw,al,M->k,M->radix);
+}
+
+void MCL_MONT_sqr(const mcl_mont *M,unsign64 *r,const unsign64 *a)
+{
+	unsign64 al[MCL_MONT_LIMBS] MCL_MONT_ALIGN;
+	int pad=(M->k+7)&~7;
+	to_limbs(al,M->k,pad,a,M->nw,M->radix);
+	mont_limbs(M,al,al,al);
+	from_limbs(r,M->nw,al,M->k,M->radix);
+}
+
+#else
+
+int MCL_MONT_best(void)
+{
+	return MCL_MONT_SCALAR;
+}
+
+int MCL_MONT_kernel(int bits)
+{
+	return MCL_MONT_SCALAR;
+}
+
+int MCL_MONT_init(mcl_mont *M,const unsign64 *p,int bits)
+{
+	return M->kernel=MCL_MONT_SCALAR;
+}
+
+void MCL_MONT_mul(const mcl_mont *M,unsign64 *r,const unsign64 *a,const unsign64 *b)
+{
+}
+
+void MCL_MONT_sqr(const mcl_mont *M,unsign64 *r,const unsign64 *a)
+{
+}
+
+#endif
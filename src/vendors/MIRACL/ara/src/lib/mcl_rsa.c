@@ -142,18 +142,21 @@ void MCL_RSA_KEY_PAIR(csprng *RNG,sign32 e,MCL_rsa_private_key *PRIV,MCL_rsa_pub
 { /* IEEE1363 A16.11/A16.12 more or less */
 
     mcl_chunk t[MCL_HFLEN][MCL_BS],p1[MCL_HFLEN][MCL_BS],q1[MCL_HFLEN][MCL_BS];
-    
+	mcl_ff_ws ws;
+	int rounds=MCL_FF_prime_fips_rounds(MCL_HFLEN);
+
+	MCL_FF_ws_init(&ws);
 	for (;;)
 	{
 
 		MCL_FF_random(PRIV->p,RNG,MCL_HFLEN);
 		while (MCL_FF_lastbits(PRIV->p,2)!=3) MCL_FF_inc(PRIV->p,1,MCL_HFLEN);
-		while (!MCL_FF_prime(PRIV->p,RNG,MCL_HFLEN))
+		while (!MCL_FF_prime_rounds_ws(PRIV->p,RNG,rounds,MCL_HFLEN,&ws))
 			MCL_FF_inc(PRIV->p,4,MCL_HFLEN);
 		MCL_FF_copy(p1,PRIV->p,MCL_HFLEN);
 		MCL_FF_dec(p1,1,MCL_HFLEN);
 
-		if (MCL_FF_cfactor(p1,e,MCL_HFLEN)) continue;
+		if (MCL_FF_cfactor_ws(p1,e,MCL_HFLEN,&ws)) continue;
 		break;
 	}
 
@@ -161,12 +164,12 @@ void MCL_RSA_KEY_PAIR(csprng *RNG,sign32 e,MCL_rsa_private_key *PRIV,MCL_rsa_pub
 	{
 		MCL_FF_random(PRIV->q,RNG,MCL_HFLEN);
 		while (MCL_FF_lastbits(PRIV->q,2)!=3) MCL_FF_inc(PRIV->q,1,MCL_HFLEN);
-		while (!MCL_FF_prime(PRIV->q,RNG,MCL_HFLEN))
+		while (!MCL_FF_prime_rounds_ws(PRIV->q,RNG,rounds,MCL_HFLEN,&ws))
 			MCL_FF_inc(PRIV->q,4,MCL_HFLEN);
 
 		MCL_FF_copy(q1,PRIV->q,MCL_HFLEN);	
 		MCL_FF_dec(q1,1,MCL_HFLEN);
-		if (MCL_FF_cfactor(q1,e,MCL_HFLEN)) continue;
+		if (MCL_FF_cfactor_ws(q1,e,MCL_HFLEN,&ws)) continue;
 
 		break;
 	}
@@ -363,7 +366,7 @@ void MCL_RSA_ENCRYPT(MCL_rsa_public_key *PUB,mcl_octet *F,mcl_octet *G)
 	mcl_chunk f[MCL_FFLEN][MCL_BS];
 	MCL_FF_fromOctet(f,F,MCL_FFLEN);
 
-    MCL_FF_power(f,f,PUB->e,PUB->n,MCL_FFLEN);
+    MCL_FF_pubpow(f,f,PUB->e,PUB->n,MCL_FFLEN);
 
 	MCL_FF_toOctet(G,f,MCL_FFLEN);
 }
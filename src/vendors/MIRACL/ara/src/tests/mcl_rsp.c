@@ -0,0 +1,340 @@
+/*************************************************************************
+                                                                         *
+Copyright (c) 2015>, MIRACL Ltd                                          *
+All rights reserved.                                                     *
+                                                                         *
+This file is derived from the MIRACL for Ara SDK.                        *
+                                                                         *
+The MIRACL for Ara SDK provides developers with an                       *
+extensive and efficient set of cryptographic functions.                  *
+For further information about its features and functionalities           *
+please refer to https://www.miracl.com                                   *
+                                                                         *
+Redistribution and use in source and binary forms, with or without       *
+modification, are permitted provided that the following conditions are   *
+met:                                                                     *
+                                                                         *
+ 1. Redistributions of source code must retain the above copyright       *
+    notice, this list of conditions and the following disclaimer.        *
+                                                                         *
+ 2. Redistributions in binary form must reproduce the above copyright    *
+    notice, this list of conditions and the following disclaimer in the  *
+    documentation and/or other materials provided with the distribution. *
+                                                                         *
+ 3. Neither the name of the copyright holder nor the names of its        *
+    contributors may be used to endorse or promote products derived      *
+    from this software without specific prior written permission.        *
+                                                                         *
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS  *
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED    *
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A          *
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT       *
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,   *
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED *
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR   *
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF   *
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING     *
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS       *
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
+                                                                         *
+**************************************************************************/
+
+/* Parallel runner for NIST CAVS response (.rsp) vector files */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mcl_rsp.h"
+
+/* A parsed file */
+typedef struct
+{
+  const char *file;
+  mcl_rsp_record *rec;
+  int nrec,maxrec;
+  mcl_rsp_section **sec;
+  int nsec,maxsec;
+} rsp_file;
+
+/* What one thread checks */
+typedef struct
+{
+  rsp_file *f;
+  int first,step;
+  mcl_rsp_check check;
+  void *arg;
+  char **fail; /* failure message per record, NULL if it passed */
+  int checked; /* records that were test cases */
+} rsp_shard;
+
+static int field_is(const mcl_rsp_field *f,const char *name)
+{
+  int l=strlen(name);
+  return f->nlen==l && memcmp(f->name,name,l)==0;
+}
+
+static const mcl_rsp_field *find(const mcl_rsp_field *f,int n,const char *name)
+{
+  int i;
+  for (i=0; i<n; i++)
+    if (field_is(&f[i],name)) return &f[i];
+  return NULL;
+}
+
+const char *MCL_RSP_value(const mcl_rsp_record *r,const char *name,int *len)
+{
+  const mcl_rsp_field *f=find(r->f,r->n,name);
+  if (f==NULL && r->sec!=NULL) f=find(r->sec->f,r->sec->n,name);
+  if (f==NULL) return NULL;
+  if (len!=NULL) *len=f->vlen;
+  return f->val;
+}
+
+static int nibble(char c)
+{
+  if (c>='0' && c<='9') return c-'0';
+  if (c>='a' && c<='f') return c-'a'+10;
+  if (c>='A' && c<='F') return c-'A'+10;
+  return -1;
+}
+
+int MCL_RSP_hex(const mcl_rsp_record *r,const char *name,char *b,int max)
+{
+  int i,hi,lo,len;
+  const char *v=MCL_RSP_value(r,name,&len);
+  if (v==NULL || len%2!=0 || len/2>max) return -1;
+  for (i=0; i<len/2; i++) {
+    hi=nibble(v[2*i]);
+    lo=nibble(v[2*i+1]);
+    if (hi<0 || lo<0) return -1;
+    b[i]=(char)(hi<<4|lo);
+  }
+  return len/2;
+}
+
+int MCL_RSP_int(const mcl_rsp_record *r,const char *name,int *v)
+{
+  int i,len,x=0;
+  const char *s=MCL_RSP_value(r,name,&len);
+  if (s==NULL || len==0 || len>9) return -1;
+  for (i=0; i<len; i++) {
+    if (s[i]<'0' || s[i]>'9') return -1;
+    x=10*x+s[i]-'0';
+  }
+  *v=x;
+  return 0;
+}
+
+/* Split a line into a field. Leading and trailing blanks are already gone */
+static void split(const char *s,int len,mcl_rsp_field *f)
+{
+  int i,e;
+  for (i=0; i<len && s[i]!='='; i++);
+  for (e=i; e>0 && s[e-1]==' '; e--);
+  f->name=s;
+  f->nlen=e;
+  for (i++; i<len && s[i]==' '; i++);
+  f->val=s+i;
+  f->vlen=(i<len)?len-i:0;
+}
+
+static mcl_rsp_record *new_record(rsp_file *p)
+{
+  mcl_rsp_record *r;
+  if (p->nrec==p->maxrec) {
+    p->maxrec=p->maxrec?2*p->maxrec:1024;
+    r=(mcl_rsp_record *)realloc(p->rec,p->maxrec*sizeof(mcl_rsp_record));
+    if (r==NULL) return NULL;
+    p->rec=r;
+  }
+  r=&p->rec[p->nrec++];
+  r->file=p->file;
+  r->n=0;
+  r->sec=NULL;
+  return r;
+}
+
+static mcl_rsp_section *new_section(rsp_file *p)
+{
+  mcl_rsp_section **s,*sec;
+  if (p->nsec==p->maxsec) {
+    p->maxsec=p->maxsec?2*p->maxsec:16;
+    s=(mcl_rsp_section **)realloc(p->sec,p->maxsec*sizeof(mcl_rsp_section *));
+    if (s==NULL) return NULL;
+    p->sec=s;
+  }
+  sec=(mcl_rsp_section *)malloc(sizeof(mcl_rsp_section));
+  if (sec==NULL) return NULL;
+  sec->n=0;
+  p->sec[p->nsec++]=sec;
+  return sec;
+}
+
+/* Tokenise the mapped file. Returns 0, or -1 if out of memory or a record
+   or section has too many fields */
+static int parse(rsp_file *p,const char *s,size_t size)
+{
+  const char *end=s+size,*e,*nl;
+  int line=0,insec=0;
+  mcl_rsp_section *sec=NULL;
+  mcl_rsp_record *r=NULL;
+
+  for (; s<end; s=nl+1) {
+    line++;
+    nl=memchr(s,'\n',end-s);
+    if (nl==NULL) nl=end;
+    for (e=nl; e>s && (e[-1]=='\r' || e[-1]==' ' || e[-1]=='\t'); e--);
+    while (s<e && (*s==' ' || *s=='\t')) s++;
+
+    if (s==e) { /* blank line ends a record */
+      r=NULL;
+      insec=0;
+      continue;
+    }
+    if (*s=='#') continue;
+    if (*s=='[') { /* [Name = value] - a new section unless the last line was one too */
+      r=NULL;
+      if (!insec) {
+        if ((sec=new_section(p))==NULL) return -1;
+        insec=1;
+      }
+      if (sec->n==MCL_RSP_FIELDS) return -1;
+      s++;
+      if (e>s && e[-1]==']') e--;
+      split(s,e-s,&sec->f[sec->n++]);
+      continue;
+    }
+    insec=0;
+    if (r==NULL) {
+      if ((r=new_record(p))==NULL) return -1;
+      r->line=line;
+      r->sec=sec;
+    }
+    if (r->n==MCL_RSP_FIELDS) return -1;
+    split(s,e-s,&r->f[r->n++]);
+  }
+  return 0;
+}
+
+static char oom[]="failed, and out of memory";
+
+static void *shard(void *a)
+{
+  rsp_shard *t=(rsp_shard *)a;
+  int i,rc;
+  char msg[MCL_RSP_MSG];
+  for (i=t->first; i<t->f->nrec; i+=t->step) {
+    msg[0]=0;
+    rc=t->check(&t->f->rec[i],t->arg,msg);
+    if (rc==MCL_RSP_SKIP) continue;
+    t->checked++;
+    if (rc!=0) {
+      if (msg[0]==0) strcpy(msg,"failed");
+      t->fail[i]=strdup(msg);
+      if (t->fail[i]==NULL) t->fail[i]=oom;
+    }
+  }
+  return NULL;
+}
+
+int MCL_RSP_run(const char *file,int threads,mcl_rsp_check check,void *arg,int *cases)
+{
+  int i,fd,bad=-1,made=0,checked=0;
+  struct stat st;
+  void *map=NULL;
+  rsp_file p;
+  rsp_shard *sh=NULL;
+  pthread_t *tid=NULL;
+  char **fail=NULL;
+
+  memset(&p,0,sizeof(p));
+  p.file=file;
+  if (cases!=NULL) *cases=0;
+
+  fd=open(file,O_RDONLY);
+  if (fd<0) {
+    printf("Cannot open %s\n",file);
+    return -1;
+  }
+  if (fstat(fd,&st)!=0) {
+    printf("Cannot read %s\n",file);
+    close(fd);
+    return -1;
+  }
+  if (st.st_size>0) {
+    map=mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    if (map==MAP_FAILED) {
+      printf("Cannot map %s\n",file);
+      close(fd);
+      return -1;
+    }
+    if (parse(&p,(const char *)map,st.st_size)!=0) {
+      printf("%s: cannot parse, out of memory or more than %d fields in a record\n",file,MCL_RSP_FIELDS);
+      goto out;
+    }
+  }
+
+  if (threads<=0) threads=(int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads<=0) threads=1;
+  if (threads>p.nrec) threads=p.nrec;
+
+  if (p.nrec>0) {
+    fail=(char **)calloc(p.nrec,sizeof(char *));
+    sh=(rsp_shard *)calloc(threads,sizeof(rsp_shard));
+    tid=(pthread_t *)calloc(threads,sizeof(pthread_t));
+    if (fail==NULL || sh==NULL || tid==NULL) {
+      printf("%s: out of memory\n",file);
+      goto out;
+    }
+  }
+
+  /* records are dealt out in turn, as later sections tend to be larger */
+  for (i=0; i<threads; i++) {
+    sh[i].f=&p;
+    sh[i].first=i;
+    sh[i].step=threads;
+    sh[i].check=check;
+    sh[i].arg=arg;
+    sh[i].fail=fail;
+  }
+  /* this thread takes the first shard, and any that can't get a thread */
+  for (made=1; made<threads; made++)
+    if (pthread_create(&tid[made],NULL,shard,&sh[made])!=0) break;
+  for (i=0; i<threads; i++)
+    if (i==0 || i>=made) shard(&sh[i]);
+  for (i=1; i<made && i<threads; i++) pthread_join(tid[i],NULL);
+
+  bad=0;
+  for (i=0; i<threads; i++) checked+=sh[i].checked;
+  for (i=0; i<p.nrec; i++) {
+    if (fail[i]==NULL) continue;
+    printf("%s:%d: %s\n",file,p.rec[i].line,fail[i]);
+    bad++;
+  }
+  if (checked==0) {
+    printf("%s: no test cases\n",file);
+    bad++;
+  }
+  if (cases!=NULL) *cases=checked;
+
+out:
+  if (fail!=NULL) {
+    for (i=0; i<p.nrec; i++)
+      if (fail[i]!=oom) free(fail[i]);
+    free(fail);
+  }
+  free(sh);
+  free(tid);
+  for (i=0; i<p.nsec; i++) free(p.sec[i]);
+  free(p.sec);
+  free(p.rec);
+  if (map!=NULL) munmap(map,st.st_size);
+  close(fd);
+  return bad;
+}
@@ -48,6 +48,7 @@ static void test()
 {
   int res,i;
   char *pp="M0ng00se";
+  char s2[MCL_EGS],w2[2*MCL_EFS+1],w3[2*MCL_EFS+1];
   char s0[MCL_EGS],s1[MCL_EGS],w0[2*MCL_EFS+1],w1[2*MCL_EFS+1],z0[MCL_EFS],z1[MCL_EFS],seed[32],key[MCL_EAS],salt[32],pw[20],p1[30],p2[30],v[2*MCL_EFS+1],m[32],c[64],t[32],cs[MCL_EGS],ds[MCL_EGS];
   mcl_octet S0={0,sizeof(s0),s0};
   mcl_octet S1={0,sizeof(s1),s1};
@@ -67,6 +68,9 @@ static void test()
   mcl_octet T={0,sizeof(t),t};
   mcl_octet CS={0,sizeof(cs),cs};
   mcl_octet DS={0,sizeof(ds),ds};
+  mcl_octet S2={0,sizeof(s2),s2};
+  mcl_octet W2={0,sizeof(w2),w2};
+  mcl_octet W3={0,sizeof(w3),w3};
   csprng RNG;                
 
   /* fake random seed source */
@@ -184,6 +188,24 @@ static void test()
   }
 #endif
 
+  printf("Testing fixed base key generation\r\n");
+  MCL_ECP_FIXED_BASE_INIT();
+  res=0;
+  for (i=0;i<=100;i++)
+  {
+    /* random private keys, then one of all 1s (reduced mod the order) */
+    if (i<100) MCL_ECP_KEY_PAIR_GENERATE(&RNG,&S2,&W2);
+    else {S2.len=MCL_EGS; memset(S2.val,0xff,MCL_EGS);}
+    MCL_ECP_KEY_PAIR_GENERATE(NULL,&S2,&W2);
+    MCL_ECP_KEY_PAIR_GENERATE_FIXED(NULL,&S2,&W3);
+    if (!MCL_OCT_comp(&W2,&W3)) res=1;
+  }
+  if (res) {
+    printf("*** Fixed base key generation Failed\r\n");
+  } else {
+    printf("Fixed base key generation succeeded\r\n");
+  }
+
   MCL_KILL_CSPRNG(&RNG);
 }
 
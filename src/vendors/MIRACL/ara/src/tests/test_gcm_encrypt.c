@@ -39,176 +39,229 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
                                                                          *
 **************************************************************************/
 
+
+/* Checks AES-GCM against NIST CAVS encryption vectors, for every AES kernel
+   this CPU runs. Each case is also decrypted, and its key is used for an
+   ECB round trip. The vectors are too short for the AES-NI 64-byte loops,
+   so the kernels are also compared on longer random messages, fed whole
+   and in pieces.
+
+   test_gcm_encrypt [-j threads] file.rsp ... */
+
 #include "mcl_arch.h"
 #include "mcl_gcm.h"
 #include "mcl_utils.h"
+#include "mcl_rsp.h"
 
-#define LINE_LEN 300
+#define MAX_LEN 256 /* bytes in the longest field */
 
-int main(int argc, char** argv)
-{
-  if (argc != 2) {
-    printf("usage: ./testgcm_encrypt [path to test vector file]\n");
-  }
+#define LONG_CASES 256 /* random messages in the kernel comparison */
+#define LONG_MIN 64 /* bytes in the shortest of them */
+#define LONG_MAX 1024 /* bytes in the longest of them */
 
-  FILE * fp = NULL;
-  char line[LINE_LEN];
-  char * linePtr = NULL;
-  int l1=0;
-  char * Key = NULL;
-  int KeyLen = 0;
-  const char* KeyStr = "Key = ";
-  char * IV = NULL;
-  int IVLen = 0;
-  const char* IVStr = "IV = ";
-  char * PT = NULL;
-  int PTLen = 0;
-  const char* PTStr = "PT = ";
-  char * AAD = NULL;
-  int AADLen = 0;
-  const char* AADStr = "AAD = ";
-  char * CT = NULL;
-  int CTLen = 0;        
-  char * CTHex = NULL;
-  const char* CTStr = "CT = ";
-  char Tag[16];
-  char * TagHex = NULL;
-  const char* TagStr = "Tag = ";
-
-  fp = fopen(argv[1], "r");
-  if (fp == NULL)
-      exit(EXIT_FAILURE);
-
-  int i=0; 
-  while (fgets(line, LINE_LEN, fp) != NULL)  {
-    i++;
-    if (!strncmp(line, KeyStr, strlen(KeyStr))) {
-      // printf("line %d %s\n", i,line);	
-      // Find hex value in string
-      linePtr = line + strlen(KeyStr);
-
-      // Allocate memory
-      l1 = strlen(linePtr)-1;
-      KeyLen = l1/2;
-      Key = (char*) malloc (KeyLen);
-      if (Key==NULL) 
-        exit(EXIT_FAILURE);
-
-      // Key binary value
-      MCL_hex2bin(linePtr, Key, l1);
-    }
+/* A field of len bytes agrees with its section's length in bits, if any */
+static int bits_match(const mcl_rsp_record *r,const char *name,int len)
+{
+  int bits;
+  return MCL_RSP_int(r,name,&bits)!=0 || bits==8*len;
+}
 
-    if (!strncmp(line, IVStr, strlen(IVStr))) {
-      // printf("line %d %s\n", i,line);
-      // Find hex value in string
-      linePtr = line + strlen(IVStr);
+static int check(const mcl_rsp_record *r,void *arg,char *msg)
+{
+  char Key[32],IV[MAX_LEN],PT[MAX_LEN],AAD[MAX_LEN],CT[MAX_LEN],Tag[16];
+  char C[MAX_LEN],P[MAX_LEN],T[16],B1[16],B2[16];
+  int KeyLen,IVLen,PTLen,AADLen,CTLen,TagLen;
+  mcl_gcm g;
+  mcl_aes a;
 
-      // Allocate memory
-      l1 = strlen(linePtr)-1;
-      IVLen = l1/2;
-      IV = (char*) malloc (IVLen);
-      if (IV==NULL) 
-        exit(EXIT_FAILURE);
+  /* A record cut short (a truncated file, say) must not pass unchecked */
+  if (MCL_RSP_value(r,"Tag",NULL)==NULL) {
+    sprintf(msg,"incomplete record, no Tag");
+    return 1;
+  }
+  KeyLen=MCL_RSP_hex(r,"Key",Key,sizeof(Key));
+  IVLen=MCL_RSP_hex(r,"IV",IV,sizeof(IV));
+  PTLen=MCL_RSP_hex(r,"PT",PT,sizeof(PT));
+  AADLen=MCL_RSP_hex(r,"AAD",AAD,sizeof(AAD));
+  CTLen=MCL_RSP_hex(r,"CT",CT,sizeof(CT));
+  TagLen=MCL_RSP_hex(r,"Tag",Tag,sizeof(Tag));
+  if (KeyLen<16 || IVLen<1 || PTLen<0 || AADLen<0 || CTLen!=PTLen || TagLen<0) {
+    sprintf(msg,"bad or missing field");
+    return 1;
+  }
+  if (!bits_match(r,"Keylen",KeyLen) || !bits_match(r,"IVlen",IVLen) ||
+      !bits_match(r,"PTlen",PTLen) || !bits_match(r,"AADlen",AADLen) ||
+      !bits_match(r,"Taglen",TagLen)) {
+    sprintf(msg,"incomplete record, a field disagrees with its section length");
+    return 1;
+  }
 
-      // IV binary value
-      MCL_hex2bin(linePtr, IV, l1);
-    }
+  MCL_GCM_init(&g,KeyLen,Key,IVLen,IV);
+  MCL_GCM_add_header(&g,AAD,AADLen);
+  MCL_GCM_add_plain(&g,C,PT,PTLen);
+  MCL_GCM_finish(&g,T);
+  if (memcmp(C,CT,CTLen)) {
+    sprintf(msg,"GCM ENCRYPT ciphertext differs");
+    return 1;
+  }
+  if (memcmp(T,Tag,TagLen)) {
+    sprintf(msg,"GCM ENCRYPT tag differs");
+    return 1;
+  }
 
-    if (!strncmp(line, PTStr, strlen(PTStr))) {
-      // printf("line %d %s\n", i,line);
-      // Find hex value in string
-      linePtr = line + strlen(PTStr);
+  /* Decrypting gives back the plaintext and the same tag */
+  MCL_GCM_init(&g,KeyLen,Key,IVLen,IV);
+  MCL_GCM_add_header(&g,AAD,AADLen);
+  MCL_GCM_add_cipher(&g,P,CT,CTLen);
+  MCL_GCM_finish(&g,T);
+  if (memcmp(P,PT,PTLen) || memcmp(T,Tag,TagLen)) {
+    sprintf(msg,"GCM DECRYPT differs");
+    return 1;
+  }
 
-      // Allocate memory
-      l1 = strlen(linePtr)-1;
-      PTLen = l1/2;
-      PT = (char*) malloc (PTLen);
-      if (PT==NULL) 
-        exit(EXIT_FAILURE);
+  /* ECB decryption undoes encryption */
+  MCL_AES_init(&a,ECB,KeyLen,Key,NULL);
+  memcpy(B1,Key,16);
+  memcpy(B2,Key,16);
+  MCL_AES_ecb_encrypt(&a,(uchar *)B2);
+  MCL_AES_ecb_decrypt(&a,(uchar *)B2);
+  MCL_AES_end(&a);
+  if (memcmp(B1,B2,16)) {
+    sprintf(msg,"AES ECB DECRYPT differs");
+    return 1;
+  }
+  return 0;
+}
 
-      // PT binary value
-      MCL_hex2bin(linePtr, PT, l1);
-    }
+static unsign32 rnd_state=0x12345678;
 
-    if (!strncmp(line, AADStr, strlen(AADStr))) {
-      // printf("line %d %s\n", i,line);
-      // Find hex value in string
-      linePtr = line + strlen(AADStr);
+static unsign32 rnd(void)
+{ /* xorshift32: the comparison needs repeatable, not secret, data */
+  rnd_state^=rnd_state<<13;
+  rnd_state^=rnd_state>>17;
+  rnd_state^=rnd_state<<5;
+  return rnd_state;
+}
 
-      // Allocate memory
-      l1 = strlen(linePtr)-1;
-      AADLen = l1/2;
-      AAD = (char*) malloc (AADLen);
-      if (AAD==NULL) 
-        exit(EXIT_FAILURE);
+/* GCM with the header fed in calls of hs bytes and the message in calls of
+   ms bytes, the last of each taking what is left. After a call that ends
+   mid-block GCM refuses more, so returns how many calls it accepted. */
+static int gcm_run(int kernel,int dec,int nk,char *key,int niv,char *iv,
+                   char *aad,int alen,int hs,char *in,char *out,int len,
+                   int ms,char *tag)
+{
+  mcl_gcm g;
+  int j,n,ok=0;
 
-      // AAD binary value
-      MCL_hex2bin(linePtr, AAD, l1);
-    }
+  MCL_AES_select(kernel);
+  MCL_GCM_init(&g,nk,key,niv,iv);
+  for (j=0; j<alen; j+=n) {
+    n=(alen-j<hs)? alen-j : hs;
+    ok+=MCL_GCM_add_header(&g,&aad[j],n);
+  }
+  memset(out,0,len);
+  for (j=0; j<len; j+=n) {
+    n=(len-j<ms)? len-j : ms;
+    if (dec) ok+=MCL_GCM_add_cipher(&g,&out[j],&in[j],n);
+    else ok+=MCL_GCM_add_plain(&g,&out[j],&in[j],n);
+  }
+  MCL_GCM_finish(&g,tag);
+  return ok;
+}
 
-    if (!strncmp(line, CTStr, strlen(CTStr))) {
-      // printf("line %d %s\n", i,line);
-      // Find hex value in string
-      linePtr = line + strlen(CTStr);
+/* Compares the AES-NI kernel with the table kernel on long messages, with
+   splits at block boundaries and mid-block, and returns the failures */
+static int compare_kernels(void)
+{
+  static const int pieces[]={LONG_MAX,16,48,64,80,128,1,67};
+  char key[32],iv[64],aad[LONG_MAX],PT[LONG_MAX],CT[LONG_MAX];
+  char C[2][LONG_MAX],P[LONG_MAX],T[2][16],T1[16];
+  int i,j,k,p,nk,niv,alen,len,hs,ms,ok[2],bad=0,cases=0;
 
-      // Allocate memory
-      l1 = strlen(linePtr);
-      CTHex = (char*) malloc (l1);
-      if (CTHex==NULL) 
-        exit(EXIT_FAILURE);
+  for (i=0; i<LONG_CASES; i++) {
+    nk=(rnd()&1)? 32 : 16;
+    niv=(i%4==0)? 1+rnd()%64 : 12;
+    alen=rnd()%(LONG_MAX/2+1);
+    len=LONG_MIN+rnd()%(LONG_MAX-LONG_MIN+1);
+    for (j=0; j<nk; j++) key[j]=rnd();
+    for (j=0; j<niv; j++) iv[j]=rnd();
+    for (j=0; j<alen; j++) aad[j]=rnd();
+    for (j=0; j<len; j++) PT[j]=rnd();
 
-      CTLen = l1/2;
-      CT = (char*) malloc (CTLen);
-      if (CT==NULL) 
-        exit(EXIT_FAILURE);
+    /* Whole, for reference */
+    gcm_run(MCL_AES_TABLE,0,nk,key,niv,iv,aad,alen,LONG_MAX,PT,CT,len,
+            LONG_MAX,T1);
 
-      // Golden CT value
-      strcpy(CTHex, linePtr);
-    }
+    for (p=0; p<(int)(sizeof(pieces)/sizeof(pieces[0])); p++) {
+      ms=pieces[p];
+      hs=pieces[(p+i)%(sizeof(pieces)/sizeof(pieces[0]))];
+      for (k=0; k<2; k++) {
+        ok[k]=gcm_run(k? MCL_AES_NI : MCL_AES_TABLE,0,nk,key,niv,iv,
+                      aad,alen,hs,PT,C[k],len,ms,T[k]);
+      }
+      cases++;
+      if (ok[0]!=ok[1] || memcmp(C[0],C[1],len) || memcmp(T[0],T[1],16)) {
+        printf("kernels differ: %d byte message in %d byte pieces, "
+               "%d byte header in %d byte pieces\n",len,ms,alen,hs);
+        bad++;
+        continue;
+      }
+      if (ms%16 || hs%16) continue;
 
-    if (!strncmp(line, TagStr, strlen(TagStr))) {
-      // printf("line %d %s\n", i,line);
-      // Find hex value in string
-      linePtr = line + strlen(TagStr);
-
-      // Allocate memory
-      l1 = strlen(linePtr);
-      TagHex = (char*) malloc (l1);
-      if (TagHex==NULL) 
-        exit(EXIT_FAILURE);
-
-      // Golden TAG value
-      strcpy(TagHex, linePtr);
-
-      mcl_gcm g;
-
-      MCL_GCM_init(&g,KeyLen,Key,IVLen,IV);
-      MCL_GCM_add_header(&g,AAD,AADLen);
-      MCL_GCM_add_plain(&g,CT,PT,PTLen);
-      MCL_GCM_finish(&g,Tag);
-    
-      int rc = MCL_test_value(CTHex, CT);
-      if (rc) {
-        printf("1 TEST GCM ENCRYPT FAILED LINE %d\n",i);
-        exit(EXIT_FAILURE);
+      /* Whole blocks at a time is the same stream as all at once */
+      if (memcmp(C[0],CT,len) || memcmp(T[0],T1,16)) {
+        printf("split stream differs: %d byte message in %d byte pieces, "
+               "%d byte header in %d byte pieces\n",len,ms,alen,hs);
+        bad++;
+        continue;
       }
-    
-      rc = MCL_test_value(TagHex, Tag);
-      if (rc){
-        printf("2 TEST GCM ENCRYPT FAILED LINE %d\n",i);
-        exit(EXIT_FAILURE);
+      for (k=0; k<2; k++) {
+        gcm_run(k? MCL_AES_NI : MCL_AES_TABLE,1,nk,key,niv,iv,aad,alen,hs,
+                CT,P,len,ms,T[k]);
+        if (memcmp(P,PT,len) || memcmp(T[k],T1,16)) {
+          printf("decryption differs: %d byte message in %d byte pieces, "
+                 "%s kernel\n",len,ms,k? "AES-NI" : "table");
+          bad++;
+        }
       }
+    }
+  }
+  MCL_AES_select(-1);
+  printf("kernel comparison: %d cases, %d failed\n",cases,bad);
+  return bad;
+}
+
+int main(int argc, char** argv)
+{
+  static const char *names[]={"table","AES-NI"};
+  int i,k,rc,cases,threads=0,first=1,bad=0;
 
-      free(Key);
-      free(IV);
-      free(PT);
-      free(AAD);
-      free(CT);
-      free(CTHex);
-      free(TagHex);
+  if (argc>2 && !strcmp(argv[1],"-j")) {
+    threads=atoi(argv[2]);
+    first=3;
+  }
+  if (first>=argc) {
+    printf("usage: ./test_gcm_encrypt [-j threads] [path to test vector file] ...\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Every AES kernel this CPU runs must match the vectors
+  for (k=MCL_AES_TABLE; k<=MCL_AES_best(); k++) {
+    MCL_AES_select(k);
+    for (i=first; i<argc; i++) {
+      rc=MCL_RSP_run(argv[i],threads,check,NULL,&cases);
+      if (rc<0) exit(EXIT_FAILURE);
+      printf("%s: %d cases, %d failed, %s kernel\n",argv[i],cases,rc,names[k]);
+      bad+=rc;
     }
   }
-  fclose(fp);
+  MCL_AES_select(-1);
+  if (MCL_AES_best()>MCL_AES_TABLE) bad+=compare_kernels();
+
+  if (bad) {
+    printf("TEST GCM ENCRYPT FAILED\n");
+    exit(EXIT_FAILURE);
+  }
   printf("TEST GCM ENCRYPT PASSED\n");
   exit(EXIT_SUCCESS);
 }
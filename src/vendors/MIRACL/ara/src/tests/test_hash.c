@@ -48,7 +48,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
 static void test()
 {
   char digest[64];
-  int i;
+  int i,j,k,n;
   mcl_hash160 sh160;
   mcl_hash256 sh256;
   mcl_hash384 sh384;
@@ -64,6 +64,15 @@ static void test()
   char* MD256Hex = "c644612cd326b38b1c6813b1daded34448805aef317c35f548dfb4a0d74b8106";
   MCL_hex2bin(Msg256Hex,Msg256,58);
 
+  char* Msg256Long = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopqabcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  char* MD256LongHex = "59f109d9533b2b70e7c3b814a2bd218f78ea5d3714455bc67987cf0d664399cf";
+  static char Msg256Million[1000];
+  char* MD256MillionHex = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+  char MD256[32],MD256Long[32],MD256Million[32];
+  MCL_hex2bin(MD256Hex,MD256,64);
+  MCL_hex2bin(MD256LongHex,MD256Long,64);
+  MCL_hex2bin(MD256MillionHex,MD256Million,64);
+
   char* Msg384Hex = "718e0cfe1386cb1421b4799b15788b862bf03a8072bb30d02303888032";
   char Msg384[29];
   char* MD384Hex = "6d8b8a5bc7ea365ea07f11d3b12e95872a9633684752495cc431636caf1b273a35321044af31c974d8575d38711f56c6";
@@ -94,6 +103,106 @@ static void test()
     printf("%02x",(unsigned char)digest[i]);
   printf("\r\n");
 
+  /* Bulk update, split at awkward offsets, with each available kernel */
+  for (k=MCL_HASH_KERNEL_SCALAR;k<=MCL_HASH_KERNEL_SHANI;k++)
+  {
+    if (MCL_HASH256_kernel(k)!=k) continue;
+
+    MCL_HASH256_init(&sh256);
+    MCL_HASH256_update(&sh256,Msg256,29);
+    MCL_HASH256_hash(&sh256,digest); 
+    printf("Want %s \r\n", MD256Hex);   
+    printf("Got  ");
+    for (i=0;i<32;i++) 
+      printf("%02x",(unsigned char)digest[i]);
+    printf("\r\n");
+    if (memcmp(digest,MD256,32)!=0)
+    {
+      printf("FAILURE SHA256 kernel %d\r\n",k);
+      exit(EXIT_FAILURE);
+    }
+
+    MCL_HASH256_init(&sh256);
+    MCL_HASH256_update(&sh256,Msg256Long,3);
+    MCL_HASH256_update(&sh256,Msg256Long+3,(int)strlen(Msg256Long)-3);
+    MCL_HASH256_hash(&sh256,digest); 
+    printf("Want %s \r\n", MD256LongHex);   
+    printf("Got  ");
+    for (i=0;i<32;i++) 
+      printf("%02x",(unsigned char)digest[i]);
+    printf("\r\n");
+    if (memcmp(digest,MD256Long,32)!=0)
+    {
+      printf("FAILURE SHA256 kernel %d\r\n",k);
+      exit(EXIT_FAILURE);
+    }
+
+    /* One million 'a's, fed in 1000-byte runs */
+    memset(Msg256Million,'a',sizeof(Msg256Million));
+    MCL_HASH256_init(&sh256);
+    for (i=0;i<1000;i++)
+      MCL_HASH256_update(&sh256,Msg256Million,sizeof(Msg256Million));
+    MCL_HASH256_hash(&sh256,digest); 
+    printf("Want %s \r\n", MD256MillionHex);   
+    printf("Got  ");
+    for (i=0;i<32;i++) 
+      printf("%02x",(unsigned char)digest[i]);
+    printf("\r\n");
+
+    if (memcmp(digest,MD256Million,32)!=0)
+    {
+      printf("FAILURE SHA256 kernel %d\r\n",k);
+      exit(EXIT_FAILURE);
+    }
+  }
+  MCL_HASH256_kernel(MCL_HASH_KERNEL_AUTO);
+
+  /* Multi-buffer: 19 messages fill whole and partial lane groups of every
+     width. Lane 0 carries the NIST message, the others distinct data; all
+     must match hashing each message on its own */
+  static const int MultiLen[]={0,29,55,56,64,119,200};
+  static char MultiMsg[19][200];
+  static char MultiMD[19][32],MultiRef[19][32];
+  const char *mptr[19];
+  char *dptr[19];
+  for (j=0;j<19;j++)
+  {
+    for (i=0;i<200;i++) MultiMsg[j][i]=(char)(i*31+j*7+1);
+    mptr[j]=MultiMsg[j];
+    dptr[j]=MultiMD[j];
+  }
+  memcpy(MultiMsg[0],Msg256,29);
+  for (n=0;n<(int)(sizeof(MultiLen)/sizeof(MultiLen[0]));n++)
+  {
+    for (j=0;j<19;j++)
+    {
+      MCL_HASH256_init(&sh256);
+      MCL_HASH256_update(&sh256,MultiMsg[j],MultiLen[n]);
+      MCL_HASH256_hash(&sh256,MultiRef[j]);
+    }
+    if (MultiLen[n]==29 && memcmp(MultiRef[0],MD256,32)!=0)
+    {
+      printf("FAILURE SHA256 multi-buffer reference\r\n");
+      exit(EXIT_FAILURE);
+    }
+    for (k=MCL_HASH_MULTI_SCALAR;k<=MCL_HASH_MULTI_AVX512;k++)
+    {
+      if (MCL_HASH256_multi_kernel(k)!=k) continue;
+      memset(MultiMD,0,sizeof(MultiMD));
+      MCL_HASH256_multi(19,mptr,MultiLen[n],dptr);
+      for (j=0;j<19;j++)
+      {
+        if (memcmp(MultiMD[j],MultiRef[j],32)!=0)
+        {
+          printf("FAILURE SHA256 multi-buffer kernel %d length %d lane %d\r\n",k,MultiLen[n],j);
+          exit(EXIT_FAILURE);
+        }
+      }
+      printf("SHA256 multi-buffer kernel %d length %d OK\r\n",k,MultiLen[n]);
+    }
+  }
+  MCL_HASH256_multi_kernel(MCL_HASH_MULTI_AUTO);
+
   MCL_HASH384_init(&sh384);
   for (i=0;i<29;i++) 
     MCL_HASH384_process(&sh384,Msg384[i]);
@@ -44,6 +44,78 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.             *
  
 #include "mcl_rsa.h"
 #include "mcl_utils.h"
+#include "mcl_mont.h"
+
+/* the workspace routines must agree with the stack ones and hand all scratch back */
+static mcl_ff_ws ws;
+
+static void test_ff_ws(MCL_rsa_private_key *priv,MCL_rsa_public_key *pub,csprng *RNG)
+{
+  mcl_chunk x[MCL_HFLEN][MCL_BS],e[MCL_HFLEN][MCL_BS],r1[MCL_HFLEN][MCL_BS],r2[MCL_HFLEN][MCL_BS];
+  int ok=1;
+
+  MCL_FF_ws_init(&ws);
+  MCL_FF_randomnum_ws(x,priv->p,RNG,MCL_HFLEN,&ws);
+  MCL_FF_skpow(r1,x,priv->dp,priv->p,MCL_HFLEN);
+  MCL_FF_skpow_ws(r2,x,priv->dp,priv->p,MCL_HFLEN,&ws);
+  if (MCL_FF_comp(r1,r2,MCL_HFLEN)!=0) ok=0;
+  MCL_FF_pow_ws(r2,x,priv->dp,priv->p,MCL_HFLEN,&ws);
+  if (MCL_FF_comp(r1,r2,MCL_HFLEN)!=0) ok=0;
+  MCL_FF_skpow_ladder_ws(r2,x,priv->dp,priv->p,MCL_HFLEN,&ws);
+  if (MCL_FF_comp(r1,r2,MCL_HFLEN)!=0) ok=0;
+  /* a short exponent, both ways */
+  MCL_FF_zero(e,MCL_HFLEN);
+  MCL_BIG_copy(e[0],priv->dp[0]);
+  MCL_FF_skspow_ws(r1,x,e[0],priv->p,MCL_HFLEN,&ws);
+  MCL_FF_pow_ws(r2,x,e,priv->p,MCL_HFLEN,&ws);
+  if (MCL_FF_comp(r1,r2,MCL_HFLEN)!=0) ok=0;
+  MCL_FF_power_ws(r1,x,65537,priv->p,MCL_HFLEN,&ws);
+  MCL_FF_pubpow_ws(r2,x,65537,priv->p,MCL_HFLEN,&ws);
+  if (MCL_FF_comp(r1,r2,MCL_HFLEN)!=0) ok=0;
+  if (!MCL_FF_prime_ws(priv->p,RNG,MCL_HFLEN,&ws)) ok=0;
+  if (!MCL_FF_prime_ws(priv->q,RNG,MCL_HFLEN,&ws)) ok=0;
+  /* a full length modulus only leaves room for a narrower window */
+  if (MCL_FF_prime_rounds_ws(pub->n,RNG,MCL_FF_prime_fips_rounds(MCL_FFLEN),MCL_FFLEN,&ws)) ok=0;
+  if (!MCL_FF_prime_rounds(priv->p,RNG,MCL_FF_prime_fips_rounds(MCL_HFLEN),MCL_HFLEN)) ok=0;
+  if (ws.top!=0) ok=0;
+
+  if (ok) {
+    printf("FF workspace routines agree\r\n");
+  } else {
+    printf("FF workspace routines DISAGREE\r\n");
+  }
+}
+
+/* every Montgomery kernel this CPU runs must give the scalar code's answers */
+static void test_mont(MCL_rsa_private_key *priv,MCL_rsa_public_key *pub,csprng *RNG,mcl_octet *C,mcl_octet *S)
+{
+  mcl_chunk x[MCL_HFLEN][MCL_BS],r0[MCL_HFLEN][MCL_BS],r1[MCL_HFLEN][MCL_BS],r2[MCL_HFLEN][MCL_BS];
+  char s[MCL_RFS],m[MCL_RFS];
+  mcl_octet S2={0,sizeof(s),s};
+  mcl_octet M2={0,sizeof(m),m};
+  int k,ok;
+  static const char *names[]={"scalar","AVX2","AVX-512 IFMA"};
+
+  MCL_FF_randomnum(x,priv->p,RNG,MCL_HFLEN);
+  MCL_MONT_select(MCL_MONT_SCALAR);
+  MCL_FF_skpow(r0,x,priv->dp,priv->p,MCL_HFLEN);
+  for (k=MCL_MONT_SCALAR;k<=MCL_MONT_best();k++)
+  {
+    MCL_MONT_select(k);
+    ok=1;
+    MCL_FF_skpow(r1,x,priv->dp,priv->p,MCL_HFLEN);
+    MCL_FF_pow(r2,x,priv->dp,priv->p,MCL_HFLEN);
+    if (MCL_FF_comp(r0,r1,MCL_HFLEN)!=0 || MCL_FF_comp(r0,r2,MCL_HFLEN)!=0) ok=0;
+    if (!MCL_FF_prime_rounds(priv->q,RNG,MCL_FF_prime_fips_rounds(MCL_HFLEN),MCL_HFLEN)) ok=0;
+    if (MCL_FF_prime_rounds(pub->n,RNG,MCL_FF_prime_fips_rounds(MCL_FFLEN),MCL_FFLEN)) ok=0;
+    MCL_RSA_DECRYPT(priv,C,&S2);
+    if (!MCL_OCT_comp(S,&S2)) ok=0;
+    MCL_RSA_ENCRYPT(pub,S,&M2);
+    if (!MCL_OCT_comp(C,&M2)) ok=0;
+    printf("Montgomery kernel %s %s\r\n",names[k],ok?"agrees":"DISAGREES");
+  }
+  MCL_MONT_select(-1);
+}
 
 static void test()
 {
@@ -107,6 +179,9 @@ static void test()
     printf("Signature is INVALID\r\n");
   }
 
+  test_ff_ws(&priv,&pub,&RNG);
+  test_mont(&priv,&pub,&RNG,&C,&S);
+
   MCL_RSA_KILL_CSPRNG(&RNG);
 
   MCL_RSA_PRIVATE_KEY_KILL(&priv);